@@ -1218,6 +1218,7 @@ struct buffer {
   char lockers;
   char dirty;
   char hashIndex;
+  struct DirIndex *index;     /* name index of a header page, see dir.c */
   afs_rwlock_t lock;          /* the lock for this structure */
 };
 
@@ -142,6 +142,7 @@ DInit(int abuffers)
 	tb->data = &BufferData[AFS_BUFFER_PAGESIZE * (i & (NPB - 1))];
 	tb->hashIndex = 0;
 	tb->dirty = 0;
+	tb->index = NULL;
 	AFS_RWLOCK_INIT(&tb->lock, "buffer lock");
     }
     return;
@@ -364,6 +365,7 @@ afs_newslot(struct dcache *adc, afs_int32 apage, struct buffer *lp)
 	    tp->data = &BufferData[AFS_BUFFER_PAGESIZE * i];
 	    tp->hashIndex = 0;
 	    tp->dirty = 0;
+	    tp->index = NULL;
 	    AFS_RWLOCK_INIT(&tp->lock, "buffer lock");
 	}
 	lp = &Buffers[nbuffers];
@@ -381,6 +383,11 @@ afs_newslot(struct dcache *adc, afs_int32 apage, struct buffer *lp)
 	AFS_STATS(afs_stats_cmperf.bufFlushDirty++);
     }
 
+    if (lp->index) {
+	afs_dir_FreeIndex(lp->index);
+	lp->index = NULL;
+    }
+
     /* Zero out the data so we don't leak something we shouldn't. */
     memset(lp->data, 0, AFS_BUFFER_PAGESIZE);
     /* Now fill in the header. */
@@ -452,11 +459,54 @@ DZap(struct dcache *adc)
 		tb->fid = NULLIDX;
 		afs_reset_inode(&tb->inode);
 		tb->dirty = 0;
+		/* an index still in use is freed by afs_newslot */
+		if (tb->index && tb->lockers == 0) {
+		    afs_dir_FreeIndex(tb->index);
+		    tb->index = NULL;
+		}
 		ReleaseWriteLock(&tb->lock);
 	    }
     ReleaseReadLock(&afs_bufferLock);
 }
 
+/*!
+ * Return the name index hung off a directory's header page, if any.
+ *
+ * \param entry The header page of the directory.
+ */
+struct DirIndex *
+DGetIndex(struct DirBuffer *entry)
+{
+    struct buffer *tb = entry->buffer;
+
+    return tb->index;
+}
+
+/*!
+ * Hang a name index off a directory's header page.  The buffer owns the
+ * index from then on, and frees it when the page leaves the cache.
+ *
+ * \param entry The header page of the directory.
+ * \param index The index to install.
+ *
+ * \return 0, or EEXIST if the page already has an index; the caller then
+ *         still owns the one it passed in.
+ */
+int
+DSetIndex(struct DirBuffer *entry, struct DirIndex *index)
+{
+    struct buffer *tb = entry->buffer;
+    int code = 0;
+
+    ObtainWriteLock(&tb->lock, 267);
+    if (tb->index)
+	code = EEXIST;
+    else
+	tb->index = index;
+    ReleaseWriteLock(&tb->lock);
+    return code;
+}
+
 static void
 DFlushBuffer(struct buffer *ab)
 {
@@ -578,6 +628,10 @@ shutdown_bufferpackage(void)
     if (afs_cold_shutdown) {
 	dinit_flag = 0;
 	tp = Buffers;
+	for (i = 0; i < nbuffers; i++) {
+	    if (tp[i].index)
+		afs_dir_FreeIndex(tp[i].index);
+	}
 	for (i = 0; i < nbuffers; i += NPB, tp += NPB) {
 	    afs_osi_Free(tp->data, NPB * AFS_BUFFER_PAGESIZE);
 	}
@@ -99,6 +99,23 @@ char *fs_varNames[] = {
     "rx_nBusies",
     "fs_nBusies",
     "fs_nGetCaps",
+    "fs_nFetchReads",
+    "fs_FetchReadKBytes",
+    "fs_FetchCopyKBytes",
+    "fs_CBBreakQueued",
+    "fs_CBBreakQueuedMax",
+    "fs_nCBBreakBatches",
+    "fs_nCBBreakFids",
+    "fs_nCBBreakFailed",
+    "fs_CBBreakAvgMsec",
+    "fs_CBBreakMaxMsec",
+    "fs_VolAttachFound",
+    "fs_VolAttached",
+    "fs_VolAttachFailed",
+    "fs_VolAttachHot",
+    "fs_VolAttachHotDone",
+    "fs_VolAttachSecs",
+    "fs_VolAttachETA",
     /* spares */
     "epoch",			/* RPC Operation timings */
     "FetchData_ops",
@@ -632,7 +649,7 @@ ending positional indices to fs_varNames[]. Unimportant information
 is placed at the end of the section. */
 
 char *fs_categories[] = {
-    "PerfStats_section 6",
+    "PerfStats_section 9",
     "VnodeCache_group 1 13",
     "Directory_group 14 16",
     "Rx_group 17 57",
@@ -641,13 +658,16 @@ char *fs_categories[] = {
     /* skip sysname id */
     "Busies_group 67 68",
     /* skip get caps */
+    "FetchIO_group 70 72",
+    "CallBackBreak_group 73 79",
+    "VolAttach_group 80 86",
     /* skip spares */
     "RPCop_section 2",
-    "RPCopTimes_group 70 238",
-    "RPCopBytes_group 239 274",
+    "RPCopTimes_group 87 255",
+    "RPCopBytes_group 256 291",
     "CallBackStats_section 2",
-    "CallBackCounters_group 275 285",
-    "GotSomeSpaces_group 286 290"
+    "CallBackCounters_group 292 302",
+    "GotSomeSpaces_group 303 307"
 };
 
 
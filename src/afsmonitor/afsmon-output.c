@@ -233,6 +233,33 @@ Print_fs_OverallPerfInfo(struct afs_PerfStats *a_ovP)
     fprintf(fs_outFD, "\t%10d fs_nBusies\n", a_ovP->fs_nBusies);
     fprintf(fs_outFD, "\t%10d fs_GetCapabilities\n\n", a_ovP->fs_nGetCaps);
 
+    fprintf(fs_outFD, "\t%10d fs_nFetchReads\n", a_ovP->fs_nFetchReads);
+    fprintf(fs_outFD, "\t%10d fs_FetchReadKBytes\n",
+	    a_ovP->fs_FetchReadKBytes);
+    fprintf(fs_outFD, "\t%10d fs_FetchCopyKBytes\n\n",
+	    a_ovP->fs_FetchCopyKBytes);
+
+    fprintf(fs_outFD, "\t%10d fs_CBBreakQueued\n", a_ovP->fs_CBBreakQueued);
+    fprintf(fs_outFD, "\t%10d fs_CBBreakQueuedMax\n",
+	    a_ovP->fs_CBBreakQueuedMax);
+    fprintf(fs_outFD, "\t%10d fs_nCBBreakBatches\n",
+	    a_ovP->fs_nCBBreakBatches);
+    fprintf(fs_outFD, "\t%10d fs_nCBBreakFids\n", a_ovP->fs_nCBBreakFids);
+    fprintf(fs_outFD, "\t%10d fs_nCBBreakFailed\n", a_ovP->fs_nCBBreakFailed);
+    fprintf(fs_outFD, "\t%10d fs_CBBreakAvgMsec\n", a_ovP->fs_CBBreakAvgMsec);
+    fprintf(fs_outFD, "\t%10d fs_CBBreakMaxMsec\n\n",
+	    a_ovP->fs_CBBreakMaxMsec);
+
+    fprintf(fs_outFD, "\t%10d fs_VolAttachFound\n", a_ovP->fs_VolAttachFound);
+    fprintf(fs_outFD, "\t%10d fs_VolAttached\n", a_ovP->fs_VolAttached);
+    fprintf(fs_outFD, "\t%10d fs_VolAttachFailed\n",
+	    a_ovP->fs_VolAttachFailed);
+    fprintf(fs_outFD, "\t%10d fs_VolAttachHot\n", a_ovP->fs_VolAttachHot);
+    fprintf(fs_outFD, "\t%10d fs_VolAttachHotDone\n",
+	    a_ovP->fs_VolAttachHotDone);
+    fprintf(fs_outFD, "\t%10d fs_VolAttachSecs\n", a_ovP->fs_VolAttachSecs);
+    fprintf(fs_outFD, "\t%10d fs_VolAttachETA\n\n", a_ovP->fs_VolAttachETA);
+
     /*
      * Host module fields.
      */
@@ -41,7 +41,7 @@ struct afsmon_hostEntry {
     struct afsmon_hostEntry *next;
 };
 
-#define NUM_FS_FULLPERF_ENTRIES 275 /* number fields saved from full prefs */
+#define NUM_FS_FULLPERF_ENTRIES 292 /* number fields saved from full prefs */
 #define NUM_FS_CB_ENTRIES 16	/* number fields saved from callback counters */
 #define NUM_FS_STAT_ENTRIES  \
 	(NUM_FS_FULLPERF_ENTRIES + NUM_FS_CB_ENTRIES)
@@ -15,15 +15,18 @@ AC_CHECK_FUNCS([ \
     mkstemp \
     openlog \
     poll \
+    posix_fadvise \
     pread \
     preadv \
     preadv64 \
     pwrite \
     pwritev \
     pwritev64 \
+    recvmmsg \
     regcomp \
     regerror \
     regexec \
+    sendmmsg \
     setitimer \
     setvbuf \
     sigaction \
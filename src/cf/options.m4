@@ -44,7 +44,8 @@ AC_ARG_ENABLE([pthreaded-ubik],
     [enable_pthreaded_ubik="yes"])
 AC_ARG_ENABLE([ubik-read-while-write],
     [AS_HELP_STRING([--enable-ubik-read-while-write],
-        [enable vlserver read from db cache during write locks (EXPERIMENTAL)])],
+        [enable vlserver and ptserver reads from a snapshot of the database
+         during write transactions (EXPERIMENTAL)])],
     [],
     [enable_ubik_read_while_write="no"])
 
@@ -12,8 +12,10 @@
 
 #include <roken.h>
 #include <afs/opr.h>
+#include <opr/jhash.h>
 
 #include <lock.h>
+#include <rx/rx_atomic.h>
 
 #include "dir.h"
 
@@ -29,12 +31,13 @@ struct buffer {
      */
     char fid[BUFFER_FID_SIZE];
     afs_int32 page;
-    afs_int32 accesstime;
     struct buffer *hashNext;
     void *data;
-    char lockers;
+    int lockers;
     char dirty;
-    char hashIndex;
+    char referenced;		/* used since the clock hand last passed */
+    int hashIndex;		/* bucket we are on, or -1 */
+    struct DirIndex *index;	/* name index of a header page, see dir.c */
     struct Lock lock;
 };
 
@@ -44,40 +47,55 @@ bufferDir(struct buffer *b)
     return (dir_file_t) &b->fid;
 }
 
-struct Lock afs_bufferLock;
+/*
+ * Page hash table.  Each bucket has its own lock, which protects the
+ * chain and the identity (fid and page) of the buffers on it.  A buffer's
+ * own lock protects its lockers count and dirty flag.  Locks are always
+ * taken bucket first, then buffer.
+ */
+struct bucket {
+    struct Lock lock;
+    struct buffer *chain;
+    rx_atomic_t ndirty;		/* dirty buffers on the chain */
+};
 
 /* page size */
 #define BUFFER_PAGE_SIZE 2048
 /* log page size */
 #define LOGPS 11
-/* page hash table size */
+/* minimum page hash table size */
 #define PHSIZE 32
-/* The hash table should be somewhat efficient even if there are only
- * a few partitions (less than 32). So the hash for the fileserver is now
- * based on the volume id. This means this macro is dependent upon the
- * layout of DirHandle in viced/viced.h, vol/salvage.h and volser/salvage.h.
- */
-#define pHash(fid) (((afs_int32 *)fid)[0] & (PHSIZE-1))
-#define vHash(vid) (vid & (PHSIZE-1))
+#define pHash(fid, page) \
+    (opr_jhash_int2(FidHash(fid), (page), 0) & (nbuckets - 1))
 
-/* admittedly system dependent, this is the maximum signed 32-bit value */
-#define BUFFER_LONG_MAX   2147483647
 #ifndef	NULL
 #define NULL 0
 #endif
 
-static struct buffer **Buffers;
-
-char *BufferData;
+/*
+ * Buffers are replaced with the CLOCK algorithm.  The hand sweeps the
+ * Buffers array, clearing the referenced bit of each buffer it passes, and
+ * takes the first unlocked buffer not referenced since its last pass.  The
+ * clock lock protects the hand, and the Buffers array and nbuffers, which
+ * only grow.
+ *
+ * If the hand has to go all the way round before it finds a buffer, every
+ * buffer was used since its last pass, and the cache is grown by a
+ * quarter, up to afs_dir_maxBuffers.  It is also grown, rather than
+ * giving up, if every buffer is locked.
+ */
+struct Lock afs_bufferLock;
 
-static struct buffer *phTable[PHSIZE];	/* page hash table */
-static struct buffer *LastBuffer;
+static struct buffer **Buffers;
+static struct bucket *phTable;	/* page hash table */
+static int nbuckets;
+static int clockHand;
 int nbuffers;
-int timecounter;
-static int calls = 0, ios = 0;
+int afs_dir_maxBuffers;		/* grow no further than this; 0 never grows */
+static rx_atomic_t calls, ios, evictions;
 
-struct buffer *newslot(dir_file_t dir, afs_int32 apage,
-		       struct buffer *lp);
+static struct buffer *newslot(dir_file_t dir, afs_int32 apage,
+			      struct bucket *bp);
 
 /* XXX - This sucks. The correct prototypes for these functions are ...
  *
@@ -88,6 +106,7 @@ struct buffer *newslot(dir_file_t dir, afs_int32 apage,
 
 extern void FidZero(dir_file_t);
 extern int FidEq(dir_file_t, dir_file_t);
+extern afs_uint32 FidHash(dir_file_t);
 extern int ReallyRead(dir_file_t, int block, char *data);
 extern int ReallyWrite(dir_file_t, int block, char *data);
 extern void FidZap(dir_file_t);
@@ -98,53 +117,173 @@ int
 DStat(int *abuffers, int *acalls, int *aios)
 {
     *abuffers = nbuffers;
-    *acalls = calls;
-    *aios = ios;
+    *acalls = rx_atomic_read(&calls);
+    *aios = rx_atomic_read(&ios);
     return 0;
 }
 
 /**
- * initialize the directory package.
+ * allocate and initialize directory buffers.
  *
- * @param[in] abuffers  size of directory buffer cache
+ * @param[in] abuffers  number of buffers
  *
- * @return operation status
- *    @retval 0 success
+ * @return array of buffer pointers
  */
-void
-DInit(int abuffers)
+static struct buffer **
+DAllocBuffers(int abuffers)
 {
-    /* Initialize the venus buffer system. */
     int i, tsize;
-    struct buffer *tb;
-    char *tp;
+    struct buffer *tb, **tbp;
+    char *tp, *data;
 
-    Lock_Init(&afs_bufferLock);
     /* Align each element of Buffers on a doubleword boundary */
     tsize = (sizeof(struct buffer) + 7) & ~7;
     tp = malloc(abuffers * tsize);
-    Buffers = malloc(abuffers * sizeof(struct buffer *));
-    BufferData = malloc(abuffers * BUFFER_PAGE_SIZE);
-    timecounter = 0;
-    LastBuffer = (struct buffer *)tp;
-    nbuffers = abuffers;
-    for (i = 0; i < PHSIZE; i++)
-	phTable[i] = 0;
+    tbp = malloc(abuffers * sizeof(struct buffer *));
+    data = malloc(abuffers * BUFFER_PAGE_SIZE);
+    opr_Assert(tp != NULL && tbp != NULL && data != NULL);
     for (i = 0; i < abuffers; i++) {
 	/* Fill in each buffer with an empty indication. */
 	tb = (struct buffer *)tp;
-	Buffers[i] = tb;
+	tbp[i] = tb;
 	tp += tsize;
 	FidZero(bufferDir(tb));
-	tb->accesstime = tb->lockers = 0;
-	tb->data = &BufferData[BUFFER_PAGE_SIZE * i];
-	tb->hashIndex = 0;
+	tb->lockers = 0;
+	tb->referenced = 0;
+	tb->data = &data[BUFFER_PAGE_SIZE * i];
+	tb->hashIndex = -1;
+	tb->hashNext = NULL;
 	tb->dirty = 0;
+	tb->index = NULL;
 	Lock_Init(&tb->lock);
     }
+    return tbp;
+}
+
+/**
+ * initialize the directory package.
+ *
+ * @param[in] abuffers  size of directory buffer cache
+ *
+ * @return operation status
+ *    @retval 0 success
+ *
+ * @note set afs_dir_maxBuffers first for a cache which grows on demand
+ */
+void
+DInit(int abuffers)
+{
+    /* Initialize the venus buffer system. */
+    int i;
+
+    Lock_Init(&afs_bufferLock);
+    if (afs_dir_maxBuffers != 0 && afs_dir_maxBuffers < abuffers)
+	afs_dir_maxBuffers = abuffers;
+    /* enough buckets for the largest the cache may grow to */
+    for (nbuckets = PHSIZE;
+	 nbuckets < abuffers || nbuckets < afs_dir_maxBuffers; nbuckets <<= 1)
+	;
+    phTable = calloc(nbuckets, sizeof(struct bucket));
+    opr_Assert(phTable != NULL);
+    for (i = 0; i < nbuckets; i++) {
+	Lock_Init(&phTable[i].lock);
+	rx_atomic_set(&phTable[i].ndirty, 0);
+    }
+    Buffers = DAllocBuffers(abuffers);
+    nbuffers = abuffers;
+    clockHand = 0;
+    rx_atomic_set(&calls, 0);
+    rx_atomic_set(&ios, 0);
+    rx_atomic_set(&evictions, 0);
     return;
 }
 
+/* add buffers to the cache.  the clock lock must be write locked. */
+static void
+DGrow_r(int abuffers)
+{
+    struct buffer **tbp, **old;
+    int n = abuffers - nbuffers;
+
+    tbp = malloc(abuffers * sizeof(struct buffer *));
+    old = DAllocBuffers(n);
+    opr_Assert(tbp != NULL);
+    memcpy(tbp, Buffers, nbuffers * sizeof(struct buffer *));
+    memcpy(tbp + nbuffers, old, n * sizeof(struct buffer *));
+    free(old);
+    old = Buffers;
+    Buffers = tbp;
+    nbuffers = abuffers;
+    free(old);
+}
+
+/**
+ * grow the directory buffer cache while it is in use.
+ *
+ * A nonzero afs_dir_maxBuffers smaller than the new size is raised to it.
+ *
+ * @param[in] abuffers  new size of directory buffer cache
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval EINVAL the cache is already at least that large
+ *
+ * @note the number of hash buckets is fixed by DInit
+ */
+int
+DResize(int abuffers)
+{
+    ObtainWriteLock(&afs_bufferLock);
+    if (abuffers <= nbuffers) {
+	ReleaseWriteLock(&afs_bufferLock);
+	return EINVAL;
+    }
+    DGrow_r(abuffers);
+    if (afs_dir_maxBuffers != 0 && afs_dir_maxBuffers < abuffers)
+	afs_dir_maxBuffers = abuffers;
+    ReleaseWriteLock(&afs_bufferLock);
+    return 0;
+}
+
+/* size the cache should grow to, or 0 if it is as large as it may be.
+ * the clock lock must be held. */
+static int
+DGrowSize_r(void)
+{
+    int n;
+
+    if (nbuffers >= afs_dir_maxBuffers)
+	return 0;
+    n = nbuffers + (nbuffers > 64 ? nbuffers / 4 : 16);
+    return (n < afs_dir_maxBuffers) ? n : afs_dir_maxBuffers;
+}
+
+/* find a page on a hash chain.  the bucket must be locked. */
+static struct buffer *
+DFind(struct bucket *bp, dir_file_t fid, int page)
+{
+    struct buffer *tb;
+
+    for (tb = bp->chain; tb; tb = tb->hashNext) {
+	if (tb->page == page && FidEq(bufferDir(tb), fid))
+	    return tb;
+    }
+    return NULL;
+}
+
+/* take a reference on a buffer found on a chain.  the bucket must be
+ * locked. */
+static void
+DHold(struct buffer *tb, struct DirBuffer *entry)
+{
+    ObtainWriteLock(&tb->lock);
+    tb->lockers++;
+    tb->referenced = 1;
+    ReleaseWriteLock(&tb->lock);
+    entry->buffer = tb;
+    entry->data = tb->data;
+}
+
 /**
  * read a page out of a directory object.
  *
@@ -158,76 +297,36 @@ int
 DRead(dir_file_t fid, int page, struct DirBuffer *entry)
 {
     /* Read a page from the disk. */
-    struct buffer *tb, *tb2, **bufhead;
+    struct buffer *tb;
+    struct bucket *bp;
 
     memset(entry, 0, sizeof(struct DirBuffer));
 
-    ObtainWriteLock(&afs_bufferLock);
-    calls++;
+    rx_atomic_inc(&calls);
+    bp = &phTable[pHash(fid, page)];
 
-#define bufmatch(tb,fid) (tb->page == page && FidEq(bufferDir(tb), fid))
-#define buf_Front(head,parent,p) {(parent)->hashNext = (p)->hashNext; (p)->hashNext= *(head);*(head)=(p);}
+    /* most reads hit, and share the bucket */
+    ObtainReadLock(&bp->lock);
+    if ((tb = DFind(bp, fid, page))) {
+	DHold(tb, entry);
+	ReleaseReadLock(&bp->lock);
+	return 0;
+    }
+    ReleaseReadLock(&bp->lock);
 
-    /* this apparently-complicated-looking code is simply an example of
-     * a little bit of loop unrolling, and is a standard linked-list
-     * traversal trick. It saves a few assignments at the the expense
-     * of larger code size.  This could be simplified by better use of
-     * macros.  With the use of these LRU queues, the old one-cache is
-     * probably obsolete.
-     */
-    if ((tb = phTable[pHash(fid)])) {	/* ASSMT HERE */
-	if (bufmatch(tb, fid)) {
-	    ObtainWriteLock(&tb->lock);
-	    tb->lockers++;
-	    ReleaseWriteLock(&afs_bufferLock);
-	    tb->accesstime = ++timecounter;
-	    ReleaseWriteLock(&tb->lock);
-	    entry->buffer = tb;
-	    entry->data = tb->data;
-	    return 0;
-	} else {
-	    bufhead = &(phTable[pHash(fid)]);
-	    while ((tb2 = tb->hashNext)) {
-		if (bufmatch(tb2, fid)) {
-		    buf_Front(bufhead, tb, tb2);
-		    ObtainWriteLock(&tb2->lock);
-		    tb2->lockers++;
-		    ReleaseWriteLock(&afs_bufferLock);
-		    tb2->accesstime = ++timecounter;
-		    ReleaseWriteLock(&tb2->lock);
-		    entry->buffer = tb2;
-		    entry->data = tb2->data;
-		    return 0;
-		}
-		if ((tb = tb2->hashNext)) {	/* ASSIGNMENT HERE! */
-		    if (bufmatch(tb, fid)) {
-			buf_Front(bufhead, tb2, tb);
-			ObtainWriteLock(&tb->lock);
-			tb->lockers++;
-			ReleaseWriteLock(&afs_bufferLock);
-			tb->accesstime = ++timecounter;
-			ReleaseWriteLock(&tb->lock);
-			entry->buffer = tb;
-			entry->data = tb->data;
-			return 0;
-		    }
-		} else
-		    break;
-	    }
-	}
-    } else
-	tb2 = NULL;
+    /* look again, now that nobody else can add the page */
+    ObtainWriteLock(&bp->lock);
+    if ((tb = DFind(bp, fid, page))) {
+	DHold(tb, entry);
+	ReleaseWriteLock(&bp->lock);
+	return 0;
+    }
 
     /* can't find it */
-    /* The last thing we looked at was either tb or tb2 (or nothing). That
-     * is at least the oldest buffer on one particular hash chain, so it's
-     * a pretty good place to start looking for the truly oldest buffer.
-     */
-    tb = newslot(fid, page, (tb ? tb : tb2));
-    ios++;
+    tb = newslot(fid, page, bp);
+    rx_atomic_inc(&ios);
     ObtainWriteLock(&tb->lock);
-    tb->lockers++;
-    ReleaseWriteLock(&afs_bufferLock);
+    ReleaseWriteLock(&bp->lock);
     if (ReallyRead(bufferDir(tb), tb->page, tb->data)) {
 	tb->lockers--;
 	FidZap(bufferDir(tb));	/* disaster */
@@ -243,16 +342,13 @@ DRead(dir_file_t fid, int page, struct DirBuffer *entry)
     return 0;
 }
 
-
-static int
-FixupBucket(struct buffer *ap)
+/* take a buffer off its hash chain.  the bucket must be write locked. */
+static void
+DUnhash(struct buffer *ap)
 {
     struct buffer **lp, *tp;
-    int i;
 
-    /* first try to get it out of its current hash bucket, in which it might not be */
-    i = ap->hashIndex;
-    lp = &phTable[i];
+    lp = &phTable[ap->hashIndex].chain;
     for (tp = *lp; tp; tp = tp->hashNext) {
 	if (tp == ap) {
 	    *lp = tp->hashNext;
@@ -260,54 +356,109 @@ FixupBucket(struct buffer *ap)
 	}
 	lp = &tp->hashNext;
     }
-    /* now figure the new hash bucket */
-    i = pHash(ap);
-    ap->hashIndex = i;		/* remember where we are for deletion */
-    ap->hashNext = phTable[i];	/* add us to the list */
-    phTable[i] = ap;		/* at the front, since it's LRU */
-    return 0;
+    ap->hashIndex = -1;
+    ap->hashNext = NULL;
 }
 
-struct buffer *
-newslot(dir_file_t dir, afs_int32 apage, struct buffer *lp)
+/* write out a dirty buffer.  the buffer must be locked, and on the
+ * bucket's chain. */
+static int
+DWriteBack(struct buffer *tb)
 {
-    /* Find a usable buffer slot */
-    afs_int32 i;
-    afs_int32 lt;
-    struct buffer **tbp;
-
-    if (lp && (lp->lockers == 0)) {
-	lt = lp->accesstime;
-    } else {
-	lp = 0;
-	lt = BUFFER_LONG_MAX;
+    int code;
+
+    code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
+    if (!code) {
+	tb->dirty = 0;
+	rx_atomic_dec(&phTable[tb->hashIndex].ndirty);
     }
+    return code;
+}
+
+/*
+ * Pick a buffer to replace, and take it off its hash chain, writing it out
+ * first if it is dirty.  The buffer comes back with one locker, so no
+ * other thread can pick it.  Buckets other than our own are only ever
+ * tried, never waited for, so threads replacing buffers cannot deadlock.
+ *
+ * bp is write locked by the caller.
+ */
+static struct buffer *
+DGetVictim(struct bucket *bp)
+{
+    struct buffer *tb;
+    struct bucket *obp;
+    int i, n, code, busy;
+
+    for (;;) {
+	ObtainWriteLock(&afs_bufferLock);
+	for (busy = 0, i = 0; i < 2 * nbuffers; i++) {
+	    tb = Buffers[clockHand];
+	    clockHand = (clockHand + 1) % nbuffers;
+	    if (tb->lockers)
+		continue;
+	    if (tb->referenced) {
+		tb->referenced = 0;
+		continue;
+	    }
+	    obp = (tb->hashIndex < 0) ? NULL : &phTable[tb->hashIndex];
+	    if (obp && obp != bp) {
+		ObtainWriteLockNoBlock(&obp->lock, code);
+		if (code) {
+		    busy = 1;
+		    continue;
+		}
+	    }
+	    /* with its bucket locked, nobody can start using the buffer */
+	    ObtainWriteLock(&tb->lock);
+	    if (tb->lockers) {
+		ReleaseWriteLock(&tb->lock);
+		if (obp && obp != bp)
+		    ReleaseWriteLock(&obp->lock);
+		continue;
+	    }
+	    tb->lockers++;
+	    if (i >= nbuffers && (n = DGrowSize_r()) != 0)
+		DGrow_r(n);	/* all in use since the last pass */
+	    ReleaseWriteLock(&afs_bufferLock);
 
-    tbp = Buffers;
-    for (i = 0; i < nbuffers; i++, tbp++) {
-	if ((*tbp)->lockers == 0) {
-	    if ((*tbp)->accesstime < lt) {
-		lp = (*tbp);
-		lt = (*tbp)->accesstime;
+	    if (tb->dirty) {
+		if (DWriteBack(tb))
+		    Die("writing bogus buffer");
 	    }
+	    if (obp) {
+		DUnhash(tb);
+		rx_atomic_inc(&evictions);
+	    }
+	    ReleaseWriteLock(&tb->lock);
+	    if (obp && obp != bp)
+		ReleaseWriteLock(&obp->lock);
+	    return tb;
 	}
-    }
+	if (!busy && (n = DGrowSize_r()) != 0) {
+	    /* There are no unlocked buffers; make some */
+	    DGrow_r(n);
+	    busy = 1;
+	}
+	ReleaseWriteLock(&afs_bufferLock);
 
-    /* There are no unlocked buffers */
-    if (lp == 0) {
-	if (lt < 0)
-	    Die("accesstime counter wrapped");
-	else
+	/* There are no unlocked buffers */
+	if (!busy)
 	    Die("all buffers locked");
     }
+}
 
-    /* We do not need to lock the buffer here because it has no lockers
-     * and the afs_bufferLock prevents other threads from zapping this
-     * buffer while we are writing it out */
-    if (lp->dirty) {
-	if (ReallyWrite(bufferDir(lp), lp->page, lp->data))
-	    Die("writing bogus buffer");
-	lp->dirty = 0;
+/* find a usable buffer slot for a page, and put it on the page's hash
+ * chain, with one locker.  the bucket must be write locked. */
+static struct buffer *
+newslot(dir_file_t dir, afs_int32 apage, struct bucket *bp)
+{
+    struct buffer *lp;
+
+    lp = DGetVictim(bp);
+    if (lp->index) {
+	afs_dir_FreeIndex(lp->index);
+	lp->index = NULL;
     }
 
     /* Now fill in the header. */
@@ -315,9 +466,11 @@ newslot(dir_file_t dir, afs_int32 apage, struct buffer *lp)
     FidCpy(bufferDir(lp), dir);	/* set this */
     memset(lp->data, 0, BUFFER_PAGE_SIZE);  /* Don't leak stale data. */
     lp->page = apage;
-    lp->accesstime = ++timecounter;
+    lp->referenced = 1;
 
-    FixupBucket(lp);		/* move to the right hash bucket */
+    lp->hashIndex = bp - phTable;	/* remember where we are for deletion */
+    lp->hashNext = bp->chain;	/* add us to the list */
+    bp->chain = lp;
 
     return lp;
 }
@@ -334,8 +487,10 @@ DRelease(struct DirBuffer *entry, int flag)
 	return;
     ObtainWriteLock(&bp->lock);
     bp->lockers--;
-    if (flag)
+    if (flag && !bp->dirty) {
 	bp->dirty = 1;
+	rx_atomic_inc(&phTable[bp->hashIndex].ndirty);
+    }
     ReleaseWriteLock(&bp->lock);
 }
 
@@ -349,20 +504,77 @@ DVOffset(struct DirBuffer *entry)
     return BUFFER_PAGE_SIZE * bp->page + (char *)entry->data - (char *)bp->data;
 }
 
+/* Return the name index hung off a directory's header page, if any. */
+struct DirIndex *
+DGetIndex(struct DirBuffer *entry)
+{
+    struct buffer *bp;
+    struct DirIndex *index;
+
+    bp = entry->buffer;
+    ObtainReadLock(&bp->lock);
+    index = bp->index;
+    ReleaseReadLock(&bp->lock);
+    return index;
+}
+
+/*
+ * Hang a name index off a directory's header page.  The buffer owns the
+ * index from then on, and frees it when the page leaves the cache.  If
+ * another thread got there first, its index is kept and EEXIST returned;
+ * the caller still owns the one it passed in.
+ */
+int
+DSetIndex(struct DirBuffer *entry, struct DirIndex *index)
+{
+    struct buffer *bp;
+    int code = 0;
+
+    bp = entry->buffer;
+    ObtainWriteLock(&bp->lock);
+    if (bp->index)
+	code = EEXIST;
+    else
+	bp->index = index;
+    ReleaseWriteLock(&bp->lock);
+    return code;
+}
+
+/* Forget a buffer's contents.  The buffer must be locked.  A name index
+ * still in use is left for newslot to free. */
+static void
+DForget(struct buffer *tb)
+{
+    FidZap(bufferDir(tb));
+    if (tb->dirty) {
+	tb->dirty = 0;
+	rx_atomic_dec(&phTable[tb->hashIndex].ndirty);
+    }
+    if (tb->index && tb->lockers == 0) {
+	afs_dir_FreeIndex(tb->index);
+	tb->index = NULL;
+    }
+    tb->referenced = 0;
+}
+
 void
 DZap(dir_file_t dir)
 {
-    /* Destroy all buffers pertaining to a particular fid. */
+    /* Destroy all buffers pertaining to a particular fid.  Its pages are
+     * spread over the whole hash table. */
     struct buffer *tb;
-    ObtainReadLock(&afs_bufferLock);
-    for (tb = phTable[pHash(dir)]; tb; tb = tb->hashNext)
-	if (FidEq(bufferDir(tb), dir)) {
-	    ObtainWriteLock(&tb->lock);
-	    FidZap(bufferDir(tb));
-	    tb->dirty = 0;
-	    ReleaseWriteLock(&tb->lock);
-	}
-    ReleaseReadLock(&afs_bufferLock);
+    int i;
+
+    for (i = 0; i < nbuckets; i++) {
+	ObtainReadLock(&phTable[i].lock);
+	for (tb = phTable[i].chain; tb; tb = tb->hashNext)
+	    if (FidEq(bufferDir(tb), dir)) {
+		ObtainWriteLock(&tb->lock);
+		DForget(tb);
+		ReleaseWriteLock(&tb->lock);
+	    }
+	ReleaseReadLock(&phTable[i].lock);
+    }
 }
 
 int
@@ -370,21 +582,49 @@ DFlushVolume(afs_int32 vid)
 {
     /* Flush all data and release all inode handles for a particular volume */
     struct buffer *tb;
-    int code, rcode = 0;
-    ObtainReadLock(&afs_bufferLock);
-    for (tb = phTable[vHash(vid)]; tb; tb = tb->hashNext)
-	if (FidVolEq(bufferDir(tb), vid)) {
-	    ObtainWriteLock(&tb->lock);
-	    if (tb->dirty) {
-		code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
-		if (code && !rcode)
-		    rcode = code;
-		tb->dirty = 0;
+    int i, code, rcode = 0;
+
+    for (i = 0; i < nbuckets; i++) {
+	ObtainReadLock(&phTable[i].lock);
+	for (tb = phTable[i].chain; tb; tb = tb->hashNext)
+	    if (FidVolEq(bufferDir(tb), vid)) {
+		ObtainWriteLock(&tb->lock);
+		if (tb->dirty) {
+		    code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
+		    if (code && !rcode)
+			rcode = code;
+		}
+		DForget(tb);
+		ReleaseWriteLock(&tb->lock);
 	    }
-	    FidZap(bufferDir(tb));
-	    ReleaseWriteLock(&tb->lock);
+	ReleaseReadLock(&phTable[i].lock);
+    }
+    return rcode;
+}
+
+/* Write out the dirty buffers on one hash chain, optionally only those of
+ * one fid. */
+static int
+DFlushBucket(struct bucket *bp, dir_file_t fid)
+{
+    struct buffer *tb;
+    int code, rcode = 0;
+
+    ObtainReadLock(&bp->lock);
+    for (tb = bp->chain; tb; tb = tb->hashNext) {
+	if (!tb->dirty || (fid && !FidEq(bufferDir(tb), fid)))
+	    continue;
+	ObtainWriteLock(&tb->lock);
+	if (tb->dirty) {
+	    code = DWriteBack(tb);
+	    if (code && !rcode)
+		rcode = code;
 	}
-    ReleaseReadLock(&afs_bufferLock);
+	ReleaseWriteLock(&tb->lock);
+	if (rcode && fid)
+	    break;
+    }
+    ReleaseReadLock(&bp->lock);
     return rcode;
 }
 
@@ -392,58 +632,34 @@ int
 DFlushEntry(dir_file_t fid)
 {
     /* Flush pages modified by one entry. */
-    struct buffer *tb;
-    int code;
-
-    ObtainReadLock(&afs_bufferLock);
-    for (tb = phTable[pHash(fid)]; tb; tb = tb->hashNext)
-	if (FidEq(bufferDir(tb), fid) && tb->dirty) {
-	    ObtainWriteLock(&tb->lock);
-	    if (tb->dirty) {
-		code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
-		if (code) {
-		    ReleaseWriteLock(&tb->lock);
-		    ReleaseReadLock(&afs_bufferLock);
-		    return code;
-		}
-		tb->dirty = 0;
-	    }
-	    ReleaseWriteLock(&tb->lock);
-	}
-    ReleaseReadLock(&afs_bufferLock);
+    int i, code;
+
+    for (i = 0; i < nbuckets; i++) {
+	if (rx_atomic_read(&phTable[i].ndirty) == 0)
+	    continue;
+	code = DFlushBucket(&phTable[i], fid);
+	if (code)
+	    return code;
+    }
     return 0;
 }
 
 int
 DFlush(void)
 {
-    /* Flush all the modified buffers. */
+    /* Flush all the modified buffers.  Most chains are clean, and are
+     * skipped without taking their locks. */
     int i;
-    struct buffer **tbp;
     afs_int32 code, rcode;
 
     rcode = 0;
-    tbp = Buffers;
-    ObtainReadLock(&afs_bufferLock);
-    for (i = 0; i < nbuffers; i++, tbp++) {
-	if ((*tbp)->dirty) {
-	    ObtainWriteLock(&(*tbp)->lock);
-	    (*tbp)->lockers++;
-	    ReleaseReadLock(&afs_bufferLock);
-	    if ((*tbp)->dirty) {
-		code = ReallyWrite(bufferDir(*tbp), (*tbp)->page, (*tbp)->data);
-		if (!code)
-		    (*tbp)->dirty = 0;	/* Clear the dirty flag */
-		if (code && !rcode) {
-		    rcode = code;
-		}
-	    }
-	    (*tbp)->lockers--;
-	    ReleaseWriteLock(&(*tbp)->lock);
-	    ObtainReadLock(&afs_bufferLock);
-	}
+    for (i = 0; i < nbuckets; i++) {
+	if (rx_atomic_read(&phTable[i].ndirty) == 0)
+	    continue;
+	code = DFlushBucket(&phTable[i], NULL);
+	if (code && !rcode)
+	    rcode = code;
     }
-    ReleaseReadLock(&afs_bufferLock);
     return rcode;
 }
 
@@ -454,18 +670,17 @@ int
 DNew(dir_file_t dir, int page, struct DirBuffer *entry)
 {
     struct buffer *tb;
+    struct bucket *bp;
 
     memset(entry,0, sizeof(struct DirBuffer));
 
-    ObtainWriteLock(&afs_bufferLock);
-    if ((tb = newslot(dir, page, 0)) == 0) {
-	ReleaseWriteLock(&afs_bufferLock);
+    bp = &phTable[pHash(dir, page)];
+    ObtainWriteLock(&bp->lock);
+    if ((tb = newslot(dir, page, bp)) == 0) {
+	ReleaseWriteLock(&bp->lock);
 	return EIO;
     }
-    ObtainWriteLock(&tb->lock);
-    tb->lockers++;
-    ReleaseWriteLock(&afs_bufferLock);
-    ReleaseWriteLock(&tb->lock);
+    ReleaseWriteLock(&bp->lock);
 
     entry->buffer = tb;
     entry->data = tb->data;
@@ -60,6 +60,10 @@ struct dcache;
 struct DirBuffer;
 extern int DRead(struct dcache *adc, int page, struct DirBuffer *);
 extern int DNew(struct dcache *adc, int page, struct DirBuffer *);
+extern void *afs_osi_Alloc(size_t x);
+# ifndef afs_osi_Free
+extern void afs_osi_Free(void *x, size_t asize);
+# endif
 
 # include "afs/afs_osi.h"
 
@@ -75,14 +79,65 @@ extern int DNew(struct dcache *adc, int page, struct DirBuffer *);
 # include "dir.h"
 #endif /* KERNEL */
 
+#include <opr/jhash.h>
+
+#ifdef KERNEL
+# define dir_alloc(n) afs_osi_Alloc(n)
+# define dir_free(p, n) afs_osi_Free((p), (n))
+#else
+# define dir_alloc(n) malloc(n)
+# define dir_free(p, n) free(p)
+#endif
+
 afs_int32 DErrno;
 
+/*
+ * The name index.  A directory has only NHASHENT hash chains, so finding a
+ * name in a directory of thousands of entries walks a long chain, reading
+ * each entry on it.  Once a directory has afs_dir_indexPages pages, the
+ * first search builds an in-memory hash table of all its names, which
+ * afs_dir_Create and afs_dir_Delete then keep up to date.  Each slot also
+ * records the entry before its own on the on-disk chain, so that deleting
+ * an entry doesn't walk the chain either.  The header's allocation map
+ * only covers the first MAXPAGES pages, so the index also counts the free
+ * blobs of the pages beyond, which FindBlobs would otherwise read one by
+ * one on every create.
+ *
+ * The index hangs off the buffer holding the directory's header page, and
+ * the buffer package frees it whenever that page leaves the cache, so it
+ * never outlives the pages it describes.  Callers already keep changes to
+ * a directory from running alongside anything else on it; the only new
+ * race, two readers building the index at once, is settled by DSetIndex.
+ * Readers never change an index.  If a change cannot be applied, the
+ * writer empties the index, and the directory goes back to walking its
+ * chains until the header page is next read in.
+ */
+struct DirIndexEntry {
+    afs_uint32 hash;		/* name hash, or 0 if never used */
+    unsigned short blob;	/* first blob of the entry, or 0 if deleted */
+    unsigned short prev;	/* blob before us on the chain, or 0 */
+};
+
+struct DirIndex {
+    int size;			/* slots, a power of 2; 0 if unusable */
+    int used;			/* slots with a hash */
+    int count;			/* slots with an entry */
+    struct DirIndexEntry *slots;
+    char freeMap[BIGMAXPAGES - MAXPAGES];	/* alloMap for later pages */
+};
+
+int afs_dir_indexPages = DIR_INDEX_PAGES;
+
 /* Local static prototypes */
 static int FindBlobs(dir_file_t, int);
 static void AddPage(dir_file_t, int);
 static void FreeBlobs(dir_file_t, int, int);
 static int FindItem(dir_file_t, char *, struct DirBuffer *,
 		    struct DirBuffer *);
+static int IndexAdd(dir_file_t, struct DirIndex *, char *, int, int);
+static int IndexRemove(dir_file_t, struct DirIndex *, char *, int, int,
+		       int);
+static void IndexDisable(struct DirIndex *);
 
 /* Find out how many entries are required to store a name. */
 int
@@ -104,6 +159,7 @@ afs_dir_Create(dir_file_t dir, char *entry, void *voidfid)
     struct DirBuffer entrybuf, prevbuf, headerbuf;
     struct DirEntry *ep;
     struct DirHeader *dhp;
+    struct DirIndex *index;
 
     /* check name quality */
     if (*entry == 0)
@@ -141,31 +197,43 @@ afs_dir_Create(dir_file_t dir, char *entry, void *voidfid)
     i = afs_dir_DirHash(entry);
     ep->next = dhp->hashTable[i];
     dhp->hashTable[i] = htons(firstelt);
+    index = DGetIndex(&headerbuf);
+    if (index && index->size
+	&& IndexAdd(dir, index, entry, firstelt, ntohs(ep->next)) != 0)
+	IndexDisable(index);
     DRelease(&headerbuf, 1);
     DRelease(&entrybuf, 1);
     return 0;
 }
 
+/* Return the number of pages in a directory. */
+static int
+DirPages(struct DirHeader *dhp)
+{
+    int i, ctr;
+
+    if (dhp->header.pgcount != 0)
+	return ntohs(dhp->header.pgcount);
+
+    /* old style, count the pages */
+    ctr = 0;
+    for (i = 0; i < MAXPAGES; i++)
+	if (dhp->alloMap[i] != EPP)
+	    ctr++;
+    return ctr;
+}
+
 int
 afs_dir_Length(dir_file_t dir)
 {
-    int i, ctr;
+    int ctr;
     struct DirBuffer headerbuf;
     struct DirHeader *dhp;
 
     if (DRead(dir, 0, &headerbuf) != 0)
 	return 0;
     dhp = (struct DirHeader *)headerbuf.data;
-
-    if (dhp->header.pgcount != 0)
-	ctr = ntohs(dhp->header.pgcount);
-    else {
-	/* old style, count the pages */
-	ctr = 0;
-	for (i = 0; i < MAXPAGES; i++)
-	    if (dhp->alloMap[i] != EPP)
-		ctr++;
-    }
+    ctr = DirPages(dhp);
     DRelease(&headerbuf, 0);
     return ctr * AFS_PAGESIZE;
 }
@@ -176,10 +244,11 @@ int
 afs_dir_Delete(dir_file_t dir, char *entry)
 {
 
-    int nitems, index;
-    struct DirBuffer entrybuf, prevbuf;
+    int nitems, index, prev;
+    struct DirBuffer entrybuf, prevbuf, headerbuf;
     struct DirEntry *firstitem;
     unsigned short *previtem;
+    struct DirIndex *nameindex;
 
     if (FindItem(dir, entry, &prevbuf, &entrybuf) != 0)
 	return ENOENT;
@@ -188,8 +257,19 @@ afs_dir_Delete(dir_file_t dir, char *entry)
     previtem = (unsigned short *)prevbuf.data;
 
     *previtem = firstitem->next;
+    /* the blob holding the link we changed, or 0 for the header */
+    prev = DVOffset(&prevbuf);
+    prev = (prev < (int)sizeof(struct DirHeader)) ? 0 : prev / 32;
     DRelease(&prevbuf, 1);
     index = DVOffset(&entrybuf) / 32;
+    if (DRead(dir, 0, &headerbuf) == 0) {
+	nameindex = DGetIndex(&headerbuf);
+	if (nameindex && nameindex->size
+	    && IndexRemove(dir, nameindex, entry, index, prev,
+			   ntohs(firstitem->next)) != 0)
+	    IndexDisable(nameindex);
+	DRelease(&headerbuf, 0);
+    }
     nitems = afs_dir_NameBlobs(firstitem->name);
     /* Clear entire DirEntry and any DirXEntry extensions */
     memset(firstitem, 0, nitems * sizeof(*firstitem));
@@ -207,14 +287,21 @@ FindBlobs(dir_file_t dir, int nblobs)
     struct DirBuffer headerbuf, pagebuf;
     struct DirHeader *dhp;
     struct PageHeader *pp;
+    struct DirIndex *index;
     int pgcount;
 
     /* read the dir header in first. */
     if (DRead(dir, 0, &headerbuf) != 0)
 	return -1;
     dhp = (struct DirHeader *)headerbuf.data;
+    index = DGetIndex(&headerbuf);
+    if (index && index->size == 0)
+	index = NULL;
 
     for (i = 0; i < BIGMAXPAGES; i++) {
+	if (index && i >= MAXPAGES && i < ntohs(dhp->header.pgcount)
+	    && index->freeMap[i - MAXPAGES] < nblobs)
+	    continue;		/* not enough room on this page */
 	if (i >= MAXPAGES || dhp->alloMap[i] >= nblobs) {
 	    /* if page could contain enough entries */
 	    /* If there are EPP free entries, then the page is not even allocated. */
@@ -229,6 +316,8 @@ FindBlobs(dir_file_t dir, int nblobs)
 		    /* this page is bigger than last allocated page */
 		    AddPage(dir, i);
 		    dhp->header.pgcount = htons(i + 1);
+		    if (index)
+			index->freeMap[i - MAXPAGES] = EPP - 1;
 		}
 	    } else if (dhp->alloMap[i] == EPP) {
 		/* Add the page to the directory. */
@@ -258,6 +347,8 @@ FindBlobs(dir_file_t dir, int nblobs)
 		 * and free up any resources we've got allocated. */
 		if (i < MAXPAGES)
 		    dhp->alloMap[i] -= nblobs;
+		else if (index)
+		    index->freeMap[i - MAXPAGES] -= nblobs;
 		DRelease(&headerbuf, 1);
 		for (k = 0; k < nblobs; k++)
 		    pp->freebitmap[(j + k) >> 3] |= 1 << ((j + k) & 7);
@@ -303,6 +394,7 @@ FreeBlobs(dir_file_t dir, int firstblob, int nblobs)
     struct DirBuffer headerbuf, pagehdbuf;
     struct DirHeader *dhp;
     struct PageHeader *pp;
+    struct DirIndex *index;
     page = firstblob / EPP;
     firstblob -= EPP * page;	/* convert to page-relative entry */
 
@@ -312,6 +404,8 @@ FreeBlobs(dir_file_t dir, int firstblob, int nblobs)
 
     if (page < MAXPAGES)
 	dhp->alloMap[page] += nblobs;
+    else if ((index = DGetIndex(&headerbuf)) != NULL && index->size)
+	index->freeMap[page - MAXPAGES] += nblobs;
 
     DRelease(&headerbuf, 1);
 
@@ -585,6 +679,306 @@ afs_dir_DirHash(char *string)
 }
 
 
+static afs_uint32
+IndexHash(char *name)
+{
+    afs_uint32 hash;
+
+    hash = opr_jhash_opaque(name, strlen(name), 0);
+    return hash ? hash : 1;
+}
+
+void
+afs_dir_FreeIndex(struct DirIndex *index)
+{
+    if (index->slots)
+	dir_free(index->slots, index->size * sizeof(struct DirIndexEntry));
+    dir_free(index, sizeof(struct DirIndex));
+}
+
+/* Empty an index that no longer matches its directory.  The empty index
+ * stays on the header page, so it is not built again straight away. */
+static void
+IndexDisable(struct DirIndex *index)
+{
+    if (index->slots)
+	dir_free(index->slots, index->size * sizeof(struct DirIndexEntry));
+    index->slots = NULL;
+    index->size = index->used = index->count = 0;
+}
+
+/* Move the entries of an index into a new table of size slots, dropping
+ * the deleted ones. */
+static int
+IndexResize(struct DirIndex *index, int size)
+{
+    struct DirIndexEntry *slots, *ep;
+    int i, j;
+
+    slots = dir_alloc(size * sizeof(struct DirIndexEntry));
+    if (slots == NULL)
+	return ENOMEM;
+    memset(slots, 0, size * sizeof(struct DirIndexEntry));
+    for (i = 0; i < index->size; i++) {
+	ep = &index->slots[i];
+	if (ep->blob == 0)
+	    continue;
+	for (j = ep->hash & (size - 1); slots[j].hash; j = (j + 1) & (size - 1))
+	    ;
+	slots[j] = *ep;
+    }
+    if (index->slots)
+	dir_free(index->slots, index->size * sizeof(struct DirIndexEntry));
+    index->slots = slots;
+    index->size = size;
+    index->used = index->count;
+    return 0;
+}
+
+/* Put an entry in an index, growing it if need be. */
+static int
+IndexInsert(struct DirIndex *index, afs_uint32 hash, int blob, int prev)
+{
+    struct DirIndexEntry *ep;
+    int i, size;
+
+    if (4 * (index->used + 1) > 3 * index->size) {
+	for (size = index->size; 2 * (index->count + 1) > size; size <<= 1)
+	    ;
+	if (IndexResize(index, size))
+	    return ENOMEM;
+    }
+    for (i = hash & (index->size - 1); index->slots[i].blob;
+	 i = (i + 1) & (index->size - 1))
+	;
+    ep = &index->slots[i];
+    if (ep->hash == 0)
+	index->used++;
+    ep->hash = hash;
+    ep->blob = blob;
+    ep->prev = prev;
+    index->count++;
+    return 0;
+}
+
+/* Find the slot of the entry starting at blob. */
+static struct DirIndexEntry *
+IndexSlot(struct DirIndex *index, afs_uint32 hash, int blob)
+{
+    int i;
+
+    for (i = hash & (index->size - 1); index->slots[i].hash;
+	 i = (i + 1) & (index->size - 1)) {
+	if (index->slots[i].hash == hash && index->slots[i].blob == blob)
+	    return &index->slots[i];
+    }
+    return NULL;
+}
+
+/* Record that the entry starting at blob now follows prev on its chain. */
+static int
+IndexSetPrev(dir_file_t dir, struct DirIndex *index, int blob, int prev)
+{
+    struct DirBuffer entrybuf;
+    struct DirIndexEntry *ep;
+    int code;
+
+    code = afs_dir_GetVerifiedBlob(dir, blob, &entrybuf);
+    if (code)
+	return code;
+    ep = IndexSlot(index,
+		   IndexHash(((struct DirEntry *)entrybuf.data)->name), blob);
+    DRelease(&entrybuf, 0);
+    if (ep == NULL)
+	return ENOENT;
+    ep->prev = prev;
+    return 0;
+}
+
+/* Index a new entry, which has just been put at the head of its chain,
+ * in front of next. */
+static int
+IndexAdd(dir_file_t dir, struct DirIndex *index, char *name, int blob,
+	 int next)
+{
+    int code;
+
+    code = IndexInsert(index, IndexHash(name), blob, 0);
+    if (code == 0 && next != 0)
+	code = IndexSetPrev(dir, index, next, blob);
+    return code;
+}
+
+/* Drop an entry which has just been taken off its chain, where it sat
+ * between prev and next. */
+static int
+IndexRemove(dir_file_t dir, struct DirIndex *index, char *name, int blob,
+	    int prev, int next)
+{
+    struct DirIndexEntry *ep;
+
+    ep = IndexSlot(index, IndexHash(name), blob);
+    if (ep == NULL)
+	return ENOENT;
+    ep->blob = 0;
+    index->count--;
+    if (next != 0)
+	return IndexSetPrev(dir, index, next, prev);
+    return 0;
+}
+
+/* Build the index of a directory by walking all of its chains. */
+static struct DirIndex *
+IndexBuild(dir_file_t dir, struct DirHeader *dhp, int pages)
+{
+    struct DirIndex *index;
+    struct DirBuffer entrybuf, pagebuf;
+    struct DirEntry *ep;
+    struct PageHeader *pp;
+    int i, j, num, prev, size, elements, code;
+
+    index = dir_alloc(sizeof(struct DirIndex));
+    if (index == NULL)
+	return NULL;
+    memset(index, 0, sizeof(struct DirIndex));
+
+    /* most names take one or two blobs */
+    for (size = EPP; size < pages * EPP; size <<= 1)
+	;
+    if (IndexResize(index, size))
+	goto fail;
+
+    for (i = 0; i < NHASHENT; i++) {
+	prev = 0;
+	num = ntohs(dhp->hashTable[i]);
+	elements = 0;
+	while (num != 0) {
+	    /* Detect circular hash chains. */
+	    if (++elements > BIGMAXPAGES * EPP)
+		goto fail;
+	    if (afs_dir_GetVerifiedBlob(dir, num, &entrybuf) != 0)
+		goto fail;
+	    ep = (struct DirEntry *)entrybuf.data;
+	    code = IndexInsert(index, IndexHash(ep->name), num, prev);
+	    prev = num;
+	    num = ntohs(ep->next);
+	    DRelease(&entrybuf, 0);
+	    if (code)
+		goto fail;
+	}
+    }
+
+    for (i = MAXPAGES; i < pages && i < BIGMAXPAGES; i++) {
+	if (DRead(dir, i, &pagebuf) != 0)
+	    goto fail;
+	pp = (struct PageHeader *)pagebuf.data;
+	index->freeMap[i - MAXPAGES] = EPP;
+	for (j = 0; j < EPP; j++)
+	    if ((pp->freebitmap[j >> 3] >> (j & 7)) & 1)
+		index->freeMap[i - MAXPAGES]--;
+	DRelease(&pagebuf, 0);
+    }
+    return index;
+
+  fail:
+    /* an empty index keeps us from trying again on every lookup */
+    IndexDisable(index);
+    return index;
+}
+
+/*
+ * Return the usable name index of a directory, building it if the
+ * directory is big enough and has none yet.  headerbuf holds the
+ * directory's header page.
+ */
+static struct DirIndex *
+GetIndex(dir_file_t dir, struct DirBuffer *headerbuf)
+{
+    struct DirHeader *dhp = (struct DirHeader *)headerbuf->data;
+    struct DirIndex *index;
+    int pages;
+
+    index = DGetIndex(headerbuf);
+    if (index == NULL) {
+	pages = DirPages(dhp);
+	if (afs_dir_indexPages <= 0 || pages < afs_dir_indexPages)
+	    return NULL;
+	index = IndexBuild(dir, dhp, pages);
+	if (index == NULL)
+	    return NULL;
+	if (DSetIndex(headerbuf, index) != 0) {
+	    /* somebody else built one first */
+	    afs_dir_FreeIndex(index);
+	    index = DGetIndex(headerbuf);
+	}
+    }
+    return (index->size != 0) ? index : NULL;
+}
+
+/*
+ * Find a directory entry through the name index.  On success, the results
+ * are as for FindItem, and the header page is released unless it is
+ * returned in prevbuf.  If the index disagrees with the directory, it
+ * returns EAGAIN with prev still holding the header page, and the caller
+ * falls back to walking the chain.
+ */
+static int
+IndexFind(dir_file_t dir, struct DirIndex *index, int i, char *ename,
+	  struct DirBuffer *prev, struct DirBuffer *prevbuf,
+	  struct DirBuffer *itembuf)
+{
+    struct DirHeader *dhp = (struct DirHeader *)prev->data;
+    struct DirIndexEntry *ep;
+    struct DirBuffer curr, pbuf;
+    struct DirEntry *tp;
+    afs_uint32 hash;
+    int j;
+
+    hash = IndexHash(ename);
+    for (j = hash & (index->size - 1); index->slots[j].hash;
+	 j = (j + 1) & (index->size - 1)) {
+	ep = &index->slots[j];
+	if (ep->hash != hash || ep->blob == 0)
+	    continue;
+	if (afs_dir_GetVerifiedBlob(dir, ep->blob, &curr) != 0)
+	    return EAGAIN;
+	tp = (struct DirEntry *)curr.data;
+	if (strcmp(ename, tp->name) != 0) {
+	    DRelease(&curr, 0);
+	    continue;
+	}
+
+	/* Found it; check that the link the caller may change is ours. */
+	if (ep->prev == 0) {
+	    if (dhp->hashTable[i] != htons(ep->blob)) {
+		DRelease(&curr, 0);
+		return EAGAIN;
+	    }
+	    prev->data = &(dhp->hashTable[i]);
+	    *prevbuf = *prev;
+	} else {
+	    if (afs_dir_GetVerifiedBlob(dir, ep->prev, &pbuf) != 0) {
+		DRelease(&curr, 0);
+		return EAGAIN;
+	    }
+	    tp = (struct DirEntry *)pbuf.data;
+	    if (tp->next != htons(ep->blob)) {
+		DRelease(&pbuf, 0);
+		DRelease(&curr, 0);
+		return EAGAIN;
+	    }
+	    pbuf.data = &(tp->next);
+	    DRelease(prev, 0);
+	    *prevbuf = pbuf;
+	}
+	*itembuf = curr;
+	return 0;
+    }
+
+    DRelease(prev, 0);
+    return ENOENT;
+}
+
 /* Find a directory entry, given its name.  This entry returns a pointer
  * to a locked buffer, and a pointer to a locked buffer (in previtem)
  * referencing the found item (to aid the delete code).  If no entry is
@@ -599,6 +993,7 @@ FindItem(dir_file_t dir, char *ename, struct DirBuffer *prevbuf,
     struct DirBuffer curr, prev;
     struct DirHeader *dhp;
     struct DirEntry *tp;
+    struct DirIndex *index;
     int elements;
 
     memset(prevbuf, 0, sizeof(struct DirBuffer));
@@ -610,6 +1005,12 @@ FindItem(dir_file_t dir, char *ename, struct DirBuffer *prevbuf,
     dhp = (struct DirHeader *)prev.data;
 
     i = afs_dir_DirHash(ename);
+    index = GetIndex(dir, &prev);
+    if (index) {
+	code = IndexFind(dir, index, i, ename, &prev, prevbuf, itembuf);
+	if (code != EAGAIN)
+	    return code;
+    }
     if (dhp->hashTable[i] == 0) {
 	/* no such entry */
 	DRelease(&prev, 0);
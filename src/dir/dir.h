@@ -115,9 +115,21 @@ extern int afs_dir_InverseLookup (void *dir, afs_uint32 vnode,
 extern int afs_dir_ChangeFid(dir_file_t dir, char *entry,
 		             afs_uint32 *old_fid, afs_uint32 *new_fid);
 
+/* In-memory name index, built for directories of at least
+ * afs_dir_indexPages pages.  Zero disables it. */
+#define DIR_INDEX_PAGES 16
+
+struct DirIndex;
+extern int afs_dir_indexPages;
+extern void afs_dir_FreeIndex(struct DirIndex *index);
+
 /* buffer operations */
 
+extern int afs_dir_maxBuffers;
 extern void DInit(int abuffers);
+#ifndef KERNEL
+extern int DResize(int abuffers);
+#endif
 extern int DRead(dir_file_t fid, int page, struct DirBuffer *);
 extern int DFlush(void);
 extern int DFlushVolume(afs_int32);
@@ -128,6 +140,8 @@ extern int DStat(int *abuffers, int *acalls, int *aios);
 extern int DFlushVolume(afs_int32 vid);
 extern int DFlushEntry(dir_file_t fid);
 extern int DVOffset(struct DirBuffer *);
+extern struct DirIndex *DGetIndex(struct DirBuffer *);
+extern int DSetIndex(struct DirBuffer *, struct DirIndex *);
 
 /* salvage.c */
 
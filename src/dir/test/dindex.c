@@ -0,0 +1,304 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Exercise the in-memory name index on a large directory.  The directory
+ * is filled, then put through a run of random creates and deletes, and
+ * every name is looked up several times; each result is checked against
+ * a model of what the directory should hold, and the directory against
+ * DirOK at the end.  Run it with -n as well to time the same work with
+ * the index disabled.
+ */
+
+#define PAGESIZE 2048
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <afs/dir.h>
+
+typedef struct DirHandle {
+    int fd;
+    int uniq;
+} dirhandle;
+int Uniq;
+
+static afs_int32 *model;	/* unique of each name present, 0 if absent */
+static int nentries;		/* names in the model */
+static int nfound;		/* names found by EnumerateDir */
+static int failures;
+static unsigned int seed = 1;
+
+static void
+Usage(void)
+{
+    printf("Usage: dindex [-n] file [entries [buffers]]\n");
+    printf("-n - disable the name index\n");
+    exit(1);
+}
+
+static unsigned int
+Random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) & 0xffffff;
+}
+
+static double
+Elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) +
+	(now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void
+EntryName(char *buf, size_t len, int i)
+{
+    snprintf(buf, len, "entry.name.%07d", i);
+}
+
+static void
+Fail(const char *what, int i, int code)
+{
+    char name[32];
+
+    EntryName(name, sizeof(name), i);
+    printf("%s of '%s' failed: code %d, expected %s\n", what, name, code,
+	   model[i] ? "present" : "absent");
+    failures++;
+}
+
+static void
+CreateEntry(dirhandle *dir, int i, afs_int32 uniq)
+{
+    char name[32];
+    afs_int32 fid[3];
+    int code;
+
+    EntryName(name, sizeof(name), i);
+    fid[0] = 0;
+    fid[1] = i + 2;
+    fid[2] = uniq;
+    code = afs_dir_Create(dir, name, fid);
+    if (code != (model[i] ? EEXIST : 0))
+	Fail("create", i, code);
+    if (code == 0) {
+	model[i] = uniq;
+	nentries++;
+    }
+}
+
+static void
+DeleteEntry(dirhandle *dir, int i)
+{
+    char name[32];
+    int code;
+
+    EntryName(name, sizeof(name), i);
+    code = afs_dir_Delete(dir, name);
+    if (code != (model[i] ? 0 : ENOENT))
+	Fail("delete", i, code);
+    if (code == 0) {
+	model[i] = 0;
+	nentries--;
+    }
+}
+
+static void
+LookupEntry(dirhandle *dir, int i)
+{
+    char name[32];
+    afs_int32 fid[3];
+    int code;
+
+    EntryName(name, sizeof(name), i);
+    code = afs_dir_Lookup(dir, name, fid);
+    if (model[i]) {
+	if (code != 0 || fid[1] != i + 2 || fid[2] != model[i])
+	    Fail("lookup", i, code);
+    } else if (code != ENOENT) {
+	Fail("lookup", i, code);
+    }
+}
+
+static int
+CountEntry(void *handle, char *name, afs_int32 vnode, afs_int32 unique)
+{
+    nfound++;
+    return 0;
+}
+
+static void
+CreateDir(char *name, dirhandle *dir)
+{
+    dir->fd = open(name, O_CREAT | O_RDWR | O_TRUNC, 0666);
+    dir->uniq = ++Uniq;
+    if (dir->fd == -1) {
+	printf("Couldn't create %s\n", name);
+	exit(1);
+    }
+}
+
+int
+ReallyRead(dirhandle *dir, int block, char *data)
+{
+    int code;
+    if (lseek(dir->fd, block * PAGESIZE, 0) == -1)
+	return errno;
+    code = read(dir->fd, data, PAGESIZE);
+    if (code < 0)
+	return errno;
+    if (code != PAGESIZE)
+	return EIO;
+    return 0;
+}
+
+int
+ReallyWrite(dirhandle *dir, int block, char *data)
+{
+    int code;
+    if (lseek(dir->fd, block * PAGESIZE, 0) == -1)
+	return errno;
+    code = write(dir->fd, data, PAGESIZE);
+    if (code < 0)
+	return errno;
+    if (code != PAGESIZE)
+	return EIO;
+    return 0;
+}
+
+void
+FidZap(dirhandle *dir)
+{
+    dir->fd = -1;
+}
+
+void
+FidZero(long *afid)
+{
+    *afid = 0;
+}
+
+int
+FidEq(dirhandle *dir1, dirhandle *dir2)
+{
+    return (dir1->uniq == dir2->uniq);
+}
+
+afs_uint32
+FidHash(dirhandle *dir)
+{
+    return dir->uniq;
+}
+
+int
+FidVolEq(long *afid, long *bfid)
+{
+    return 1;
+}
+
+void
+FidCpy(dirhandle *todir, dirhandle *fromdir)
+{
+    *todir = *fromdir;
+}
+
+void
+Die(const char *msg)
+{
+    printf("Something died with this message:  %s\n", msg);
+    exit(1);
+}
+
+void
+Log(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+int
+main(int argc, char **argv)
+{
+    dirhandle dir;
+    struct timeval start;
+    afs_int32 me[3], uniq = 1;
+    int i, j, count = 20000, buffers = 100;
+
+    argc--;
+    argv++;
+    if (argc > 0 && strcmp(*argv, "-n") == 0) {
+	afs_dir_indexPages = 0;
+	argc--;
+	argv++;
+    }
+    if (argc < 1 || argc > 3)
+	Usage();
+    if (argc > 1)
+	count = atoi(argv[1]);
+    if (argc > 2)
+	buffers = atoi(argv[2]);
+    if (count <= 0 || buffers <= 0)
+	Usage();
+
+    model = calloc(count, sizeof(afs_int32));
+    if (model == NULL)
+	Die("out of memory");
+    DInit(buffers);
+    CreateDir(argv[0], &dir);
+    memset(me, 0, sizeof(me));
+    me[1] = me[2] = 1;
+    afs_dir_MakeDir(&dir, me, me);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++)
+	CreateEntry(&dir, i, uniq++);
+    DFlush();
+    printf("%d creates: %.2f sec\n", count, Elapsed(&start));
+
+    gettimeofday(&start, NULL);
+    for (j = 0; j < 2 * count; j++) {
+	i = Random() % count;
+	/* a create of a name that is present must fail with EEXIST */
+	if (model[i] && (Random() & 1))
+	    DeleteEntry(&dir, i);
+	else
+	    CreateEntry(&dir, i, uniq++);
+    }
+    DFlush();
+    printf("%d mixed creates and deletes: %.2f sec, %d entries left\n",
+	   2 * count, Elapsed(&start), nentries);
+
+    gettimeofday(&start, NULL);
+    for (j = 0; j < 5; j++)
+	for (i = 0; i < count; i++)
+	    LookupEntry(&dir, i);
+    printf("%d lookups: %.2f sec\n", 5 * count, Elapsed(&start));
+
+    afs_dir_EnumerateDir(&dir, CountEntry, NULL);
+    if (nfound != nentries + 2) {
+	printf("directory has %d entries, expected %d\n", nfound,
+	       nentries + 2);
+	failures++;
+    }
+    if (!DirOK(&dir)) {
+	printf("DirOK failed\n");
+	failures++;
+    }
+
+    printf("%s: %d failures\n", failures ? "FAILED" : "ok", failures);
+    exit(failures ? 1 : 0);
+}
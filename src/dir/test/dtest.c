@@ -231,6 +231,12 @@ FidEq(dirhandle *dir1, dirhandle *dir2)
     return (dir1->uniq == dir2->uniq);
 }
 
+afs_uint32
+FidHash(dirhandle *dir)
+{
+    return dir->uniq;
+}
+
 int
 FidVolEq(long *afid, long *bfid)
 {
@@ -209,6 +209,20 @@ ReadPreamble(struct ubik_trans **tt)
 {
     int code;
 
+#if defined(UBIK_READ_WHILE_WRITE) && !defined(SUPERGROUPS)
+    /* Read from a snapshot without taking any lock, so lookups never wait
+     * for a writer.  Readers get header words through the trans, not from
+     * cheader; only a dbase that is not built yet takes the slow way. */
+    code = ubik_BeginTransReadAnyWrite(dbase, UBIK_READTRANS, tt);
+    if (code)
+	return code;
+
+    code = Checkdb(*tt);
+    if (code == 0)
+	return 0;
+    ubik_AbortTrans(*tt);
+#endif
+
     code = Initdb();
     if (code)
 	return code;
@@ -1472,7 +1486,10 @@ listEntries(struct rx_call *call, afs_int32 flag, afs_int32 startindex,
     if (!code && !pr_noAuth)
 	ABORT_WITH(tt, PRPERM);
 
-    eof = ntohl(cheader.eofPtr) - sizeof(cheader);
+    code = get_header_word(tt, eofPtr, &eof);
+    if (code)
+	ABORT_WITH(tt, code);
+    eof = ntohl(eof) - sizeof(cheader);
     maxentries = eof / sizeof(struct prentry);
     for (i = startindex; i < maxentries; i++) {
 	pos = i * sizeof(struct prentry) + sizeof(cheader);
@@ -1885,7 +1902,10 @@ listOwned(struct rx_call *call, afs_int32 aid, prlist *alist, afs_int32 *lastP,
 	} else {
 	    if (!AccessOK(tt, *cid, 0, 0, 0))
 		ABORT_WITH(tt, PRPERM);
-	    head = ntohl(cheader.orphan);
+	    code = get_header_word(tt, orphan, &head);
+	    if (code)
+		ABORT_WITH(tt, code);
+	    head = ntohl(head);
 	}
     }
 
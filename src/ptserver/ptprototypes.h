@@ -97,6 +97,7 @@ extern afs_int32 GetOwnedChain(struct ubik_trans *ut, afs_int32 *next,
 			       prlist *alist);
 extern afs_int32 AddToPRList(prlist *alist, int *sizeP, afs_int32 id);
 extern afs_int32 read_DbHeader(struct ubik_trans *tt);
+extern afs_int32 Checkdb(struct ubik_trans *tt);
 extern afs_int32 Initdb(void);
 
 /* ptuser.c */
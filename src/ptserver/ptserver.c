@@ -153,6 +153,7 @@ extern afs_int32 depthsg;
 int restricted = 0;
 int restrict_anonymous = 0;
 int rxMaxMTU = -1;
+int rxListeners = 0;
 int rxBind = 0;
 int rxkadDisableDotCheck = 0;
 
@@ -195,6 +196,18 @@ pr_rxstat_userok(struct rx_call *call)
     return afsconf_SuperUser(prdir, call, NULL);
 }
 
+#if defined(UBIK_READ_WHILE_WRITE) && !defined(SUPERGROUPS)
+/*
+ * Readers that do not wait for writers never look at cheader, and writers
+ * keep it current as they go, so there is nothing to copy at commit.
+ */
+static int
+pr_SyncWriterCache(void)
+{
+    return 0;
+}
+#endif
+
 /**
  * Return true if this name is a member of the local realm.
  */
@@ -226,6 +239,7 @@ enum optionsList {
     OPT_debug,
     OPT_logfile,
     OPT_threads,
+    OPT_ubikbuffers,
 #ifdef HAVE_SYSLOG
     OPT_syslog,
 #endif
@@ -233,6 +247,7 @@ enum optionsList {
     OPT_process,
     OPT_rxbind,
     OPT_rxmaxmtu,
+    OPT_rxlisteners,
     OPT_dotted,
     OPT_transarc_logs
 };
@@ -341,6 +356,8 @@ main(int argc, char **argv)
 		        CMD_OPTIONAL, "location of logfile");
     cmd_AddParmAtOffset(opts, OPT_threads, "-p", CMD_SINGLE,
 		        CMD_OPTIONAL, "number of threads");
+    cmd_AddParmAtOffset(opts, OPT_ubikbuffers, "-ubikbuffers", CMD_SINGLE,
+		        CMD_OPTIONAL, "number of ubik database page buffers");
 #ifdef HAVE_SYSLOG
     cmd_AddParmAtOffset(opts, OPT_syslog, "-syslog", CMD_SINGLE_OR_FLAG, 
 		        CMD_OPTIONAL, "log to syslog");
@@ -357,6 +374,8 @@ main(int argc, char **argv)
 		        CMD_OPTIONAL, "bind only to the primary interface");
     cmd_AddParmAtOffset(opts, OPT_rxmaxmtu, "-rxmaxmtu", CMD_SINGLE,
 		        CMD_OPTIONAL, "maximum MTU for RX");
+    cmd_AddParmAtOffset(opts, OPT_rxlisteners, "-rxlisteners", CMD_SINGLE,
+		        CMD_OPTIONAL, "number of rx listener threads");
 
     /* rxkad options */
     cmd_AddParmAtOffset(opts, OPT_dotted, "-allow-dotted-principals",
@@ -416,6 +435,8 @@ main(int argc, char **argv)
 	}
     }
 
+    cmd_OptionAsInt(opts, OPT_ubikbuffers, &ubik_nBuffers);
+
 #ifdef HAVE_SYSLOG
     if (cmd_OptionPresent(opts, OPT_syslog)) {
 	if (cmd_OptionPresent(opts, OPT_logfile)) {
@@ -456,6 +477,10 @@ main(int argc, char **argv)
 
     cmd_OptionAsInt(opts, OPT_rxmaxmtu, &rxMaxMTU);
 
+    /* Must be set before the first rx_InitHost */
+    if (cmd_OptionAsInt(opts, OPT_rxlisteners, &rxListeners) == 0)
+	rx_SetListenerThreads(rxListeners);
+
     /* rxkad options */
     cmd_OptionAsFlag(opts, OPT_dotted, &rxkadDisableDotCheck);
 
@@ -524,7 +549,11 @@ main(int argc, char **argv)
      * CoEntry this adds up to as much as 1+1+39*3 = 119.  If all these entries
      * and the header are in separate Ubik buffers then 120 buffers may be
      * required. */
-    ubik_nBuffers = 120 + /*fudge */ 40;
+    if (ubik_nBuffers < 120 + /*fudge */ 40) {
+	printf("Warning: '-ubikbuffers %d' is too small; using %d instead\n",
+	       ubik_nBuffers, 120 + 40);
+	ubik_nBuffers = 120 + 40;
+    }
 
     if (rxBind) {
 	afs_int32 ccode;
@@ -559,6 +588,9 @@ main(int argc, char **argv)
 	}
     }
 
+#if defined(UBIK_READ_WHILE_WRITE) && !defined(SUPERGROUPS)
+    ubik_SyncWriterCacheProc = pr_SyncWriterCache;
+#endif
     code =
 	ubik_ServerInitByInfo(myHost, htons(AFSCONF_PROTPORT), &info, clones,
 			      pr_dbaseName, &dbase);
@@ -56,6 +56,12 @@ extern struct prheader cheader;
 	    ((cheader.field = (value)), (char *)&(cheader.field)),    \
 	    sizeof(afs_int32))
 
+/* Reads a header word through the trans rather than from cheader, which a
+ * write trans updates in place; the value is left in network order. */
+#define get_header_word(tt,field,valuep) \
+  pr_Read ((tt), 0, ((char *)&(cheader.field) - (char *)&cheader),    \
+	   (char *)(valuep), sizeof(afs_int32))
+
 #define inc_header_word(tt,field,inc) \
   pr_Write ((tt), 0, ((char *)&(cheader.field) - (char *)&cheader), \
 	    ((cheader.field = (htonl(ntohl(cheader.field)+(inc)))),	    \
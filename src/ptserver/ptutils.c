@@ -1660,8 +1660,13 @@ GetOwnedChain(struct ubik_trans *ut, afs_int32 *next, prlist *alist)
 afs_int32
 GetMax(struct ubik_trans *at, afs_int32 *uid, afs_int32 *gid)
 {
-    *uid = ntohl(cheader.maxID);
-    *gid = ntohl(cheader.maxGroup);
+    afs_int32 maxID, maxGroup;
+
+    if (get_header_word(at, maxID, &maxID) != 0
+	|| get_header_word(at, maxGroup, &maxGroup) != 0)
+	return PRDBFAIL;
+    *uid = ntohl(maxID);
+    *gid = ntohl(maxGroup);
     return PRSUCCESS;
 }
 
@@ -1744,6 +1749,36 @@ Initdb_check(struct ubik_trans *tt, void *rock)
     return 0;
 }
 
+/**
+ * checks that the dbase seen by a read trans has been built.
+ *
+ * Unlike Initdb(), this takes no locks and leaves cheader alone, so it can be
+ * used by a trans reading from a snapshot.
+ *
+ * @param[in] tt  ubik transaction
+ *
+ * @return operation status
+ *   @retval 0 success
+ *   @retval nonzero the dbase is not usable yet; use Initdb()
+ */
+afs_int32
+Checkdb(struct ubik_trans *tt)
+{
+    afs_int32 version, headerSize, eofPtr;
+
+    pr_noAuth = afsconf_GetNoAuthFlag(prdir);
+
+    if (get_header_word(tt, version, &version) != 0
+	|| get_header_word(tt, headerSize, &headerSize) != 0
+	|| get_header_word(tt, eofPtr, &eofPtr) != 0)
+	return PRDBFAIL;
+    if ((ntohl(version) == PRDBVERSION)
+	&& ntohl(headerSize) == sizeof(cheader)
+	&& ntohl(eofPtr) != 0)
+	return 0;
+    return PRDBBAD;
+}
+
 afs_int32
 Initdb(void)
 {
@@ -273,7 +273,9 @@ FindByID(struct ubik_trans *at, afs_int32 aid)
     if ((aid == PRBADID) || (aid == 0))
 	return 0;
     i = IDHash(aid);
-    entry = ntohl(cheader.idHash[i]);
+    if (get_header_word(at, idHash[i], &entry) != 0)
+	return 0;
+    entry = ntohl(entry);
     if (entry == 0)
 	return entry;
     memset(&tentry, 0, sizeof(tentry));
@@ -306,7 +308,9 @@ FindByName(struct ubik_trans *at, char aname[PR_MAXNAMELEN], struct prentry *ten
     afs_int32 entry;
 
     i = NameHash(aname);
-    entry = ntohl(cheader.nameHash[i]);
+    if (get_header_word(at, nameHash[i], &entry) != 0)
+	return 0;
+    entry = ntohl(entry);
     if (entry == 0)
 	return entry;
     memset(tentryp, 0, sizeof(struct prentry));
@@ -73,6 +73,7 @@ extern afs_int32 afs_termState;
 #endif /* KERNEL */
 
 #include <opr/queue.h>
+#include <opr/jhash.h>
 #include <hcrypto/rand.h>
 
 #include "rx.h"
@@ -159,6 +160,12 @@ static void rxi_CancelKeepAliveEvent(struct rx_call *call);
 static void rxi_CancelDelayedAbortEvent(struct rx_call *call);
 static void rxi_CancelGrowMTUEvent(struct rx_call *call);
 static void update_nextCid(void);
+static void rxi_InitHashTables(void);
+static void rxi_FreeHashTables(void);
+static void rxi_GrowConnHashShard(struct rx_connHashShard *shard);
+static void rxi_GrowPeerHashShard(struct rx_peerHashShard *shard);
+static struct rx_peer *rxi_LookupPeer(afs_uint32 host, u_short port);
+static void rxi_PutPeer(struct rx_peer *peer);
 
 #ifdef RX_ENABLE_LOCKS
 struct rx_tq_debug {
@@ -386,18 +393,15 @@ pthread_once_t rx_once_init = PTHREAD_ONCE_INIT;
 static afs_kmutex_t rx_rpc_stats;
 #endif
 
-/* We keep a "last conn pointer" in rxi_FindConnection. The odds are
-** pretty good that the next packet coming in is from the same connection
-** as the last packet, since we're send multiple packets in a transmit window.
-*/
-struct rx_connection *rxLastConn = 0;
-
 #ifdef RX_ENABLE_LOCKS
 /* The locking hierarchy for rx fine grain locking is composed of these
  * tiers:
  *
- * rx_connHashTable_lock - synchronizes conn creation, rx_connHashTable access
+ * rx_connHashTable_lock - synchronizes conn creation and removal, and walks
+ *                         and resizes of the conn hash table
  *                         also protects updates to rx_nextCid
+ * rx_connHashShards[].lock - protects the chains, counts and lastConn of
+ *                         one shard of the conn hash table
  * conn_call_lock - used to synchonize rx_EndCall and rx_NewCall
  * call->lock - locks call data fields.
  * These are independent of each other:
@@ -408,6 +412,8 @@ struct rx_connection *rxLastConn = 0;
  *
  * serverQueueEntry->lock
  * rx_peerHashTable_lock - locked under rx_connHashTable_lock
+ * rx_peerHashShards[].lock - protects the chains of one shard of the peer
+ *                         hash table, and the refCount of the peers in it
  * rx_rpc_stats
  * peer->lock - locks peer data fields.
  * conn_data_lock - that more than one thread is not updating a conn data
@@ -463,8 +469,6 @@ rx_InitHost(u_int host, u_int port)
 #else /* KERNEL */
     struct timeval tv;
 #endif /* KERNEL */
-    char *htable, *ptable;
-
     SPLVAR;
 
     INIT_PTHREAD_LOCKS;
@@ -529,12 +533,7 @@ rx_InitHost(u_int host, u_int port)
     rx_connDeadTime = 12;
     rx_tranquil = 0;		/* reset flag */
     rxi_ResetStatistics();
-    htable = osi_Alloc(rx_hashTableSize * sizeof(struct rx_connection *));
-    PIN(htable, rx_hashTableSize * sizeof(struct rx_connection *));	/* XXXXX */
-    memset(htable, 0, rx_hashTableSize * sizeof(struct rx_connection *));
-    ptable = osi_Alloc(rx_hashTableSize * sizeof(struct rx_peer *));
-    PIN(ptable, rx_hashTableSize * sizeof(struct rx_peer *));	/* XXXXX */
-    memset(ptable, 0, rx_hashTableSize * sizeof(struct rx_peer *));
+    rxi_InitHashTables();
 
     /* Malloc up a bunch of packets & buffers */
     rx_nFreePackets = 0;
@@ -581,7 +580,7 @@ rx_InitHost(u_int host, u_int port)
 #endif
 	if (getsockname((intptr_t)rx_socket, (struct sockaddr *)&addr, &addrlen)) {
 	    rx_Finalize();
-	    osi_Free(htable, rx_hashTableSize * sizeof(struct rx_connection *));
+	    rxi_FreeHashTables();
 	    return -1;
 	}
 	rx_port = addr.sin_port;
@@ -600,8 +599,6 @@ rx_InitHost(u_int host, u_int port)
     /* *Slightly* random start time for the cid.  This is just to help
      * out with the hashing function at the peer */
     rx_nextCid = ((tv.tv_sec ^ tv.tv_usec) << RX_CIDSHIFT);
-    rx_connHashTable = (struct rx_connection **)htable;
-    rx_peerHashTable = (struct rx_peer **)ptable;
 
     rx_hardAckDelay.sec = 0;
     rx_hardAckDelay.usec = 100000;	/* 100 milliseconds */
@@ -1008,8 +1005,10 @@ rx_NewConnection(afs_uint32 shost, u_short sport, u_short sservice,
 		 struct rx_securityClass *securityObject,
 		 int serviceSecurityIndex)
 {
-    int hashindex, i;
+    afs_uint32 hash;
+    int i, grow;
     struct rx_connection *conn;
+    struct rx_connHashShard *shard;
 
     SPLVAR;
 
@@ -1054,16 +1053,23 @@ rx_NewConnection(afs_uint32 shost, u_short sport, u_short sservice,
     }
 
     RXS_NewConnection(securityObject, conn);
-    hashindex =
+    hash =
 	CONN_HASH(shost, sport, conn->cid, conn->epoch, RX_CLIENT_CONNECTION);
+    shard = RX_CONN_SHARD(hash);
 
     conn->refCount++;		/* no lock required since only this thread knows... */
-    conn->next = rx_connHashTable[hashindex];
-    rx_connHashTable[hashindex] = conn;
+    MUTEX_ENTER(&shard->lock);
+    conn->next = shard->buckets[RX_HASH_BUCKET(shard, hash)];
+    shard->buckets[RX_HASH_BUCKET(shard, hash)] = conn;
+    shard->nEntries++;
+    grow = (shard->nEntries > shard->nBuckets * RX_HASH_LOAD);
+    MUTEX_EXIT(&shard->lock);
     if (rx_stats_active)
 	rx_atomic_inc(&rx_stats.nClientConns);
     MUTEX_EXIT(&rx_connHashTable_lock);
     USERPRI;
+    if (grow)
+	rxi_GrowConnHashShard(shard);
     return conn;
 }
 
@@ -1134,6 +1140,8 @@ int rxi_lowConnRefCount = 0;
 static void
 rxi_CleanupConnection(struct rx_connection *conn)
 {
+    struct rx_peerHashShard *shard;
+
     /* Notify the service exporter, if requested, that this connection
      * is being destroyed */
     if (conn->type == RX_SERVER_CONNECTION && conn->service->destroyConnProc)
@@ -1146,7 +1154,8 @@ rxi_CleanupConnection(struct rx_connection *conn)
      * idle time to now. rxi_ReapConnections will reap it if it's still
      * idle (refCount == 0) after rx_idlePeerTime (60 seconds) have passed.
      */
-    MUTEX_ENTER(&rx_peerHashTable_lock);
+    shard = RX_PEER_SHARD(PEER_HASH(conn->peer->host, conn->peer->port));
+    MUTEX_ENTER(&shard->lock);
     if (conn->peer->refCount < 2) {
 	conn->peer->idleWhen = clock_Sec();
 	if (conn->peer->refCount < 1) {
@@ -1159,7 +1168,7 @@ rxi_CleanupConnection(struct rx_connection *conn)
 	}
     }
     conn->peer->refCount--;
-    MUTEX_EXIT(&rx_peerHashTable_lock);
+    MUTEX_EXIT(&shard->lock);
 
     if (rx_stats_active)
     {
@@ -1212,13 +1221,21 @@ static void
 rxi_DestroyConnectionNoLock(struct rx_connection *conn)
 {
     struct rx_connection **conn_ptr;
+    struct rx_connHashShard *shard;
+    afs_uint32 hash;
     int havecalls = 0;
     int i;
     SPLVAR;
 
     clock_NewTime();
 
+    /* Hold the shard lock throughout, so that rxi_FindConnection can't
+     * pick up a new reference to conn once we've decided to destroy it. */
+    hash = CONN_HASH(0, 0, conn->cid, conn->epoch, conn->type);
+    shard = RX_CONN_SHARD(hash);
+
     NETPRI;
+    MUTEX_ENTER(&shard->lock);
     MUTEX_ENTER(&conn->conn_data_lock);
     MUTEX_ENTER(&rx_refcnt_mutex);
     if (conn->refCount > 0)
@@ -1238,6 +1255,7 @@ rxi_DestroyConnectionNoLock(struct rx_connection *conn)
 	/* Busy; wait till the last guy before proceeding */
         MUTEX_EXIT(&rx_refcnt_mutex);
 	MUTEX_EXIT(&conn->conn_data_lock);
+	MUTEX_EXIT(&shard->lock);
 	USERPRI;
 	return;
     }
@@ -1250,6 +1268,7 @@ rxi_DestroyConnectionNoLock(struct rx_connection *conn)
 	conn->flags |= RX_CONN_DESTROY_ME;
 	MUTEX_EXIT(&rx_refcnt_mutex);
 	MUTEX_EXIT(&conn->conn_data_lock);
+	MUTEX_EXIT(&shard->lock);
 	USERPRI;
 	return;
     }
@@ -1299,25 +1318,25 @@ rxi_DestroyConnectionNoLock(struct rx_connection *conn)
 	MUTEX_ENTER(&conn->conn_data_lock);
 	conn->flags |= RX_CONN_DESTROY_ME;
 	MUTEX_EXIT(&conn->conn_data_lock);
+	MUTEX_EXIT(&shard->lock);
 	USERPRI;
 	return;
     }
 
     /* Remove from connection hash table before proceeding */
-    conn_ptr =
-	&rx_connHashTable[CONN_HASH
-			  (peer->host, peer->port, conn->cid, conn->epoch,
-			   conn->type)];
+    conn_ptr = &shard->buckets[RX_HASH_BUCKET(shard, hash)];
     for (; *conn_ptr; conn_ptr = &(*conn_ptr)->next) {
 	if (*conn_ptr == conn) {
 	    *conn_ptr = conn->next;
+	    shard->nEntries--;
 	    break;
 	}
     }
     /* if the conn that we are destroying was the last connection, then we
-     * clear rxLastConn as well */
-    if (rxLastConn == conn)
-	rxLastConn = 0;
+     * clear the shard's lastConn as well */
+    if (shard->lastConn == conn)
+	shard->lastConn = NULL;
+    MUTEX_EXIT(&shard->lock);
 
     /* Make sure the connection is completely reset before deleting it. */
     /*
@@ -2492,28 +2511,40 @@ rx_EndCall(struct rx_call *call, afs_int32 rc)
 void
 rx_Finalize(void)
 {
-    struct rx_connection **conn_ptr, **conn_end;
+    struct rx_connHashShard *shard;
+    afs_uint32 bucket;
 
     INIT_PTHREAD_LOCKS;
     if (rx_atomic_test_and_set_bit(&rxinit_status, 0))
 	return;			/* Already shutdown. */
 
     rxi_DeleteCachedConnections();
-    if (rx_connHashTable) {
+    if (rx_connHashShards[0].buckets) {
 	MUTEX_ENTER(&rx_connHashTable_lock);
-	for (conn_ptr = &rx_connHashTable[0], conn_end =
-	     &rx_connHashTable[rx_hashTableSize]; conn_ptr < conn_end;
-	     conn_ptr++) {
-	    struct rx_connection *conn, *next;
-	    for (conn = *conn_ptr; conn; conn = next) {
-		next = conn->next;
-		if (conn->type == RX_CLIENT_CONNECTION) {
-                    rx_GetConnection(conn);
+	for (shard = &rx_connHashShards[0];
+	     shard < &rx_connHashShards[RX_HASH_SHARDS]; shard++) {
+	    for (bucket = 0; bucket < shard->nBuckets; bucket++) {
+		struct rx_connection *conn, *next;
+
+		/* Holding rx_connHashTable_lock keeps the shard from being
+		 * resized and its connections from being unlinked by anyone
+		 * else, but inserts only take the shard lock, so the chain
+		 * links are read under it. */
+		MUTEX_ENTER(&shard->lock);
+		conn = shard->buckets[bucket];
+		MUTEX_EXIT(&shard->lock);
+		for (; conn; conn = next) {
+		    MUTEX_ENTER(&shard->lock);
+		    next = conn->next;
+		    MUTEX_EXIT(&shard->lock);
+		    if (conn->type == RX_CLIENT_CONNECTION) {
+			rx_GetConnection(conn);
 #ifdef RX_ENABLE_LOCKS
-		    rxi_DestroyConnectionNoLock(conn);
+			rxi_DestroyConnectionNoLock(conn);
 #else /* RX_ENABLE_LOCKS */
-		    rxi_DestroyConnection(conn);
+			rxi_DestroyConnection(conn);
 #endif /* RX_ENABLE_LOCKS */
+		    }
 		}
 	    }
 	}
@@ -2569,6 +2600,9 @@ static struct rx_service *
 rxi_FindService(osi_socket socket, u_short serviceId)
 {
     struct rx_service **sp;
+
+    /* Services are registered with the first socket bound to a port */
+    socket = rxi_PrimarySocket(socket);
     for (sp = &rx_services[0]; *sp; sp++) {
 	if ((*sp)->serviceId == serviceId && (*sp)->socket == socket)
 	    return *sp;
@@ -2815,66 +2849,63 @@ rxi_Free(void *addr, size_t size)
     osi_Free(addr, size);
 }
 
+static void
+rxi_LowerPeerMtu(struct rx_peer *peer, int mtu)
+{
+    MUTEX_ENTER(&peer->peer_lock);
+    /* We don't handle dropping below min, so don't */
+    mtu = MAX(mtu, RX_MIN_PACKET_SIZE);
+    peer->ifMTU=MIN(mtu, peer->ifMTU);
+    peer->natMTU = rxi_AdjustIfMTU(peer->ifMTU);
+    /* if we tweaked this down, need to tune our peer MTU too */
+    peer->MTU = MIN(peer->MTU, peer->natMTU);
+    /* if we discovered a sub-1500 mtu, degrade */
+    if (peer->ifMTU < OLD_MAX_PACKET_SIZE)
+	peer->maxDgramPackets = 1;
+    /* We no longer have valid peer packet information */
+    if (peer->maxPacketSize + RX_HEADER_SIZE > peer->ifMTU)
+	peer->maxPacketSize = 0;
+    MUTEX_EXIT(&peer->peer_lock);
+}
+
 void
 rxi_SetPeerMtu(struct rx_peer *peer, afs_uint32 host, afs_uint32 port, int mtu)
 {
-    struct rx_peer **peer_ptr = NULL, **peer_end = NULL;
-    struct rx_peer *next = NULL;
-    int hashIndex;
-
-    if (!peer) {
-	MUTEX_ENTER(&rx_peerHashTable_lock);
-	if (port == 0) {
-	    peer_ptr = &rx_peerHashTable[0];
-	    peer_end = &rx_peerHashTable[rx_hashTableSize];
-	    next = NULL;
-	resume:
-	    for ( ; peer_ptr < peer_end; peer_ptr++) {
-		if (!peer)
-		    peer = *peer_ptr;
-		for ( ; peer; peer = next) {
-		    next = peer->next;
-		    if (host == peer->host)
-			break;
-		}
-	    }
-	} else {
-	    hashIndex = PEER_HASH(host, port);
-	    for (peer = rx_peerHashTable[hashIndex]; peer; peer = peer->next) {
-		if ((peer->host == host) && (peer->port == port))
-		    break;
-	    }
-	}
-    } else {
-	MUTEX_ENTER(&rx_peerHashTable_lock);
-    }
+    struct rx_peerHashShard *shard;
+    afs_uint32 bucket;
 
     if (peer) {
-        peer->refCount++;
-        MUTEX_EXIT(&rx_peerHashTable_lock);
+	rxi_LowerPeerMtu(peer, mtu);
+	return;
+    }
 
-        MUTEX_ENTER(&peer->peer_lock);
-	/* We don't handle dropping below min, so don't */
-	mtu = MAX(mtu, RX_MIN_PACKET_SIZE);
-        peer->ifMTU=MIN(mtu, peer->ifMTU);
-        peer->natMTU = rxi_AdjustIfMTU(peer->ifMTU);
-	/* if we tweaked this down, need to tune our peer MTU too */
-	peer->MTU = MIN(peer->MTU, peer->natMTU);
-	/* if we discovered a sub-1500 mtu, degrade */
-	if (peer->ifMTU < OLD_MAX_PACKET_SIZE)
-	    peer->maxDgramPackets = 1;
-	/* We no longer have valid peer packet information */
-	if (peer->maxPacketSize + RX_HEADER_SIZE > peer->ifMTU)
-	    peer->maxPacketSize = 0;
-        MUTEX_EXIT(&peer->peer_lock);
+    if (port) {
+	peer = rxi_LookupPeer(host, port);
+	if (peer) {
+	    rxi_LowerPeerMtu(peer, mtu);
+	    rxi_PutPeer(peer);
+	}
+	return;
+    }
 
-        MUTEX_ENTER(&rx_peerHashTable_lock);
-        peer->refCount--;
-        if (host && !port) {
-            peer = next;
-	    /* pick up where we left off */
-            goto resume;
-        }
+    /* Every peer on this host.  Holding the table lock keeps each peer in
+     * its chain while we drop the shard lock to adjust it. */
+    MUTEX_ENTER(&rx_peerHashTable_lock);
+    for (shard = &rx_peerHashShards[0];
+	 shard < &rx_peerHashShards[RX_HASH_SHARDS]; shard++) {
+	MUTEX_ENTER(&shard->lock);
+	for (bucket = 0; bucket < shard->nBuckets; bucket++) {
+	    for (peer = shard->buckets[bucket]; peer; peer = peer->next) {
+		if (peer->host != host)
+		    continue;
+		peer->refCount++;
+		MUTEX_EXIT(&shard->lock);
+		rxi_LowerPeerMtu(peer, mtu);
+		MUTEX_ENTER(&shard->lock);
+		peer->refCount--;
+	    }
+	}
+	MUTEX_EXIT(&shard->lock);
     }
     MUTEX_EXIT(&rx_peerHashTable_lock);
 }
@@ -2883,20 +2914,9 @@ rxi_SetPeerMtu(struct rx_peer *peer, afs_uint32 host, afs_uint32 port, int mtu)
 static void
 rxi_SetPeerDead(struct sock_extended_err *err, afs_uint32 host, afs_uint16 port)
 {
-    int hashIndex = PEER_HASH(host, port);
     struct rx_peer *peer;
 
-    MUTEX_ENTER(&rx_peerHashTable_lock);
-
-    for (peer = rx_peerHashTable[hashIndex]; peer; peer = peer->next) {
-	if (peer->host == host && peer->port == port) {
-	    peer->refCount++;
-	    break;
-	}
-    }
-
-    MUTEX_EXIT(&rx_peerHashTable_lock);
-
+    peer = rxi_LookupPeer(host, port);
     if (peer) {
 	rx_atomic_inc(&peer->neterrs);
 	MUTEX_ENTER(&peer->peer_lock);
@@ -2905,9 +2925,7 @@ rxi_SetPeerDead(struct sock_extended_err *err, afs_uint32 host, afs_uint16 port)
 	peer->last_err_code = err->ee_code;
 	MUTEX_EXIT(&peer->peer_lock);
 
-	MUTEX_ENTER(&rx_peerHashTable_lock);
-	peer->refCount--;
-	MUTEX_EXIT(&rx_peerHashTable_lock);
+	rxi_PutPeer(peer);
     }
 }
 
@@ -3016,10 +3034,15 @@ struct rx_peer *
 rxi_FindPeer(afs_uint32 host, u_short port, int create)
 {
     struct rx_peer *pp;
-    int hashIndex;
-    hashIndex = PEER_HASH(host, port);
-    MUTEX_ENTER(&rx_peerHashTable_lock);
-    for (pp = rx_peerHashTable[hashIndex]; pp; pp = pp->next) {
+    struct rx_peerHashShard *shard;
+    afs_uint32 hash, bucket;
+    int grow = 0;
+
+    hash = PEER_HASH(host, port);
+    shard = RX_PEER_SHARD(hash);
+    MUTEX_ENTER(&shard->lock);
+    bucket = RX_HASH_BUCKET(shard, hash);
+    for (pp = shard->buckets[bucket]; pp; pp = pp->next) {
 	if ((pp->host == host) && (pp->port == port))
 	    break;
     }
@@ -3033,8 +3056,10 @@ rxi_FindPeer(afs_uint32 host, u_short port, int create)
 #endif
 	    MUTEX_INIT(&pp->peer_lock, "peer_lock", MUTEX_DEFAULT, 0);
 	    opr_queue_Init(&pp->rpcStats);
-	    pp->next = rx_peerHashTable[hashIndex];
-	    rx_peerHashTable[hashIndex] = pp;
+	    pp->next = shard->buckets[bucket];
+	    shard->buckets[bucket] = pp;
+	    shard->nEntries++;
+	    grow = (shard->nEntries > shard->nBuckets * RX_HASH_LOAD);
 	    rxi_InitPeerParams(pp);
             if (rx_stats_active)
 		rx_atomic_inc(&rx_stats.nPeerStructs);
@@ -3043,10 +3068,263 @@ rxi_FindPeer(afs_uint32 host, u_short port, int create)
     if (pp && create) {
 	pp->refCount++;
     }
-    MUTEX_EXIT(&rx_peerHashTable_lock);
+    MUTEX_EXIT(&shard->lock);
+    if (grow)
+	rxi_GrowPeerHashShard(shard);
+    return pp;
+}
+
+/* Find an existing peer, and take a reference on it which must be dropped
+ * with rxi_PutPeer */
+static struct rx_peer *
+rxi_LookupPeer(afs_uint32 host, u_short port)
+{
+    struct rx_peer *pp;
+    struct rx_peerHashShard *shard;
+    afs_uint32 hash;
+
+    hash = PEER_HASH(host, port);
+    shard = RX_PEER_SHARD(hash);
+    MUTEX_ENTER(&shard->lock);
+    for (pp = shard->buckets[RX_HASH_BUCKET(shard, hash)]; pp; pp = pp->next) {
+	if ((pp->host == host) && (pp->port == port)) {
+	    pp->refCount++;
+	    break;
+	}
+    }
+    MUTEX_EXIT(&shard->lock);
     return pp;
 }
 
+static void
+rxi_PutPeer(struct rx_peer *peer)
+{
+    struct rx_peerHashShard *shard;
+
+    shard = RX_PEER_SHARD(PEER_HASH(peer->host, peer->port));
+    MUTEX_ENTER(&shard->lock);
+    peer->refCount--;
+    MUTEX_EXIT(&shard->lock);
+}
+
+/*
+ * Set up an empty bucket array for each shard of the connection and peer
+ * hash tables.
+ */
+static void
+rxi_InitHashTables(void)
+{
+    size_t csize = RX_HASH_INIT_BUCKETS * sizeof(struct rx_connection *);
+    size_t psize = RX_HASH_INIT_BUCKETS * sizeof(struct rx_peer *);
+    int i;
+
+    for (i = 0; i < RX_HASH_SHARDS; i++) {
+	struct rx_connHashShard *cshard = &rx_connHashShards[i];
+	struct rx_peerHashShard *pshard = &rx_peerHashShards[i];
+
+	MUTEX_INIT(&cshard->lock, "rx_connHashShard lock", MUTEX_DEFAULT, 0);
+	cshard->buckets = osi_Alloc(csize);
+	PIN(cshard->buckets, csize);	/* XXXXX */
+	memset(cshard->buckets, 0, csize);
+	cshard->nBuckets = RX_HASH_INIT_BUCKETS;
+	cshard->nEntries = 0;
+	cshard->grows = 0;
+	cshard->lastConn = NULL;
+
+	MUTEX_INIT(&pshard->lock, "rx_peerHashShard lock", MUTEX_DEFAULT, 0);
+	pshard->buckets = osi_Alloc(psize);
+	PIN(pshard->buckets, psize);	/* XXXXX */
+	memset(pshard->buckets, 0, psize);
+	pshard->nBuckets = RX_HASH_INIT_BUCKETS;
+	pshard->nEntries = 0;
+	pshard->grows = 0;
+    }
+}
+
+/*
+ * Release the bucket arrays and locks of the connection and peer hash
+ * tables.  Any connections and peers still in them are not freed.
+ */
+static void
+rxi_FreeHashTables(void)
+{
+    int i;
+
+    for (i = 0; i < RX_HASH_SHARDS; i++) {
+	struct rx_connHashShard *cshard = &rx_connHashShards[i];
+	struct rx_peerHashShard *pshard = &rx_peerHashShards[i];
+
+	if (cshard->buckets) {
+	    UNPIN(cshard->buckets,
+		  cshard->nBuckets * sizeof(struct rx_connection *));
+	    osi_Free(cshard->buckets,
+		     cshard->nBuckets * sizeof(struct rx_connection *));
+	    cshard->buckets = NULL;
+	    MUTEX_DESTROY(&cshard->lock);
+	}
+	cshard->nBuckets = cshard->nEntries = 0;
+	cshard->lastConn = NULL;
+
+	if (pshard->buckets) {
+	    UNPIN(pshard->buckets, pshard->nBuckets * sizeof(struct rx_peer *));
+	    osi_Free(pshard->buckets,
+		     pshard->nBuckets * sizeof(struct rx_peer *));
+	    pshard->buckets = NULL;
+	    MUTEX_DESTROY(&pshard->lock);
+	}
+	pshard->nBuckets = pshard->nEntries = 0;
+    }
+}
+
+/*
+ * Double the number of buckets in a connection hash shard which has
+ * become overloaded.  Called with no hash table locks held.  Resizing
+ * needs the table lock as well as the shard lock, so if some other thread
+ * is busy with the table we just skip it; the next insert into this shard
+ * will try again.
+ */
+static void
+rxi_GrowConnHashShard(struct rx_connHashShard *shard)
+{
+    struct rx_connection **buckets, **obuckets, *conn;
+    afs_uint32 nBuckets, onBuckets, hash, i;
+
+    onBuckets = shard->nBuckets;
+    if (onBuckets >= RX_HASH_MAX_BUCKETS)
+	return;
+    nBuckets = onBuckets * 2;
+    buckets = osi_Alloc(nBuckets * sizeof(struct rx_connection *));
+    if (buckets == NULL)
+	return;
+    PIN(buckets, nBuckets * sizeof(struct rx_connection *));	/* XXXXX */
+    memset(buckets, 0, nBuckets * sizeof(struct rx_connection *));
+
+    if (MUTEX_TRYENTER(&rx_connHashTable_lock)) {
+	MUTEX_ENTER(&shard->lock);
+	if (shard->nBuckets == onBuckets) {
+	    obuckets = shard->buckets;
+	    for (i = 0; i < onBuckets; i++) {
+		while ((conn = obuckets[i]) != NULL) {
+		    obuckets[i] = conn->next;
+		    hash = CONN_HASH(0, 0, conn->cid, conn->epoch, conn->type);
+		    hash = (hash >> RX_HASH_SHARD_BITS) & (nBuckets - 1);
+		    conn->next = buckets[hash];
+		    buckets[hash] = conn;
+		}
+	    }
+	    shard->buckets = buckets;
+	    shard->nBuckets = nBuckets;
+	    shard->grows++;
+	    /* free the old array instead */
+	    buckets = obuckets;
+	    nBuckets = onBuckets;
+	}
+	MUTEX_EXIT(&shard->lock);
+	MUTEX_EXIT(&rx_connHashTable_lock);
+    }
+    UNPIN(buckets, nBuckets * sizeof(struct rx_connection *));
+    osi_Free(buckets, nBuckets * sizeof(struct rx_connection *));
+}
+
+/* As rxi_GrowConnHashShard, for the peer hash table */
+static void
+rxi_GrowPeerHashShard(struct rx_peerHashShard *shard)
+{
+    struct rx_peer **buckets, **obuckets, *peer;
+    afs_uint32 nBuckets, onBuckets, hash, i;
+
+    onBuckets = shard->nBuckets;
+    if (onBuckets >= RX_HASH_MAX_BUCKETS)
+	return;
+    nBuckets = onBuckets * 2;
+    buckets = osi_Alloc(nBuckets * sizeof(struct rx_peer *));
+    if (buckets == NULL)
+	return;
+    PIN(buckets, nBuckets * sizeof(struct rx_peer *));	/* XXXXX */
+    memset(buckets, 0, nBuckets * sizeof(struct rx_peer *));
+
+    if (MUTEX_TRYENTER(&rx_peerHashTable_lock)) {
+	MUTEX_ENTER(&shard->lock);
+	if (shard->nBuckets == onBuckets) {
+	    obuckets = shard->buckets;
+	    for (i = 0; i < onBuckets; i++) {
+		while ((peer = obuckets[i]) != NULL) {
+		    obuckets[i] = peer->next;
+		    hash = PEER_HASH(peer->host, peer->port);
+		    hash = (hash >> RX_HASH_SHARD_BITS) & (nBuckets - 1);
+		    peer->next = buckets[hash];
+		    buckets[hash] = peer;
+		}
+	    }
+	    shard->buckets = buckets;
+	    shard->nBuckets = nBuckets;
+	    shard->grows++;
+	    buckets = obuckets;
+	    nBuckets = onBuckets;
+	}
+	MUTEX_EXIT(&shard->lock);
+	MUTEX_EXIT(&rx_peerHashTable_lock);
+    }
+    UNPIN(buckets, nBuckets * sizeof(struct rx_peer *));
+    osi_Free(buckets, nBuckets * sizeof(struct rx_peer *));
+}
+
+/*
+ * Fill in a summary of the conn and peer hash tables, for rxdebug.  Chain
+ * lengths are counted into the bins 0, 1, 2, 3-4, 5-8, 9-16, 17-32 and
+ * 33 or more.
+ */
+static void
+rxi_CountHashChain(struct rx_debugHashTable *table, afs_uint32 length)
+{
+    int bin = 0;
+
+    while (bin < RX_DEBUG_HASH_CHAINS - 1 && length > (1 << bin) >> 1)
+	bin++;
+    table->chains[bin]++;
+    if (length > table->maxChain)
+	table->maxChain = length;
+}
+
+void
+rxi_GetHashStats(struct rx_debugHashStats *stats)
+{
+    struct rx_connHashShard *cshard;
+    struct rx_peerHashShard *pshard;
+    struct rx_connection *conn;
+    struct rx_peer *peer;
+    afs_uint32 bucket, length;
+
+    memset(stats, 0, sizeof(*stats));
+    for (cshard = &rx_connHashShards[0];
+	 cshard < &rx_connHashShards[RX_HASH_SHARDS]; cshard++) {
+	MUTEX_ENTER(&cshard->lock);
+	stats->conns.nBuckets += cshard->nBuckets;
+	stats->conns.nEntries += cshard->nEntries;
+	stats->conns.grows += cshard->grows;
+	for (bucket = 0; bucket < cshard->nBuckets; bucket++) {
+	    length = 0;
+	    for (conn = cshard->buckets[bucket]; conn; conn = conn->next)
+		length++;
+	    rxi_CountHashChain(&stats->conns, length);
+	}
+	MUTEX_EXIT(&cshard->lock);
+    }
+    for (pshard = &rx_peerHashShards[0];
+	 pshard < &rx_peerHashShards[RX_HASH_SHARDS]; pshard++) {
+	MUTEX_ENTER(&pshard->lock);
+	stats->peers.nBuckets += pshard->nBuckets;
+	stats->peers.nEntries += pshard->nEntries;
+	stats->peers.grows += pshard->grows;
+	for (bucket = 0; bucket < pshard->nBuckets; bucket++) {
+	    length = 0;
+	    for (peer = pshard->buckets[bucket]; peer; peer = peer->next)
+		length++;
+	    rxi_CountHashChain(&stats->peers, length);
+	}
+	MUTEX_EXIT(&pshard->lock);
+    }
+}
 
 /* Find the connection at (host, port) started at epoch, and with the
  * given connection id.  Creates the server connection if necessary.
@@ -3066,14 +3344,21 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 		   afs_uint32 epoch, int type, u_int securityIndex,
                    int *unknownService)
 {
-    int hashindex, flag, i;
+    int flag, i, grow = 0;
+    afs_uint32 hash, bucket;
     struct rx_connection *conn;
+    struct rx_connHashShard *shard;
     *unknownService = 0;
-    hashindex = CONN_HASH(host, port, cid, epoch, type);
-    MUTEX_ENTER(&rx_connHashTable_lock);
-    rxLastConn ? (conn = rxLastConn, flag = 0) : (conn =
-						  rx_connHashTable[hashindex],
-						  flag = 1);
+    hash = CONN_HASH(host, port, cid, epoch, type);
+    shard = RX_CONN_SHARD(hash);
+    MUTEX_ENTER(&shard->lock);
+    bucket = RX_HASH_BUCKET(shard, hash);
+    /* We keep a "last conn pointer" for each shard. The odds are pretty
+     * good that the next packet coming in is from the same connection as
+     * the last packet, since we're send multiple packets in a transmit
+     * window. */
+    shard->lastConn ? (conn = shard->lastConn, flag = 0) :
+	(conn = shard->buckets[bucket], flag = 1);
     for (; conn;) {
 	if ((conn->type == type) && ((cid & RX_CIDMASK) == conn->cid)
 	    && (epoch == conn->epoch)) {
@@ -3083,7 +3368,7 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 		 * like this, and there seems to be some CM bug that makes this
 		 * happen from time to time -- in which case, the fileserver
 		 * asserts. */
-		MUTEX_EXIT(&rx_connHashTable_lock);
+		MUTEX_EXIT(&shard->lock);
 		return (struct rx_connection *)0;
 	    }
 	    if (pp->host == host && pp->port == port)
@@ -3096,23 +3381,23 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 		break;
 	}
 	if (!flag) {
-	    /* the connection rxLastConn that was used the last time is not the
+	    /* the connection lastConn that was used the last time is not the
 	     ** one we are looking for now. Hence, start searching in the hash */
 	    flag = 1;
-	    conn = rx_connHashTable[hashindex];
+	    conn = shard->buckets[bucket];
 	} else
 	    conn = conn->next;
     }
     if (!conn) {
 	struct rx_service *service;
 	if (type == RX_CLIENT_CONNECTION) {
-	    MUTEX_EXIT(&rx_connHashTable_lock);
+	    MUTEX_EXIT(&shard->lock);
 	    return (struct rx_connection *)0;
 	}
 	service = rxi_FindService(socket, serviceId);
 	if (!service || (securityIndex >= service->nSecurityObjects)
 	    || (service->securityObjects[securityIndex] == 0)) {
-	    MUTEX_EXIT(&rx_connHashTable_lock);
+	    MUTEX_EXIT(&shard->lock);
             *unknownService = 1;
 	    return (struct rx_connection *)0;
 	}
@@ -3120,8 +3405,10 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 	MUTEX_INIT(&conn->conn_call_lock, "conn call lock", MUTEX_DEFAULT, 0);
 	MUTEX_INIT(&conn->conn_data_lock, "conn data lock", MUTEX_DEFAULT, 0);
 	CV_INIT(&conn->conn_call_cv, "conn call cv", CV_DEFAULT, 0);
-	conn->next = rx_connHashTable[hashindex];
-	rx_connHashTable[hashindex] = conn;
+	conn->next = shard->buckets[bucket];
+	shard->buckets[bucket] = conn;
+	shard->nEntries++;
+	grow = (shard->nEntries > shard->nBuckets * RX_HASH_LOAD);
 	conn->peer = rxi_FindPeer(host, port, 1);
 	conn->type = RX_SERVER_CONNECTION;
 	conn->lastSendTime = clock_Sec();	/* don't GC immediately */
@@ -3151,8 +3438,10 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 
     rx_GetConnection(conn);
 
-    rxLastConn = conn;		/* store this connection as the last conn used */
-    MUTEX_EXIT(&rx_connHashTable_lock);
+    shard->lastConn = conn;	/* store this connection as the last conn used */
+    MUTEX_EXIT(&shard->lock);
+    if (grow)
+	rxi_GrowConnHashShard(shard);
     return conn;
 }
 
@@ -5800,8 +6089,8 @@ rxi_SendList(struct rx_call *call, struct xmitlist *xmit,
  */
 
 static void
-rxi_SendXmitList(struct rx_call *call, struct rx_packet **list, int len,
-		 int istack)
+rxi_SendXmitListInt(struct rx_call *call, struct rx_packet **list, int len,
+		    int istack)
 {
     int i;
     int recovery;
@@ -5908,6 +6197,24 @@ rxi_SendXmitList(struct rx_call *call, struct rx_packet **list, int len,
     }
 }
 
+static void
+rxi_SendXmitList(struct rx_call *call, struct rx_packet **list, int len,
+		 int istack)
+{
+#ifdef RX_ENABLE_MMSG
+    struct rx_sendbatch *batch;
+
+    /* Collect the datagrams for this flush, and hand them all to the
+     * kernel at once when we're done */
+    batch = rxi_BeginSendBatch(call);
+    rxi_SendXmitListInt(call, list, len, istack);
+    if (batch != NULL)
+	rxi_EndSendBatch(batch);
+#else
+    rxi_SendXmitListInt(call, list, len, istack);
+#endif
+}
+
 /**
  * Check if the peer for the given call is known to be dead
  *
@@ -6966,20 +7273,30 @@ rxi_ReapConnections(struct rxevent *unused, void *unused1, void *unused2,
     /* Find server connection structures that haven't been used for
      * greater than rx_idleConnectionTime */
     {
-	struct rx_connection **conn_ptr, **conn_end;
+	struct rx_connHashShard *shard;
+	afs_uint32 bucket;
 	int i, havecalls = 0;
 	MUTEX_ENTER(&rx_connHashTable_lock);
-	for (conn_ptr = &rx_connHashTable[0], conn_end =
-	     &rx_connHashTable[rx_hashTableSize]; conn_ptr < conn_end;
-	     conn_ptr++) {
+	for (shard = &rx_connHashShards[0];
+	     shard < &rx_connHashShards[RX_HASH_SHARDS]; shard++)
+	for (bucket = 0; bucket < shard->nBuckets; bucket++) {
 	    struct rx_connection *conn, *next;
 	    struct rx_call *call;
 	    int result;
 
 	  rereap:
-	    for (conn = *conn_ptr; conn; conn = next) {
+	    /* Holding rx_connHashTable_lock stops anyone else removing
+	     * connections or resizing the shard, so we only need the shard
+	     * lock to follow the chain; it can't be held across
+	     * rxi_CheckCall or the destroy, which take it themselves. */
+	    MUTEX_ENTER(&shard->lock);
+	    conn = shard->buckets[bucket];
+	    MUTEX_EXIT(&shard->lock);
+	    for (; conn; conn = next) {
 		/* XXX -- Shouldn't the connection be locked? */
+		MUTEX_ENTER(&shard->lock);
 		next = conn->next;
+		MUTEX_EXIT(&shard->lock);
 		havecalls = 0;
 		for (i = 0; i < RX_MAXCALLS; i++) {
 		    call = conn->call[i];
@@ -7042,29 +7359,24 @@ rxi_ReapConnections(struct rxevent *unused, void *unused1, void *unused2,
     /* Find any peer structures that haven't been used (haven't had an
      * associated connection) for greater than rx_idlePeerTime */
     {
-	struct rx_peer **peer_ptr, **peer_end;
+	struct rx_peerHashShard *shard;
+	struct rx_peer **peer_ptr, *peer;
+	afs_uint32 bucket;
 	int code;
 
-        /*
-         * Why do we need to hold the rx_peerHashTable_lock across
-         * the incrementing of peer_ptr since the rx_peerHashTable
-         * array is not changing?  We don't.
-         *
-         * By dropping the lock periodically we can permit other
-         * activities to be performed while a rxi_ReapConnections
-         * call is in progress.  The goal of reap connections
-         * is to clean up quickly without causing large amounts
-         * of contention.  Therefore, it is important that global
-         * mutexes not be held for extended periods of time.
-         */
-	for (peer_ptr = &rx_peerHashTable[0], peer_end =
-	     &rx_peerHashTable[rx_hashTableSize]; peer_ptr < peer_end;
-	     peer_ptr++) {
-	    struct rx_peer *peer, *next, *prev;
-
-            MUTEX_ENTER(&rx_peerHashTable_lock);
-            for (prev = peer = *peer_ptr; peer; peer = next) {
-		next = peer->next;
+	/*
+	 * Lookups and inserts only need the shard locks, so holding
+	 * rx_peerHashTable_lock for the whole walk doesn't get in their
+	 * way; it just stops the shards being resized while we drop a
+	 * shard lock to free a peer, so peer_ptr remains valid.
+	 */
+	MUTEX_ENTER(&rx_peerHashTable_lock);
+	for (shard = &rx_peerHashShards[0];
+	     shard < &rx_peerHashShards[RX_HASH_SHARDS]; shard++)
+	for (bucket = 0; bucket < shard->nBuckets; bucket++) {
+	    MUTEX_ENTER(&shard->lock);
+	    peer_ptr = &shard->buckets[bucket];
+	    while ((peer = *peer_ptr) != NULL) {
 		code = MUTEX_TRYENTER(&peer->peer_lock);
 		if ((code) && (peer->refCount == 0)
 		    && ((peer->idleWhen + rx_idlePeerTime) < now.sec)) {
@@ -7078,25 +7390,18 @@ rxi_ReapConnections(struct rxevent *unused, void *unused1, void *unused2,
                      * Lets remove it first and decrement the struct
                      * nPeerStructs count.
                      */
-		    if (peer == *peer_ptr) {
-			*peer_ptr = next;
-			prev = next;
-		    } else
-			prev->next = next;
+		    *peer_ptr = peer->next;
+		    shard->nEntries--;
 
                     if (rx_stats_active)
                         rx_atomic_dec(&rx_stats.nPeerStructs);
 
                     /*
-                     * Now if we hold references on 'prev' and 'next'
-                     * we can safely drop the rx_peerHashTable_lock
-                     * while we destroy this 'peer' object.
+                     * Nobody else can unlink the peer before peer_ptr,
+                     * so we can safely drop the shard lock while we
+                     * destroy this 'peer' object.
                      */
-                    if (next)
-                        next->refCount++;
-                    if (prev)
-                        prev->refCount++;
-                    MUTEX_EXIT(&rx_peerHashTable_lock);
+		    MUTEX_EXIT(&shard->lock);
 
 		    MUTEX_EXIT(&peer->peer_lock);
 		    MUTEX_DESTROY(&peer->peer_lock);
@@ -7126,25 +7431,17 @@ rxi_ReapConnections(struct rxevent *unused, void *unused1, void *unused2,
 		    }
 		    rxi_FreePeer(peer);
 
-                    /*
-                     * Regain the rx_peerHashTable_lock and
-                     * decrement the reference count on 'prev'
-                     * and 'next'.
-                     */
-                    MUTEX_ENTER(&rx_peerHashTable_lock);
-                    if (next)
-                        next->refCount--;
-                    if (prev)
-                        prev->refCount--;
+		    MUTEX_ENTER(&shard->lock);
 		} else {
 		    if (code) {
 			MUTEX_EXIT(&peer->peer_lock);
 		    }
-		    prev = peer;
+		    peer_ptr = &peer->next;
 		}
 	    }
-            MUTEX_EXIT(&rx_peerHashTable_lock);
+	    MUTEX_EXIT(&shard->lock);
 	}
+	MUTEX_EXIT(&rx_peerHashTable_lock);
     }
 
     /* THIS HACK IS A TEMPORARY HACK.  The idea is that the race condition in
@@ -7348,6 +7645,13 @@ rx_PrintTheseStats(FILE * file, struct rx_statistics *s, int size,
 	    s->nServerConns, s->nClientConns, s->nPeerStructs,
 	    s->nCallStructs, s->nFreeCallStructs);
 
+    if (s->batchReads || s->batchSends) {
+	fprintf(file,
+		"   batched udp: reads %u (%u packets), "
+		"sends %u (%u datagrams)\n", s->batchReads,
+		s->batchReadPackets, s->batchSends, s->batchSendPackets);
+    }
+
 #if	!defined(AFS_PTHREAD_ENV) && !defined(AFS_USE_GETTIMEOFDAY)
     fprintf(file, "   %d clock updates\n", clock_nUpdates);
 #endif
@@ -7553,6 +7857,9 @@ rx_GetServerDebug(osi_socket socket, afs_uint32 remoteAddr,
 	if (stat->version >= RX_DEBUGI_VERSION_W_PACKETS) {
 	    *supportedValues |= RX_SERVER_DEBUG_PACKETS_CNT;
 	}
+	if (stat->version >= RX_DEBUGI_VERSION_W_HASHSTATS) {
+	    *supportedValues |= RX_SERVER_DEBUG_HASH_STATS;
+	}
 	stat->nFreePackets = ntohl(stat->nFreePackets);
 	stat->packetReclaims = ntohl(stat->packetReclaims);
 	stat->callsExecuted = ntohl(stat->callsExecuted);
@@ -7769,6 +8076,46 @@ rx_GetServerPeers(osi_socket socket, afs_uint32 remoteAddr,
     return rc;
 }
 
+afs_int32
+rx_GetServerHashStats(osi_socket socket, afs_uint32 remoteAddr,
+		      afs_uint16 remotePort, struct rx_debugHashStats *stats,
+		      afs_uint32 * supportedValues)
+{
+#if defined(RXDEBUG) || defined(MAKEDEBUGCALL)
+    afs_int32 rc = 0;
+    struct rx_debugIn in;
+    afs_uint32 *lp = (afs_uint32 *) stats;
+    int i;
+
+    /*
+     * supportedValues is currently unused, but added to allow future
+     * versioning of this function.
+     */
+
+    *supportedValues = 0;
+    in.type = htonl(RX_DEBUGI_HASHSTATS);
+    in.index = 0;
+    memset(stats, 0, sizeof(*stats));
+
+    rc = MakeDebugCall(socket, remoteAddr, remotePort, RX_PACKET_TYPE_DEBUG,
+		       &in, sizeof(in), stats, sizeof(*stats));
+
+    if (rc >= 0) {
+
+	/*
+	 * Do net to host conversion here
+	 */
+
+	for (i = 0; i < sizeof(*stats) / sizeof(afs_int32); i++, lp++) {
+	    *lp = ntohl(*lp);
+	}
+    }
+#else
+    afs_int32 rc = -1;
+#endif
+    return rc;
+}
+
 afs_int32
 rx_GetLocalPeers(afs_uint32 peerHost, afs_uint16 peerPort,
 		struct rx_debugPeer * peerStats)
@@ -7776,9 +8123,10 @@ rx_GetLocalPeers(afs_uint32 peerHost, afs_uint16 peerPort,
 	struct rx_peer *tp;
 	afs_int32 error = 1; /* default to "did not succeed" */
 	afs_uint32 hashValue = PEER_HASH(peerHost, peerPort);
+	struct rx_peerHashShard *shard = RX_PEER_SHARD(hashValue);
 
-	MUTEX_ENTER(&rx_peerHashTable_lock);
-	for(tp = rx_peerHashTable[hashValue];
+	MUTEX_ENTER(&shard->lock);
+	for(tp = shard->buckets[RX_HASH_BUCKET(shard, hashValue)];
 	      tp != NULL; tp = tp->next) {
 		if (tp->host == peerHost)
 			break;
@@ -7786,7 +8134,7 @@ rx_GetLocalPeers(afs_uint32 peerHost, afs_uint16 peerPort,
 
 	if (tp) {
                 tp->refCount++;
-                MUTEX_EXIT(&rx_peerHashTable_lock);
+                MUTEX_EXIT(&shard->lock);
 
 		error = 0;
 
@@ -7821,10 +8169,10 @@ rx_GetLocalPeers(afs_uint32 peerHost, afs_uint16 peerPort,
 				= tp->bytesReceived & MAX_AFS_UINT32;
                 MUTEX_EXIT(&tp->peer_lock);
 
-                MUTEX_ENTER(&rx_peerHashTable_lock);
+                MUTEX_ENTER(&shard->lock);
                 tp->refCount--;
 	}
-	MUTEX_EXIT(&rx_peerHashTable_lock);
+	MUTEX_EXIT(&shard->lock);
 
 	return error;
 }
@@ -7873,14 +8221,15 @@ shutdown_rx(void)
 #endif /* KERNEL */
 
     {
-	struct rx_peer **peer_ptr, **peer_end;
-	for (peer_ptr = &rx_peerHashTable[0], peer_end =
-	     &rx_peerHashTable[rx_hashTableSize]; peer_ptr < peer_end;
-	     peer_ptr++) {
+	struct rx_peerHashShard *shard;
+	afs_uint32 bucket;
+	for (shard = &rx_peerHashShards[0];
+	     shard < &rx_peerHashShards[RX_HASH_SHARDS]; shard++) {
 	    struct rx_peer *peer, *next;
 
-            MUTEX_ENTER(&rx_peerHashTable_lock);
-            for (peer = *peer_ptr; peer; peer = next) {
+            MUTEX_ENTER(&shard->lock);
+	    for (bucket = 0; bucket < shard->nBuckets; bucket++)
+            for (peer = shard->buckets[bucket]; peer; peer = next) {
 		struct opr_queue *cursor, *store;
 		size_t space;
 
@@ -7914,17 +8263,20 @@ shutdown_rx(void)
                 if (rx_stats_active)
                     rx_atomic_dec(&rx_stats.nPeerStructs);
 	    }
-            MUTEX_EXIT(&rx_peerHashTable_lock);
+            MUTEX_EXIT(&shard->lock);
 	}
     }
     for (i = 0; i < RX_MAX_SERVICES; i++) {
 	if (rx_services[i])
 	    rxi_Free(rx_services[i], sizeof(*rx_services[i]));
     }
-    for (i = 0; i < rx_hashTableSize; i++) {
+    for (i = 0; i < RX_HASH_SHARDS; i++) {
+	struct rx_connHashShard *shard = &rx_connHashShards[i];
 	struct rx_connection *tc, *ntc;
-	MUTEX_ENTER(&rx_connHashTable_lock);
-	for (tc = rx_connHashTable[i]; tc; tc = ntc) {
+	afs_uint32 bucket;
+	MUTEX_ENTER(&shard->lock);
+	for (bucket = 0; bucket < shard->nBuckets; bucket++)
+	for (tc = shard->buckets[bucket]; tc; tc = ntc) {
 	    ntc = tc->next;
 	    for (j = 0; j < RX_MAXCALLS; j++) {
 		if (tc->call[j]) {
@@ -7933,7 +8285,7 @@ shutdown_rx(void)
 	    }
 	    rxi_Free(tc, sizeof(*tc));
 	}
-	MUTEX_EXIT(&rx_connHashTable_lock);
+	MUTEX_EXIT(&shard->lock);
     }
 
     MUTEX_ENTER(&freeSQEList_lock);
@@ -7951,13 +8303,7 @@ shutdown_rx(void)
     MUTEX_DESTROY(&rx_peerHashTable_lock);
     MUTEX_DESTROY(&rx_serverPool_lock);
 
-    osi_Free(rx_connHashTable,
-	     rx_hashTableSize * sizeof(struct rx_connection *));
-    osi_Free(rx_peerHashTable, rx_hashTableSize * sizeof(struct rx_peer *));
-
-    UNPIN(rx_connHashTable,
-	  rx_hashTableSize * sizeof(struct rx_connection *));
-    UNPIN(rx_peerHashTable, rx_hashTableSize * sizeof(struct rx_peer *));
+    rxi_FreeHashTables();
 
     MUTEX_ENTER(&rx_quota_mutex);
     rxi_dataQuota = RX_MAX_QUOTA;
@@ -8952,7 +9298,9 @@ rx_disableProcessRPCStats(void)
 void
 rx_disablePeerRPCStats(void)
 {
-    struct rx_peer **peer_ptr, **peer_end;
+    struct rx_peerHashShard *shard;
+    struct rx_peer *peer;
+    afs_uint32 bucket;
     int code;
 
     /*
@@ -8965,33 +9313,17 @@ rx_disablePeerRPCStats(void)
 	rx_enable_stats = 0;
     }
 
-    for (peer_ptr = &rx_peerHashTable[0], peer_end =
-	 &rx_peerHashTable[rx_hashTableSize]; peer_ptr < peer_end;
-	 peer_ptr++) {
-	struct rx_peer *peer, *next, *prev;
-
-        MUTEX_ENTER(&rx_peerHashTable_lock);
+    for (shard = &rx_peerHashShards[0];
+	 shard < &rx_peerHashShards[RX_HASH_SHARDS]; shard++) {
+        MUTEX_ENTER(&shard->lock);
         MUTEX_ENTER(&rx_rpc_stats);
-        for (prev = peer = *peer_ptr; peer; peer = next) {
-	    next = peer->next;
+	for (bucket = 0; bucket < shard->nBuckets; bucket++)
+        for (peer = shard->buckets[bucket]; peer; peer = peer->next) {
 	    code = MUTEX_TRYENTER(&peer->peer_lock);
 	    if (code) {
 		size_t space;
 		struct opr_queue *cursor, *store;
 
-		if (prev == *peer_ptr) {
-		    *peer_ptr = next;
-		    prev = next;
-		} else
-		    prev->next = next;
-
-                if (next)
-                    next->refCount++;
-                if (prev)
-                    prev->refCount++;
-                peer->refCount++;
-                MUTEX_EXIT(&rx_peerHashTable_lock);
-
                 for (opr_queue_ScanSafe(&peer->rpcStats, cursor, store)) {
 		    unsigned int num_funcs = 0;
 		    struct rx_interface_stat *rpc_stat
@@ -9010,19 +9342,10 @@ rx_disablePeerRPCStats(void)
 		    rxi_rpc_peer_stat_cnt -= num_funcs;
 		}
 		MUTEX_EXIT(&peer->peer_lock);
-
-                MUTEX_ENTER(&rx_peerHashTable_lock);
-                if (next)
-                    next->refCount--;
-                if (prev)
-                    prev->refCount--;
-                peer->refCount--;
-	    } else {
-		prev = peer;
 	    }
 	}
         MUTEX_EXIT(&rx_rpc_stats);
-        MUTEX_EXIT(&rx_peerHashTable_lock);
+        MUTEX_EXIT(&shard->lock);
     }
 }
 
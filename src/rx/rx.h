@@ -667,7 +667,10 @@ struct rx_statistics {		/* General rx statistics */
     int receiveCbufPktAllocFailures;
     int sendCbufPktAllocFailures;
     int nBusies;
-    int spares[4];
+    int batchReads;		/* Number of recvmmsg calls returning packets */
+    int batchReadPackets;	/* Number of packets read by those calls */
+    int batchSends;		/* Number of sendmmsg calls */
+    int batchSendPackets;	/* Number of datagrams sent by those calls */
 };
 
 /* structures for debug input and output packets */
@@ -682,7 +685,7 @@ struct rx_debugIn {
 #define RX_DEBUGI_BADTYPE     (-8)
 
 #define RX_DEBUGI_VERSION_MINIMUM ('L')	/* earliest real version */
-#define RX_DEBUGI_VERSION     ('S')    /* Latest version */
+#define RX_DEBUGI_VERSION     ('T')    /* Latest version */
     /* first version w/ secStats */
 #define RX_DEBUGI_VERSION_W_SECSTATS ('L')
     /* version M is first supporting GETALLCONN and RXSTATS type */
@@ -696,12 +699,14 @@ struct rx_debugIn {
 #define RX_DEBUGI_VERSION_W_GETPEER ('Q')
 #define RX_DEBUGI_VERSION_W_WAITED ('R')
 #define RX_DEBUGI_VERSION_W_PACKETS ('S')
+#define RX_DEBUGI_VERSION_W_HASHSTATS ('T')
 
 #define	RX_DEBUGI_GETSTATS	1	/* get basic rx stats */
 #define	RX_DEBUGI_GETCONN	2	/* get connection info */
 #define	RX_DEBUGI_GETALLCONN	3	/* get even uninteresting conns */
 #define	RX_DEBUGI_RXSTATS	4	/* get all rx stats */
 #define	RX_DEBUGI_GETPEER	5	/* get all peer structs */
+#define	RX_DEBUGI_HASHSTATS	6	/* get conn and peer hash table stats */
 
 struct rx_debugStats {
     afs_int32 nFreePackets;
@@ -789,6 +794,23 @@ struct rx_debugPeer {
     afs_int32 sparel[10];
 };
 
+/* Chain length bins: 0, 1, 2, 3-4, 5-8, 9-16, 17-32, 33+ */
+#define RX_DEBUG_HASH_CHAINS	8
+
+struct rx_debugHashTable {
+    afs_uint32 nBuckets;
+    afs_uint32 nEntries;
+    afs_uint32 maxChain;	/* length of the longest chain */
+    afs_uint32 grows;		/* number of times a shard has been resized */
+    afs_uint32 chains[RX_DEBUG_HASH_CHAINS];	/* buckets by chain length */
+};
+
+struct rx_debugHashStats {
+    struct rx_debugHashTable conns;
+    struct rx_debugHashTable peers;
+    afs_int32 sparel[8];
+};
+
 #define	RX_OTHER_IN	1	/* packets avail in in queue */
 #define	RX_OTHER_OUT	2	/* packets avail in out queue */
 
@@ -802,6 +824,7 @@ struct rx_debugPeer {
 #define RX_SERVER_DEBUG_ALL_PEER		0x80
 #define RX_SERVER_DEBUG_WAITED_CNT              0x100
 #define RX_SERVER_DEBUG_PACKETS_CNT              0x200
+#define RX_SERVER_DEBUG_HASH_STATS		0x400
 
 #define AFS_RX_STATS_CLEAR_ALL			0xffffffff
 #define AFS_RX_STATS_CLEAR_INVOCATIONS		0x1
@@ -22,7 +22,7 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-/* A reimplementation of the rx_event handler using red/black trees
+/* A reimplementation of the rx_event handler using timing wheels
  *
  * The first rx_event implementation used a simple sorted queue of all
  * events, which lead to O(n^2) performance, where n is the number of
@@ -34,9 +34,23 @@
  * where RTT times are in the millisecond, most connections will have events
  * expiring within the next second, so the problem reoccurs.
  *
- * This new implementation uses Red-Black trees to store a sorted list of
- * events. Red Black trees are guaranteed to have no worse than O(log N)
- * insertion, and are commonly used in timer applications
+ * The third implementation used Red-Black trees to store a sorted list of
+ * events, giving O(log N) insertion. But every resend, ack and keepalive
+ * timer is posted and cancelled many times over the life of a call, and
+ * with tens of thousands of calls the tree walks and the single tree lock
+ * became significant.
+ *
+ * This implementation uses hierarchical timing wheels, as described by
+ * Varghese and Lauck. Each wheel has RXEVENT_LEVELS levels of
+ * RXEVENT_SLOTS slots; a slot at level 0 holds the events due in one
+ * millisecond tick, and a slot at level n covers RXEVENT_SLOTS times the
+ * span of a slot at level n-1. Posting and cancelling an event is O(1).
+ * As time advances, the events in a higher level slot are cascaded down
+ * into the lower levels, so each event is moved at most RXEVENT_LEVELS
+ * times before it fires. Events are spread over several independent
+ * wheels, chosen by the event's argument (normally its call or
+ * connection), so that posting and cancelling events for different calls
+ * doesn't contend on a single lock.
  */
 
 #include <afsconfig.h>
@@ -51,18 +65,29 @@
 
 #include <afs/opr.h>
 #include <opr/queue.h>
-#include <opr/rbtree.h>
+#include <opr/jhash.h>
 
 #include "rx.h"
 #include "rx_atomic.h"
 #include "rx_call.h"
 #include "rx_globals.h"
 
+#define RXEVENT_WHEELS		4	/* must be a power of 2 */
+#define RXEVENT_LEVELS		5
+#define RXEVENT_SLOT_BITS	6
+#define RXEVENT_SLOTS		(1 << RXEVENT_SLOT_BITS)
+#define RXEVENT_SLOT_MASK	(RXEVENT_SLOTS - 1)
+/* Events further away than this are parked in the top level, and
+ * re-placed each time that they are cascaded (about every 12 days) */
+#define RXEVENT_MAX_TICKS	((afs_uint64)1 << (RXEVENT_LEVELS * RXEVENT_SLOT_BITS))
+
+struct rxevent_wheel;
+
 struct rxevent {
     struct opr_queue q;
-    struct opr_rbtree_node node;
+    struct rxevent_wheel *wheel;
+    afs_uint64 tick;
     struct clock eventTime;
-    struct rxevent *next;
     rx_atomic_t refcnt;
     int handled;
     void (*func)(struct rxevent *, void *, void *, int);
@@ -83,11 +108,16 @@ static struct {
     struct malloclist *mallocs;
 } freeEvents;
 
-static struct {
+/* All of the fields of a wheel are protected by its lock. Every event in
+ * the wheel is on one of its slots, or on the due queue once its tick has
+ * passed. */
+static struct rxevent_wheel {
     afs_kmutex_t lock;
-    struct opr_rbtree head;
-    struct rxevent *first;
-} eventTree;
+    afs_uint64 current;		/* the next tick to be processed */
+    int count;			/* events in this wheel */
+    struct opr_queue due;	/* events waiting to be fired */
+    struct opr_queue slots[RXEVENT_LEVELS][RXEVENT_SLOTS];
+} eventWheels[RXEVENT_WHEELS];
 
 static struct {
     afs_kmutex_t lock;
@@ -172,26 +202,152 @@ rxevent_Get(struct rxevent *ev) {
     return rxevent_get(ev);
 }
 
+/* Convert a clock time into a wheel tick. Times before the epoch are
+ * already due, so can go in tick 0. */
+static_inline afs_uint64
+clockToTick(struct clock *c)
+{
+    if (c->sec < 0)
+	return 0;
+    return (afs_uint64)c->sec * 1000 + c->usec / 1000;
+}
+
+static_inline void
+tickToClock(afs_uint64 tick, struct clock *c)
+{
+    c->sec = tick / 1000;
+    c->usec = (tick % 1000) * 1000;
+}
+
+/* Put an event into the slot of wheel which will be processed at, or
+ * cascaded down at, the event's tick. Events that are already due go into
+ * the slot for the current tick. */
+static void
+wheelInsert(struct rxevent_wheel *wheel, struct rxevent *ev)
+{
+    afs_uint64 tick = ev->tick;
+    afs_uint64 delta;
+    int level;
+
+    if (tick < wheel->current)
+	tick = wheel->current;
+    delta = tick - wheel->current;
+    if (delta >= RXEVENT_MAX_TICKS) {
+	tick = wheel->current + RXEVENT_MAX_TICKS - 1;
+	delta = RXEVENT_MAX_TICKS - 1;
+    }
+
+    for (level = 0; level < RXEVENT_LEVELS - 1; level++) {
+	if (delta < ((afs_uint64)1 << ((level + 1) * RXEVENT_SLOT_BITS)))
+	    break;
+    }
+    opr_queue_Append(&wheel->slots[level]
+			[(tick >> (level * RXEVENT_SLOT_BITS)) & RXEVENT_SLOT_MASK],
+		     &ev->q);
+}
+
+/* Re-place every event in a slot, now that the wheel has moved on */
+static void
+wheelCascade(struct rxevent_wheel *wheel, struct opr_queue *slot)
+{
+    struct opr_queue moving;
+    struct rxevent *ev;
+
+    opr_queue_Init(&moving);
+    opr_queue_SpliceAppend(&moving, slot);
+    while (!opr_queue_IsEmpty(&moving)) {
+	ev = opr_queue_First(&moving, struct rxevent, q);
+	opr_queue_Remove(&ev->q);
+	wheelInsert(wheel, ev);
+    }
+}
+
+/* Advance the wheel up to (but not including) tick, moving every event
+ * whose tick has passed onto the due queue. */
+static void
+wheelAdvance(struct rxevent_wheel *wheel, afs_uint64 tick)
+{
+    int level, index;
+
+    if (wheel->count == 0) {
+	if (tick > wheel->current)
+	    wheel->current = tick;
+	return;
+    }
+
+    while (wheel->current < tick) {
+	/* When a level wraps, pull down the next slot from the level
+	 * above. */
+	for (level = 1; level < RXEVENT_LEVELS; level++) {
+	    if (((wheel->current >> ((level - 1) * RXEVENT_SLOT_BITS))
+		 & RXEVENT_SLOT_MASK) != 0)
+		break;
+	    index = (wheel->current >> (level * RXEVENT_SLOT_BITS))
+		    & RXEVENT_SLOT_MASK;
+	    wheelCascade(wheel, &wheel->slots[level][index]);
+	}
+	opr_queue_SpliceAppend(&wheel->due,
+			       &wheel->slots[0][wheel->current
+						 & RXEVENT_SLOT_MASK]);
+	wheel->current++;
+    }
+}
+
+/* Work out the tick by which something next needs to happen in this
+ * wheel: either an event becomes due, or a non-empty slot in a higher
+ * level needs to be cascaded down. A tick is only processed once the
+ * clock has moved past it. Returns 0 if the wheel is empty. */
+static afs_uint64
+wheelNextTick(struct rxevent_wheel *wheel)
+{
+    afs_uint64 next = 0, candidate, base;
+    int level, i, first, index, shift;
+
+    if (wheel->count == 0)
+	return 0;
+    if (!opr_queue_IsEmpty(&wheel->due))
+	return wheel->current;
+
+    for (level = 0; level < RXEVENT_LEVELS; level++) {
+	shift = level * RXEVENT_SLOT_BITS;
+	base = wheel->current >> shift;
+	/* The slot for the current tick at this level has already been
+	 * dealt with, unless the wheel is sat on its boundary */
+	first = (level == 0
+		 || (wheel->current & (((afs_uint64)1 << shift) - 1)) == 0)
+		? 0 : 1;
+	for (i = first; i < first + RXEVENT_SLOTS; i++) {
+	    index = (base + i) & RXEVENT_SLOT_MASK;
+	    if (!opr_queue_IsEmpty(&wheel->slots[level][index])) {
+		candidate = ((base + i) << shift) + 1;
+		if (next == 0 || candidate < next)
+		    next = candidate;
+		break;
+	    }
+	}
+    }
+    return next;
+}
+
 /* Called if the time now is older than the last time we recorded running an
  * event. This test catches machines where the system time has been set
  * backwards, and avoids RX completely stalling when timers fail to fire.
  *
  * Take the different between now and the last event time, and subtract that
  * from the timing of every event on the system. This does a relatively slow
- * walk of the completely eventTree, but time-travel will hopefully be a pretty
- * rare occurrence.
- *
- * This can only safely be called from the event thread, as it plays with the
- * schedule directly.
- *
+ * walk of every event in every wheel, but time-travel will hopefully be a
+ * pretty rare occurrence.
  */
 static void
 adjustTimes(void)
 {
-    struct opr_rbtree_node *node;
+    struct rxevent_wheel *wheel;
+    struct opr_queue moving;
+    struct rxevent *ev;
     struct clock adjTime, now;
+    int level, index;
 
-    MUTEX_ENTER(&eventTree.lock);
+    MUTEX_ENTER(&eventSchedule.lock);
     /* Time adjustment is expensive, make absolutely certain that we have
      * to do it, by getting an up to date time to base our decision on
      * once we've acquired the relevant locks.
@@ -205,35 +361,55 @@ adjustTimes(void)
 
     clock_Sub(&adjTime, &now);
 
-    /* If there are no events in the tree, then there's nothing to adjust */
-    if (eventTree.first == NULL)
-	goto out;
-
-    node = opr_rbtree_first(&eventTree.head);
-    while(node) {
-	struct rxevent *event = opr_containerof(node, struct rxevent, node);
-
-	clock_Sub(&event->eventTime, &adjTime);
-	node = opr_rbtree_next(node);
+    for (wheel = eventWheels; wheel < &eventWheels[RXEVENT_WHEELS]; wheel++) {
+	MUTEX_ENTER(&wheel->lock);
+	opr_queue_Init(&moving);
+	opr_queue_SpliceAppend(&moving, &wheel->due);
+	for (level = 0; level < RXEVENT_LEVELS; level++)
+	    for (index = 0; index < RXEVENT_SLOTS; index++)
+		opr_queue_SpliceAppend(&moving, &wheel->slots[level][index]);
+
+	wheel->current = clockToTick(&now);
+	while (!opr_queue_IsEmpty(&moving)) {
+	    ev = opr_queue_First(&moving, struct rxevent, q);
+	    opr_queue_Remove(&ev->q);
+	    clock_Sub(&ev->eventTime, &adjTime);
+	    ev->tick = clockToTick(&ev->eventTime);
+	    wheelInsert(wheel, ev);
+	}
+	MUTEX_EXIT(&wheel->lock);
     }
-    eventSchedule.next = eventTree.first->eventTime;
+    /* Make sure that the event thread recalculates its next wakeup */
+    clock_Zero(&eventSchedule.next);
 
 out:
-    MUTEX_EXIT(&eventTree.lock);
+    MUTEX_EXIT(&eventSchedule.lock);
 }
 
 static int initialised = 0;
 void
 rxevent_Init(int nEvents, void (*scheduler)(void))
 {
+    struct rxevent_wheel *wheel;
+    struct clock now;
+    int level, index;
+
     if (initialised)
 	return;
 
     initialised = 1;
 
     clock_Init();
-    MUTEX_INIT(&eventTree.lock, "event tree lock", MUTEX_DEFAULT, 0);
-    opr_rbtree_init(&eventTree.head);
+    clock_GetTime(&now);
+    for (wheel = eventWheels; wheel < &eventWheels[RXEVENT_WHEELS]; wheel++) {
+	MUTEX_INIT(&wheel->lock, "event wheel lock", MUTEX_DEFAULT, 0);
+	wheel->current = clockToTick(&now);
+	wheel->count = 0;
+	opr_queue_Init(&wheel->due);
+	for (level = 0; level < RXEVENT_LEVELS; level++)
+	    for (index = 0; index < RXEVENT_SLOTS; index++)
+		opr_queue_Init(&wheel->slots[level][index]);
+    }
 
     MUTEX_INIT(&freeEvents.lock, "free events lock", MUTEX_DEFAULT, 0);
     opr_queue_Init(&freeEvents.list);
@@ -242,6 +418,7 @@ rxevent_Init(int nEvents, void (*scheduler)(void))
     if (nEvents)
 	allocUnit = nEvents;
 
+    MUTEX_INIT(&eventSchedule.lock, "event schedule lock", MUTEX_DEFAULT, 0);
     clock_Zero(&eventSchedule.next);
     clock_Zero(&eventSchedule.last);
     eventSchedule.raised = 0;
@@ -253,11 +430,13 @@ rxevent_Post(struct clock *when, struct clock *now,
 	     void (*func) (struct rxevent *, void *, void *, int),
 	     void *arg, void *arg1, int arg2)
 {
-    struct rxevent *ev, *event;
-    struct opr_rbtree_node **childptr, *parent = NULL;
+    struct rxevent *ev;
+    struct rxevent_wheel *wheel;
+    int reschedule = 0;
 
     ev = rxevent_alloc();
     ev->eventTime = *when;
+    ev->tick = clockToTick(when);
     ev->func = func;
     ev->arg = arg;
     ev->arg1 = arg1;
@@ -266,53 +445,30 @@ rxevent_Post(struct clock *when, struct clock *now,
     if (clock_Lt(now, &eventSchedule.last))
 	adjustTimes();
 
-    MUTEX_ENTER(&eventTree.lock);
+    /* Keep all of the events for a call on the same wheel */
+    wheel = &eventWheels[opr_jhash_int2((afs_uint32)(intptr_t)arg, 0, 0)
+			 & (RXEVENT_WHEELS - 1)];
+    ev->wheel = wheel;
 
-    /* Work out where in the tree we'll be storing this */
-    childptr = &eventTree.head.root;
+    MUTEX_ENTER(&wheel->lock);
+    wheelInsert(wheel, ev);
+    wheel->count++;
+    rxevent_get(ev);		/* The wheel's reference */
+    MUTEX_EXIT(&wheel->lock);
 
-    while(*childptr) {
-	event = opr_containerof((*childptr), struct rxevent, node);
-
-	parent = *childptr;
-	if (clock_Lt(when, &event->eventTime))
-	    childptr = &(*childptr)->left;
-	else if (clock_Gt(when, &event->eventTime))
-	    childptr = &(*childptr)->right;
-	else {
-	    opr_queue_Append(&event->q, &ev->q);
-	    goto out;
-	}
-    }
-    opr_queue_Init(&ev->q);
-    opr_rbtree_insert(&eventTree.head, parent, childptr, &ev->node);
-
-    if (eventTree.first == NULL ||
-	clock_Lt(when, &(eventTree.first->eventTime))) {
-	eventTree.first = ev;
+    /* If the event thread is going to sleep past this event, wake it up */
+    MUTEX_ENTER(&eventSchedule.lock);
+    if (!eventSchedule.raised || clock_Lt(when, &eventSchedule.next)) {
 	eventSchedule.raised = 1;
 	clock_Zero(&eventSchedule.next);
-	MUTEX_EXIT(&eventTree.lock);
-	if (eventSchedule.func != NULL)
-	    (*eventSchedule.func)();
-	return rxevent_get(ev);
+	reschedule = 1;
     }
+    MUTEX_EXIT(&eventSchedule.lock);
 
-out:
-    MUTEX_EXIT(&eventTree.lock);
-    return rxevent_get(ev);
-}
+    if (reschedule && eventSchedule.func != NULL)
+	(*eventSchedule.func)();
 
-/* We're going to remove ev from the tree, so set the first pointer to the
- * next event after it */
-static_inline void
-resetFirst(struct rxevent *ev)
-{
-    struct opr_rbtree_node *next = opr_rbtree_next(&ev->node);
-    if (next)
-	eventTree.first = opr_containerof(next, struct rxevent, node);
-    else
-	eventTree.first = NULL;
+    return ev;
 }
 
 /*!
@@ -326,56 +482,26 @@ int
 rxevent_Cancel(struct rxevent **evp)
 {
     struct rxevent *event;
+    struct rxevent_wheel *wheel;
     int cancelled = 0;
 
     if (!evp || !*evp)
 	return 0;
 
     event = *evp;
+    wheel = event->wheel;
 
-    MUTEX_ENTER(&eventTree.lock);
+    MUTEX_ENTER(&wheel->lock);
 
     if (!event->handled) {
-	/* We're a node on the red/black tree. If our list is non-empty,
-	 * then swap the first element in the list in in our place,
-	 * promoting it to the list head */
-	if (event->node.parent == NULL
-	    && eventTree.head.root != &event->node) {
-	    /* Not in the rbtree, therefore must be a list element */
-	    opr_queue_Remove(&event->q);
-	} else {
-	    if (!opr_queue_IsEmpty(&event->q)) {
-	        struct rxevent *next;
-
-		next = opr_queue_First(&event->q, struct rxevent, q);
-		opr_queue_Remove(&next->q); /* Remove ourselves from list */
-		if (event->q.prev == &event->q) {
-		    next->q.prev = next->q.next = &next->q;
-		} else {
-		    next->q = event->q;
-		    next->q.prev->next = &next->q;
-		    next->q.next->prev = &next->q;
-		}
-
-		opr_rbtree_replace(&eventTree.head, &event->node,
-				   &next->node);
-
-		if (eventTree.first == event)
-		    eventTree.first = next;
-
-	    } else {
-		if (eventTree.first == event)
-		    resetFirst(event);
-
-		opr_rbtree_remove(&eventTree.head, &event->node);
-	    }
-	}
+	opr_queue_Remove(&event->q);
+	wheel->count--;
 	event->handled = 1;
-	rxevent_put(event); /* Dispose of eventTree reference */
+	rxevent_put(event); /* Dispose of the wheel's reference */
 	cancelled = 1;
     }
 
-    MUTEX_EXIT(&eventTree.lock);
+    MUTEX_EXIT(&wheel->lock);
 
     *evp = NULL;
     rxevent_put(event); /* Dispose of caller's reference */
@@ -396,8 +522,10 @@ rxevent_Cancel(struct rxevent **evp)
 int
 rxevent_RaiseEvents(struct clock *wait)
 {
+    struct rxevent_wheel *wheel;
     struct clock now;
     struct rxevent *event;
+    afs_uint64 tick, next, wheelNext;
     int ret;
 
     clock_GetTime(&now);
@@ -407,41 +535,53 @@ rxevent_RaiseEvents(struct clock *wait)
 	  adjustTimes();
     eventSchedule.last = now;
 
-    MUTEX_ENTER(&eventTree.lock);
-    /* Lock our event tree */
-    while (eventTree.first != NULL
-	   && clock_Lt(&eventTree.first->eventTime, &now)) {
+    /* Everything in a tick before the current one has definitely expired */
+    tick = clockToTick(&now);
 
-	/* Grab the next node, either in the event's list, or in the tree node
-	 * itself, and remove it from the event tree */
-	event = eventTree.first;
-	if (!opr_queue_IsEmpty(&event->q)) {
-	    event = opr_queue_Last(&event->q, struct rxevent, q);
+    for (wheel = eventWheels; wheel < &eventWheels[RXEVENT_WHEELS]; wheel++) {
+	MUTEX_ENTER(&wheel->lock);
+	wheelAdvance(wheel, tick);
+	while (!opr_queue_IsEmpty(&wheel->due)) {
+	    event = opr_queue_First(&wheel->due, struct rxevent, q);
 	    opr_queue_Remove(&event->q);
-	} else {
-	    resetFirst(event);
-	    opr_rbtree_remove(&eventTree.head, &event->node);
-	}
-	event->handled = 1;
-        MUTEX_EXIT(&eventTree.lock);
+	    wheel->count--;
+	    event->handled = 1;
+	    MUTEX_EXIT(&wheel->lock);
+
+	    /* Fire the event, then free the structure */
+	    event->func(event, event->arg, event->arg1, event->arg2);
+	    rxevent_put(event);
 
-        /* Fire the event, then free the structure */
-	event->func(event, event->arg, event->arg1, event->arg2);
-	rxevent_put(event);
+	    MUTEX_ENTER(&wheel->lock);
+	}
+	MUTEX_EXIT(&wheel->lock);
+    }
 
-	MUTEX_ENTER(&eventTree.lock);
+    /* Figure out when we next need to be scheduled. Hold the schedule lock
+     * whilst we look, so that anything posted after we've checked its
+     * wheel will see our new time and wake us if it needs to. */
+    MUTEX_ENTER(&eventSchedule.lock);
+    next = 0;
+    for (wheel = eventWheels; wheel < &eventWheels[RXEVENT_WHEELS]; wheel++) {
+	MUTEX_ENTER(&wheel->lock);
+	wheelNext = wheelNextTick(wheel);
+	MUTEX_EXIT(&wheel->lock);
+	if (wheelNext != 0 && (next == 0 || wheelNext < next))
+	    next = wheelNext;
     }
 
-    /* Figure out when we next need to be scheduled */
-    if (eventTree.first != NULL) {
-	*wait = eventSchedule.next = eventTree.first->eventTime;
+    if (next != 0) {
+	if (next <= tick)
+	    next = tick + 1;
+	tickToClock(next, &eventSchedule.next);
+	*wait = eventSchedule.next;
 	ret = eventSchedule.raised = 1;
 	clock_Sub(wait, &now);
     } else {
 	ret = eventSchedule.raised = 0;
     }
 
-    MUTEX_EXIT(&eventTree.lock);
+    MUTEX_EXIT(&eventSchedule.lock);
 
     return ret;
 }
@@ -449,12 +589,15 @@ rxevent_RaiseEvents(struct clock *wait)
 void
 shutdown_rxevent(void)
 {
+    struct rxevent_wheel *wheel;
     struct malloclist *mrec, *nmrec;
 
     if (!initialised) {
 	return;
     }
-    MUTEX_DESTROY(&eventTree.lock);
+    for (wheel = eventWheels; wheel < &eventWheels[RXEVENT_WHEELS]; wheel++)
+	MUTEX_DESTROY(&wheel->lock);
+    MUTEX_DESTROY(&eventSchedule.lock);
 
 #if !defined(AFS_AIX32_ENV) || !defined(KERNEL)
     MUTEX_DESTROY(&freeEvents.lock);
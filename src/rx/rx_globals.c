@@ -89,6 +89,36 @@ int rx_GetMinPeerTimeout(void)
     return rx_minPeerTimeout;
 }
 
+void rx_SetUdpBatchSize(int packets)
+{
+    if (packets < 0)
+	packets = 0;
+    if (packets > RX_MAX_UDP_BATCH)
+	packets = RX_MAX_UDP_BATCH;
+
+    rx_udpBatchSize = packets;
+}
+
+int rx_GetUdpBatchSize(void)
+{
+    return rx_udpBatchSize;
+}
+
+void rx_SetListenerThreads(int threads)
+{
+    if (threads < 1)
+	threads = 1;
+    if (threads > RX_MAX_LISTENERS)
+	threads = RX_MAX_LISTENERS;
+
+    rx_listenerThreads = threads;
+}
+
+int rx_GetListenerThreads(void)
+{
+    return rx_listenerThreads;
+}
+
 #ifdef AFS_NT40_ENV
 
 void rx_SetRxDeadTime(int seconds)
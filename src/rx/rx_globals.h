@@ -91,6 +91,28 @@ void  rx_SetUdpBufSize(int x);
 #define rx_GetMinUdpBufSize()   (64*1024)
 #define rx_SetUdpBufSize(x)     (((x)>rx_GetMinUdpBufSize()) ? (rx_UdpBufSize = (x)):0)
 #endif
+
+/*
+ * Batched UDP I/O. When rx_udpBatchSize is greater than one, the pthreaded
+ * listener drains up to that many datagrams with each recvmmsg, and
+ * transmit queue flushes are handed to the kernel with one sendmmsg.
+ */
+#if defined(AFS_PTHREAD_ENV) && !defined(KERNEL) \
+    && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+# define RX_ENABLE_MMSG
+#endif
+#define RX_MAX_UDP_BATCH 32
+EXT int rx_udpBatchSize GLOBALSINIT(0);
+
+/*
+ * Number of listener threads for each port. When greater than one, each
+ * listener owns its own socket on the port; the first is bound exclusively,
+ * the others join it with SO_REUSEPORT, and the kernel distributes peers
+ * between them.
+ */
+#define RX_MAX_LISTENERS 64
+EXT int rx_listenerThreads GLOBALSINIT(1);
+
 /*
  * Variables to control RX overload management. When the number of calls
  * waiting for a thread exceed the threshold, new calls are aborted
@@ -168,6 +190,7 @@ typedef struct rx_ts_info_t {
         int galloc_xfer;
     } _FPQ;
     struct rx_packet * local_special_packet;
+    struct rx_sendbatch * sendbatch;	/* pending sendmmsg datagrams */
 } rx_ts_info_t;
 EXT struct rx_ts_info_t * rx_ts_info_init(void);   /* init function for thread-specific data struct */
 #define RX_TS_INFO_GET(ts_info_p) \
@@ -525,18 +548,66 @@ EXT afs_kcondvar_t rx_waitingForPackets_cv;
 #endif
 EXT char rx_waitingForPackets;	/* Processes set and wait on this variable when waiting for packet buffers */
 
-EXT struct rx_peer **rx_peerHashTable;
-EXT struct rx_connection **rx_connHashTable;
+/*
+ * The connection and peer hash tables are each split into RX_HASH_SHARDS
+ * shards, chosen by the low bits of the hash value.  Each shard has its
+ * own lock and its own array of buckets, which is doubled whenever the
+ * shard holds more than RX_HASH_LOAD entries per bucket.
+ *
+ * Looking up or inserting an entry only needs the shard's lock.  Removing
+ * an entry, resizing a shard, and walking a table while dropping the shard
+ * lock part way along a chain also need the table's global lock
+ * (rx_connHashTable_lock or rx_peerHashTable_lock), so that chains can't
+ * be rearranged underneath a walker.  Shards are only ever resized by
+ * threads which can take the global lock without waiting.
+ */
+#define RX_HASH_SHARD_BITS	6
+#define RX_HASH_SHARDS		(1 << RX_HASH_SHARD_BITS)
+#define RX_HASH_INIT_BUCKETS	4	/* per shard; must be a power of 2 */
+#define RX_HASH_MAX_BUCKETS	(1 << 16)	/* per shard */
+#define RX_HASH_LOAD		2	/* entries per bucket before growing */
+
+struct rx_connHashShard {
+#ifdef RX_ENABLE_LOCKS
+    afs_kmutex_t lock;
+#endif
+    struct rx_connection **buckets;
+    afs_uint32 nBuckets;
+    afs_uint32 nEntries;
+    afs_uint32 grows;		/* number of times buckets has doubled */
+    struct rx_connection *lastConn; /* last conn found in this shard */
+};
+
+struct rx_peerHashShard {
+#ifdef RX_ENABLE_LOCKS
+    afs_kmutex_t lock;
+#endif
+    struct rx_peer **buckets;
+    afs_uint32 nBuckets;
+    afs_uint32 nEntries;
+    afs_uint32 grows;
+};
+
+EXT struct rx_connHashShard rx_connHashShards[RX_HASH_SHARDS];
+EXT struct rx_peerHashShard rx_peerHashShards[RX_HASH_SHARDS];
 EXT struct rx_connection *rx_connCleanup_list GLOBALSINIT(0);
-EXT afs_uint32 rx_hashTableSize GLOBALSINIT(257);	/* Prime number */
 #ifdef RX_ENABLE_LOCKS
 EXT afs_kmutex_t rx_peerHashTable_lock;
 EXT afs_kmutex_t rx_connHashTable_lock;
 #endif /* RX_ENABLE_LOCKS */
 
-#define CONN_HASH(host, port, cid, epoch, type) ((((cid)>>RX_CIDSHIFT)%rx_hashTableSize))
-
-#define PEER_HASH(host, port)  ((host ^ port) % rx_hashTableSize)
+/*
+ * Connections can't be hashed on the peer's address, since a multihomed
+ * client may move a connection between its interfaces.
+ */
+#define CONN_HASH(host, port, cid, epoch, type) \
+    opr_jhash_int2((cid) >> RX_CIDSHIFT, (epoch), 0)
+#define PEER_HASH(host, port)  opr_jhash_int2((host), (port), 0)
+
+#define RX_CONN_SHARD(hash) (&rx_connHashShards[(hash) & (RX_HASH_SHARDS - 1)])
+#define RX_PEER_SHARD(hash) (&rx_peerHashShards[(hash) & (RX_HASH_SHARDS - 1)])
+#define RX_HASH_BUCKET(shard, hash) \
+    (((hash) >> RX_HASH_SHARD_BITS) & ((shard)->nBuckets - 1))
 
 /* Forward definitions of internal procedures */
 
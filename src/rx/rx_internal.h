@@ -30,6 +30,7 @@ extern void rxi_ProcessNetError(struct sock_extended_err *err,
 #endif
 extern struct rx_peer *rxi_FindPeer(afs_uint32 host, u_short port,
 				    int create);
+extern void rxi_GetHashStats(struct rx_debugHashStats *stats);
 extern struct rx_packet *rxi_ReceivePacket(struct rx_packet *np,
 					   osi_socket socket, afs_uint32 host,
 					   u_short port, int *tnop,
@@ -66,3 +67,24 @@ extern int rxi_SendIovecs(struct rx_connection *conn, struct iovec *iov,
 			  int iovcnt, size_t length, int istack);
 extern void rxi_SendRaw(struct rx_call *call, struct rx_connection *conn,
 			int type, char *data, int bytes, int istack);
+#ifdef RX_ENABLE_MMSG
+struct rx_sendbatch;
+extern int rxi_ReadPackets(osi_socket socket, struct rx_packet **pkts,
+			   int npackets, afs_uint32 *hosts, u_short *ports);
+extern struct rx_sendbatch *rxi_BeginSendBatch(struct rx_call *call);
+extern void rxi_EndSendBatch(struct rx_sendbatch *batch);
+#endif
+
+/* rx_pthread.c */
+#if defined(AFS_PTHREAD_ENV) && !defined(KERNEL)
+extern int rxi_ListenShared(osi_socket sock, osi_socket primary);
+extern osi_socket rxi_PrimarySocket(osi_socket sock);
+#else
+# define rxi_PrimarySocket(sock) (sock)
+#endif
+#ifdef RX_ENABLE_MMSG
+extern int rxi_Recvmmsg(osi_socket socket, struct mmsghdr *msgs,
+			unsigned int nmsgs, int flags);
+extern int rxi_Sendmmsg(osi_socket socket, struct mmsghdr *msgs,
+			unsigned int nmsgs, int flags);
+#endif
@@ -59,6 +59,7 @@
 #endif
 
 #include <opr/queue.h>
+#include <opr/jhash.h>
 
 #include "rx.h"
 #include "rx_clock.h"
@@ -1432,20 +1433,18 @@ CountFDs(int amax)
 
 #if !defined(KERNEL) || defined(UKERNEL)
 
-/* This function reads a single packet from the interface into the
- * supplied packet buffer (*p).  Return 0 if the packet is bogus.  The
- * (host,port) of the sender are stored in the supplied variables, and
- * the data length of the packet is stored in the packet structure.
- * The header is decoded. */
-int
-rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
-	       u_short * port)
+/* Prepare a packet to be read off the wire.  The packet's data buffers
+ * are extended to the advertised maximum receive size, and the last iovec
+ * is extended into the packet's extra buffer as padding.  Returns the
+ * largest datagram we are willing to accept; the original length of the
+ * last iovec is stored in *savelen so that rxi_ReadPacketDone can restore
+ * it. */
+static afs_uint32
+rxi_ReadPacketPrepare(struct rx_packet *p, afs_uint32 *savelen)
 {
-    struct sockaddr_in from;
-    int nbytes;
     afs_int32 rlen;
-    afs_uint32 tlen, savelen;
-    struct msghdr msg;
+    afs_uint32 tlen;
+
     rx_computelen(p, tlen);
     rx_SetDataSize(p, tlen);	/* this is the size of the user data area */
 
@@ -1467,16 +1466,21 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
      * our problems caused by the lack of a length field in the rx header.
      * Use the extra buffer that follows the localdata in each packet
      * structure. */
-    savelen = p->wirevec[p->niovecs - 1].iov_len;
+    *savelen = p->wirevec[p->niovecs - 1].iov_len;
     p->wirevec[p->niovecs - 1].iov_len += RX_EXTRABUFFERSIZE;
 
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_name = (char *)&from;
-    msg.msg_namelen = sizeof(struct sockaddr_in);
-    msg.msg_iov = p->wirevec;
-    msg.msg_iovlen = p->niovecs;
-    nbytes = rxi_Recvmsg(socket, &msg, 0);
+    return tlen;
+}
 
+/* Finish reading a packet which was prepared by rxi_ReadPacketPrepare and
+ * filled with nbytes bytes from the address in *from.  Return 0 if the
+ * packet is bogus, otherwise the header is decoded and the (host,port) of
+ * the sender are stored in the supplied variables. */
+static int
+rxi_ReadPacketDone(struct rx_packet *p, int nbytes, afs_uint32 tlen,
+		   afs_uint32 savelen, struct sockaddr_in *from,
+		   afs_uint32 *host, u_short *port)
+{
     /* restore the vec to its correct state */
     p->wirevec[p->niovecs - 1].iov_len = savelen;
 
@@ -1488,10 +1492,10 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
 	} else if (nbytes <= 0) {
             if (rx_stats_active) {
                 rx_atomic_inc(&rx_stats.bogusPacketOnRead);
-                rx_stats.bogusHost = from.sin_addr.s_addr;
+                rx_stats.bogusHost = from->sin_addr.s_addr;
             }
-	    dpf(("B: bogus packet from [%x,%d] nb=%d\n", ntohl(from.sin_addr.s_addr),
-		 ntohs(from.sin_port), nbytes));
+	    dpf(("B: bogus packet from [%x,%d] nb=%d\n", ntohl(from->sin_addr.s_addr),
+		 ntohs(from->sin_port), nbytes));
 	}
 	return 0;
     }
@@ -1500,8 +1504,8 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
 		&& (random() % 100 < rx_intentionallyDroppedOnReadPer100)) {
 	rxi_DecodePacketHeader(p);
 
-	*host = from.sin_addr.s_addr;
-	*port = from.sin_port;
+	*host = from->sin_addr.s_addr;
+	*port = from->sin_port;
 
 	dpf(("Dropped %d %s: %x.%u.%u.%u.%u.%u.%u flags %d len %d\n",
 	      p->header.serial, rx_packetTypes[p->header.type - 1], ntohl(*host), ntohs(*port), p->header.serial,
@@ -1517,8 +1521,8 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
 	/* Extract packet header. */
 	rxi_DecodePacketHeader(p);
 
-	*host = from.sin_addr.s_addr;
-	*port = from.sin_port;
+	*host = from->sin_addr.s_addr;
+	*port = from->sin_port;
 	if (rx_stats_active
 	    && p->header.type > 0 && p->header.type < RX_N_PACKET_TYPES) {
 
@@ -1533,6 +1537,100 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
     }
 }
 
+/* This function reads a single packet from the interface into the
+ * supplied packet buffer (*p).  Return 0 if the packet is bogus.  The
+ * (host,port) of the sender are stored in the supplied variables, and
+ * the data length of the packet is stored in the packet structure.
+ * The header is decoded. */
+int
+rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
+	       u_short * port)
+{
+    struct sockaddr_in from;
+    int nbytes;
+    afs_uint32 tlen, savelen;
+    struct msghdr msg;
+
+    tlen = rxi_ReadPacketPrepare(p, &savelen);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (char *)&from;
+    msg.msg_namelen = sizeof(struct sockaddr_in);
+    msg.msg_iov = p->wirevec;
+    msg.msg_iovlen = p->niovecs;
+    nbytes = rxi_Recvmsg(socket, &msg, 0);
+
+    return rxi_ReadPacketDone(p, nbytes, tlen, savelen, &from, host, port);
+}
+
+#ifdef RX_ENABLE_MMSG
+/* Read up to npackets datagrams from the interface with a single recvmmsg,
+ * blocking until at least one is available.  The good packets are moved to
+ * the front of the supplied array, with their senders stored in the
+ * corresponding elements of hosts and ports; the number of good packets is
+ * returned.  Packets which were not filled, or which were bogus, are left
+ * at the end of the array so that the caller can reuse them. */
+int
+rxi_ReadPackets(osi_socket socket, struct rx_packet **pkts, int npackets,
+		afs_uint32 *hosts, u_short *ports)
+{
+    struct mmsghdr msgs[RX_MAX_UDP_BATCH];
+    struct sockaddr_in from[RX_MAX_UDP_BATCH];
+    afs_uint32 tlen[RX_MAX_UDP_BATCH];
+    afs_uint32 savelen[RX_MAX_UDP_BATCH];
+    struct rx_packet *p;
+    int i, nmsgs, ngood;
+
+    if (npackets > RX_MAX_UDP_BATCH)
+	npackets = RX_MAX_UDP_BATCH;
+
+    memset(msgs, 0, npackets * sizeof(msgs[0]));
+    for (i = 0; i < npackets; i++) {
+	tlen[i] = rxi_ReadPacketPrepare(pkts[i], &savelen[i]);
+	msgs[i].msg_hdr.msg_name = (char *)&from[i];
+	msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	msgs[i].msg_hdr.msg_iov = pkts[i]->wirevec;
+	msgs[i].msg_hdr.msg_iovlen = pkts[i]->niovecs;
+    }
+
+    nmsgs = rxi_Recvmmsg(socket, msgs, npackets, MSG_WAITFORONE);
+    if (nmsgs <= 0) {
+	/* Nothing was read, so there is no sender to blame */
+	for (i = 0; i < npackets; i++)
+	    pkts[i]->wirevec[pkts[i]->niovecs - 1].iov_len = savelen[i];
+	if (nmsgs == 0 || errno == EWOULDBLOCK) {
+	    if (rx_stats_active)
+		rx_atomic_inc(&rx_stats.noPacketOnRead);
+	} else {
+	    if (rx_stats_active)
+		rx_atomic_inc(&rx_stats.bogusPacketOnRead);
+	    dpf(("B: recvmmsg failed, errno %d\n", errno));
+	}
+	return 0;
+    }
+
+    if (rx_stats_active) {
+	rx_atomic_inc(&rx_stats.batchReads);
+	rx_atomic_add(&rx_stats.batchReadPackets, nmsgs);
+    }
+
+    ngood = 0;
+    for (i = 0; i < npackets; i++) {
+	p = pkts[i];
+	if (i >= nmsgs) {
+	    p->wirevec[p->niovecs - 1].iov_len = savelen[i];
+	    continue;
+	}
+	if (rxi_ReadPacketDone(p, msgs[i].msg_len, tlen[i], savelen[i],
+			       &from[i], &hosts[ngood], &ports[ngood])) {
+	    pkts[i] = pkts[ngood];
+	    pkts[ngood++] = p;
+	}
+    }
+    return ngood;
+}
+#endif /* RX_ENABLE_MMSG */
+
 #endif /* !KERNEL || UKERNEL */
 
 /* This function splits off the first packet in a jumbo packet.
@@ -1841,6 +1939,8 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
     case RX_DEBUGI_GETALLCONN:
     case RX_DEBUGI_GETCONN:{
             unsigned int i, j;
+	    struct rx_connHashShard *shard;
+	    afs_uint32 bucket;
 	    struct rx_connection *tc;
 	    struct rx_call *tcall;
 	    struct rx_debugConn tconn;
@@ -1855,7 +1955,8 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 
 	    memset(&tconn, 0, sizeof(tconn));	/* make sure spares are zero */
 	    /* get N'th (maybe) "interesting" connection info */
-	    for (i = 0; i < rx_hashTableSize; i++) {
+	    for (shard = &rx_connHashShards[0];
+		 shard < &rx_connHashShards[RX_HASH_SHARDS]; shard++) {
 #if !defined(KERNEL)
 		/* the time complexity of the algorithm used here
 		 * exponentially increses with the number of connections.
@@ -1866,11 +1967,14 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 		(void)IOMGR_Poll();
 #endif
 #endif
-		MUTEX_ENTER(&rx_connHashTable_lock);
+		/* The shard lock is held across all of its buckets, so
+		 * that it can't be resized under us. */
+		MUTEX_ENTER(&shard->lock);
+		for (bucket = 0; bucket < shard->nBuckets; bucket++)
 		/* We might be slightly out of step since we are not
 		 * locking each call, but this is only debugging output.
 		 */
-		for (tc = rx_connHashTable[i]; tc; tc = tc->next) {
+		for (tc = shard->buckets[bucket]; tc; tc = tc->next) {
 		    if ((all || rxi_IsConnInteresting(tc))
 			&& tin.index-- <= 0) {
 			tconn.host = tc->peer->host;
@@ -1920,7 +2024,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 				DOHTONL(sparel[i]);
 			}
 
-			MUTEX_EXIT(&rx_connHashTable_lock);
+			MUTEX_EXIT(&shard->lock);
 			rx_packetwrite(ap, 0, sizeof(struct rx_debugConn),
 				       (char *)&tconn);
 			tl = ap->length;
@@ -1931,7 +2035,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 			return ap;
 		    }
 		}
-		MUTEX_EXIT(&rx_connHashTable_lock);
+		MUTEX_EXIT(&shard->lock);
 	    }
 	    /* if we make it here, there are no interesting packets */
 	    tconn.cid = htonl(0xffffffff);	/* means end */
@@ -1949,7 +2053,8 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 	 */
 
     case RX_DEBUGI_GETPEER:{
-	    unsigned int i;
+	    struct rx_peerHashShard *shard;
+	    afs_uint32 bucket;
 	    struct rx_peer *tp;
 	    struct rx_debugPeer tpeer;
 
@@ -1961,16 +2066,16 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 		return ap;
 
 	    memset(&tpeer, 0, sizeof(tpeer));
-	    for (i = 0; i < rx_hashTableSize; i++) {
+	    for (shard = &rx_peerHashShards[0];
+		 shard < &rx_peerHashShards[RX_HASH_SHARDS]; shard++) {
 #if !defined(KERNEL)
 		/* the time complexity of the algorithm used here
 		 * exponentially increses with the number of peers.
 		 *
-		 * Yielding after processing each hash table entry
-		 * and dropping rx_peerHashTable_lock.
-		 * also increases the risk that we will miss a new
-		 * entry - but we are willing to live with this
-		 * limitation since this is meant for debugging only
+		 * Yielding after processing each shard and dropping
+		 * the shard lock also increases the risk that we will
+		 * miss a new entry - but we are willing to live with
+		 * this limitation since this is meant for debugging only
 		 */
 #ifdef AFS_PTHREAD_ENV
 		pthread_yield();
@@ -1978,11 +2083,14 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 		(void)IOMGR_Poll();
 #endif
 #endif
-		MUTEX_ENTER(&rx_peerHashTable_lock);
-		for (tp = rx_peerHashTable[i]; tp; tp = tp->next) {
+		/* held across all of the shard's buckets, so that it can't
+		 * be resized under us */
+		MUTEX_ENTER(&shard->lock);
+		for (bucket = 0; bucket < shard->nBuckets; bucket++)
+		for (tp = shard->buckets[bucket]; tp; tp = tp->next) {
 		    if (tin.index-- <= 0) {
                         tp->refCount++;
-                        MUTEX_EXIT(&rx_peerHashTable_lock);
+                        MUTEX_EXIT(&shard->lock);
 
                         MUTEX_ENTER(&tp->peer_lock);
 			tpeer.host = tp->host;
@@ -2016,9 +2124,9 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 			    htonl(tp->bytesReceived & MAX_AFS_UINT32);
                         MUTEX_EXIT(&tp->peer_lock);
 
-                        MUTEX_ENTER(&rx_peerHashTable_lock);
+                        MUTEX_ENTER(&shard->lock);
                         tp->refCount--;
-			MUTEX_EXIT(&rx_peerHashTable_lock);
+			MUTEX_EXIT(&shard->lock);
 
 			rx_packetwrite(ap, 0, sizeof(struct rx_debugPeer),
 				       (char *)&tpeer);
@@ -2030,7 +2138,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 			return ap;
 		    }
 		}
-		MUTEX_EXIT(&rx_peerHashTable_lock);
+		MUTEX_EXIT(&shard->lock);
 	    }
 	    /* if we make it here, there are no interesting packets */
 	    tpeer.host = htonl(0xffffffff);	/* means end */
@@ -2069,6 +2177,31 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 	    break;
 	}
 
+    case RX_DEBUGI_HASHSTATS:{
+	    int i;
+	    afs_uint32 *s;
+	    struct rx_debugHashStats tstats;
+
+	    tl = sizeof(tstats) - ap->length;
+	    if (tl > 0)
+		tl = rxi_AllocDataBuf(ap, tl, RX_PACKET_CLASS_SEND_CBUF);
+	    if (tl > 0)
+		return ap;
+
+	    rxi_GetHashStats(&tstats);
+
+	    /* Since its all int32s convert to network order with a loop. */
+	    s = (afs_uint32 *) &tstats;
+	    for (i = 0; i < sizeof(tstats) / sizeof(afs_int32); i++, s++)
+		rx_PutInt32(ap, i * sizeof(afs_int32), htonl(*s));
+
+	    tl = ap->length;
+	    ap->length = sizeof(tstats);
+	    rxi_SendDebugPacket(ap, asocket, ahost, aport, istack);
+	    ap->length = tl;
+	    break;
+	}
+
     default:
 	/* error response packet */
 	tin.type = htonl(RX_DEBUGI_BADTYPE);
@@ -2205,6 +2338,173 @@ rxi_NetSendError(struct rx_call *call, int code)
     }
 }
 
+#ifdef RX_ENABLE_MMSG
+/*
+ * Datagrams queued for a single sendmmsg while rxi_SendXmitList runs for
+ * a call.  The iovecs and addresses are copied here, but the packets they
+ * describe are not; they are protected from being freed or rewritten by
+ * the call's RX_CALL_TQ_BUSY flag, which is held until the batch has been
+ * flushed by rxi_EndSendBatch.
+ */
+#define RX_SENDBATCH_MAXPACKETS (RX_MAX_UDP_BATCH * RX_MAX_DGRAM_PACKETS)
+
+struct rx_sendbatch {
+    struct rx_call *call;	/* call being batched, NULL if inactive */
+    osi_socket socket;
+    int nmsgs;
+    int npackets;
+    int error;			/* first send error, for rxi_NetSendError */
+    struct mmsghdr msgs[RX_MAX_UDP_BATCH];
+    struct sockaddr_in addrs[RX_MAX_UDP_BATCH];
+    struct iovec iovs[RX_MAX_UDP_BATCH][RX_MAXIOVECS];
+    int first[RX_MAX_UDP_BATCH];	/* first packet of each datagram */
+    int count[RX_MAX_UDP_BATCH];	/* number of packets in each datagram */
+    struct rx_packet *packets[RX_SENDBATCH_MAXPACKETS];
+};
+
+/* Hand the queued datagrams to the kernel.  This may run without the call
+ * lock, so a send error is only recorded in batch->error; the caller must
+ * pass it to rxi_NetSendError once it holds the lock. */
+static void
+rxi_FlushSendBatch(struct rx_sendbatch *batch)
+{
+    struct rx_packet *p;
+    int i, j, code;
+
+    i = 0;
+    while (i < batch->nmsgs) {
+	code = rxi_Sendmmsg(batch->socket, &batch->msgs[i],
+			    batch->nmsgs - i, 0);
+	if (code > 0) {
+	    if (rx_stats_active) {
+		rx_atomic_inc(&rx_stats.batchSends);
+		rx_atomic_add(&rx_stats.batchSendPackets, code);
+	    }
+	    i += code;
+	    continue;
+	}
+	if (code < 0) {
+	    /* send failed, so let's hurry up the resend, eh? */
+	    if (rx_stats_active)
+		rx_atomic_inc(&rx_stats.netSendFailures);
+	    for (j = 0; j < batch->count[i]; j++) {
+		p = batch->packets[batch->first[i] + j];
+		p->flags &= ~RX_PKTFLAG_SENT;	/* resend it very soon */
+	    }
+	    if (batch->error == 0)
+		batch->error = code;
+	}
+	/* Skip the datagram which failed and carry on with the rest */
+	i++;
+    }
+    batch->nmsgs = 0;
+    batch->npackets = 0;
+}
+
+/* Queue a datagram on the calling thread's send batch, if one is active
+ * for this call.  Returns 1 if the datagram was queued, or 0 if the caller
+ * must send it immediately. */
+static int
+rxi_SendBatchAdd(struct rx_call *call, osi_socket socket,
+		 struct sockaddr_in *addr, struct iovec *iov, int niovecs,
+		 struct rx_packet **list, int len)
+{
+    struct rx_ts_info_t *rx_ts_info;
+    struct rx_sendbatch *batch;
+    struct mmsghdr *msg;
+    int i;
+
+    if (call == NULL || rx_udpBatchSize <= 1)
+	return 0;
+    RX_TS_INFO_GET(rx_ts_info);
+    batch = rx_ts_info->sendbatch;
+    if (batch == NULL || batch->call != call || len > RX_SENDBATCH_MAXPACKETS)
+	return 0;
+
+    if (batch->nmsgs > 0
+	&& (batch->nmsgs >= rx_udpBatchSize || batch->socket != socket
+	    || batch->npackets + len > RX_SENDBATCH_MAXPACKETS)) {
+	/* we hold the call lock here */
+	rxi_FlushSendBatch(batch);
+	if (batch->error) {
+	    rxi_NetSendError(call, batch->error);
+	    batch->error = 0;
+	}
+    }
+
+    i = batch->nmsgs;
+    batch->socket = socket;
+    batch->addrs[i] = *addr;
+    memcpy(batch->iovs[i], iov, niovecs * sizeof(struct iovec));
+    batch->first[i] = batch->npackets;
+    batch->count[i] = len;
+    memcpy(&batch->packets[batch->npackets], list,
+	   len * sizeof(struct rx_packet *));
+    batch->npackets += len;
+
+    msg = &batch->msgs[i];
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_hdr.msg_name = &batch->addrs[i];
+    msg->msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    msg->msg_hdr.msg_iov = batch->iovs[i];
+    msg->msg_hdr.msg_iovlen = niovecs;
+    batch->nmsgs++;
+
+    return 1;
+}
+
+/* Start collecting the datagrams sent for this call by the current thread,
+ * so that they can be handed to the kernel with a single sendmmsg.  Must
+ * be called with the call's transmit queue busy.  Returns NULL if batching
+ * is disabled, or if this thread is already batching. */
+struct rx_sendbatch *
+rxi_BeginSendBatch(struct rx_call *call)
+{
+    struct rx_ts_info_t *rx_ts_info;
+    struct rx_sendbatch *batch;
+
+    if (rx_udpBatchSize <= 1)
+	return NULL;
+
+    RX_TS_INFO_GET(rx_ts_info);
+    batch = rx_ts_info->sendbatch;
+    if (batch == NULL) {
+	batch = calloc(1, sizeof(*batch));
+	if (batch == NULL)
+	    return NULL;
+	rx_ts_info->sendbatch = batch;
+    }
+    if (batch->call != NULL)
+	return NULL;
+
+    batch->call = call;
+    return batch;
+}
+
+/* Send everything queued since rxi_BeginSendBatch.  Must be called with
+ * the call lock held; it is dropped while the datagrams are sent. */
+void
+rxi_EndSendBatch(struct rx_sendbatch *batch)
+{
+    struct rx_call *call = batch->call;
+
+    if (batch->nmsgs > 0) {
+	CALL_HOLD(call, RX_CALL_REFCOUNT_SEND);
+	MUTEX_EXIT(&call->lock);
+	rxi_FlushSendBatch(batch);
+	MUTEX_ENTER(&call->lock);
+	CALL_RELE(call, RX_CALL_REFCOUNT_SEND);
+	if (batch->error) {
+	    rxi_NetSendError(call, batch->error);
+	    batch->error = 0;
+	}
+    }
+    batch->call = NULL;
+}
+#else
+# define rxi_SendBatchAdd(call, socket, addr, iov, niovecs, list, len) 0
+#endif /* RX_ENABLE_MMSG */
+
 /* Send the packet to appropriate destination for the specified
  * call.  The header is first encoded and placed in the packet.
  */
@@ -2309,7 +2609,10 @@ rxi_SendPacket(struct rx_call *call, struct rx_connection *conn,
 	    AFS_GUNLOCK();
 #endif
 #endif
-	if ((code =
+	if (rxi_SendBatchAdd(call, socket, &addr, p->wirevec, p->niovecs,
+			     &p, 1)) {
+	    /* rxi_EndSendBatch will hand this one to the kernel */
+	} else if ((code =
 	     osi_NetSend(socket, &addr, p->wirevec, p->niovecs,
 			 p->length + RX_HEADER_SIZE, istack)) != 0) {
 	    /* send failed, so let's hurry up the resend, eh? */
@@ -2507,7 +2810,10 @@ rxi_SendPacketList(struct rx_call *call, struct rx_connection *conn,
 	if (!istack && waslocked)
 	    AFS_GUNLOCK();
 #endif
-	if ((code =
+	if (rxi_SendBatchAdd(call, socket, &addr, &wirevec[0], len + 1,
+			     list, len)) {
+	    /* rxi_EndSendBatch will hand this one to the kernel */
+	} else if ((code =
 	     osi_NetSend(socket, &addr, &wirevec[0], len + 1, length,
 			 istack)) != 0) {
 	    /* send failed, so let's hurry up the resend, eh? */
@@ -115,6 +115,11 @@ extern afs_int32 rx_GetServerPeers(osi_socket socket, afs_uint32 remoteAddr,
 				   afs_uint32 debugSupportedValues,
 				   struct rx_debugPeer *peer,
 				   afs_uint32 * supportedValues);
+extern afs_int32 rx_GetServerHashStats(osi_socket socket,
+				       afs_uint32 remoteAddr,
+				       afs_uint16 remotePort,
+				       struct rx_debugHashStats *stats,
+				       afs_uint32 * supportedValues);
 extern afs_int32 rx_GetLocalPeers(afs_uint32 peerHost, afs_uint16 peerPort,
 				      struct rx_debugPeer * peerStats);
 extern void shutdown_rx(void);
@@ -240,6 +245,10 @@ extern void rx_SetMaxReceiveWindow(int packets);
 extern void rx_SetMaxSendWindow(int packets);
 extern int rx_GetMinPeerTimeout(void);
 extern void rx_SetMinPeerTimeout(int msecs);
+extern int rx_GetUdpBatchSize(void);
+extern void rx_SetUdpBatchSize(int packets);
+extern int rx_GetListenerThreads(void);
+extern void rx_SetListenerThreads(int threads);
 
 #ifdef KERNEL
 /* rx_kcommon.c */
@@ -59,6 +59,20 @@ afs_kmutex_t event_handler_mutex;
 afs_kcondvar_t rx_listener_cond;
 afs_kmutex_t listener_mutex;
 static int listeners_started = 0;
+
+/*
+ * Sockets which share the port of a primary socket, and listen for it.
+ * New connections arriving on them are matched against the services
+ * registered with the primary socket.
+ *
+ * Protected by listener_mutex
+ */
+struct rx_sharedSocket {
+    struct rx_sharedSocket *next;
+    osi_socket socket;
+    osi_socket primary;
+};
+static struct rx_sharedSocket *rx_sharedSockets = NULL;
 afs_kmutex_t rx_clock_mutex;
 struct clock rxi_clockNow;
 
@@ -199,6 +213,64 @@ rxi_ReScheduleEvents(void)
 }
 
 
+#ifdef RX_ENABLE_MMSG
+/* Loop to listen on a socket, reading up to rx_udpBatchSize packets with
+ * each system call. Return setting *newcallp if this thread should become
+ * a server thread.  */
+static void
+rxi_BatchListenerProc(osi_socket sock, int *tnop, struct rx_call **newcallp)
+{
+    struct rx_packet *pkts[RX_MAX_UDP_BATCH];
+    afs_uint32 hosts[RX_MAX_UDP_BATCH];
+    u_short ports[RX_MAX_UDP_BATCH];
+    int i, n, npackets;
+
+    npackets = rx_udpBatchSize;
+    memset(pkts, 0, sizeof(pkts));
+
+    for (;;) {
+        /* See if a check for additional packets was issued */
+        rx_CheckPackets();
+
+	/*
+	 * Refill the batch, re-using the packets which weren't kept by
+	 * rxi_ReceivePacket last time around
+	 */
+	for (i = 0; i < npackets; i++) {
+	    if (pkts[i]) {
+		rxi_RestoreDataBufs(pkts[i]);
+	    } else if (!(pkts[i] = rxi_AllocPacket(RX_PACKET_CLASS_RECEIVE))) {
+		osi_Panic("rxi_Listener: no packets!");	/* Shouldn't happen */
+	    }
+	}
+
+	n = rxi_ReadPackets(sock, pkts, npackets, hosts, ports);
+	if (n > 0)
+	    clock_NewTime();
+
+	for (i = 0; i < n; i++) {
+	    pkts[i] = rxi_ReceivePacket(pkts[i], sock, hosts[i], ports[i],
+					tnop, newcallp);
+	    if (newcallp && *newcallp) {
+		/* We are about to become a server thread. Hand the rest of
+		 * the batch to rx without offering this thread any more
+		 * calls, and give back the packets we are holding. */
+		for (i++; i < n; i++) {
+		    pkts[i] = rxi_ReceivePacket(pkts[i], sock, hosts[i],
+						ports[i], NULL, NULL);
+		}
+		for (i = 0; i < npackets; i++) {
+		    if (pkts[i])
+			rxi_FreePacket(pkts[i]);
+		}
+		return;
+	    }
+	}
+    }
+    /* NOTREACHED */
+}
+#endif /* RX_ENABLE_MMSG */
+
 /* Loop to listen on a socket. Return setting *newcallp if this
  * thread should become a server thread.  */
 static void
@@ -214,6 +286,13 @@ rxi_ListenerProc(osi_socket sock, int *tnop, struct rx_call **newcallp)
     }
     MUTEX_EXIT(&listener_mutex);
 
+#ifdef RX_ENABLE_MMSG
+    if (rx_udpBatchSize > 1) {
+	rxi_BatchListenerProc(sock, tnop, newcallp);
+	return;
+    }
+#endif
+
     for (;;) {
         /* See if a check for additional packets was issued */
         rx_CheckPackets();
@@ -382,6 +461,48 @@ rxi_Listen(osi_socket sock)
     return 0;
 }
 
+/*
+ * Listen on the specified socket, which shares its port with primary.
+ */
+int
+rxi_ListenShared(osi_socket sock, osi_socket primary)
+{
+    struct rx_sharedSocket *ss;
+
+    ss = osi_Alloc(sizeof(*ss));
+    if (ss == NULL)
+	return -1;
+    ss->socket = sock;
+    ss->primary = primary;
+
+    MUTEX_ENTER(&listener_mutex);
+    ss->next = rx_sharedSockets;
+    rx_sharedSockets = ss;
+    MUTEX_EXIT(&listener_mutex);
+
+    return rxi_Listen(sock);
+}
+
+/*
+ * Return the socket whose port sock shares, or sock itself.
+ */
+osi_socket
+rxi_PrimarySocket(osi_socket sock)
+{
+    struct rx_sharedSocket *ss;
+
+    MUTEX_ENTER(&listener_mutex);
+    for (ss = rx_sharedSockets; ss; ss = ss->next) {
+	if (ss->socket == sock) {
+	    sock = ss->primary;
+	    break;
+	}
+    }
+    MUTEX_EXIT(&listener_mutex);
+
+    return sock;
+}
+
 
 /*
  * Recvmsg.
@@ -442,6 +563,68 @@ rxi_Sendmsg(osi_socket socket, struct msghdr *msg_p, int flags)
     return 0;
 }
 
+#ifdef RX_ENABLE_MMSG
+/*
+ * Recvmmsg. Returns the number of messages received, or -1 on error.
+ */
+int
+rxi_Recvmmsg(osi_socket socket, struct mmsghdr *msgs, unsigned int nmsgs,
+	     int flags)
+{
+    int ret;
+    ret = recvmmsg(socket, msgs, nmsgs, flags, NULL);
+
+#ifdef AFS_RXERRQ_ENV
+    if (ret < 0) {
+	while (rxi_HandleSocketError(socket) > 0)
+	    ;
+    }
+#endif
+
+    return ret;
+}
+
+/*
+ * Sendmmsg. Returns the number of messages sent. If the first message
+ * could not be sent, returns a negative error code as rxi_Sendmsg does, or
+ * zero if the error should be ignored.
+ */
+int
+rxi_Sendmmsg(osi_socket socket, struct mmsghdr *msgs, unsigned int nmsgs,
+	     int flags)
+{
+    int ret;
+    ret = sendmmsg(socket, msgs, nmsgs, flags);
+
+#ifdef AFS_RXERRQ_ENV
+    if (ret < 0) {
+	int err = errno;
+
+	/* draining the error queue may change errno */
+	while (rxi_HandleSocketError(socket) > 0)
+	    ;
+	dpf(("rxi_sendmmsg failed, error %d\n", err));
+	if (err > 0)
+	    return -err;
+	return -1;
+    }
+#else
+    /* linux unfortunately returns ECONNREFUSED if the target port
+     * is no longer in use */
+    /* and EAGAIN if a UDP checksum is incorrect */
+    if (ret == -1 && errno != ECONNREFUSED && errno != EAGAIN) {
+	dpf(("rxi_sendmmsg failed, error %d\n", errno));
+	if (errno > 0)
+	    return -errno;
+	return -1;
+    } else if (ret == -1) {
+	return 0;
+    }
+#endif /* !AFS_RXERRQ_ENV */
+    return ret;
+}
+#endif /* RX_ENABLE_MMSG */
+
 struct rx_ts_info_t * rx_ts_info_init(void) {
     struct rx_ts_info_t * rx_ts_info;
     rx_ts_info = calloc(1, sizeof(rx_ts_info_t));
@@ -74,7 +74,10 @@ struct rx_statisticsAtomic {    /* Atomic version of rx_statistics */
     rx_atomic_t receiveCbufPktAllocFailures;
     rx_atomic_t sendCbufPktAllocFailures;
     rx_atomic_t nBusies;
-    rx_atomic_t spares[4];
+    rx_atomic_t batchReads;
+    rx_atomic_t batchReadPackets;
+    rx_atomic_t batchSends;
+    rx_atomic_t batchSendPackets;
 };
 
 #if defined(RX_ENABLE_LOCKS)
@@ -52,6 +52,11 @@
 #include "rx_packet.h"
 #include "rx_internal.h"
 
+/* Several listeners may share a port, each with its own socket */
+#if defined(AFS_PTHREAD_ENV) && defined(SO_REUSEPORT)
+# define RX_ENABLE_REUSEPORT
+#endif
+
 #ifdef AFS_PTHREAD_ENV
 
 /*
@@ -82,13 +87,13 @@ afs_kmutex_t rx_if_mutex;
 
 
 /*
- * Make a socket for receiving/sending IP packets.  Set it into non-blocking
- * and large buffering modes.  If port isn't specified, the kernel will pick
- * one.  Returns the socket (>= 0) on success.  Returns OSI_NULLSOCKET on
- * failure. Port must be in network byte order.
+ * Make and bind a socket for receiving/sending IP packets, and set it into
+ * large buffering mode.  If reuseport is set, the socket may join a port
+ * which is opened to it by rxi_StartPortListeners.  No listener is started
+ * for the socket.
  */
-osi_socket
-rxi_GetHostUDPSocket(u_int ahost, u_short port)
+static osi_socket
+rxi_MakeUDPSocket(u_int ahost, u_short port, int reuseport)
 {
     int binds, code = 0;
     osi_socket socketFd = OSI_NULLSOCKET;
@@ -136,6 +141,17 @@ rxi_GetHostUDPSocket(u_int ahost, u_short port)
 #ifdef STRUCT_SOCKADDR_HAS_SA_LEN
     taddr.sin_len = sizeof(struct sockaddr_in);
 #endif
+#ifdef RX_ENABLE_REUSEPORT
+    if (reuseport) {
+	int on = 1;
+	if (setsockopt(socketFd, SOL_SOCKET, SO_REUSEPORT, &on,
+		       sizeof(on)) < 0) {
+	    (osi_Msg "%s*WARNING* Unable to set SO_REUSEPORT on socket\n",
+	     name);
+	    goto error;
+	}
+    }
+#endif
 #define MAX_RX_BINDS 10
     for (binds = 0; binds < MAX_RX_BINDS; binds++) {
 	if (binds)
@@ -206,9 +222,6 @@ rxi_GetHostUDPSocket(u_int ahost, u_short port)
 	setsockopt(socketFd, SOL_IP, IP_RECVERR, &recverr, sizeof(recverr));
     }
 #endif
-    if (rxi_Listen(socketFd) < 0) {
-	goto error;
-    }
 
     return socketFd;
 
@@ -224,6 +237,90 @@ rxi_GetHostUDPSocket(u_int ahost, u_short port)
     return OSI_NULLSOCKET;
 }
 
+#ifdef RX_ENABLE_REUSEPORT
+/*
+ * Start rx_listenerThreads - 1 more listeners for the port that asocket is
+ * bound to, each with its own socket.  The kernel hashes every peer onto
+ * one of the sockets sharing the port, so each connection is always
+ * received by the same listener.  Packets may be sent on any of them.
+ *
+ * asocket was bound without SO_REUSEPORT, so the port was free, and it
+ * is only opened to SO_REUSEPORT sockets of the same user once it is ours.
+ * Every rx server binds its first socket without SO_REUSEPORT, so another
+ * fileserver or volserver on the port still fails to bind, as it did with
+ * a single listener.  The option has to stay set on all the sockets, as
+ * the kernel only spreads packets between sockets which have it.
+ */
+static void
+rxi_StartPortListeners(osi_socket asocket, u_int ahost)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    osi_socket socketFd;
+    int i, on = 1;
+
+    if (getsockname(asocket, (struct sockaddr *)&addr, &addrlen) != 0) {
+	(osi_Msg "rxi_StartPortListeners: getsockname failed\n");
+	return;
+    }
+    if (setsockopt(asocket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+	(osi_Msg "rxi_StartPortListeners: *WARNING* unable to share port "
+	 "%d; using one listener\n", ntohs(addr.sin_port));
+	return;
+    }
+
+    for (i = 1; i < rx_listenerThreads; i++) {
+	socketFd = rxi_MakeUDPSocket(ahost, addr.sin_port, 1);
+	if (socketFd == OSI_NULLSOCKET)
+	    break;
+	if (rxi_ListenShared(socketFd, asocket) < 0) {
+	    close(socketFd);
+	    break;
+	}
+    }
+    if (i < rx_listenerThreads) {
+	(osi_Msg "rxi_StartPortListeners: *WARNING* only started %d of "
+	 "%d listeners for port %d\n", i, rx_listenerThreads,
+	 ntohs(addr.sin_port));
+    }
+}
+#endif
+
+/*
+ * Make a socket for receiving/sending IP packets, and start listening on
+ * it.  If more than one listener thread has been requested, additional
+ * sockets sharing the same port are made, each with its own listener.  If
+ * port isn't specified, the kernel will pick one.  Returns the socket
+ * (>= 0) on success.  Returns OSI_NULLSOCKET on failure. Port must be in
+ * network byte order.
+ */
+osi_socket
+rxi_GetHostUDPSocket(u_int ahost, u_short port)
+{
+    osi_socket socketFd;
+
+    /* bound exclusively; see rxi_StartPortListeners */
+    socketFd = rxi_MakeUDPSocket(ahost, port, 0);
+    if (socketFd == OSI_NULLSOCKET)
+	return OSI_NULLSOCKET;
+
+    if (rxi_Listen(socketFd) < 0) {
+#ifdef AFS_NT40_ENV
+	closesocket(socketFd);
+#else
+	close(socketFd);
+#endif
+	return OSI_NULLSOCKET;
+    }
+
+#ifdef RX_ENABLE_REUSEPORT
+    if (rx_listenerThreads > 1)
+	rxi_StartPortListeners(socketFd, ahost);
+#endif
+
+    return socketFd;
+}
+
 osi_socket
 rxi_GetUDPSocket(u_short port)
 {
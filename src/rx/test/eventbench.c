@@ -0,0 +1,217 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Microbenchmark for the rx event scheduler.
+ *
+ * Simulates the timer traffic of a busy server: every call has a resend
+ * timer which is almost always cancelled and reposted before it fires,
+ * and the event thread periodically runs whatever has expired.
+ *
+ * The same workload is run against rx_event.c, and against the red/black
+ * tree scheduler it replaced (rx_event_rbtree.c, with its entry points
+ * renamed to rbevent_*), and the ns/op of each is reported.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <pthread.h>
+
+#include <rx/rx_clock.h>
+#include <rx/rx_event.h>
+
+static int nCalls = 10000;
+static int nOps = 2000000;
+static int nThreads = 1;
+static int raiseEvery = 1000;
+
+static volatile int fired;
+
+/* The red/black tree scheduler, from rx_event_rbtree.c */
+extern void rbevent_Init(int nEvents, void (*scheduler)(void));
+extern struct rxevent *rbevent_Post(struct clock *when, struct clock *now,
+				    void (*func) (struct rxevent *, void *,
+						  void *, int),
+				    void *arg, void *arg1, int arg2);
+extern int rbevent_Cancel(struct rxevent **);
+extern int rbevent_RaiseEvents(struct clock *wait);
+
+struct scheduler {
+    char *name;
+    void (*init)(int, void (*)(void));
+    struct rxevent *(*post)(struct clock *, struct clock *,
+			    void (*)(struct rxevent *, void *, void *, int),
+			    void *, void *, int);
+    int (*cancel)(struct rxevent **);
+    int (*raise)(struct clock *);
+};
+
+static struct scheduler schedulers[] = {
+    { "wheel", rxevent_Init, rxevent_Post, rxevent_Cancel,
+      rxevent_RaiseEvents },
+    { "rbtree", rbevent_Init, rbevent_Post, rbevent_Cancel,
+      rbevent_RaiseEvents },
+};
+#define NSCHEDULERS (sizeof(schedulers) / sizeof(schedulers[0]))
+
+static struct scheduler *sched;
+
+static void
+fire(struct rxevent *event, void *arg, void *arg1, int arg2)
+{
+    /* The caller's reference is dropped when the slot is next reused */
+    fired++;
+}
+
+struct worker {
+    pthread_t thread;
+    int first;
+    int count;
+    int ops;
+    unsigned int seed;
+};
+
+static void **slots;
+
+static void *
+runWorker(void *arg)
+{
+    struct worker *w = arg;
+    struct clock now, when;
+    struct rxevent *ev;
+    int i, n;
+
+    for (i = 0; i < w->ops; i++) {
+	n = w->first + (rand_r(&w->seed) % w->count);
+	clock_GetTime(&now);
+	when = now;
+	/* Resend timers are mostly a few hundred milliseconds out, with a
+	 * tail of keepalive and idle timers several seconds away */
+	if (rand_r(&w->seed) % 10 == 0)
+	    clock_Addmsec(&when, 1000 + rand_r(&w->seed) % 60000);
+	else
+	    clock_Addmsec(&when, 1 + rand_r(&w->seed) % 500);
+
+	ev = slots[n];
+	if (ev != NULL)
+	    (*sched->cancel)(&ev);
+	slots[n] = (*sched->post)(&when, &now, fire, &slots[n], NULL, 0);
+
+	if (w->first == 0 && i % raiseEvery == 0) {
+	    struct clock wait;
+	    (*sched->raise)(&wait);
+	}
+    }
+    return NULL;
+}
+
+static double
+runBench(void)
+{
+    struct worker *workers;
+    struct clock start, end;
+    int i, per;
+
+    slots = calloc(nCalls, sizeof(void *));
+    workers = calloc(nThreads, sizeof(struct worker));
+    per = nCalls / nThreads;
+    fired = 0;
+
+    clock_GetTime(&start);
+    for (i = 0; i < nThreads; i++) {
+	workers[i].first = i * per;
+	workers[i].count = per;
+	workers[i].ops = nOps / nThreads;
+	workers[i].seed = i + 1;
+	pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]);
+    }
+    for (i = 0; i < nThreads; i++)
+	pthread_join(workers[i].thread, NULL);
+    clock_GetTime(&end);
+
+    for (i = 0; i < nCalls; i++) {
+	struct rxevent *ev = slots[i];
+
+	if (ev == NULL)
+	    continue;
+	(*sched->cancel)(&ev);
+    }
+    free(slots);
+    free(workers);
+
+    clock_Sub(&end, &start);
+    return end.sec + end.usec / 1000000.0;
+}
+
+static void
+usage(char *progname)
+{
+    fprintf(stderr,
+	    "usage: %s [-c calls] [-o operations] [-t threads] [-r raise] "
+	    "[-s wheel|rbtree]\n", progname);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    double elapsed;
+    char *only = NULL;
+    int ch, i;
+
+    while ((ch = getopt(argc, argv, "c:o:t:r:s:")) != -1) {
+	switch (ch) {
+	case 'c':
+	    nCalls = atoi(optarg);
+	    break;
+	case 'o':
+	    nOps = atoi(optarg);
+	    break;
+	case 't':
+	    nThreads = atoi(optarg);
+	    break;
+	case 'r':
+	    raiseEvery = atoi(optarg);
+	    break;
+	case 's':
+	    only = optarg;
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (nCalls < 1 || nOps < 1 || nThreads < 1 || nThreads > nCalls
+	|| raiseEvery < 1)
+	usage(argv[0]);
+
+    if (only != NULL) {
+	for (i = 0; i < NSCHEDULERS; i++)
+	    if (strcmp(only, schedulers[i].name) == 0)
+		break;
+	if (i == NSCHEDULERS)
+	    usage(argv[0]);
+    }
+
+    for (i = 0; i < NSCHEDULERS; i++) {
+	if (only != NULL && strcmp(only, schedulers[i].name) != 0)
+	    continue;
+	sched = &schedulers[i];
+	(*sched->init)(100, NULL);
+
+	elapsed = runBench();
+	printf("%-6s: %d ops over %d calls in %d threads: %.3f sec "
+	       "(%.0f ns/op, %d fired)\n", sched->name, nOps, nCalls,
+	       nThreads, elapsed, elapsed * 1e9 / nOps, fired);
+    }
+
+    return 0;
+}
@@ -51,6 +51,25 @@ PortName(char *aname)
     return ts->s_port;		/* returns it in network byte order */
 }
 
+static void
+PrintHashTable(char *name, struct rx_debugHashTable *table)
+{
+    static char *bins[RX_DEBUG_HASH_CHAINS] =
+	{ "0", "1", "2", "3-4", "5-8", "9-16", "17-32", "33+" };
+    int i;
+
+    printf("%s hash table: %u entries in %u buckets, longest chain %u, "
+	   "%u resizes\n", name, table->nEntries, table->nBuckets,
+	   table->maxChain, table->grows);
+    printf("\tchain length:");
+    for (i = 0; i < RX_DEBUG_HASH_CHAINS; i++)
+	printf(" %6s", bins[i]);
+    printf("\n\tbuckets:     ");
+    for (i = 0; i < RX_DEBUG_HASH_CHAINS; i++)
+	printf(" %6u", table->chains[i]);
+    printf("\n");
+}
+
 int
 MainCommand(struct cmd_syndesc *as, void *arock)
 {
@@ -80,6 +99,7 @@ MainCommand(struct cmd_syndesc *as, void *arock)
     int withWaited;
     int withPeers;
     int withPackets;
+    int withHashStats;
     struct rx_debugStats tstats;
     char *portName, *hostName;
     char hoststr[20];
@@ -87,6 +107,7 @@ MainCommand(struct cmd_syndesc *as, void *arock)
     short noConns;
     short showPeers;
     short showLong;
+    short hashStats;
     int version_flag;
     char version[64];
     afs_int32 length = 64;
@@ -107,6 +128,7 @@ MainCommand(struct cmd_syndesc *as, void *arock)
     noConns = (as->parms[11].items ? 1 : 0);
     showPeers = (as->parms[12].items ? 1 : 0);
     showLong = (as->parms[13].items ? 1 : 0);
+    hashStats = (as->parms[14].items ? 1 : 0);
 
     if (as->parms[0].items)
 	hostName = as->parms[0].items->data;
@@ -244,6 +266,7 @@ MainCommand(struct cmd_syndesc *as, void *arock)
     withWaited = (supportedDebugValues & RX_SERVER_DEBUG_WAITED_CNT);
     withPeers = (supportedDebugValues & RX_SERVER_DEBUG_ALL_PEER);
     withPackets = (supportedDebugValues & RX_SERVER_DEBUG_PACKETS_CNT);
+    withHashStats = (supportedDebugValues & RX_SERVER_DEBUG_HASH_STATS);
 
     if (withPackets)
         printf("Free packets: %d/%d, packet reclaims: %d, calls: %d, used FDs: %d\n",
@@ -296,6 +319,25 @@ MainCommand(struct cmd_syndesc *as, void *arock)
 	}
     }
 
+    if (hashStats) {
+	if (!withHashStats) {
+	    fprintf(stderr,
+		    "WARNING: Server doesn't support retrieval of hash table statistics\n");
+	} else {
+	    struct rx_debugHashStats thash;
+	    afs_uint32 supportedHashValues = 0;
+
+	    code = rx_GetServerHashStats(s, host, port, &thash,
+					 &supportedHashValues);
+	    if (code < 0) {
+		printf("hashstats call failed with code %d\n", code);
+		exit(1);
+	    }
+	    PrintHashTable("Connection", &thash.conns);
+	    PrintHashTable("Peer", &thash.peers);
+	}
+    }
+
     if (!noConns) {
 	if (allconns) {
 	    if (!withAllConn)
@@ -624,6 +666,8 @@ main(int argc, char **argv)
 		"show no connections");
     cmd_AddParm(ts, "-peers", CMD_FLAG, CMD_OPTIONAL, "show peers");
     cmd_AddParm(ts, "-long", CMD_FLAG, CMD_OPTIONAL, "detailed output");
+    cmd_AddParm(ts, "-chains", CMD_FLAG, CMD_OPTIONAL,
+		"show connection and peer hash chain statistics");
 
     cmd_Dispatch(argc, argv);
     exit(0);
@@ -869,7 +869,7 @@ rxperf_server(int argc, char **argv)
     char *ptr;
     int ch;
 
-    while ((ch = getopt(argc, argv, "r:d:p:P:w:W:HNjm:u:4:s:S:V")) != -1) {
+    while ((ch = getopt(argc, argv, "r:d:p:P:w:W:HNjm:u:4:s:S:VB:L:")) != -1) {
 	switch (ch) {
 	case 'd':
 #ifdef RXDEBUG
@@ -935,6 +935,16 @@ rxperf_server(int argc, char **argv)
 	    if (ptr && *ptr != '\0')
 		errx(1, "can't resolve upd buffer size (Kbytes)");
 	    break;
+	case 'B':
+	    rx_SetUdpBatchSize(strtol(optarg, &ptr, 0));
+	    if (ptr && *ptr != '\0')
+		errx(1, "can't resolve udp batch size (packets)");
+	    break;
+	case 'L':
+	    rx_SetListenerThreads(strtol(optarg, &ptr, 0));
+	    if (ptr && *ptr != '\0')
+		errx(1, "can't resolve number of listener threads");
+	    break;
 	case 'V':
 	    use_rx_readv = 1;
 	    break;
@@ -989,7 +999,7 @@ rxperf_client(int argc, char **argv)
 
     cmd = RX_PERF_UNKNOWN;
 
-    while ((ch = getopt(argc, argv, "T:S:R:b:c:d:p:P:r:s:w:W:f:HDNjm:u:4:t:V")) != -1) {
+    while ((ch = getopt(argc, argv, "T:S:R:b:c:d:p:P:r:s:w:W:f:HDNjm:u:4:t:VB:")) != -1) {
 	switch (ch) {
 	case 'b':
 	    bytes = strtol(optarg, &ptr, 0);
@@ -1107,6 +1117,11 @@ rxperf_client(int argc, char **argv)
 	    if (ptr && *ptr != '\0')
 		errx(1, "can't resolve upd buffer size (Kbytes)");
 	    break;
+	case 'B':
+	    rx_SetUdpBatchSize(strtol(optarg, &ptr, 0));
+	    if (ptr && *ptr != '\0')
+		errx(1, "can't resolve udp batch size (packets)");
+	    break;
 	case '4':
 	  RX_IPUDP_SIZE = 28;
 	  break;
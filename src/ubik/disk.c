@@ -12,6 +12,7 @@
 
 #include <roken.h>
 #include <afs/opr.h>
+#include <opr/jhash.h>
 
 #ifdef AFS_PTHREAD_ENV
 # include <opr/lock.h>
@@ -24,7 +25,12 @@
 #include "ubik.h"
 #include "ubik_int.h"
 
-#define	PHSIZE	128
+/*
+ * The page hash table is sized to the number of buffers, so that a large
+ * cache doesn't mean long chains.  Dirty buffers are also kept on a list of
+ * their own, so that committing or aborting a transaction takes time in
+ * proportion to the pages it changed, not to the size of the cache.
+ */
 static struct buffer {
     struct ubik_dbase *dbase;	/*!< dbase within which the buffer resides */
     afs_int32 file;		/*!< Unique cache key */
@@ -32,24 +38,69 @@ static struct buffer {
     struct buffer *lru_next;
     struct buffer *lru_prev;
     struct buffer *hashNext;	/*!< next dude in hash table */
+    struct buffer *dirtyNext;	/*!< next dude on the dirty list */
     char *data;			/*!< ptr to the data */
     char lockers;		/*!< usage ref count */
     char dirty;			/*!< is buffer modified */
-    char hashIndex;		/*!< back ptr to hash table */
+    char readAhead;		/*!< read ahead, and not asked for since */
+    int hashIndex;		/*!< back ptr to hash table */
 } *Buffers;
 
-#define pHash(page) ((page) & (PHSIZE-1))
+#define pHash(fid, page) (opr_jhash_int2((fid), (page), 0) & (phSize - 1))
 
 afs_int32 ubik_nBuffers = NBUFFERS;
-static struct buffer *phTable[PHSIZE];	/*!< page hash table */
+static struct buffer **phTable;	/*!< page hash table */
+static int phSize;		/*!< buckets in phTable, a power of 2 */
+static struct buffer *DirtyList;	/*!< dirty buffers */
 static struct buffer *LruBuffer;
 static int nbuffers;
 static int calls = 0, ios = 0, lastb = 0;
+static int hits = 0, raPages = 0, raHits = 0;
 static char *BufferData;
 static struct buffer *newslot(struct ubik_dbase *adbase, afs_int32 afid,
 			      afs_int32 apage);
 #define	BADFID	    0xffffffff
 
+/*
+ * Read-ahead.  A miss on the page just after the last one asked for in
+ * the same file is taken to be part of a sequential scan, such as the
+ * vlserver's ListEntry or the ptserver's ListEntries, and reads the page
+ * and the ones after it in a single call.  The window doubles with each
+ * sequential miss, up to UBIK_READAHEAD pages or an eighth of the cache.
+ */
+#define UBIK_READAHEAD	32
+static struct {
+    struct ubik_dbase *dbase;
+    afs_int32 file;
+    afs_int32 next;		/*!< page a sequential scan asks for next */
+    int window;			/*!< pages to read on a sequential miss */
+} readAhead;
+static char *ReadAheadData;
+
+/*
+ * Snapshots.  A read transaction begun with ubik_BeginTransReadAnyWrite()
+ * takes no ubik lock, so writers may commit while it runs.  It reads the
+ * dbase as it was after the first \p snapshot commits made since startup.
+ * Before a write transaction first changes a page, and before a commit
+ * truncates one away, the committed contents are kept here, tagged with the
+ * number of the commit that replaces them; they are freed once no
+ * transaction can want them.  Pages of the write transaction in progress
+ * are never freed, since a reader may begin before it commits.
+ */
+struct snapPage {
+    struct snapPage *hashNext;	/*!< next dude in snapTable */
+    struct snapPage *next;	/*!< next dude in commit order */
+    struct ubik_dbase *dbase;
+    afs_int32 file;
+    afs_int32 page;
+    afs_int32 seq;		/*!< commit which replaced this data */
+    char data[UBIK_PAGESIZE];
+};
+static struct snapPage **snapTable;	/*!< snapshot pages, hashed by pHash */
+static struct snapPage *snapHead, *snapTail;
+static afs_int32 commitSeq;	/*!< write trans committed since startup */
+static int snapPages;
+
 static int DTrunc(struct ubik_trans *atrans, afs_int32 fid, afs_int32 length);
 
 static struct ubik_trunc *freeTruncList = 0;
@@ -95,6 +146,26 @@ udisk_Debug(struct ubik_debug *aparm)
     }
 }
 
+/*!
+ * \brief page cache statistics
+ */
+void
+udisk_CacheDebug(struct ubik_cachedebug *aparm)
+{
+    struct buffer *tb;
+
+    memset(aparm, 0, sizeof(*aparm));
+    aparm->buffers = nbuffers;
+    aparm->lookups = calls;
+    aparm->hits = hits;
+    aparm->reads = ios;
+    aparm->readAheadPages = raPages;
+    aparm->readAheadHits = raHits;
+    aparm->snapshotPages = snapPages;
+    for (tb = DirtyList; tb; tb = tb->dirtyNext)
+	aparm->dirtyPages++;
+}
+
 /*!
  * \brief Write an opcode to the log.
  *
@@ -245,9 +316,16 @@ udisk_Init(int abuffers)
     struct buffer *tb;
     Buffers = calloc(abuffers, sizeof(struct buffer));
     BufferData = malloc(abuffers * UBIK_PAGESIZE);
+    ReadAheadData = malloc(UBIK_READAHEAD * UBIK_PAGESIZE);
     nbuffers = abuffers;
-    for (i = 0; i < PHSIZE; i++)
-	phTable[i] = 0;
+    for (phSize = 128; phSize < abuffers; phSize <<= 1)
+	;
+    phTable = calloc(phSize, sizeof(struct buffer *));
+    snapTable = calloc(phSize, sizeof(struct snapPage *));
+    if (Buffers == NULL || BufferData == NULL || ReadAheadData == NULL
+	|| phTable == NULL || snapTable == NULL)
+	return UNOMEM;
+    DirtyList = NULL;
     for (i = 0; i < abuffers; i++) {
 	/* Fill in each buffer with an empty indication. */
 	tb = &Buffers[i];
@@ -328,6 +406,74 @@ MatchBuffer(struct buffer *buf, int page, afs_int32 fid,
     return 1;
 }
 
+/*!
+ * \brief Take a reference on a buffer found in the cache.
+ */
+static_inline char *
+DHit(struct buffer *tb)
+{
+    hits++;
+    if (tb->readAhead) {
+	tb->readAhead = 0;
+	raHits++;
+    }
+    tb->lockers++;
+    return tb->data;
+}
+
+/*!
+ * \brief Is any version of a page in the cache?
+ */
+static int
+DCached(struct ubik_dbase *dbase, afs_int32 fid, int page)
+{
+    struct buffer *tb;
+
+    for (tb = phTable[pHash(fid, page)]; tb; tb = tb->hashNext) {
+	if (tb->page == page && tb->file == fid && tb->dbase == dbase)
+	    return 1;
+    }
+    return 0;
+}
+
+/*!
+ * \brief Read a page into a new buffer, along with up to \p npages - 1 of
+ * the pages after it which are not in the cache yet.
+ *
+ * \return the number of bytes read, or a negative value on error
+ */
+static int
+DReadAhead(struct ubik_dbase *dbase, afs_int32 fid, int page, int npages,
+	   struct buffer *abuf)
+{
+    struct buffer *tb;
+    int i, code;
+
+    memset(ReadAheadData, 0, npages * UBIK_PAGESIZE);
+    code =
+	(*dbase->read) (dbase, fid, ReadAheadData, page * UBIK_PAGESIZE,
+			npages * UBIK_PAGESIZE);
+    if (code < 0)
+	return code;
+    memcpy(abuf->data, ReadAheadData, UBIK_PAGESIZE);
+
+    /* only pages the read reached; DRead handles any past the end */
+    for (i = 1; i < npages && i * UBIK_PAGESIZE < code; i++) {
+	if (DCached(dbase, fid, page + i))
+	    continue;
+	/* never force newslot to hunt for room, or to complain */
+	if (LruBuffer->lockers || LruBuffer->dirty)
+	    break;
+	tb = newslot(dbase, fid, page + i);
+	if (!tb)
+	    break;
+	memcpy(tb->data, ReadAheadData + i * UBIK_PAGESIZE, UBIK_PAGESIZE);
+	tb->readAhead = 1;
+	raPages++;
+    }
+    return code;
+}
+
 /*!
  * \brief Get a pointer to a particular buffer.
  */
@@ -338,19 +484,22 @@ DRead(struct ubik_trans *atrans, afs_int32 fid, int page)
     struct buffer *tb, *lastbuffer, *found_tb = NULL;
     afs_int32 code;
     struct ubik_dbase *dbase = atrans->dbase;
+    int sequential;
 
     calls++;
+    sequential = (page == readAhead.next && fid == readAhead.file
+		  && dbase == readAhead.dbase);
+    if (sequential)
+	readAhead.next++;
     lastbuffer = LruBuffer->lru_prev;
 
     /* Skip for write transactions for a clean page - this may not be the right page to use */
     if (MatchBuffer(lastbuffer, page, fid, atrans)
 		&& (atrans->type == UBIK_READTRANS || lastbuffer->dirty)) {
-	tb = lastbuffer;
-	tb->lockers++;
 	lastb++;
-	return tb->data;
+	return DHit(lastbuffer);
     }
-    for (tb = phTable[pHash(page)]; tb; tb = tb->hashNext) {
+    for (tb = phTable[pHash(fid, page)]; tb; tb = tb->hashNext) {
 	if (MatchBuffer(tb, page, fid, atrans)) {
 	    if (tb->dirty || atrans->type == UBIK_READTRANS) {
 		found_tb = tb;
@@ -363,20 +512,32 @@ DRead(struct ubik_trans *atrans, afs_int32 fid, int page)
     /* For a write transaction, use a matching clean page if no dirty one was found */
     if (found_tb) {
 	Dmru(found_tb);
-	found_tb->lockers++;
-	return found_tb->data;
+	return DHit(found_tb);
     }
 
     /* can't find it */
+    if (!sequential) {
+	readAhead.dbase = dbase;
+	readAhead.file = fid;
+	readAhead.next = page + 1;
+	readAhead.window = 1;
+    } else if (readAhead.window < UBIK_READAHEAD
+	       && 16 * readAhead.window <= nbuffers) {
+	readAhead.window *= 2;
+    }
     tb = newslot(dbase, fid, page);
     if (!tb)
 	return 0;
-    memset(tb->data, 0, UBIK_PAGESIZE);
 
     tb->lockers++;
-    code =
-	(*dbase->read) (dbase, fid, tb->data, page * UBIK_PAGESIZE,
-			UBIK_PAGESIZE);
+    if (sequential && readAhead.window > 1) {
+	code = DReadAhead(dbase, fid, page, readAhead.window, tb);
+    } else {
+	memset(tb->data, 0, UBIK_PAGESIZE);
+	code =
+	    (*dbase->read) (dbase, fid, tb->data, page * UBIK_PAGESIZE,
+			    UBIK_PAGESIZE);
+    }
     if (code < 0) {
 	tb->file = BADFID;
 	Dlru(tb);
@@ -482,6 +643,194 @@ DoTruncs(struct ubik_trans *atrans)
     return (rcode);
 }
 
+/*!
+ * \brief Find the oldest snapshot still being read.
+ *
+ * \return the number of transactions reading snapshots
+ */
+static int
+SnapReaders(struct ubik_dbase *adbase, afs_int32 *aoldest)
+{
+    struct ubik_trans *tt;
+    int n = 0;
+
+    for (tt = adbase->activeTrans; tt; tt = tt->next) {
+	if (!(tt->flags & TRREADWRITE) || (tt->flags & TRDONE))
+	    continue;
+	if (n == 0 || tt->snapshot < *aoldest)
+	    *aoldest = tt->snapshot;
+	n++;
+    }
+    return n;
+}
+
+static void
+SnapUnhash(struct snapPage *sp)
+{
+    struct snapPage **lp;
+
+    for (lp = &snapTable[pHash(sp->file, sp->page)]; *lp;
+	 lp = &(*lp)->hashNext) {
+	if (*lp == sp) {
+	    *lp = sp->hashNext;
+	    break;
+	}
+    }
+    snapPages--;
+}
+
+/*!
+ * \brief Free the snapshot pages which no transaction can read any more.
+ */
+static void
+SnapTrim(struct ubik_dbase *adbase)
+{
+    struct snapPage *sp;
+    afs_int32 oldest = 0;
+    int readers;
+
+    readers = SnapReaders(adbase, &oldest);
+    while ((sp = snapHead) != NULL && sp->seq <= commitSeq
+	   && (!readers || sp->seq <= oldest)) {
+	snapHead = sp->next;
+	SnapUnhash(sp);
+	free(sp);
+    }
+    if (snapHead == NULL)
+	snapTail = NULL;
+}
+
+/*!
+ * \brief Find a page as it was in the snapshot \p atrans is reading.
+ *
+ * \return NULL if the page hasn't been replaced since
+ */
+static char *
+SnapFind(struct ubik_trans *atrans, afs_int32 afile, afs_int32 apage)
+{
+    struct snapPage *sp, *found = NULL;
+
+    for (sp = snapTable[pHash(afile, apage)]; sp; sp = sp->hashNext) {
+	if (sp->page == apage && sp->file == afile
+	    && sp->dbase == atrans->dbase && sp->seq > atrans->snapshot
+	    && (found == NULL || sp->seq < found->seq))
+	    found = sp;
+    }
+    return found ? found->data : NULL;
+}
+
+/*!
+ * \brief Keep the committed contents of a page the write trans in progress
+ * is about to replace.
+ */
+static int
+SnapSave(struct ubik_dbase *adbase, afs_int32 afile, afs_int32 apage)
+{
+    struct snapPage *sp;
+    struct buffer *tb;
+    afs_int32 seq = commitSeq + 1;
+    int code;
+
+    for (sp = snapTable[pHash(afile, apage)]; sp; sp = sp->hashNext) {
+	if (sp->page == apage && sp->file == afile && sp->dbase == adbase
+	    && sp->seq == seq)
+	    return 0;		/* already kept */
+    }
+    sp = malloc(sizeof(struct snapPage));
+    if (sp == NULL)
+	return UNOMEM;
+
+    /* a clean copy in the cache holds the committed contents */
+    for (tb = phTable[pHash(afile, apage)]; tb; tb = tb->hashNext) {
+	if (tb->page == apage && tb->file == afile && tb->dbase == adbase
+	    && !tb->dirty)
+	    break;
+    }
+    if (tb) {
+	memcpy(sp->data, tb->data, UBIK_PAGESIZE);
+    } else {
+	memset(sp->data, 0, UBIK_PAGESIZE);
+	code =
+	    (*adbase->read) (adbase, afile, sp->data, apage * UBIK_PAGESIZE,
+			     UBIK_PAGESIZE);
+	if (code < 0) {
+	    free(sp);
+	    return UIOERROR;
+	}
+    }
+    sp->dbase = adbase;
+    sp->file = afile;
+    sp->page = apage;
+    sp->seq = seq;
+    sp->hashNext = snapTable[pHash(afile, apage)];
+    snapTable[pHash(afile, apage)] = sp;
+    sp->next = NULL;
+    if (snapTail)
+	snapTail->next = sp;
+    else
+	snapHead = sp;
+    snapTail = sp;
+    snapPages++;
+    return 0;
+}
+
+/*!
+ * \brief Keep every page \p atrans is about to truncate away, if any
+ * snapshot reader might still want it.
+ *
+ * Pages it changed were kept by udisk_write().
+ */
+static int
+SnapCommit(struct ubik_trans *atrans)
+{
+    struct ubik_dbase *dbase = atrans->dbase;
+    struct ubik_trunc *tt;
+    struct ubik_stat ustat;
+    afs_int32 oldest, page, end;
+    int code;
+
+    if (!SnapReaders(dbase, &oldest))
+	return 0;
+    for (tt = atrans->activeTruncs; tt; tt = tt->next) {
+	code = (*dbase->stat) (dbase, tt->file, &ustat);
+	if (code < 0)
+	    return UIOERROR;
+	end = (ustat.size + UBIK_PAGESIZE - 1) >> UBIK_LOGPAGESIZE;
+	for (page = tt->length >> UBIK_LOGPAGESIZE; page < end; page++) {
+	    code = SnapSave(dbase, tt->file, page);
+	    if (code)
+		return code;
+	}
+    }
+    return 0;
+}
+
+/*!
+ * \brief Abort the snapshot readers; used when their snapshot can't be kept.
+ */
+static void
+SnapAbort(struct ubik_dbase *adbase)
+{
+    struct ubik_trans *tt;
+
+    for (tt = adbase->activeTrans; tt; tt = tt->next) {
+	if ((tt->flags & TRREADWRITE) && !(tt->flags & TRDONE))
+	    udisk_abort(tt);
+    }
+}
+
+/*!
+ * \brief Move the snapshot read by \p atrans up to the latest commit.
+ *
+ * ubik_CheckCache() calls this once it holds the application cache, so that
+ * the transaction reads the same version of the dbase as the cache holds.
+ */
+void
+udisk_Snapshot(struct ubik_trans *atrans)
+{
+    atrans->snapshot = commitSeq;
+}
+
 /*!
  * \brief Mark an \p fid as invalid.
  */
@@ -489,8 +838,22 @@ int
 udisk_Invalidate(struct ubik_dbase *adbase, afs_int32 afid)
 {
     struct buffer *tb;
+    struct snapPage *sp, **lp;
     int i;
 
+    /* the file was replaced, so any snapshot of it is gone too */
+    snapTail = NULL;
+    for (lp = &snapHead; (sp = *lp) != NULL;) {
+	if (sp->file == afid && sp->dbase == adbase) {
+	    *lp = sp->next;
+	    SnapUnhash(sp);
+	    free(sp);
+	} else {
+	    snapTail = sp;
+	    lp = &sp->next;
+	}
+    }
+
     for (i = 0, tb = Buffers; i < nbuffers; i++, tb++) {
 	if (tb->file == afid) {
 	    tb->file = BADFID;
@@ -519,7 +882,7 @@ FixupBucket(struct buffer *ap)
 	lp = &tp->hashNext;
     }
     /* now figure the new hash bucket */
-    i = pHash(ap->page);
+    i = pHash(ap->file, ap->page);
     ap->hashIndex = i;		/* remember where we are for deletion */
     ap->hashNext = phTable[i];	/* add us to the list */
     phTable[i] = ap;
@@ -554,6 +917,7 @@ newslot(struct ubik_dbase *adbase, afs_int32 afid, afs_int32 apage)
     pp->dbase = adbase;
     pp->file = afid;
     pp->page = apage;
+    pp->readAhead = 0;
 
     FixupBucket(pp);		/* move to the right hash bucket */
     Dmru(pp);
@@ -574,8 +938,11 @@ DRelease(char *ap, int flag)
     index = (int)(ap - (char *)BufferData) >> UBIK_LOGPAGESIZE;
     bp = &(Buffers[index]);
     bp->lockers--;
-    if (flag)
+    if (flag && !bp->dirty) {
 	bp->dirty = 1;
+	bp->dirtyNext = DirtyList;
+	DirtyList = bp;
+    }
     return;
 }
 
@@ -591,21 +958,17 @@ DRelease(char *ap, int flag)
 static int
 DFlush(struct ubik_trans *atrans)
 {
-    int i;
     afs_int32 code;
     struct buffer *tb;
     struct ubik_dbase *adbase = atrans->dbase;
 
-    tb = Buffers;
-    for (i = 0; i < nbuffers; i++, tb++) {
-	if (tb->dirty) {
-	    code = tb->page * UBIK_PAGESIZE;	/* offset within file */
-	    code =
-		(*adbase->write) (adbase, tb->file, tb->data, code,
-				  UBIK_PAGESIZE);
-	    if (code != UBIK_PAGESIZE)
-		return UIOERROR;
-	}
+    for (tb = DirtyList; tb; tb = tb->dirtyNext) {
+	code = tb->page * UBIK_PAGESIZE;	/* offset within file */
+	code =
+	    (*adbase->write) (adbase, tb->file, tb->data, code,
+			      UBIK_PAGESIZE);
+	if (code != UBIK_PAGESIZE)
+	    return UIOERROR;
     }
     return 0;
 }
@@ -616,17 +979,14 @@ DFlush(struct ubik_trans *atrans)
 static int
 DAbort(struct ubik_trans *atrans)
 {
-    int i;
     struct buffer *tb;
 
-    tb = Buffers;
-    for (i = 0; i < nbuffers; i++, tb++) {
-	if (tb->dirty) {
-	    tb->dirty = 0;
-	    tb->file = BADFID;
-	    Dlru(tb);
-	}
+    for (tb = DirtyList; tb; tb = tb->dirtyNext) {
+	tb->dirty = 0;
+	tb->file = BADFID;
+	Dlru(tb);
     }
+    DirtyList = NULL;
     return 0;
 }
 
@@ -641,7 +1001,7 @@ static void
 DedupBuffer(struct buffer *abuf)
 {
     struct buffer *tb;
-    for (tb = phTable[pHash(abuf->page)]; tb; tb = tb->hashNext) {
+    for (tb = phTable[pHash(abuf->file, abuf->page)]; tb; tb = tb->hashNext) {
 	if (tb->page == abuf->page && tb != abuf && tb->file == abuf->file
 	    && tb->dbase == abuf->dbase) {
 
@@ -657,29 +1017,27 @@ DedupBuffer(struct buffer *abuf)
 static int
 DSync(struct ubik_trans *atrans)
 {
-    int i;
     afs_int32 code;
-    struct buffer *tb;
+    struct buffer *tb, **tbp;
     afs_int32 file;
     afs_int32 rCode;
     struct ubik_dbase *adbase = atrans->dbase;
 
     rCode = 0;
-    while (1) {
-	file = BADFID;
-	for (i = 0, tb = Buffers; i < nbuffers; i++, tb++) {
-	    if (tb->dirty == 1) {
-		if (file == BADFID)
-		    file = tb->file;
-		if (file != BADFID && tb->file == file) {
-		    tb->dirty = 0;
-		    DedupBuffer(tb);
-		}
+    while (DirtyList) {
+	/* clean every dirty page of the first file on the list */
+	file = DirtyList->file;
+	for (tbp = &DirtyList; (tb = *tbp) != NULL;) {
+	    if (tb->file == file) {
+		tb->dirty = 0;
+		*tbp = tb->dirtyNext;
+		DedupBuffer(tb);
+	    } else {
+		tbp = &tb->dirtyNext;
 	    }
 	}
 	if (file == BADFID)
-	    break;
-	/* otherwise we have a file to sync */
+	    continue;
 	code = (*adbase->sync) (adbase, file);
 	if (code)
 	    rCode = code;
@@ -710,14 +1068,17 @@ int
 udisk_read(struct ubik_trans *atrans, afs_int32 afile, void *abuffer,
 	   afs_int32 apos, afs_int32 alen)
 {
-    char *bp;
+    char *bp, *sp;
     afs_int32 offset, len, totalLen;
 
     if (atrans->flags & TRDONE)
 	return UDONE;
     totalLen = 0;
     while (alen > 0) {
-	bp = DRead(atrans, afile, apos >> UBIK_LOGPAGESIZE);
+	sp = NULL;
+	if ((atrans->flags & TRREADWRITE) && snapHead)
+	    sp = SnapFind(atrans, afile, apos >> UBIK_LOGPAGESIZE);
+	bp = sp ? sp : DRead(atrans, afile, apos >> UBIK_LOGPAGESIZE);
 	if (!bp)
 	    return UEOF;
 	/* otherwise, min of remaining bytes and end of buffer to user mode */
@@ -730,7 +1091,8 @@ udisk_read(struct ubik_trans *atrans, afs_int32 afile, void *abuffer,
 	apos += len;
 	alen -= len;
 	totalLen += len;
-	DRelease(bp, 0);
+	if (!sp)
+	    DRelease(bp, 0);
     }
     return 0;
 }
@@ -808,6 +1170,15 @@ udisk_write(struct ubik_trans *atrans, afs_int32 afile, void *abuffer,
 	    if (!bp)
 		return UIOERROR;
 	}
+	/* readers of a snapshot may begin at any time before we commit, so
+	 * keep what they should see before the page first changes */
+	if (ubik_SyncWriterCacheProc) {
+	    code = SnapSave(atrans->dbase, afile, apos >> UBIK_LOGPAGESIZE);
+	    if (code) {
+		DRelease(bp, 0);
+		return code;
+	    }
+	}
 	/* otherwise, min of remaining bytes and end of buffer to user mode */
 	offset = apos & (UBIK_PAGESIZE - 1);
 	len = UBIK_PAGESIZE - offset;
@@ -845,6 +1216,7 @@ udisk_begin(struct ubik_dbase *adbase, int atype, struct ubik_trans **atrans)
     tt->next = adbase->activeTrans;
     adbase->activeTrans = tt;
     tt->type = atype;
+    tt->snapshot = commitSeq;
     if (atype == UBIK_READTRANS)
 	adbase->readers++;
     else if (atype == UBIK_WRITETRANS) {
@@ -921,6 +1293,10 @@ udisk_commit(struct ubik_trans *atrans)
 	}
 	UBIK_VERSION_UNLOCK;
 
+	/* readers which can't have their snapshot kept can't go on */
+	if (SnapCommit(atrans))
+	    SnapAbort(dbase);
+
 	/* If we fail anytime after this, then panic and let the
 	 * recovery replay the log.
 	 */
@@ -944,6 +1320,9 @@ udisk_commit(struct ubik_trans *atrans)
 	if (code)
 	    panic("Truncating Ubik logfile\n");
 
+	commitSeq++;
+	SnapTrim(dbase);
+
     }
 
     /* When the transaction is marked done, it also means the logfile
@@ -1005,6 +1384,8 @@ udisk_end(struct ubik_trans *atrans)
 
     ulock_relLock(atrans);
     unthread(atrans);
+    if (atrans->flags & TRREADWRITE)
+	SnapTrim(dbase);
 
     /* check if we are the write trans before unsetting the DBWRITING bit, else
      * we could be unsetting someone else's bit.
@@ -59,6 +59,11 @@ SDISK_Begin(struct rx_call *rxcall, struct ubik_tid *atid)
 	code = UNOQUORUM;
 	goto out;
     }
+    if (ubik_dbase->flags & DBRECEIVING) {
+	/* a new database is on its way; this trans would be lost anyway */
+	code = USYNC;
+	goto out;
+    }
     urecovery_CheckTid(atid, 1);
     code = udisk_begin(ubik_dbase, UBIK_WRITETRANS, &ubik_currentTrans);
     if (!code && ubik_currentTrans) {
@@ -82,7 +87,7 @@ SDISK_Commit(struct rx_call *rxcall, struct ubik_tid *atid)
     }
     ObtainWriteLock(&ubik_dbase->cache_lock);
     DBHOLD(ubik_dbase);
-    if (!ubik_currentTrans) {
+    if (!ubik_currentTrans || (ubik_dbase->flags & DBRECEIVING)) {
 	code = USYNC;
 	goto done;
     }
@@ -446,7 +451,6 @@ SDISK_SendFile(struct rx_call *rxcall, afs_int32 file,
     struct ubik_dbase *dbase = NULL;
     char tbuffer[1024];
     afs_int32 offset;
-    struct ubik_version tversion;
     int tlen;
     struct rx_peer *tpeer;
     struct rx_connection *tconn;
@@ -454,7 +458,6 @@ SDISK_SendFile(struct rx_call *rxcall, afs_int32 file,
     char hoststr[16];
     char pbuffer[1028];
     int fd = -1;
-    afs_int32 epoch = 0;
     afs_int32 pass;
 
     /* send the file back to the requester */
@@ -491,33 +494,37 @@ SDISK_SendFile(struct rx_call *rxcall, afs_int32 file,
     }
 
     DBHOLD(dbase);
-
-    /* abort any active trans that may scribble over the database */
-    urecovery_AbortAll(dbase);
+    if (dbase->flags & DBRECEIVING) {
+	/* already being sent one */
+	DBRELE(dbase);
+	return USYNC;
+    }
+    UBIK_VERSION_LOCK;
+    dbase->flags |= DBRECEIVING;
+    UBIK_VERSION_UNLOCK;
+    DBRELE(dbase);
 
     ViceLog(0, ("Ubik: Synchronize database via DISK_SendFile from server %s\n",
 	       afs_inet_ntoa_r(otherHost, hoststr)));
 
+    /* Receive the new database beside the old one without holding the
+     * database lock, so that readers can go on using the old one until we
+     * swap them.  DBRECEIVING keeps remote writers off it meanwhile. */
     offset = 0;
-    UBIK_VERSION_LOCK;
-    epoch = tversion.epoch = 0;		/* start off by labelling in-transit db as invalid */
-    (*dbase->setlabel) (dbase, file, &tversion);	/* setlabel does sync */
     snprintf(pbuffer, sizeof(pbuffer), "%s.DB%s%d.TMP",
 	     ubik_dbase->pathName, (file<0)?"SYS":"",
 	     (file<0)?-file:file);
     fd = open(pbuffer, O_CREAT | O_RDWR | O_TRUNC, 0600);
     if (fd < 0) {
 	code = errno;
-	goto failed_locked;
+	goto failed;
     }
     code = lseek(fd, HDRSIZE, 0);
     if (code != HDRSIZE) {
 	close(fd);
-	goto failed_locked;
+	goto failed;
     }
     pass = 0;
-    memcpy(&ubik_dbase->version, &tversion, sizeof(struct ubik_version));
-    UBIK_VERSION_UNLOCK;
     while (length > 0) {
 	tlen = (length > sizeof(tbuffer) ? sizeof(tbuffer) : length);
 #if !defined(AFS_PTHREAD_ENV)
@@ -546,6 +553,11 @@ SDISK_SendFile(struct rx_call *rxcall, afs_int32 file,
     if (code)
 	goto failed;
 
+    DBHOLD(dbase);
+
+    /* abort any active trans that may scribble over the database */
+    urecovery_AbortAll(dbase);
+
     /* sync data first, then write label and resync (resync done by setlabel call).
      * This way, good label is only on good database. */
     snprintf(tbuffer, sizeof(tbuffer), "%s.DB%s%d",
@@ -565,35 +577,30 @@ SDISK_SendFile(struct rx_call *rxcall, afs_int32 file,
     if (!code) {
 	(*ubik_dbase->open) (ubik_dbase, file);
 	code = (*ubik_dbase->setlabel) (dbase, file, avers);
+	memcpy(&ubik_dbase->version, avers, sizeof(struct ubik_version));
+	udisk_Invalidate(dbase, file);	/* new dbase, flush disk buffers */
+#ifdef AFS_PTHREAD_ENV
+	opr_Assert(pthread_cond_broadcast(&dbase->version_cond) == 0);
+#else
+	LWP_NoYieldSignal(&dbase->version);
+#endif
     }
 #ifdef AFS_NT40_ENV
     snprintf(pbuffer, sizeof(pbuffer), "%s.DB%s%d.OLD",
 	     ubik_dbase->pathName, (file<0)?"SYS":"", (file<0)?-file:file);
     unlink(pbuffer);
 #endif
-    memcpy(&ubik_dbase->version, avers, sizeof(struct ubik_version));
-    udisk_Invalidate(dbase, file);	/* new dbase, flush disk buffers */
-#ifdef AFS_PTHREAD_ENV
-    opr_Assert(pthread_cond_broadcast(&dbase->version_cond) == 0);
-#else
-    LWP_NoYieldSignal(&dbase->version);
-#endif
-
-failed_locked:
     UBIK_VERSION_UNLOCK;
+    DBRELE(dbase);
 
 failed:
+    DBHOLD(dbase);
+    UBIK_VERSION_LOCK;
+    dbase->flags &= ~DBRECEIVING;
+    UBIK_VERSION_UNLOCK;
     if (code) {
 	if (pbuffer[0] != '\0')
 	    unlink(pbuffer);
-
-	/* Failed to sync. Allow reads again for now. */
-	if (dbase != NULL) {
-	    UBIK_VERSION_LOCK;
-	    tversion.epoch = epoch;
-	    (*dbase->setlabel) (dbase, file, &tversion);
-	    UBIK_VERSION_UNLOCK;
-	}
 	ViceLog(0, ("Ubik: Synchronize database with server %s failed (error = %d)\n",
 	     afs_inet_ntoa_r(otherHost, hoststr), code));
     } else {
@@ -451,7 +451,9 @@ ubik_ServerInitCommon(afs_uint32 myHost, short myPort,
 
     ubik_callPortal = myPort;
 
-    udisk_Init(ubik_nBuffers);
+    code = udisk_Init(ubik_nBuffers);
+    if (code)
+	return code;
     ulock_Init();
 
     code = uvote_Init();
@@ -589,6 +591,11 @@ ubik_ServerInit(afs_uint32 myHost, short myPort, afs_uint32 serverList[],
  * ubik_BeginTrans() or ubik_BeginTransReadAny() or
  * ubik_BeginTransReadAnyWrite() below.
  *
+ * A read transaction begun with ubik_BeginTransReadAnyWrite() takes no
+ * ubik lock and never waits for writers.  It sees the dbase as of the last
+ * commit before it began; pages later commits replace are kept for it until
+ * it ends.
+ *
  * \note We can only begin transaction when we have an up-to-date database.
  */
 static int
@@ -865,7 +872,12 @@ ubik_EndTrans(struct ubik_trans *transPtr)
 
 	ReleaseWriteLock(&dbase->cache_lock);
 
+	/* The commit is already visible locally, and our write lock keeps
+	 * out other writers, so don't make readers wait out the RPCs; the
+	 * wait for down servers below releases the dbase the same way. */
+	DBRELE(dbase);
 	code = ContactQuorum_NoArguments(DISK_Commit, transPtr, CStampVersion, "DISK_Commit");
+	DBHOLD(dbase);
 
     } else {
 	memset(&dbase->cachedVersion, 0, sizeof(struct ubik_version));
@@ -1306,6 +1318,22 @@ ubik_CacheUpdate(struct ubik_trans *atrans)
     return vcmp(atrans->dbase->cachedVersion, atrans->dbase->version) != 0;
 }
 
+/*!
+ * \brief Bring the snapshot read by a #TRREADWRITE trans up to date.
+ *
+ * Called with the application cache locked, so no commit can come between
+ * the snapshot and the cache.
+ */
+static void
+ubik_CacheSnapshot(struct ubik_trans *atrans)
+{
+    if (atrans->flags & TRREADWRITE) {
+	DBHOLD(atrans->dbase);
+	udisk_Snapshot(atrans);
+	DBRELE(atrans->dbase);
+    }
+}
+
 /**
  * check and possibly update cache of ubik db.
  *
@@ -1327,6 +1355,10 @@ ubik_CacheUpdate(struct ubik_trans *atrans)
  *   @retval 0       success
  *   @retval nonzero error; cachedVersion not updated
  *
+ * A transaction begun with ubik_BeginTransReadAnyWrite() reads the dbase
+ * from then on as of the version the cache holds, even if that is newer than
+ * the version it began with.
+ *
  * @post On success, application cache is read-locked, and cache data is
  *       up-to-date
  */
@@ -1349,6 +1381,7 @@ ubik_CheckCache(struct ubik_trans *atrans, ubik_updatecache_func cbf, void *rock
 
 	    BoostSharedLock(&atrans->dbase->cache_lock);
 
+	    ubik_CacheSnapshot(atrans);
 	    ret = (*cbf) (atrans, rock);
 	    if (ret == 0) {
 		memcpy(&atrans->dbase->cachedVersion, &atrans->dbase->version,
@@ -1368,6 +1401,7 @@ ubik_CheckCache(struct ubik_trans *atrans, ubik_updatecache_func cbf, void *rock
 	ObtainReadLock(&atrans->dbase->cache_lock);
     }
 
+    ubik_CacheSnapshot(atrans);
     atrans->flags |= TRCACHELOCKED;
 
     return 0;
@@ -110,6 +110,7 @@ struct ubik_trans {
     char type;			/*!< type of trans */
     iovec_wrt iovec_info;
     iovec_buf iovec_data;
+    afs_int32 snapshot;		/*!< commits visible to a #TRREADWRITE trans */
 };
 
 /*!
@@ -225,12 +226,13 @@ extern int (*ubik_SyncWriterCacheProc) (void);
 /*! \name some ubik parameters */
 #define	UBIK_PAGESIZE	    1024	/*!< fits in current r packet */
 #define	UBIK_LOGPAGESIZE    10	/*!< base 2 log thereof */
-#define	NBUFFERS	    20	/*!< number of 1K buffers */
+#define	NBUFFERS	    1024	/*!< number of 1K buffers */
 #define	HDRSIZE		    64	/*!< bytes of header per dbfile */
 /*\}*/
 
 /*! \name ubik_dbase flags */
 #define	DBWRITING	    1	/*!< are any write trans. in progress */
+#define	DBRECEIVING	    2	/*!< is a new dbase being received */
 /*\}*/
 
 /*!\name ubik trans flags */
@@ -241,7 +243,8 @@ extern int (*ubik_SyncWriterCacheProc) (void);
                                  *   (meaning, this trans has called
                                  *   ubik_CheckCache at some point */
 #define TRREADWRITE         64  /*!< read even if there's a conflicting ubik-
-                                 *   level write lock */
+                                 *   level write lock, from a snapshot of
+                                 *   the dbase taken when the trans began */
 /*\}*/
 
 /*! \name ubik_lock flags */
@@ -497,6 +500,8 @@ extern struct addr_data addr_globals;
 /*! \name disk.c */
 extern int udisk_Init(int nBUffers);
 extern void udisk_Debug(struct ubik_debug *aparm);
+extern void udisk_CacheDebug(struct ubik_cachedebug *aparm);
+extern void udisk_Snapshot(struct ubik_trans *atrans);
 extern int udisk_Invalidate(struct ubik_dbase *adbase, afs_int32 afid);
 extern int udisk_read(struct ubik_trans *atrans, afs_int32 afile,
 		      void *abuffer, afs_int32 apos, afs_int32 alen);
@@ -77,6 +77,7 @@ CommandProc(struct cmd_syndesc *as, void *arock)
     struct rx_connection *tconn;
     struct rx_securityClass *sc;
     struct ubik_debug udebug;
+    struct ubik_cachedebug cachedebug;
     struct ubik_sdebug usdebug;
     int oldServer = 0;		/* are we talking to a pre 3.5 server? */
     afs_int32 isClone = 0;
@@ -233,6 +234,17 @@ CommandProc(struct cmd_syndesc *as, void *arock)
     printf("%d locked pages, %d of them for write\n", udebug.lockedPages,
 	   udebug.writeLockedPages);
 
+    /* servers without the page cache statistics just say RXGEN_OPCODE */
+    if (!oldServer && VOTE_CacheDebug(tconn, &cachedebug) == 0) {
+	printf("Page cache: %d pages, %d lookups, %d hits, %d reads, "
+	       "%d dirty\n", cachedebug.buffers, cachedebug.lookups,
+	       cachedebug.hits, cachedebug.reads, cachedebug.dirtyPages);
+	printf("Read-ahead: %d pages, %d of them used\n",
+	       cachedebug.readAheadPages, cachedebug.readAheadHits);
+	printf("%d old pages kept for snapshot readers\n",
+	       cachedebug.snapshotPages);
+    }
+
     if (udebug.anyReadLocks)
 	printf("There are read locks held\n");
     if (udebug.anyWriteLocks)
@@ -536,6 +536,17 @@ SVOTE_DebugOld(struct rx_call * rxcall,
     return 0;
 }
 
+/*!
+ * \brief Report page cache statistics.
+ */
+afs_int32
+SVOTE_CacheDebug(struct rx_call * rxcall, struct ubik_cachedebug * aparm)
+{
+    DBHOLD(ubik_dbase);
+    udisk_CacheDebug(aparm);
+    DBRELE(ubik_dbase);
+    return 0;
+}
 
 /*!
  * \brief Get the sync site; called by remote servers to find where they should go.
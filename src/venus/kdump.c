@@ -445,6 +445,7 @@ extern off64_t lseek64();
 
 #include <afs/cmd.h>
 #include <rx/rx.h>
+#include <rx/rx_globals.h>
 
 
 #undef	KERNEL
@@ -515,6 +516,8 @@ void print_global_afs_cache();
 void print_rxstats();
 void print_rx();
 void print_services();
+static void **read_rx_chains(afs_int32 kmem, char *sym, int peers,
+			     long *nchainsp);
 #ifdef KDUMP_RX_LOCK
 void print_peertable_lock();
 void print_conntable_lock();
@@ -2146,13 +2149,12 @@ print_allocs(int pnt)
     T += k;
     printf("%20s:\t%8d bytes\t[%d free packets/%d bytes each]\n",
 	   "Rx packet freelist", k, count, sizeof(struct rx_packet));
-#define rx_hashTableSize 256	/* XXX */
-    i = (rx_hashTableSize * sizeof(struct rx_connection *));
-    j = (rx_hashTableSize * sizeof(struct rx_peer *));
-    k = i + j;
+    free(read_rx_chains(kmem, "rx_connHashShards", 0, &i));
+    free(read_rx_chains(kmem, "rx_peerHashShards", 1, &j));
+    k = (i * sizeof(struct rx_connection *)) + (j * sizeof(struct rx_peer *));
     T += k;
     printf("%20s:\t%8d bytes\t[%d entries/%d bytes each]\n",
-	   "Rx conn/peer tables", k, rx_hashTableSize,
+	   "Rx conn/peer tables", k, i + j,
 	   sizeof(struct rx_connection *));
 
     findsym("rxi_Alloccnt", &symoff);
@@ -3535,24 +3537,63 @@ print_services(afs_int32 kmem)
 }
 
 
+/*
+ * Read the head of every hash chain in one of the sharded rx hash tables,
+ * rx_connHashShards or rx_peerHashShards.  Each shard has its own bucket
+ * array, so the chains are gathered into one malloc'd array, which the
+ * caller frees; *nchainsp is set to its length.
+ */
+static void **
+read_rx_chains(afs_int32 kmem, char *sym, int peers, long *nchainsp)
+{
+    struct rx_connHashShard cshards[RX_HASH_SHARDS];
+    struct rx_peerHashShard pshards[RX_HASH_SHARDS];
+    void **chains = NULL, **tchains;
+    off_t symoff, buckets;
+    long i, n = 0, nBuckets;
+
+    findsym(sym, &symoff);
+    if (peers)
+	kread(kmem, symoff, (char *)pshards, sizeof pshards);
+    else
+	kread(kmem, symoff, (char *)cshards, sizeof cshards);
+    for (i = 0; i < RX_HASH_SHARDS; i++) {
+	if (peers) {
+	    buckets = (off_t) pshards[i].buckets;
+	    nBuckets = pshards[i].nBuckets;
+	} else {
+	    buckets = (off_t) cshards[i].buckets;
+	    nBuckets = cshards[i].nBuckets;
+	}
+	if (!buckets || !nBuckets)
+	    continue;
+	tchains = realloc(chains, (n + nBuckets) * sizeof(void *));
+	if (!tchains)
+	    break;
+	chains = tchains;
+	kread(kmem, buckets, (char *)&chains[n], nBuckets * sizeof(void *));
+	n += nBuckets;
+    }
+    *nchainsp = n;
+    return chains;
+}
+
 #ifdef KDUMP_RX_LOCK
 void
 print_peertable_lock(afs_int32 kmem)
 {
-    off_t symoff;
-    struct rx_peer_rx_lock *rx_peerTable[256], se, *sentry = &se, *sep;
+    struct rx_peer_rx_lock **rx_peerTable, se, *sentry = &se, *sep;
     long count, i, j;
 
-    findsym("rx_peerHashTable", &symoff);
-    kread(kmem, symoff, (char *)&count, sizeof(long));
-    if (!count) {
+    rx_peerTable = (struct rx_peer_rx_lock **)
+	read_rx_chains(kmem, "rx_peerHashShards", 1, &count);
+    if (!rx_peerTable) {
 	printf("No 'rx_peer' structures found.\n");
 	return;
     }
 
-    kread(kmem, count, (char *)rx_peerTable, 256 * sizeof(long));
     printf("\n\nPrinting all 'rx_peer' structures...\n");
-    for (i = 0, j = 0; i < 256; i++) {
+    for (i = 0, j = 0; i < count; i++) {
 	for (sep = rx_peerTable[i]; sep; sep = sentry->next, j++) {
 	    kread(kmem, (off_t) sep, (char *)sentry, sizeof *sentry);
 	    printf("\t%lx: next=0x%lx, host=0x%x, ", sep, sentry->next,
@@ -3571,6 +3612,7 @@ print_peertable_lock(afs_int32 kmem)
 	    printf("\t\tpeer_lock=%d\n", sentry->peer_lock);
 	}
     }
+    free(rx_peerTable);
     printf("... found %d 'rx_peer' entries in the table\n", j);
 }
 
@@ -3578,16 +3620,14 @@ print_peertable_lock(afs_int32 kmem)
 void
 print_peertable(afs_int32 kmem)
 {
-    off_t symoff;
-    struct rx_peer *rx_peerTable[256], se, *sentry = &se, *sep;
+    struct rx_peer **rx_peerTable, se, *sentry = &se, *sep;
     long count, i, j;
 
-    findsym("rx_peerHashTable", &symoff);
-    kread(kmem, symoff, (char *)&count, sizeof(long));
+    rx_peerTable = (struct rx_peer **)
+	read_rx_chains(kmem, "rx_peerHashShards", 1, &count);
 
-    kread(kmem, count, (char *)rx_peerTable, 256 * sizeof(long));
     printf("\n\nPrinting all 'rx_peer' structures...\n");
-    for (i = 0, j = 0; i < 256; i++) {
+    for (i = 0, j = 0; i < count; i++) {
 	for (sep = rx_peerTable[i]; sep; sep = sentry->next, j++) {
 	    kread(kmem, (off_t) sep, (char *)sentry, sizeof *sentry);
 	    printf("\t%lx: next=0x%lx, host=0x%x, ", sep, sentry->next,
@@ -3608,6 +3648,7 @@ print_peertable(afs_int32 kmem)
 #endif /* RX_ENABLE_LOCKS */
 	}
     }
+    free(rx_peerTable);
     printf("... found %d 'rx_peer' entries in the table\n", j);
 }
 
@@ -3616,21 +3657,19 @@ print_peertable(afs_int32 kmem)
 void
 print_conntable_lock(afs_int32 kmem)
 {
-    off_t symoff;
-    struct rx_connection_rx_lock *rx_connTable[256], se, *sentry = &se;
+    struct rx_connection_rx_lock **rx_connTable, se, *sentry = &se;
     struct rx_connection_rx_lock *sep;
     long count, i, j;
 
-    findsym("rx_connHashTable", &symoff);
-    kread(kmem, symoff, (char *)&count, sizeof(long));
-    if (!count) {
+    rx_connTable = (struct rx_connection_rx_lock **)
+	read_rx_chains(kmem, "rx_connHashShards", 0, &count);
+    if (!rx_connTable) {
 	printf("No 'rx_connection' structures found.\n");
 	return;
     }
 
-    kread(kmem, count, (char *)rx_connTable, 256 * sizeof(long));
     printf("\n\nPrinting all 'rx_connection' structures...\n");
-    for (i = 0, j = 0; i < 256; i++) {
+    for (i = 0, j = 0; i < count; i++) {
 	for (sep = rx_connTable[i]; sep; sep = sentry->next, j++) {
 	    kread(kmem, (off_t) sep, (char *)sentry, sizeof *sentry);
 	    printf
@@ -3664,6 +3703,7 @@ print_conntable_lock(afs_int32 kmem)
 		 se.refCount);
 	}
     }
+    free(rx_connTable);
     printf("... found %d 'rx_connection' entries in the table\n", j);
 }
 #endif /* KDUMP_RX_LOCK */
@@ -3671,16 +3711,14 @@ print_conntable_lock(afs_int32 kmem)
 void
 print_conntable(afs_int32 kmem)
 {
-    off_t symoff;
-    struct rx_connection *rx_connTable[256], se, *sentry = &se, *sep;
+    struct rx_connection **rx_connTable, se, *sentry = &se, *sep;
     long count, i, j;
 
-    findsym("rx_connHashTable", &symoff);
-    kread(kmem, symoff, (char *)&count, sizeof(long));
+    rx_connTable = (struct rx_connection **)
+	read_rx_chains(kmem, "rx_connHashShards", 0, &count);
 
-    kread(kmem, count, (char *)rx_connTable, 256 * sizeof(long));
     printf("\n\nPrinting all 'rx_connection' structures...\n");
-    for (i = 0, j = 0; i < 256; i++) {
+    for (i = 0, j = 0; i < count; i++) {
 	for (sep = rx_connTable[i]; sep; sep = sentry->next, j++) {
 	    kread(kmem, (off_t) sep, (char *)sentry, sizeof *sentry);
 	    printf
@@ -3716,6 +3754,7 @@ print_conntable(afs_int32 kmem)
 #endif /* RX_ENABLE_LOCKS */
 	}
     }
+    free(rx_connTable);
     printf("... found %d 'rx_connection' entries in the table\n", j);
 }
 
@@ -3724,22 +3763,20 @@ print_conntable(afs_int32 kmem)
 void
 print_calltable_lock(afs_int32 kmem)
 {
-    off_t symoff;
-    struct rx_connection_rx_lock *rx_connTable[256], se;
+    struct rx_connection_rx_lock **rx_connTable, se;
     struct rx_connection_rx_lock *sentry = &se;
     struct rx_connection_rx_lock *sep;
     long count, i, j, k;
 
-    findsym("rx_connHashTable", &symoff);
-    kread(kmem, symoff, (char *)&count, sizeof(long));
-    if (!count) {
+    rx_connTable = (struct rx_connection_rx_lock **)
+	read_rx_chains(kmem, "rx_connHashShards", 0, &count);
+    if (!rx_connTable) {
 	printf("No 'rx_call' structures found.\n");
 	return;
     }
 
-    kread(kmem, count, (char *)rx_connTable, 256 * sizeof(long));
     printf("\n\nPrinting all active 'rx_call' structures...\n");
-    for (i = 0, j = 0; i < 256; i++) {
+    for (i = 0, j = 0; i < count; i++) {
 	for (sep = rx_connTable[i]; sep; sep = se.next) {
 	    kread(kmem, (off_t) sep, (char *)sentry, sizeof *sentry);
 	    for (k = 0; k < RX_MAXCALLS; k++) {
@@ -3799,6 +3836,7 @@ print_calltable_lock(afs_int32 kmem)
 	    }
 	}
     }
+    free(rx_connTable);
     printf("... found %d 'rx_call' entries in the table\n", j);
 }
 #endif /* KDUMP_RX_LOCK */
@@ -3806,16 +3844,14 @@ print_calltable_lock(afs_int32 kmem)
 void
 print_calltable(afs_int32 kmem)
 {
-    off_t symoff;
-    struct rx_connection *rx_connTable[256], se, *sentry = &se, *sep;
+    struct rx_connection **rx_connTable, se, *sentry = &se, *sep;
     long count, i, j, k;
 
-    findsym("rx_connHashTable", &symoff);
-    kread(kmem, symoff, (char *)&count, sizeof(long));
+    rx_connTable = (struct rx_connection **)
+	read_rx_chains(kmem, "rx_connHashShards", 0, &count);
 
-    kread(kmem, count, (char *)rx_connTable, 256 * sizeof(long));
     printf("\n\nPrinting all active 'rx_call' structures...\n");
-    for (i = 0, j = 0; i < 256; i++) {
+    for (i = 0, j = 0; i < count; i++) {
 	for (sep = rx_connTable[i]; sep; sep = se.next) {
 	    kread(kmem, (off_t) sep, (char *)sentry, sizeof *sentry);
 	    for (k = 0; k < RX_MAXCALLS; k++) {
@@ -3876,6 +3912,7 @@ print_calltable(afs_int32 kmem)
 	    }
 	}
     }
+    free(rx_connTable);
     printf("... found %d 'rx_call' entries in the table\n", j);
 }
 
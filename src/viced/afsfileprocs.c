@@ -190,6 +190,59 @@ extern int CEs, CEBlocks;
 
 extern int HTs, HTBlocks;
 
+/*
+ * FetchData reads a batch of rx packets' worth of data with each preadv.
+ * A batch of FS_FETCH_BATCH bytes fits in around 48 packet buffers, and
+ * is cut short if we run out of iovecs first.
+ */
+#define FS_FETCH_BATCH		(64 * 1024)
+#define FS_FETCH_MAXIOVECS	64
+#if defined(IOV_MAX) && IOV_MAX < FS_FETCH_MAXIOVECS
+# undef FS_FETCH_MAXIOVECS
+# define FS_FETCH_MAXIOVECS	IOV_MAX
+#endif
+/* Transfers at least this large are advised as sequential */
+#define FS_FETCH_SEQUENTIAL	(1024 * 1024)
+
+/* Running totals behind the fs_Fetch*KBytes counters, under FS_LOCK */
+static afs_uint64 FetchReadBytes;
+static afs_uint64 FetchCopyBytes;
+
+/*
+ * Large stores are pipelined: the thread serving the call keeps reading
+ * from rx while a pool of writer threads puts the data on disk. Each call
+ * has at most FS_STORE_MAXINFLIGHT buffers of sendBufSize bytes queued or
+ * being written at once.
+ */
+#define FS_STORE_MAXINFLIGHT	4
+
+struct storeWrite {
+    struct opr_queue q;
+    struct storePipe *pipe;
+    afs_foff_t pos;
+    int len;
+    char *data;
+};
+
+struct storePipe {
+    FdHandle_t *fdP;
+    pthread_cond_t cv;		/* signalled as each write completes */
+    int inflight;		/* writes queued or in progress */
+    int error;			/* a write came up short */
+    afs_foff_t errorPos;	/* lowest offset of a short write */
+    afs_sfsize_t written;	/* bytes which reached the disk */
+    struct opr_queue idle;	/* buffers free for the next read */
+    struct storeWrite bufs[FS_STORE_MAXINFLIGHT];
+};
+
+/* Protects the write queue, and the state of every storePipe */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+    struct opr_queue queue;
+    int nThreads;
+} storeWriters;
+
 static afs_int32 FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 				   struct rx_call *Call, afs_sfsize_t Pos,
 				   afs_sfsize_t Len, afs_int32 Int64Mode,
@@ -373,6 +426,27 @@ CallPreamble(struct rx_call *acall, int activecall, struct AFSFid *Fid,
     }
     *tconn = rx_ConnectionOf(acall);
 
+    /* Most calls come in on connections whose client and host are in good
+     * order, and need no H_LOCK.  The host lock still covers the flags and
+     * the call times, as it does below. */
+    tclient = h_FindClientFast(*tconn, &viceid);
+    if (tclient) {
+	thost = tclient->z.host;
+	h_Lock(thost);
+	if (!(thost->z.hostFlags & (HOSTDELETED | VENUSDOWN | HFE_LATER))) {
+	    tclient->z.LastCall = thost->z.LastCall = time(NULL);
+	    if (activecall)
+		thost->z.ActiveCall = thost->z.LastCall;
+	    h_Unlock(thost);
+	    h_ReleaseClient(tclient);
+	    *ahostp = thost;
+	    return 0;
+	}
+	h_Unlock(thost);
+	h_ReleaseClient(tclient);
+	h_Release(thost);
+    }
+
     H_LOCK;
   retry:
     tclient = h_FindClient_r(*tconn, &viceid);
@@ -424,11 +498,11 @@ CallPreamble(struct rx_call *acall, int activecall, struct AFSFid *Fid,
 	goto retry;
     }
 
+    h_Lock_r(thost);
     tclient->z.LastCall = thost->z.LastCall = time(NULL);
     if (activecall)		/* For all but "GetTime", "GetStats", and "GetCaps" calls */
 	thost->z.ActiveCall = thost->z.LastCall;
 
-    h_Lock_r(thost);
     if (thost->z.hostFlags & HOSTDELETED) {
 	ViceLog(3,
 		("Discarded a packet for deleted host %s:%d\n",
@@ -481,15 +555,23 @@ CallPostamble(struct rx_connection *aconn, afs_int32 ret,
     struct host *thost;
     struct client *tclient;
     int translate = 0;
+    int locked = 0;
 
-    H_LOCK;
-    tclient = h_FindClient_r(aconn, NULL);
-    if (!tclient)
-	goto busyout;
+    tclient = h_FindClientFast(aconn, NULL);
+    if (!tclient) {
+	H_LOCK;
+	locked = 1;
+	tclient = h_FindClient_r(aconn, NULL);
+	if (!tclient)
+	    goto busyout;
+    }
     thost = tclient->z.host;
     if (thost->z.hostFlags & HERRORTRANS)
 	translate = 1;
-    h_ReleaseClient_r(tclient);
+    if (locked)
+	h_ReleaseClient_r(tclient);
+    else
+	h_ReleaseClient(tclient);
 
     if (ahost) {
 	    if (ahost != thost) {
@@ -505,7 +587,10 @@ CallPostamble(struct rx_connection *aconn, afs_int32 ret,
 				thost));
 	    }
 	    /* return the reference taken in CallPreamble */
-	    h_Release_r(ahost);
+	    if (locked)
+		h_Release_r(ahost);
+	    else
+		h_Release(ahost);
     } else {
 	    char hoststr[16];
 	    ViceLog(0, ("CallPostamble: null ahost for thost %s:%d (%p)\n",
@@ -516,10 +601,14 @@ CallPostamble(struct rx_connection *aconn, afs_int32 ret,
 
     /* return the reference taken in local h_FindClient_r--h_ReleaseClient_r
      * does not decrement refcount on client->z.host */
-    h_Release_r(thost);
+    if (locked)
+	h_Release_r(thost);
+    else
+	h_Release(thost);
 
  busyout:
-    H_UNLOCK;
+    if (locked)
+	H_UNLOCK;
     return (translate ? sys_error_to_et(ret) : ret);
 }				/*CallPostamble */
 
@@ -5220,6 +5309,8 @@ FillPerfValues(struct afs_PerfStats *a_perfP)
     int dir_Calls;		/*# read calls in dir package */
     int dir_IOs;		/*# I/O ops in dir package */
     struct rx_statistics *stats;
+    struct cbbreakcounters cbb;
+    struct VAttachStats vas;
 
     /*
      * Vnode cache section.
@@ -5316,6 +5407,27 @@ FillPerfValues(struct afs_PerfStats *a_perfP)
     a_perfP->sysname_ID = afs_perfstats.sysname_ID;
     a_perfP->rx_nBusies = (afs_int32) stats->nBusies;
     a_perfP->fs_nBusies = afs_perfstats.fs_nBusies;
+    a_perfP->fs_nFetchReads = afs_perfstats.fs_nFetchReads;
+    a_perfP->fs_FetchReadKBytes = afs_perfstats.fs_FetchReadKBytes;
+    a_perfP->fs_FetchCopyKBytes = afs_perfstats.fs_FetchCopyKBytes;
+
+    GetCallBackBreakCounters(&cbb);
+    a_perfP->fs_CBBreakQueued = cbb.queued;
+    a_perfP->fs_CBBreakQueuedMax = cbb.queuedMax;
+    a_perfP->fs_nCBBreakBatches = cbb.batches;
+    a_perfP->fs_nCBBreakFids = cbb.fids;
+    a_perfP->fs_nCBBreakFailed = cbb.failed;
+    a_perfP->fs_CBBreakAvgMsec = cbb.avgMsec;
+    a_perfP->fs_CBBreakMaxMsec = cbb.maxMsec;
+
+    VGetAttachStats(&vas);
+    a_perfP->fs_VolAttachFound = vas.found;
+    a_perfP->fs_VolAttached = vas.attached;
+    a_perfP->fs_VolAttachFailed = vas.failed;
+    a_perfP->fs_VolAttachHot = vas.hot;
+    a_perfP->fs_VolAttachHotDone = vas.hotAttached;
+    a_perfP->fs_VolAttachSecs = vas.elapsed;
+    a_perfP->fs_VolAttachETA = vas.eta;
     rx_FreeStatistics(&stats);
 }				/*FillPerfValues */
 
@@ -5468,23 +5580,25 @@ SRXAFS_GetXStats(struct rx_call *a_call, afs_int32 a_clientVersionNum,
 	dataBytes = sizeof(struct cbcounters);
 	dataBuffP = malloc(dataBytes);
 	{
-	    extern struct cbcounters cbstuff;
-	    dataBuffP[0]=cbstuff.DeleteFiles;
-	    dataBuffP[1]=cbstuff.DeleteCallBacks;
-	    dataBuffP[2]=cbstuff.BreakCallBacks;
-	    dataBuffP[3]=cbstuff.AddCallBacks;
-	    dataBuffP[4]=cbstuff.GotSomeSpaces;
-	    dataBuffP[5]=cbstuff.DeleteAllCallBacks;
-	    dataBuffP[6]=cbstuff.nFEs;
-	    dataBuffP[7]=cbstuff.nCBs;
-	    dataBuffP[8]=cbstuff.nblks;
-	    dataBuffP[9]=cbstuff.CBsTimedOut;
-	    dataBuffP[10]=cbstuff.nbreakers;
-	    dataBuffP[11]=cbstuff.GSS1;
-	    dataBuffP[12]=cbstuff.GSS2;
-	    dataBuffP[13]=cbstuff.GSS3;
-	    dataBuffP[14]=cbstuff.GSS4;
-	    dataBuffP[15]=cbstuff.GSS5;
+	    struct cbcounters cbc;
+
+	    GetCallBackCounters(&cbc);
+	    dataBuffP[0]=cbc.DeleteFiles;
+	    dataBuffP[1]=cbc.DeleteCallBacks;
+	    dataBuffP[2]=cbc.BreakCallBacks;
+	    dataBuffP[3]=cbc.AddCallBacks;
+	    dataBuffP[4]=cbc.GotSomeSpaces;
+	    dataBuffP[5]=cbc.DeleteAllCallBacks;
+	    dataBuffP[6]=cbc.nFEs;
+	    dataBuffP[7]=cbc.nCBs;
+	    dataBuffP[8]=cbc.nblks;
+	    dataBuffP[9]=cbc.CBsTimedOut;
+	    dataBuffP[10]=cbc.nbreakers;
+	    dataBuffP[11]=cbc.GSS1;
+	    dataBuffP[12]=cbc.GSS2;
+	    dataBuffP[13]=cbc.GSS3;
+	    dataBuffP[14]=cbc.GSS4;
+	    dataBuffP[15]=cbc.GSS5;
 	}
 
 	a_dataP->AFS_CollData_len = dataBytes >> 2;
@@ -6158,11 +6272,12 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 #ifndef HAVE_PIOV
     char *tbuffer;
 #else /* HAVE_PIOV */
-    struct iovec tiov[RX_MAXIOVECS];
+    struct iovec tiov[FS_FETCH_MAXIOVECS];
     int tnio;
 #endif /* HAVE_PIOV */
     afs_sfsize_t tlen;
     afs_int32 optSize;
+    afs_int32 nReads = 0;
 
     /*
      * Initialize the byte count arguments.
@@ -6194,7 +6309,15 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 		    afs_printable_VolumeId_lu(volptr->hashid)));
 	return EIO;
     }
+#ifndef HAVE_PIOV
     optSize = sendBufSize;
+#else
+    /*
+     * The packet buffers are filled directly by the read, so there is no
+     * bounce buffer to bound the size of each read.
+     */
+    optSize = max(sendBufSize, FS_FETCH_BATCH);
+#endif
     tlen = FDH_SIZE(fdP);
     ViceLog(25,
 	    ("FetchData_RXStyle: file size %llu\n", (afs_uintmax_t) tlen));
@@ -6229,6 +6352,11 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	rx_Write(Call, (char *)&low, sizeof(afs_int32));	/* send length on fetch */
     }
     (*a_bytesToFetchP) = Len;
+#ifdef FDH_ADVISE
+    /* Let the kernel read ahead of us on large transfers */
+    if (Len >= FS_FETCH_SEQUENTIAL)
+	FDH_ADVISE(fdP, Pos, Len, POSIX_FADV_SEQUENTIAL);
+#endif
 #ifndef HAVE_PIOV
     tbuffer = AllocSendBuffer();
 #endif /* HAVE_PIOV */
@@ -6239,6 +6367,7 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	    wlen = optSize;
 	else
 	    wlen = Len;
+	nReads++;
 #ifndef HAVE_PIOV
 	nBytes = FDH_PREAD(fdP, tbuffer, wlen, Pos);
 	if (nBytes != wlen) {
@@ -6251,7 +6380,7 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	}
 	nBytes = rx_Write(Call, tbuffer, wlen);
 #else /* HAVE_PIOV */
-	nBytes = rx_WritevAlloc(Call, tiov, &tnio, RX_MAXIOVECS, wlen);
+	nBytes = rx_WritevAlloc(Call, tiov, &tnio, FS_FETCH_MAXIOVECS, wlen);
 	if (nBytes <= 0) {
 	    FDH_CLOSE(fdP);
 	    return EIO;
@@ -6305,6 +6434,13 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	VN_GET_LEN(targLen, targetptr);
 	AFSCallStats.TotalFetchedBytes += targLen;
 	AFSCallStats.FetchSize1++;
+	FetchReadBytes += *a_bytesFetchedP;
+#ifndef HAVE_PIOV
+	FetchCopyBytes += *a_bytesFetchedP;
+#endif
+	afs_perfstats.fs_nFetchReads += nReads;
+	afs_perfstats.fs_FetchReadKBytes = (afs_int32)(FetchReadBytes >> 10);
+	afs_perfstats.fs_FetchCopyKBytes = (afs_int32)(FetchCopyBytes >> 10);
 	if (targLen < SIZE2)
 	    AFSCallStats.FetchSize2++;
 	else if (targLen < SIZE3)
@@ -6347,6 +6483,163 @@ GetLinkCountAndSize(Volume * vp, FdHandle_t * fdP, int *lc,
 #endif
 }
 
+static void *
+StoreWriterThread(void *unused)
+{
+    struct storeWrite *w;
+    ssize_t nBytes;
+
+    afs_pthread_setname_self("StoreWriter");
+    opr_mutex_enter(&storeWriters.lock);
+    while (1) {
+	while (opr_queue_IsEmpty(&storeWriters.queue))
+	    opr_cv_wait(&storeWriters.cv, &storeWriters.lock);
+	w = opr_queue_First(&storeWriters.queue, struct storeWrite, q);
+	opr_queue_Remove(&w->q);
+	opr_mutex_exit(&storeWriters.lock);
+
+	nBytes = FDH_PWRITE(w->pipe->fdP, w->data, w->len, w->pos);
+
+	opr_mutex_enter(&storeWriters.lock);
+	if (nBytes != w->len) {
+	    if (!w->pipe->error || w->pos < w->pipe->errorPos)
+		w->pipe->errorPos = w->pos;
+	    w->pipe->error = 1;
+	} else {
+	    w->pipe->written += nBytes;
+	}
+	w->pipe->inflight--;
+	opr_queue_Append(&w->pipe->idle, &w->q);
+	opr_cv_signal(&w->pipe->cv);
+    }
+    AFS_UNREACHED(return(NULL));
+}
+
+/*
+ * InitStoreWriters
+ *
+ * Purpose:
+ *	Start the threads which write pipelined StoreData calls to disk.
+ *	With no threads, all stores are written synchronously.
+ */
+void
+InitStoreWriters(int nThreads)
+{
+    pthread_t tid;
+    pthread_attr_t tattr;
+    int i;
+
+    opr_mutex_init(&storeWriters.lock);
+    opr_cv_init(&storeWriters.cv);
+    opr_queue_Init(&storeWriters.queue);
+
+    opr_Verify(pthread_attr_init(&tattr) == 0);
+    opr_Verify(pthread_attr_setdetachstate(&tattr,
+					   PTHREAD_CREATE_DETACHED) == 0);
+    for (i = 0; i < nThreads; i++)
+	opr_Verify(pthread_create(&tid, &tattr, StoreWriterThread, NULL) == 0);
+    storeWriters.nThreads = nThreads;
+}
+
+/*
+ * StoreData_Pipelined
+ *
+ * Purpose:
+ *	Copy Length bytes from the call to fdP at Pos, handing each
+ *	buffer to the writer threads as soon as it has been read, so that
+ *	the network and the disk are kept busy at the same time. The data
+ *	is all on disk (though not necessarily synced) when this returns.
+ *
+ *	Writes can complete out of order, so if one fails, later ones may
+ *	still have extended the file past it. The file is then truncated
+ *	back to the lowest failed offset, leaving no hole behind, and only
+ *	the bytes before it are counted in *a_bytesStoredP.
+ *
+ *	The data must be copied out of the rx packets, as rx_Readv would
+ *	free them on the next read while the write could still be pending.
+ */
+static afs_int32
+StoreData_Pipelined(struct rx_call *Call, FdHandle_t *fdP, afs_foff_t Pos,
+		    afs_sfsize_t Length, afs_int32 optSize,
+		    afs_sfsize_t *a_bytesStoredP)
+{
+    struct storePipe pipe;
+    struct storeWrite *w;
+    afs_sfsize_t bytesTransfered = 0;
+    afs_foff_t startPos = Pos;
+    afs_int32 errorCode = 0;
+    int i, rlen;
+
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.fdP = fdP;
+    opr_cv_init(&pipe.cv);
+    opr_queue_Init(&pipe.idle);
+    for (i = 0; i < FS_STORE_MAXINFLIGHT; i++) {
+	pipe.bufs[i].pipe = &pipe;
+	pipe.bufs[i].data = malloc(optSize);
+	if (pipe.bufs[i].data == NULL)
+	    ViceLogThenPanic(0, ("Failed malloc in StoreData_Pipelined\n"));
+	opr_queue_Append(&pipe.idle, &pipe.bufs[i].q);
+    }
+
+    while (bytesTransfered < Length) {
+	opr_mutex_enter(&storeWriters.lock);
+	while (opr_queue_IsEmpty(&pipe.idle))
+	    opr_cv_wait(&pipe.cv, &storeWriters.lock);
+	if (pipe.error) {
+	    opr_mutex_exit(&storeWriters.lock);
+	    break;
+	}
+	w = opr_queue_First(&pipe.idle, struct storeWrite, q);
+	opr_queue_Remove(&w->q);
+	opr_mutex_exit(&storeWriters.lock);
+
+	if (Length - bytesTransfered > optSize)
+	    rlen = optSize;
+	else
+	    rlen = (int)(Length - bytesTransfered);
+	rlen = rx_Read(Call, w->data, rlen);
+	if (rlen <= 0) {
+	    errorCode = -32;
+	    opr_mutex_enter(&storeWriters.lock);
+	    opr_queue_Append(&pipe.idle, &w->q);
+	    opr_mutex_exit(&storeWriters.lock);
+	    break;
+	}
+
+	w->pos = Pos;
+	w->len = rlen;
+	opr_mutex_enter(&storeWriters.lock);
+	pipe.inflight++;
+	opr_queue_Append(&storeWriters.queue, &w->q);
+	opr_cv_signal(&storeWriters.cv);
+	opr_mutex_exit(&storeWriters.lock);
+
+	bytesTransfered += rlen;
+	Pos += rlen;
+    }
+
+    /* Wait for everything we've queued to reach the disk */
+    opr_mutex_enter(&storeWriters.lock);
+    while (pipe.inflight > 0)
+	opr_cv_wait(&pipe.cv, &storeWriters.lock);
+    opr_mutex_exit(&storeWriters.lock);
+    if (pipe.error) {
+	(*a_bytesStoredP) += pipe.errorPos - startPos;
+	(void) FDH_TRUNC(fdP, pipe.errorPos);
+	if (errorCode == 0)
+	    errorCode = VDISKFULL;
+    } else {
+	(*a_bytesStoredP) += pipe.written;
+    }
+
+    for (i = 0; i < FS_STORE_MAXINFLIGHT; i++)
+	free(pipe.bufs[i].data);
+    opr_cv_destroy(&pipe.cv);
+
+    return errorCode;
+}
+
 /*
  * StoreData_RXStyle
  *
@@ -6550,6 +6843,11 @@ StoreData_RXStyle(Volume * volptr, Vnode * targetptr, struct AFSFid * Fid,
     } else {
 	/* have some data to copy */
 	(*a_bytesToStoreP) = Length;
+	if (storeWriters.nThreads > 0 && Length > optSize) {
+	    errorCode = StoreData_Pipelined(Call, fdP, Pos, Length, optSize,
+					    a_bytesStoredP);
+	    goto done;
+	}
 	while (1) {
 	    int rlen;
 	    if (bytesTransfered >= Length) {
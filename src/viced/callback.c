@@ -23,11 +23,12 @@
  *         reestablished
  *     Strict limit on number of call backs.
  *
- * InitCallBack(nblocks)
- *     Initialize: nblocks is max number # of file entries + # of callback entries
- *     nblocks must be < 65536
- *     Space used is nblocks*16 bytes
- *     Note that space will be reclaimed by breaking callbacks of old hosts
+ * InitCallBack(nblocks, maxblocks)
+ *     Initialize: nblocks is the number # of file entries + # of callback
+ *     entries to start with; the pool grows on demand up to maxblocks.
+ *     Space used is 32 bytes per file entry and per callback entry
+ *     Note that space will be reclaimed by breaking callbacks on the least
+ *     recently used files, and failing that on old hosts
  *
  * time = AddCallBack(host, fid)
  *     Add a call back.
@@ -90,9 +91,13 @@
 #ifdef HAVE_SYS_FILE_H
 #include <sys/file.h>
 #endif
+#ifndef AFS_NT40_ENV
+#include <sys/mman.h>
+#endif
 
 #include <afs/opr.h>
 #include <opr/lock.h>
+#include <opr/queue.h>
 #include <afs/nfs.h>		/* yuck.  This is an abomination. */
 #include <rx/rx.h>
 #include <rx/rx_queue.h>
@@ -125,8 +130,147 @@ struct cbcounters cbstuff;
 static struct FileEntry * FE = NULL;    /* don't use FE[0] */
 static struct CallBack * CB = NULL;     /* don't use CB[0] */
 
-static struct CallBack * CBfree = NULL;
-static struct FileEntry * FEfree = NULL;
+/*
+ * Call back state is split into CB_NUM_SHARDS shards by FE hash bucket, so
+ * that call backs on unrelated files can be added, broken and deleted
+ * without everyone serializing on H_LOCK.  A shard owns the FE hash buckets
+ * that map to it and every call back hanging off those FEs; it has its own
+ * free lists, timeout queues and counters, and each host keeps a separate
+ * call back list per shard (host->z.cblist[]).  All of that is protected by
+ * the shard lock.
+ *
+ * A shard lock is always taken last: after H_LOCK and after any host lock.
+ * No more than one shard lock is held at a time, except by LockAllShards,
+ * which takes them in index order.  Nothing that can block (an RPC, a host
+ * lock, H_LOCK) may be done with a shard lock held.
+ *
+ * The FE and CB arrays themselves are shared, so when a shard runs out of
+ * free entries it borrows them from the others; the per-shard nFEs and nCBs
+ * counts are therefore only meaningful when summed.
+ */
+struct cbShard {
+    pthread_mutex_t lock;
+    struct CallBack *CBfree;
+    struct FileEntry *FEfree;
+    /* Heads of CB queues; a timeout index is 1+index into this array */
+    afs_uint32 timeout[CB_NUM_TIMEOUT_QUEUES];
+    /* folded into cbstuff by GetCallBackCounters */
+    afs_int32 nFEs, nCBs;
+    afs_int32 AddCallBacks, BreakCallBacks, DeleteCallBacks, DeleteFiles;
+};
+
+static struct cbShard cbShards[CB_NUM_SHARDS];
+
+#define CB_SHARD_LOCK(sh)	opr_mutex_enter(&(sh)->lock)
+#define CB_SHARD_UNLOCK(sh)	opr_mutex_exit(&(sh)->lock)
+
+/* shard owning the call backs for a fid, or for a file entry */
+#define FidShard(fid)	(&cbShards[CBShardIndex((fid)->Volume, (fid)->Unique)])
+#define FEShard(fe)	(&cbShards[CBShardIndex((fe)->volid, (fe)->unique)])
+#define ShardIndex(sh)	((sh) - cbShards)
+
+#ifndef INTERPRET_DUMP
+/*
+ * The FE and CB arrays are reserved up front for the largest the pool may
+ * grow to, but only the first -cb entries are put on the free lists.  When
+ * every shard runs out, GrowCallBackPool adds the next CB_GROW_CHUNK
+ * entries, so memory is only touched as the pool grows and FE and CB never
+ * move.  Once the pool is at its limit, GetSomeSpace_r reclaims space by
+ * breaking the call backs on the least recently used files.
+ */
+#if !defined(AFS_NT40_ENV) && !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+#if !defined(AFS_NT40_ENV) && defined(MAP_ANONYMOUS)
+# define CB_POOL_USE_MMAP 1
+# ifndef MAP_NORESERVE
+#  define MAP_NORESERVE 0
+# endif
+#endif
+
+#define CB_GROW_CHUNK	16384	/* entries added each time the pool grows */
+#define CB_EVICT_BATCH	64	/* file entries reclaimed by each eviction */
+
+static struct {
+    pthread_mutex_t lock;	/* serializes growth */
+    afs_int32 maxblks;		/* the most entries the pool may hold */
+    afs_int32 grows;		/* times the pool has grown */
+    afs_int32 evicted;		/* file entries reclaimed, under H_LOCK */
+    afs_uint32 hand;		/* clock hand for eviction, under H_LOCK */
+    struct cbEvicted *deferred;	/* evicted breaks not yet sent, under H_LOCK */
+} cbPool;
+
+/*
+ * With no break threads, the breaks for evicted files cannot be sent by
+ * EvictCallBacks_r, as its caller holds a host lock, and a failed break
+ * would have to lock another host.  They are kept here instead, and sent
+ * by BreakEvictedCallBacks_r once no host is locked.
+ */
+struct cbEvicted {
+    struct cbEvicted *next;
+    AFSFid fid;
+    int ncbas;
+    struct cbstruct cba[1];	/* really ncbas */
+};
+
+/*
+ * Callback breaks are delivered by a pool of break threads, so that a
+ * change to a popular file does not leave the thread making it talking to
+ * each client in turn.  BreakCallBack removes the call backs from the
+ * tables as before, but then queues a break for each host rather than
+ * sending it.  Breaks queued for the same host are coalesced, up to
+ * AFSCBMAX fids to a CallBack RPC, and only one RPC is outstanding to a
+ * host at a time; a host that fails is marked down, and anything still
+ * queued for it becomes a delayed call back without another attempt.
+ *
+ * The thread making a change still waits until each of its breaks has
+ * either been delivered or left as a delayed call back, as that is what
+ * keeps the client caches coherent.  Volume breaks from BreakLaterCallBacks
+ * are already deferred, so they are queued without waiting.
+ *
+ * Each queued break keeps the hold on its host taken by BreakCallBack.
+ * cbBreaks.lock is only ever taken last, and is never held over anything
+ * that can block.
+ */
+struct cbBreakWait {
+    pthread_cond_t cv;
+    int pending;		/* breaks not yet delivered */
+};
+
+struct cbBreakItem {
+    struct opr_queue q;
+    AFSFid fid;
+    afs_uint32 thead;		/* timeout queue, for a delayed call back */
+    struct cbBreakWait *wait;	/* NULL if no one is waiting */
+    struct timeval queued;
+};
+
+struct cbBreakHost {
+    struct opr_queue q;		/* on cbBreaks.ready */
+    struct cbBreakHost *hnext;	/* hash chain */
+    struct host *host;
+    struct opr_queue items;	/* breaks queued for this host */
+    int nitems;
+    int busy;			/* a break thread is sending to the host */
+};
+
+#define CB_BREAK_HASH_SIZE	256	/* power of 2 */
+#define CB_BREAK_HASH(host)	(h_htoi(host) & (CB_BREAK_HASH_SIZE - 1))
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cv;		/* signalled when a host becomes ready */
+    struct opr_queue ready;	/* idle hosts with breaks queued */
+    struct cbBreakHost *hash[CB_BREAK_HASH_SIZE];
+    struct opr_queue freeItems;
+    int nThreads;
+    /* statistics; see GetCallBackBreakCounters */
+    afs_int32 queued, queuedMax;
+    afs_int32 batches, fids, failed;
+    afs_uint64 nDone, totalMsec;
+    afs_int32 maxMsec;
+} cbBreaks;
+#endif /* INTERPRET_DUMP */
 
 
 /* Time to live for call backs depends upon number of users of the file.
@@ -151,9 +295,6 @@ static int TimeOuts[] = {
 static int MinTimeOut = (7 * 60);
 #endif
 
-/* Heads of CB queues; a timeout index is 1+index into this array */
-static afs_uint32 timeout[CB_NUM_TIMEOUT_QUEUES];
-
 static afs_int32 tfirst;	/* cbtime of oldest unexpired call back time queue */
 
 
@@ -166,35 +307,48 @@ struct object {
 static struct FileEntry *FindFE(AFSFid * fid);
 
 #ifndef INTERPRET_DUMP
-static struct CallBack *iGetCB(int *nused);
-static int iFreeCB(struct CallBack *cb, int *nused);
-static struct FileEntry *iGetFE(int *nused);
-static int iFreeFE(struct FileEntry *fe, int *nused);
-static int TAdd(struct CallBack *cb, afs_uint32 * thead);
-static int TDel(struct CallBack *cb);
-static int HAdd(struct CallBack *cb, struct host *host);
-static int HDel(struct CallBack *cb);
-static int CDel(struct CallBack *cb, int deletefe);
-static int CDelPtr(struct FileEntry *fe, afs_uint32 * cbp,
+static struct CallBack *iGetCB(struct cbShard *sh, int *nused);
+static int iFreeCB(struct cbShard *sh, struct CallBack *cb, int *nused);
+static struct FileEntry *iGetFE(struct cbShard *sh, int *nused);
+static int iFreeFE(struct cbShard *sh, struct FileEntry *fe, int *nused);
+static int GetEntries(struct cbShard *sh, struct CallBack **cbp,
+		      struct FileEntry **fep);
+static int GrowCallBackPool(struct cbShard *sh, afs_int32 nblks);
+static int EvictCallBacks_r(struct host *hostp, int want);
+static void BreakEvictedCallBacks_r(void);
+static int TAdd(struct cbShard *sh, struct CallBack *cb, afs_uint32 * thead);
+static int TDel(struct cbShard *sh, struct CallBack *cb);
+static int HAdd(struct cbShard *sh, struct CallBack *cb, struct host *host);
+static int HDel(struct cbShard *sh, struct CallBack *cb);
+static int CDel(struct cbShard *sh, struct CallBack *cb, int deletefe);
+static int CDelPtr(struct cbShard *sh, struct FileEntry *fe, afs_uint32 * cbp,
 		   int deletefe);
 static afs_uint32 *FindCBPtr(struct FileEntry *fe, struct host *host);
-static int FDel(struct FileEntry *fe);
-static int AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 * thead,
-			  int type, int locked);
+static int FDel(struct cbShard *sh, struct FileEntry *fe);
+static int AddCallBackEntry(struct cbShard *sh, struct host *host,
+			    AFSFid * fid, afs_uint32 thead, int type,
+			    struct CallBack *newcb, struct FileEntry *newfe);
+static int AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 thead,
+			  int type);
 static void MultiBreakCallBack_r(struct cbstruct cba[], int ncbas,
 				 struct AFSCBFids *afidp);
+static void BreakCallBacks_r(struct cbstruct cba[], int ncbas, AFSFid * fid,
+			     struct cbBreakWait *wait);
+static void WaitForBreaks(struct cbBreakWait *wait);
 static int MultiBreakVolumeCallBack_r(struct host *host,
 				      struct VCBParams *parms, int deletefe);
 static int MultiBreakVolumeLaterCallBack(struct host *host, void *rock);
 static int GetSomeSpace_r(struct host *hostp, int locked);
 static int ClearHostCallbacks_r(struct host *hp, int locked);
+static void LockAllShards(void);
+static void UnlockAllShards(void);
 static int DumpCallBackState_r(void);
 #endif
 
-#define GetCB() ((struct CallBack *)iGetCB(&cbstuff.nCBs))
-#define GetFE() ((struct FileEntry *)iGetFE(&cbstuff.nFEs))
-#define FreeCB(cb) iFreeCB((struct CallBack *)cb, &cbstuff.nCBs)
-#define FreeFE(fe) iFreeFE((struct FileEntry *)fe, &cbstuff.nFEs)
+#define GetCB(sh) iGetCB((sh), &(sh)->nCBs)
+#define GetFE(sh) iGetFE((sh), &(sh)->nFEs)
+#define FreeCB(sh, cb) iFreeCB((sh), (struct CallBack *)cb, &(sh)->nCBs)
+#define FreeFE(sh, fe) iFreeFE((sh), (struct FileEntry *)fe, &(sh)->nFEs)
 
 
 /* Other protos - move out sometime */
@@ -222,50 +376,125 @@ FindFE(AFSFid * fid)
 #ifndef INTERPRET_DUMP
 
 static struct CallBack *
-iGetCB(int *nused)
+iGetCB(struct cbShard *sh, int *nused)
 {
     struct CallBack *ret;
 
-    if ((ret = CBfree)) {
-	CBfree = (struct CallBack *)(((struct object *)ret)->next);
+    if ((ret = sh->CBfree)) {
+	sh->CBfree = (struct CallBack *)(((struct object *)ret)->next);
 	(*nused)++;
     }
     return ret;
 }
 
 static int
-iFreeCB(struct CallBack *cb, int *nused)
+iFreeCB(struct cbShard *sh, struct CallBack *cb, int *nused)
 {
-    ((struct object *)cb)->next = (struct object *)CBfree;
-    CBfree = cb;
+    ((struct object *)cb)->next = (struct object *)sh->CBfree;
+    sh->CBfree = cb;
     (*nused)--;
     return 0;
 }
 
 static struct FileEntry *
-iGetFE(int *nused)
+iGetFE(struct cbShard *sh, int *nused)
 {
     struct FileEntry *ret;
 
-    if ((ret = FEfree)) {
-	FEfree = (struct FileEntry *)(((struct object *)ret)->next);
+    if ((ret = sh->FEfree)) {
+	sh->FEfree = (struct FileEntry *)(((struct object *)ret)->next);
 	(*nused)++;
     }
     return ret;
 }
 
 static int
-iFreeFE(struct FileEntry *fe, int *nused)
+iFreeFE(struct cbShard *sh, struct FileEntry *fe, int *nused)
 {
-    ((struct object *)fe)->next = (struct object *)FEfree;
-    FEfree = fe;
+    fe->status = FE_FREE;	/* for EvictCallBacks_r */
+    ((struct object *)fe)->next = (struct object *)sh->FEfree;
+    sh->FEfree = fe;
     (*nused)--;
     return 0;
 }
 
+/*
+ * Make sure *cbp and *fep point to free entries, taking them from the free
+ * lists of shard sh if possible and from the other shards otherwise.
+ * Entries already in *cbp or *fep are kept, and either pointer may be NULL
+ * if that kind of entry is not wanted.  If every shard is out of space the
+ * pool is grown; returns 0 if it is already as large as it may get.
+ * Called with no shard locked.
+ */
+static int
+GetEntries(struct cbShard *sh, struct CallBack **cbp, struct FileEntry **fep)
+{
+    int i;
+    afs_int32 nblks;
+    struct cbShard *from;
+
+    do {
+	nblks = cbstuff.nblks;
+	for (i = 0; i < CB_NUM_SHARDS && ((cbp && !*cbp) || (fep && !*fep));
+	     i++) {
+	    from = &cbShards[(ShardIndex(sh) + i) & CB_SHARD_MASK];
+	    CB_SHARD_LOCK(from);
+	    if (cbp && !*cbp)
+		*cbp = GetCB(from);
+	    if (fep && !*fep)
+		*fep = GetFE(from);
+	    CB_SHARD_UNLOCK(from);
+	}
+	if ((!cbp || *cbp) && (!fep || *fep))
+	    return 1;
+    } while (GrowCallBackPool(sh, nblks));
+    return 0;
+}
+
+/*
+ * Add the next CB_GROW_CHUNK entries of the FE and CB arrays to the free
+ * lists of shard sh.  nblks is the size of the pool when the caller found
+ * it empty; if it has grown since then, there is nothing to do but look
+ * again.  Returns 0 if the pool may not grow any larger.
+ */
+static int
+GrowCallBackPool(struct cbShard *sh, afs_int32 nblks)
+{
+    afs_int32 i, first, last;
+
+    opr_mutex_enter(&cbPool.lock);
+    if (cbstuff.nblks != nblks) {
+	opr_mutex_exit(&cbPool.lock);
+	return 1;
+    }
+    first = nblks + 1;
+    last = nblks + min(CB_GROW_CHUNK, cbPool.maxblks - nblks);
+    if (last < first) {
+	opr_mutex_exit(&cbPool.lock);
+	return 0;
+    }
+
+    CB_SHARD_LOCK(sh);
+    for (i = last; i >= first; i--) {
+	FreeFE(sh, &FE[i]);
+	FreeCB(sh, &CB[i]);
+    }
+    /* the Free calls above counted these as entries being returned */
+    sh->nFEs += last - first + 1;
+    sh->nCBs += last - first + 1;
+    cbstuff.nblks = last;
+    CB_SHARD_UNLOCK(sh);
+    cbPool.grows++;
+    opr_mutex_exit(&cbPool.lock);
+
+    ViceLog(0, ("Callback pool grown to %d entries (limit %d)\n", last,
+		cbPool.maxblks));
+    return 1;
+}
+
 /* Add cb to end of specified timeout list */
 static int
-TAdd(struct CallBack *cb, afs_uint32 * thead)
+TAdd(struct cbShard *sh, struct CallBack *cb, afs_uint32 * thead)
 {
     if (!*thead) {
 	(*thead) = cb->tnext = cb->tprev = cbtoi(cb);
@@ -281,15 +510,15 @@ TAdd(struct CallBack *cb, afs_uint32 * thead)
 		thp->tprev = cbtoi(cb);
 	}
     }
-    cb->thead = ttoi(thead);
+    cb->thead = ttoi(sh, thead);
     return 0;
 }
 
 /* Delete call back entry from timeout list */
 static int
-TDel(struct CallBack *cb)
+TDel(struct cbShard *sh, struct CallBack *cb)
 {
-    afs_uint32 *thead = itot(cb->thead);
+    afs_uint32 *thead = itot(sh, cb->thead);
 
     if (*thead == cbtoi(cb))
 	*thead = (*thead == cb->tnext ? 0 : cb->tnext);
@@ -302,13 +531,15 @@ TDel(struct CallBack *cb)
 
 /* Add cb to end of specified host list */
 static int
-HAdd(struct CallBack *cb, struct host *host)
+HAdd(struct cbShard *sh, struct CallBack *cb, struct host *host)
 {
+    afs_uint32 *hhead = &host->z.cblist[ShardIndex(sh)];
+
     cb->hhead = h_htoi(host);
-    if (!host->z.cblist) {
-	host->z.cblist = cb->hnext = cb->hprev = cbtoi(cb);
+    if (!*hhead) {
+	*hhead = cb->hnext = cb->hprev = cbtoi(cb);
     } else {
-	struct CallBack *fcb = itocb(host->z.cblist);
+	struct CallBack *fcb = itocb(*hhead);
 
 	cb->hprev = fcb->hprev;
 	cb->hnext = cbtoi(fcb);
@@ -319,9 +550,9 @@ HAdd(struct CallBack *cb, struct host *host)
 
 /* Delete call back entry from host list */
 static int
-HDel(struct CallBack *cb)
+HDel(struct cbShard *sh, struct CallBack *cb)
 {
-    afs_uint32 *hhead = &h_itoh(cb->hhead)->z.cblist;
+    afs_uint32 *hhead = &h_itoh(cb->hhead)->z.cblist[ShardIndex(sh)];
 
     if (*hhead == cbtoi(cb))
 	*hhead = (*hhead == cb->hnext ? 0 : cb->hnext);
@@ -335,7 +566,7 @@ HDel(struct CallBack *cb)
  * make sure that it is not on any other list before calling this
  * routine */
 static int
-CDel(struct CallBack *cb, int deletefe)
+CDel(struct cbShard *sh, struct CallBack *cb, int deletefe)
 {
     int cbi = cbtoi(cb);
     struct FileEntry *fe = itofe(cb->fhead);
@@ -352,7 +583,7 @@ CDel(struct CallBack *cb, int deletefe)
 	    ShutDownAndCore(PANIC);
 	}
     }
-    CDelPtr(fe, cbp, deletefe);
+    CDelPtr(sh, fe, cbp, deletefe);
     return 0;
 }
 
@@ -364,7 +595,7 @@ CDel(struct CallBack *cb, int deletefe)
 static int Ccdelpt = 0, CcdelB = 0;
 
 static int
-CDelPtr(struct FileEntry *fe, afs_uint32 * cbp,
+CDelPtr(struct cbShard *sh, struct FileEntry *fe, afs_uint32 * cbp,
 	int deletefe)
 {
     struct CallBack *cb;
@@ -376,9 +607,9 @@ CDelPtr(struct FileEntry *fe, afs_uint32 * cbp,
     if (cb != &CB[*cbp])
 	CcdelB++;
     *cbp = cb->cnext;
-    FreeCB(cb);
+    FreeCB(sh, cb);
     if ((--fe->ncbs == 0) && deletefe)
-	FDel(fe);
+	FDel(sh, fe);
     return 0;
 }
 
@@ -405,7 +636,7 @@ FindCBPtr(struct FileEntry *fe, struct host *host)
 
 /* Delete file entry from hash table */
 static int
-FDel(struct FileEntry *fe)
+FDel(struct cbShard *sh, struct FileEntry *fe)
 {
     int fei = fetoi(fe);
     afs_uint32 *p = &HashTable[FEHash(fe->volid, fe->unique)];
@@ -414,38 +645,83 @@ FDel(struct FileEntry *fe)
 	p = &itofe(*p)->fnext;
     opr_Assert(*p);
     *p = fe->fnext;
-    FreeFE(fe);
+    FreeFE(sh, fe);
     return 0;
 }
 
+/* Take every shard lock, in index order */
+static void
+LockAllShards(void)
+{
+    int i;
+
+    for (i = 0; i < CB_NUM_SHARDS; i++)
+	CB_SHARD_LOCK(&cbShards[i]);
+}
+
+static void
+UnlockAllShards(void)
+{
+    int i;
+
+    for (i = CB_NUM_SHARDS - 1; i >= 0; i--)
+	CB_SHARD_UNLOCK(&cbShards[i]);
+}
+
 /* initialize the callback package */
 int
-InitCallBack(int nblks)
+InitCallBack(int nblks, int maxblks)
 {
-    opr_Assert(nblks > 0);
+    int i;
+
+    opr_Assert(nblks > 0 && maxblks >= nblks);
 
     H_LOCK;
+    for (i = 0; i < CB_NUM_SHARDS; i++)
+	opr_mutex_init(&cbShards[i].lock);
+    opr_mutex_init(&cbPool.lock);
     tfirst = CBtime(time(NULL));
-    /* N.B. The "-1", below, is because
-     * FE[0] and CB[0] are not used--and not allocated */
-    FE = calloc(nblks, sizeof(struct FileEntry));
-    if (!FE) {
-	ViceLogThenPanic(0, ("Failed malloc in InitCallBack\n"));
+    /* Reserve space for the whole pool; with mmap, the pages beyond the
+     * first nblks entries are not used until the pool grows into them.
+     * N.B. The "+1" and "-1", below, are because FE[0] and CB[0] are not
+     * used--and not allocated */
+#ifdef CB_POOL_USE_MMAP
+    FE = mmap(NULL, (size_t)maxblks * sizeof(struct FileEntry),
+	      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+	      -1, 0);
+    CB = mmap(NULL, (size_t)maxblks * sizeof(struct CallBack),
+	      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+	      -1, 0);
+    if (FE == MAP_FAILED || CB == MAP_FAILED) {
+	ViceLog(0, ("Couldn't reserve space for %d callbacks; the callback "
+		    "pool will not grow beyond %d\n", maxblks, nblks));
+	if (FE != MAP_FAILED)
+	    munmap(FE, (size_t)maxblks * sizeof(struct FileEntry));
+	if (CB != MAP_FAILED)
+	    munmap(CB, (size_t)maxblks * sizeof(struct CallBack));
+	maxblks = nblks;
+	FE = calloc(nblks, sizeof(struct FileEntry));
+	CB = calloc(nblks, sizeof(struct CallBack));
     }
-    FE--;  /* FE[0] is supposed to point to junk */
-    cbstuff.nFEs = nblks;
-    while (cbstuff.nFEs)
-	FreeFE(&FE[cbstuff.nFEs]);	/* This is correct */
+#else
+    maxblks = nblks;
+    FE = calloc(nblks, sizeof(struct FileEntry));
     CB = calloc(nblks, sizeof(struct CallBack));
-    if (!CB) {
+#endif
+    if (!FE || !CB) {
 	ViceLogThenPanic(0, ("Failed malloc in InitCallBack\n"));
     }
+    FE--;  /* FE[0] is supposed to point to junk */
+    for (i = nblks; i > 0; i--)
+	FreeFE(&cbShards[i & CB_SHARD_MASK], &FE[i]);	/* This is correct */
     CB--;  /* CB[0] is supposed to point to junk */
-    cbstuff.nCBs = nblks;
-    while (cbstuff.nCBs)
-	FreeCB(&CB[cbstuff.nCBs]);	/* This is correct */
+    for (i = nblks; i > 0; i--)
+	FreeCB(&cbShards[i & CB_SHARD_MASK], &CB[i]);	/* This is correct */
+    for (i = 0; i < CB_NUM_SHARDS; i++)
+	cbShards[i].nFEs = cbShards[i].nCBs = 0;
     cbstuff.nblks = nblks;
     cbstuff.nbreakers = 0;
+    cbPool.maxblks = maxblks;
     H_UNLOCK;
     return 0;
 }
@@ -493,81 +769,91 @@ XCallBackBulk_r(struct host * ahost, struct AFSFid * fids, afs_int32 nfids)
 }
 
 /* the locked flag tells us if the host entry has already been locked
- * by our parent.  I don't think anybody actually calls us with the
- * host locked, but here's how to make that work:  GetSomeSpace has to
- * change so that it doesn't attempt to lock any hosts < "host".  That
- * means that it might be unable to free any objects, so it has to
- * return an exit status.  If it fails, then AddCallBack1 might fail,
- * as well. If so, the host->ResetDone should probably be set to 0,
- * and we probably don't want to return a callback promise to the
- * cache manager, either. */
+ * by our parent.  H_LOCK is only needed if every shard has run out of
+ * free entries, so that GetSomeSpace_r can reclaim some. */
 int
-AddCallBack1(struct host *host, AFSFid * fid, afs_uint32 * thead, int type,
+AddCallBack1(struct host *host, AFSFid * fid, afs_uint32 thead, int type,
 	     int locked)
 {
+    struct cbShard *sh = FidShard(fid);
+    struct CallBack *newcb = NULL;
+    struct FileEntry *newfe = NULL;
     int retVal = 0;
-    H_LOCK;
+    int reclaimed = 0;
+
     if (!locked) {
-	h_Lock_r(host);
+	h_Lock(host);
+    }
+    if (!(host->z.hostFlags & HOSTDELETED)) {
+	if (!GetEntries(sh, &newcb, &newfe)) {
+	    H_LOCK;
+	    host->z.Console |= 2;
+	    while (!GetEntries(sh, &newcb, &newfe))
+		GetSomeSpace_r(host, 1);
+	    host->z.Console &= ~2;
+	    H_UNLOCK;
+	    reclaimed = 1;
+	}
+	retVal = AddCallBackEntry(sh, host, fid, thead, type, newcb, newfe);
     }
-    if (!(host->z.hostFlags & HOSTDELETED))
-        retVal = AddCallBack1_r(host, fid, thead, type, 1);
 
     if (!locked) {
-	h_Unlock_r(host);
+	h_Unlock(host);
+	if (reclaimed) {
+	    H_LOCK;
+	    BreakEvictedCallBacks_r();
+	    H_UNLOCK;
+	}
     }
-    H_UNLOCK;
     return retVal;
 }
 
+/* Same as AddCallBack1, but called with H_LOCK held and the host locked */
 static int
-AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 * thead, int type,
-	       int locked)
+AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 thead, int type)
+{
+    struct cbShard *sh = FidShard(fid);
+    struct CallBack *newcb = NULL;
+    struct FileEntry *newfe = NULL;
+
+    host->z.Console |= 2;
+    while (!GetEntries(sh, &newcb, &newfe))
+	GetSomeSpace_r(host, 1);
+    host->z.Console &= ~2;
+
+    return AddCallBackEntry(sh, host, fid, thead, type, newcb, newfe);
+}
+
+/*
+ * Add or extend the callback of host on fid, using the free entries newcb
+ * and newfe if they are needed; whatever is not used goes back on the free
+ * lists of shard sh.  The host must be locked.  thead is the timeout queue
+ * index for CB_DELAYED callbacks, and is ignored for the other types.
+ */
+static int
+AddCallBackEntry(struct cbShard *sh, struct host *host, AFSFid * fid,
+		 afs_uint32 thead, int type, struct CallBack *newcb,
+		 struct FileEntry *newfe)
 {
     struct FileEntry *fe;
     struct CallBack *cb = 0, *lastcb = 0;
-    struct FileEntry *newfe = 0;
     afs_uint32 time_out = 0;
-    afs_uint32 *Thead = thead;
-    struct CallBack *newcb = 0;
+    afs_uint32 *Thead;
     int safety;
 
-    cbstuff.AddCallBacks++;
-
-    host->z.Console |= 2;
-
-    /* allocate these guys first, since we can't call the allocator with
-     * the host structure locked -- or we might deadlock. However, we have
-     * to avoid races with FindFE... */
-    while (!(newcb = GetCB())) {
-	GetSomeSpace_r(host, locked);
-    }
-    while (!(newfe = GetFE())) {	/* Get it now, so we don't have to call */
-	/* GetSomeSpace with the host locked, later.  This might turn out to */
-	/* have been unneccessary, but that's actually kind of unlikely, since */
-	/* most files are not shared. */
-	GetSomeSpace_r(host, locked);
-    }
-
-    if (!locked) {
-	h_Lock_r(host);		/* this can yield, so do it before we get any */
-	/* fragile info */
-	if (host->z.hostFlags & HOSTDELETED) {
-	    host->z.Console &= ~2;
-            h_Unlock_r(host);
-            return 0;
-        }
-    }
+    CB_SHARD_LOCK(sh);
+    sh->AddCallBacks++;
 
+    Thead = thead ? itot(sh, thead) : NULL;
     fe = FindFE(fid);
     if (type == CB_NORMAL) {
 	time_out =
 	    TimeCeiling(time(NULL) + TimeOut(fe ? fe->ncbs : 0) +
 			ServerBias);
-	Thead = THead(CBtime(time_out));
+	Thead = THead(sh, CBtime(time_out));
     } else if (type == CB_VOLUME) {
 	time_out = TimeCeiling((60 * 120 + time(NULL)) + ServerBias);
-	Thead = THead(CBtime(time_out));
+	Thead = THead(sh, CBtime(time_out));
     } else if (type == CB_BULK) {
 	/* bulk status can get so many callbacks all at once, and most of them
 	 * are probably not for things that will be used for long.
@@ -575,11 +861,9 @@ AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 * thead, int type,
 	time_out =
 	    TimeCeiling(time(NULL) + ServerBias +
 			TimeOut(22 + (fe ? fe->ncbs : 0)));
-	Thead = THead(CBtime(time_out));
+	Thead = THead(sh, CBtime(time_out));
     }
 
-    host->z.Console &= ~2;
-
     if (!fe) {
 	afs_uint32 hash;
 
@@ -595,6 +879,7 @@ AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 * thead, int type,
 	fe->fnext = HashTable[hash];
 	HashTable[hash] = fetoi(fe);
     }
+    fe->status |= FE_REFERENCED;
     for (safety = 0, lastcb = cb = itocb(fe->firstcb); cb;
 	 lastcb = cb, cb = itocb(cb->cnext), safety++) {
 	if (safety > cbstuff.nblks) {
@@ -610,9 +895,9 @@ AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 * thead, int type,
 	if (cb->status != CB_DELAYED)
 	    cb->status = type;
 	/* Only move if new timeout is longer */
-	if (TNorm(ttoi(Thead)) > TNorm(cb->thead)) {
-	    TDel(cb);
-	    TAdd(cb, Thead);
+	if (TNorm(ttoi(sh, Thead)) > TNorm(cb->thead)) {
+	    TDel(sh, cb);
+	    TAdd(sh, cb, Thead);
 	}
 	if (newfe == NULL) {    /* we are using the new FE */
             fe->firstcb = cbtoi(cb);
@@ -628,18 +913,16 @@ AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 * thead, int type,
 	cb->fhead = fetoi(fe);
 	cb->status = type;
 	cb->flags = 0;
-	HAdd(cb, host);
-	TAdd(cb, Thead);
+	HAdd(sh, cb, host);
+	TAdd(sh, cb, Thead);
     }
 
     /* now free any still-unused callback or host entries */
     if (newcb)
-	FreeCB(newcb);
+	FreeCB(sh, newcb);
     if (newfe)
-	FreeFE(newfe);
-
-    if (!locked)		/* freecb and freefe might(?) yield */
-	h_Unlock_r(host);
+	FreeFE(sh, newfe);
+    CB_SHARD_UNLOCK(sh);
 
     if (type == CB_NORMAL || type == CB_VOLUME || type == CB_BULK)
 	return time_out - ServerBias;	/* Expires sooner at workstation */
@@ -756,8 +1039,8 @@ MultiBreakCallBack_r(struct cbstruct cba[], int ncbas,
                             /**
                              * We always go into AddCallBack1_r with the host locked
                              */
-                            AddCallBack1_r(hp, afidp->AFSCBFids_val, itot(idx),
-                                           CB_DELAYED, 1);
+                            AddCallBack1_r(hp, afidp->AFSCBFids_val, idx,
+                                           CB_DELAYED);
                         }
 			h_Unlock_r(hp);
 			H_UNLOCK;
@@ -791,6 +1074,301 @@ MultiBreakCallBack_r(struct cbstruct cba[], int ncbas,
     return;
 }
 
+/*
+ * Send a batch of breaks to a single host.  If the host cannot be reached,
+ * mark it down and leave delayed call backs behind, so the breaks are made
+ * when it is next heard from.  Returns 1 if the breaks were not delivered,
+ * and sets *sent if an RPC was made.
+ */
+static int
+SendCallBackBreaks(struct host *host, struct AFSFid *fids,
+		   afs_uint32 *theads, int nfids, int *sent)
+{
+    static struct AFSCBs tc = { 0, 0 };
+    struct AFSCBFids tf;
+    struct rx_connection *cb_conn;
+    int code, i;
+    char hoststr[16];
+
+    tf.AFSCBFids_len = nfids;
+    tf.AFSCBFids_val = fids;
+    *sent = 0;
+
+    H_LOCK;
+    if (host->z.hostFlags & HOSTDELETED) {
+	H_UNLOCK;
+	return 0;
+    }
+    if (!(host->z.hostFlags & VENUSDOWN)) {
+	cb_conn = host->z.callback_rxcon;
+	rx_GetConnection(cb_conn);
+	rx_SetConnDeadTime(cb_conn, 4);
+	rx_SetConnHardDeadTime(cb_conn, AFS_HARDDEADTIME);
+	cbstuff.nbreakers++;
+	H_UNLOCK;
+	code = RXAFSCB_CallBack(cb_conn, &tf, &tc);
+	rx_PutConnection(cb_conn);
+	*sent = 1;
+	/* try breaking callbacks on alternate interface addresses */
+	if (code)
+	    code = MultiBreakCallBackAlternateAddress(host, &tf);
+	H_LOCK;
+	cbstuff.nbreakers--;
+	if (!code) {
+	    H_UNLOCK;
+	    return 0;
+	}
+	if (ShowProblems) {
+	    ViceLog(7,
+		    ("BCB: Failed on %d files starting with %u.%u.%u, "
+		     "Host %p (%s:%d) is down\n",
+		     nfids, fids[0].Volume, fids[0].Vnode, fids[0].Unique,
+		     host, afs_inet_ntoa_r(host->z.host, hoststr),
+		     ntohs(host->z.port)));
+	}
+    }
+
+    h_Lock_r(host);
+    if (!(host->z.hostFlags & HOSTDELETED)) {
+	host->z.hostFlags |= VENUSDOWN;
+	for (i = 0; i < nfids; i++)
+	    AddCallBack1_r(host, &fids[i], theads[i], CB_DELAYED);
+    }
+    h_Unlock_r(host);
+    H_UNLOCK;
+    return 1;
+}
+
+static void *
+CallBackBreakThread(void *unused)
+{
+    struct cbBreakHost *bh, **bhp;
+    struct cbBreakItem *items[AFSCBMAX];
+    struct AFSFid fids[AFSCBMAX];
+    afs_uint32 theads[AFSCBMAX];
+    struct host *host;
+    struct timeval now;
+    afs_int32 msec;
+    int i, n, failed, sent;
+
+    afs_pthread_setname_self("CallBackBreak");
+    opr_mutex_enter(&cbBreaks.lock);
+    while (1) {
+	while (opr_queue_IsEmpty(&cbBreaks.ready))
+	    opr_cv_wait(&cbBreaks.cv, &cbBreaks.lock);
+	bh = opr_queue_First(&cbBreaks.ready, struct cbBreakHost, q);
+	opr_queue_Remove(&bh->q);
+	bh->busy = 1;
+	host = bh->host;
+	for (n = 0; n < AFSCBMAX && !opr_queue_IsEmpty(&bh->items); n++) {
+	    items[n] = opr_queue_First(&bh->items, struct cbBreakItem, q);
+	    opr_queue_Remove(&items[n]->q);
+	    fids[n] = items[n]->fid;
+	    theads[n] = items[n]->thead;
+	}
+	bh->nitems -= n;
+	cbBreaks.queued -= n;
+	opr_mutex_exit(&cbBreaks.lock);
+
+	failed = SendCallBackBreaks(host, fids, theads, n, &sent);
+
+	gettimeofday(&now, NULL);
+	opr_mutex_enter(&cbBreaks.lock);
+	if (sent) {
+	    cbBreaks.batches++;
+	    cbBreaks.fids += n;
+	}
+	if (failed)
+	    cbBreaks.failed++;
+	for (i = 0; i < n; i++) {
+	    msec = (now.tv_sec - items[i]->queued.tv_sec) * 1000
+		+ (now.tv_usec - items[i]->queued.tv_usec) / 1000;
+	    cbBreaks.nDone++;
+	    cbBreaks.totalMsec += msec;
+	    if (msec > cbBreaks.maxMsec)
+		cbBreaks.maxMsec = msec;
+	    if (items[i]->wait && --items[i]->wait->pending == 0)
+		opr_cv_signal(&items[i]->wait->cv);
+	    opr_queue_Prepend(&cbBreaks.freeItems, &items[i]->q);
+	}
+	bh->busy = 0;
+	if (bh->nitems > 0) {
+	    opr_queue_Append(&cbBreaks.ready, &bh->q);
+	} else {
+	    for (bhp = &cbBreaks.hash[CB_BREAK_HASH(host)]; *bhp != bh;
+		 bhp = &(*bhp)->hnext)
+		;
+	    *bhp = bh->hnext;
+	    free(bh);
+	}
+	opr_mutex_exit(&cbBreaks.lock);
+
+	/* drop the holds taken by BreakCallBack for each break */
+	H_LOCK;
+	for (i = 0; i < n; i++)
+	    h_Release_r(host);
+	H_UNLOCK;
+
+	opr_mutex_enter(&cbBreaks.lock);
+    }
+    AFS_UNREACHED(return(NULL));
+}
+
+/*
+ * Queue a break on fid for each of the held hosts in cba, for the break
+ * threads to send.  Called with H_LOCK held; does not block.
+ */
+static void
+QueueCallBackBreaks_r(struct cbstruct cba[], int ncbas, AFSFid * fid,
+		      struct cbBreakWait *wait)
+{
+    struct cbBreakHost *bh;
+    struct cbBreakItem *item;
+    struct timeval now;
+    int i;
+
+    gettimeofday(&now, NULL);
+    opr_mutex_enter(&cbBreaks.lock);
+    for (i = 0; i < ncbas; i++) {
+	struct host *host = cba[i].hp;
+
+	for (bh = cbBreaks.hash[CB_BREAK_HASH(host)]; bh; bh = bh->hnext)
+	    if (bh->host == host)
+		break;
+	if (!bh) {
+	    bh = calloc(1, sizeof(struct cbBreakHost));
+	    if (!bh)
+		ViceLogThenPanic(0, ("Failed malloc in QueueCallBackBreaks_r\n"));
+	    bh->host = host;
+	    opr_queue_Init(&bh->items);
+	    bh->hnext = cbBreaks.hash[CB_BREAK_HASH(host)];
+	    cbBreaks.hash[CB_BREAK_HASH(host)] = bh;
+	}
+
+	if (opr_queue_IsEmpty(&cbBreaks.freeItems)) {
+	    item = malloc(sizeof(struct cbBreakItem));
+	    if (!item)
+		ViceLogThenPanic(0, ("Failed malloc in QueueCallBackBreaks_r\n"));
+	} else {
+	    item = opr_queue_First(&cbBreaks.freeItems, struct cbBreakItem, q);
+	    opr_queue_Remove(&item->q);
+	}
+	item->fid = *fid;
+	item->thead = cba[i].thead;
+	item->wait = wait;
+	item->queued = now;
+	opr_queue_Append(&bh->items, &item->q);
+	if (wait)
+	    wait->pending++;
+
+	/* a busy host goes back on the ready queue when its RPC is done */
+	if (bh->nitems++ == 0 && !bh->busy) {
+	    opr_queue_Append(&cbBreaks.ready, &bh->q);
+	    opr_cv_signal(&cbBreaks.cv);
+	}
+	if (++cbBreaks.queued > cbBreaks.queuedMax)
+	    cbBreaks.queuedMax = cbBreaks.queued;
+    }
+    opr_mutex_exit(&cbBreaks.lock);
+}
+
+/*
+ * Break callbacks on fid for the held hosts in cba, and release the holds
+ * once done.  If there are break threads the breaks are queued for them,
+ * and counted against wait (if not NULL) for the caller to wait on with
+ * WaitForBreaks; otherwise they are sent before returning.  Called with
+ * H_LOCK held, and no shard lock.
+ */
+static void
+BreakCallBacks_r(struct cbstruct cba[], int ncbas, AFSFid * fid,
+		 struct cbBreakWait *wait)
+{
+    struct AFSCBFids tf;
+
+    if (cbBreaks.nThreads > 0) {
+	QueueCallBackBreaks_r(cba, ncbas, fid, wait);
+	return;
+    }
+    tf.AFSCBFids_len = 1;
+    tf.AFSCBFids_val = fid;
+    MultiBreakCallBack_r(cba, ncbas, &tf);
+}
+
+/* Wait until every break counted against wait has been dealt with */
+static void
+WaitForBreaks(struct cbBreakWait *wait)
+{
+    opr_mutex_enter(&cbBreaks.lock);
+    while (wait->pending > 0)
+	opr_cv_wait(&wait->cv, &cbBreaks.lock);
+    opr_mutex_exit(&cbBreaks.lock);
+}
+
+/*
+ * InitCallBackBreakers
+ *
+ * Purpose:
+ *	Start the threads which deliver callback breaks.  With no threads,
+ *	breaks are sent by the thread breaking the callback.
+ */
+void
+InitCallBackBreakers(int nThreads)
+{
+    pthread_t tid;
+    pthread_attr_t tattr;
+    int i;
+
+    opr_mutex_init(&cbBreaks.lock);
+    opr_cv_init(&cbBreaks.cv);
+    opr_queue_Init(&cbBreaks.ready);
+    opr_queue_Init(&cbBreaks.freeItems);
+
+    opr_Verify(pthread_attr_init(&tattr) == 0);
+    opr_Verify(pthread_attr_setdetachstate(&tattr,
+					   PTHREAD_CREATE_DETACHED) == 0);
+    for (i = 0; i < nThreads; i++)
+	opr_Verify(pthread_create(&tid, &tattr, CallBackBreakThread,
+				  NULL) == 0);
+    cbBreaks.nThreads = nThreads;
+}
+
+void
+GetCallBackBreakCounters(struct cbbreakcounters *cbb)
+{
+    opr_mutex_enter(&cbBreaks.lock);
+    cbb->queued = cbBreaks.queued;
+    cbb->queuedMax = cbBreaks.queuedMax;
+    cbb->batches = cbBreaks.batches;
+    cbb->fids = cbBreaks.fids;
+    cbb->failed = cbBreaks.failed;
+    cbb->avgMsec = cbBreaks.nDone ?
+	(afs_int32)(cbBreaks.totalMsec / cbBreaks.nDone) : 0;
+    cbb->maxMsec = cbBreaks.maxMsec;
+    opr_mutex_exit(&cbBreaks.lock);
+}
+
+/*
+ * Find the file entry for fid if it has any callbacks that BreakCallBack
+ * would break.  Called with the shard for fid locked.
+ */
+static struct FileEntry *
+FindBreakableFE(AFSFid * fid, int hostindex, int flag)
+{
+    struct FileEntry *fe;
+    struct CallBack *cb;
+
+    fe = FindFE(fid);
+    if (!fe) {
+	return NULL;
+    }
+    cb = itocb(fe->firstcb);
+    if (!cb || ((fe->ncbs == 1) && (cb->hhead == hostindex) && !flag)) {
+	/* the most common case is what follows the || */
+	return NULL;
+    }
+    return fe;
+}
+
 /*
  * Break all call backs for fid, except for the specified host (unless flag
  * is true, in which case all get a callback message. Assumption: the specified
@@ -804,11 +1382,12 @@ MultiBreakCallBack_r(struct cbstruct cba[], int ncbas,
 int
 BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
 {
+    struct cbShard *sh = FidShard(fid);
     struct FileEntry *fe;
     struct CallBack *cb, *nextcb;
     struct cbstruct cba[MAX_CB_HOSTS];
     int ncbas;
-    struct AFSCBFids tf;
+    struct cbBreakWait wait;
     int hostindex;
     char hoststr[16];
 
@@ -822,20 +1401,28 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
 		("BCB: BreakCallBack(No Host, (%u,%u,%u))\n",
 		fid->Volume, fid->Vnode, fid->Unique));
 
+    hostindex = xhost ? h_htoi(xhost) : 0;
+
+    /* Usually there is nothing to break, which we can tell from the shard
+     * alone; only take H_LOCK if there are other hosts to contact. */
+    CB_SHARD_LOCK(sh);
+    sh->BreakCallBacks++;
+    fe = FindBreakableFE(fid, hostindex, flag);
+    CB_SHARD_UNLOCK(sh);
+    if (!fe) {
+	return 0;
+    }
+
+    opr_cv_init(&wait.cv);
+    wait.pending = 0;
+
     H_LOCK;
-    cbstuff.BreakCallBacks++;
-    fe = FindFE(fid);
+    CB_SHARD_LOCK(sh);
+    fe = FindBreakableFE(fid, hostindex, flag);
     if (!fe) {
 	goto done;
     }
-    hostindex = xhost ? h_htoi(xhost) : 0;
     cb = itocb(fe->firstcb);
-    if (!cb || ((fe->ncbs == 1) && (cb->hhead == hostindex) && !flag)) {
-	/* the most common case is what follows the || */
-	goto done;
-    }
-    tf.AFSCBFids_len = 1;
-    tf.AFSCBFids_val = fid;
 
     /* Set CBFLAG_BREAKING flag on all CBs we're looking at. We do this so we
      * can loop through all relevant CBs while dropping H_LOCK, and not lose
@@ -877,32 +1464,33 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
 			cba[ncbas].thead = cb->thead;
 			ncbas++;
 		    }
-		    TDel(cb);
-		    HDel(cb);
-		    CDel(cb, 1);	/* Usually first; so this delete
+		    TDel(sh, cb);
+		    HDel(sh, cb);
+		    CDel(sh, cb, 1);	/* Usually first; so this delete
 					 * is reasonably inexpensive */
 		}
 	    }
 	}
 
 	if (ncbas) {
-	    MultiBreakCallBack_r(cba, ncbas, &tf);
+	    CB_SHARD_UNLOCK(sh);
+	    BreakCallBacks_r(cba, ncbas, fid, &wait);
+	    CB_SHARD_LOCK(sh);
 
 	    /* we need to to all these initializations again because MultiBreakCallBack may block */
-	    fe = FindFE(fid);
+	    fe = FindBreakableFE(fid, hostindex, flag);
 	    if (!fe) {
 		goto done;
 	    }
 	    cb = itocb(fe->firstcb);
-	    if (!cb || ((fe->ncbs == 1) && (cb->hhead == hostindex) && !flag)) {
-		/* the most common case is what follows the || */
-		goto done;
-	    }
 	}
     }
 
   done:
+    CB_SHARD_UNLOCK(sh);
     H_UNLOCK;
+    WaitForBreaks(&wait);
+    opr_cv_destroy(&wait.cv);
     return 0;
 }
 
@@ -910,19 +1498,19 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
 int
 DeleteCallBack(struct host *host, AFSFid * fid)
 {
+    struct cbShard *sh = FidShard(fid);
     struct FileEntry *fe;
     afs_uint32 *pcb;
     char hoststr[16];
 
-    H_LOCK;
-    cbstuff.DeleteCallBacks++;
-
-    h_Lock_r(host);
+    h_Lock(host);
     /* do not care if the host has been HOSTDELETED */
+    CB_SHARD_LOCK(sh);
+    sh->DeleteCallBacks++;
     fe = FindFE(fid);
     if (!fe) {
-	h_Unlock_r(host);
-	H_UNLOCK;
+	CB_SHARD_UNLOCK(sh);
+	h_Unlock(host);
 	ViceLog(8,
 		("DCB: No call backs for fid (%u, %u, %u)\n", fid->Volume,
 		 fid->Vnode, fid->Unique));
@@ -930,19 +1518,19 @@ DeleteCallBack(struct host *host, AFSFid * fid)
     }
     pcb = FindCBPtr(fe, host);
     if (!*pcb) {
+	CB_SHARD_UNLOCK(sh);
+	h_Unlock(host);
 	ViceLog(8,
 		("DCB: No call back for host %p (%s:%d), (%u, %u, %u)\n",
 		 host, afs_inet_ntoa_r(host->z.host, hoststr), ntohs(host->z.port),
 		 fid->Volume, fid->Vnode, fid->Unique));
-	h_Unlock_r(host);
-	H_UNLOCK;
 	return 0;
     }
-    HDel(itocb(*pcb));
-    TDel(itocb(*pcb));
-    CDelPtr(fe, pcb, 1);
-    h_Unlock_r(host);
-    H_UNLOCK;
+    HDel(sh, itocb(*pcb));
+    TDel(sh, itocb(*pcb));
+    CDelPtr(sh, fe, pcb, 1);
+    CB_SHARD_UNLOCK(sh);
+    h_Unlock(host);
     return 0;
 }
 
@@ -955,16 +1543,17 @@ DeleteCallBack(struct host *host, AFSFid * fid)
 int
 DeleteFileCallBacks(AFSFid * fid)
 {
+    struct cbShard *sh = FidShard(fid);
     struct FileEntry *fe;
     struct CallBack *cb;
     afs_uint32 cbi;
     int n;
 
-    H_LOCK;
-    cbstuff.DeleteFiles++;
+    CB_SHARD_LOCK(sh);
+    sh->DeleteFiles++;
     fe = FindFE(fid);
     if (!fe) {
-	H_UNLOCK;
+	CB_SHARD_UNLOCK(sh);
 	ViceLog(8,
 		("DF: No fid (%u,%u,%u) to delete\n", fid->Volume, fid->Vnode,
 		 fid->Unique));
@@ -973,13 +1562,13 @@ DeleteFileCallBacks(AFSFid * fid)
     for (n = 0, cbi = fe->firstcb; cbi; n++) {
 	cb = itocb(cbi);
 	cbi = cb->cnext;
-	TDel(cb);
-	HDel(cb);
-	FreeCB(cb);
+	TDel(sh, cb);
+	HDel(sh, cb);
+	FreeCB(sh, cb);
 	fe->ncbs--;
     }
-    FDel(fe);
-    H_UNLOCK;
+    FDel(sh, fe);
+    CB_SHARD_UNLOCK(sh);
     return 0;
 }
 
@@ -988,25 +1577,70 @@ DeleteFileCallBacks(AFSFid * fid)
 int
 DeleteAllCallBacks_r(struct host *host, int deletefe)
 {
+    struct cbShard *sh;
     struct CallBack *cb;
-    int cbi, first;
+    int cbi, first, i, n = 0;
 
     cbstuff.DeleteAllCallBacks++;
-    cbi = first = host->z.cblist;
-    if (!cbi) {
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	sh = &cbShards[i];
+	CB_SHARD_LOCK(sh);
+	cbi = first = host->z.cblist[i];
+	if (cbi) {
+	    do {
+		cb = itocb(cbi);
+		cbi = cb->hnext;
+		TDel(sh, cb);
+		CDel(sh, cb, deletefe);
+		n++;
+	    } while (cbi != first);
+	    host->z.cblist[i] = 0;
+	}
+	CB_SHARD_UNLOCK(sh);
+    }
+    if (!n) {
 	ViceLog(8, ("DV: no call backs\n"));
-	return 0;
     }
-    do {
-	cb = itocb(cbi);
-	cbi = cb->hnext;
-	TDel(cb);
-	CDel(cb, deletefe);
-    } while (cbi != first);
-    host->z.cblist = 0;
     return 0;
 }
 
+/*
+ * Remove up to max delayed call backs of host from the call back tables,
+ * returning their fids in fids.  Called with H_LOCK held.
+ */
+static int
+GetDelayedCallBacks_r(struct host *host, struct AFSFid *fids, int max)
+{
+    struct cbShard *sh;
+    struct CallBack *cb;
+    int cbi, first, i, nfids = 0;
+
+    for (i = 0; i < CB_NUM_SHARDS && nfids < max; i++) {
+	sh = &cbShards[i];
+	CB_SHARD_LOCK(sh);
+	cbi = first = host->z.cblist[i];
+	if (cbi) {
+	    do {
+		first = host->z.cblist[i];
+		cb = itocb(cbi);
+		cbi = cb->hnext;
+		if (cb->status == CB_DELAYED) {
+		    struct FileEntry *fe = itofe(cb->fhead);
+		    fids[nfids].Volume = fe->volid;
+		    fids[nfids].Vnode = fe->vnode;
+		    fids[nfids].Unique = fe->unique;
+		    nfids++;
+		    HDel(sh, cb);
+		    TDel(sh, cb);
+		    CDel(sh, cb, 1);
+		}
+	    } while (cbi && cbi != first && nfids < max);
+	}
+	CB_SHARD_UNLOCK(sh);
+    }
+    return nfids;
+}
+
 /*
  * Break all delayed call backs for host.  Returns 1 if all call backs
  * successfully broken; 0 otherwise.  Assumes host is h_Held and h_Locked.
@@ -1026,8 +1660,7 @@ int
 BreakDelayedCallBacks_r(struct host *host)
 {
     struct AFSFid fids[AFSCBMAX];
-    int cbi, first, nfids;
-    struct CallBack *cb;
+    int nfids;
     int code;
     char hoststr[16];
     struct rx_connection *cb_conn;
@@ -1069,27 +1702,8 @@ BreakDelayedCallBacks_r(struct host *host)
 	}
     } else
 	while (!(host->z.hostFlags & HOSTDELETED)) {
-	    nfids = 0;
 	    host->z.hostFlags &= ~VENUSDOWN;	/* presume up */
-	    cbi = first = host->z.cblist;
-	    if (!cbi)
-		break;
-	    do {
-		first = host->z.cblist;
-		cb = itocb(cbi);
-		cbi = cb->hnext;
-		if (cb->status == CB_DELAYED) {
-		    struct FileEntry *fe = itofe(cb->fhead);
-		    fids[nfids].Volume = fe->volid;
-		    fids[nfids].Vnode = fe->vnode;
-		    fids[nfids].Unique = fe->unique;
-		    nfids++;
-		    HDel(cb);
-		    TDel(cb);
-		    CDel(cb, 1);
-		}
-	    } while (cbi && cbi != first && nfids < AFSCBMAX);
-
+	    nfids = GetDelayedCallBacks_r(host, fids, AFSCBMAX);
 	    if (nfids == 0) {
 		break;
 	    }
@@ -1170,13 +1784,8 @@ MultiBreakVolumeCallBack_r(struct host *host,
      ** because it would prematurely release the hold on the host
      */
     if (parms->ncbas == MAX_CB_HOSTS) {
-	struct AFSCBFids tf;
-
-	tf.AFSCBFids_len = 1;
-	tf.AFSCBFids_val = parms->fid;
-
 	/* this releases all the hosts */
-	MultiBreakCallBack_r(parms->cba, parms->ncbas, &tf);
+	BreakCallBacks_r(parms->cba, parms->ncbas, parms->fid, NULL);
 
 	parms->ncbas = 0;
     }
@@ -1220,6 +1829,7 @@ BreakVolumeCallBacksLater(VolumeId volume)
 {
     int hash;
     afs_uint32 *feip;
+    struct cbShard *sh;
     struct FileEntry *fe;
     struct CallBack *cb;
     struct host *host;
@@ -1229,6 +1839,8 @@ BreakVolumeCallBacksLater(VolumeId volume)
 		 afs_printable_VolumeId_lu(volume)));
     H_LOCK;
     for (hash = 0; hash < FEHASH_SIZE; hash++) {
+	sh = &cbShards[hash & CB_SHARD_MASK];
+	CB_SHARD_LOCK(sh);
 	for (feip = &HashTable[hash]; (fe = itofe(*feip)) != NULL; ) {
 	    if (fe->volid == volume) {
 		struct CallBack *cbnext;
@@ -1238,13 +1850,13 @@ BreakVolumeCallBacksLater(VolumeId volume)
 		    cb->status = CB_DELAYED;
 		    cbnext = itocb(cb->cnext);
 		}
-		FSYNC_LOCK;
+		/* FE_LATER is protected by the shard lock */
 		fe->status |= FE_LATER;
-		FSYNC_UNLOCK;
 		found = 1;
 	    }
 	    feip = &fe->fnext;
 	}
+	CB_SHARD_UNLOCK(sh);
     }
     H_UNLOCK;
     if (!found) {
@@ -1265,6 +1877,7 @@ BreakLaterCallBacks(void)
     struct AFSFid fid;
     int hash;
     afs_uint32 *feip;
+    struct cbShard *sh;
     struct CallBack *cb;
     struct FileEntry *fe = NULL;
     struct FileEntry *myfe = NULL;
@@ -1276,31 +1889,30 @@ BreakLaterCallBacks(void)
     /* Unchain first */
     ViceLog(25, ("Looking for FileEntries to unchain\n"));
     H_LOCK;
-    FSYNC_LOCK;
     /* Pick the first volume we see to clean up */
     fid.Volume = fid.Vnode = fid.Unique = 0;
 
     for (hash = 0; hash < FEHASH_SIZE; hash++) {
+	sh = &cbShards[hash & CB_SHARD_MASK];
+	CB_SHARD_LOCK(sh);
 	for (feip = &HashTable[hash]; (fe = itofe(*feip)) != NULL; ) {
 	    if (fe && (fe->status & FE_LATER)
 		&& (fid.Volume == 0 || fid.Volume == fe->volid)) {
-		/* Ugly, but used to avoid left side casting */
-		struct object *tmpfe;
 		ViceLog(125,
 			("Unchaining for %u:%u:%" AFS_VOLID_FMT "\n", fe->vnode,
 			 fe->unique, afs_printable_VolumeId_lu(fe->volid)));
 		fid.Volume = fe->volid;
 		*feip = fe->fnext;
-		fe->status &= ~FE_LATER; /* not strictly needed */
-		/* Works since volid is deeper than the largest pointer */
-		tmpfe = (struct object *)fe;
-		tmpfe->next = (struct object *)myfe;
+		/* Chain through fnext, so that FEShard still works on fe.
+		 * FE_LATER stays set until fe is freed below, which keeps
+		 * EvictCallBacks_r away from it. */
+		fe->fnext = fetoi(myfe);
 		myfe = fe;
 	    } else
 		feip = &fe->fnext;
 	}
+	CB_SHARD_UNLOCK(sh);
     }
-    FSYNC_UNLOCK;
 
     if (!myfe) {
 	H_UNLOCK;
@@ -1311,6 +1923,8 @@ BreakLaterCallBacks(void)
     tthead = 0;
     for (fe = myfe; fe;) {
 	struct CallBack *cbnext;
+	sh = FEShard(fe);
+	CB_SHARD_LOCK(sh);
 	for (cb = itocb(fe->firstcb); cb; cb = cbnext) {
 	    cbnext = itocb(cb->cnext);
 	    host = h_itoh(cb->hhead);
@@ -1322,9 +1936,9 @@ BreakLaterCallBacks(void)
 			tthead = cb->thead;
 		    }
 		}
-		TDel(cb);
-		HDel(cb);
-		CDel(cb, 0);	/* Don't let CDel clean up the fe */
+		TDel(sh, cb);
+		HDel(sh, cb);
+		CDel(sh, cb, 0);	/* Don't let CDel clean up the fe */
 		/* leave flag for MultiBreakVolumeCallBack to clear */
 	    } else {
 		ViceLog(125,
@@ -1335,8 +1949,9 @@ BreakLaterCallBacks(void)
 	    }
 	}
 	myfe = fe;
-	fe = (struct FileEntry *)((struct object *)fe)->next;
-	FreeFE(myfe);
+	fe = itofe(fe->fnext);
+	FreeFE(sh, myfe);
+	CB_SHARD_UNLOCK(sh);
     }
 
     if (tthead) {
@@ -1348,11 +1963,7 @@ BreakLaterCallBacks(void)
 	h_Enumerate(MultiBreakVolumeLaterCallBack, (char *)&henumParms);
 	H_LOCK;
 	if (henumParms.ncbas) {	/* do left-overs */
-	    struct AFSCBFids tf;
-	    tf.AFSCBFids_len = 1;
-	    tf.AFSCBFids_val = &fid;
-
-	    MultiBreakCallBack_r(henumParms.cba, henumParms.ncbas, &tf);
+	    BreakCallBacks_r(henumParms.cba, henumParms.ncbas, &fid, NULL);
 	    henumParms.ncbas = 0;
 	}
     }
@@ -1371,6 +1982,7 @@ CleanupTimedOutCallBacks(void)
 {
     H_LOCK;
     CleanupTimedOutCallBacks_r();
+    BreakEvictedCallBacks_r();
     H_UNLOCK;
     return 0;
 }
@@ -1380,42 +1992,69 @@ CleanupTimedOutCallBacks_r(void)
 {
     afs_uint32 now = CBtime(time(NULL));
     afs_uint32 *thead;
+    afs_int32 t;
+    struct cbShard *sh;
     struct CallBack *cb;
-    int ntimedout = 0;
+    int i, ntimedout = 0;
     char hoststr[16];
 
-    while (tfirst <= now) {
-	int cbi;
-	cbi = *(thead = THead(tfirst));
-	if (cbi) {
-	    do {
-		cb = itocb(cbi);
-		cbi = cb->tnext;
-		ViceLog(8,
-			("CCB: deleting timed out call back %x (%s:%d), (%" AFS_VOLID_FMT ",%u,%u)\n",
-			 h_itoh(cb->hhead)->z.host,
-			 afs_inet_ntoa_r(h_itoh(cb->hhead)->z.host, hoststr),
-			 h_itoh(cb->hhead)->z.port,
-			 afs_printable_VolumeId_lu(itofe(cb->fhead)->volid),
-			 itofe(cb->fhead)->vnode, itofe(cb->fhead)->unique));
-		HDel(cb);
-		CDel(cb, 1);
-		ntimedout++;
-		if (ntimedout > cbstuff.nblks) {
-		    ViceLog(0, ("CCB: Internal Error -- shutting down...\n"));
-		    DumpCallBackState_r();
-		    ShutDownAndCore(PANIC);
-		}
-	    } while (cbi != *thead);
-	    *thead = 0;
+    if (tfirst > now) {
+	return 0;
+    }
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	sh = &cbShards[i];
+	CB_SHARD_LOCK(sh);
+	for (t = tfirst; t <= now; t++) {
+	    int cbi;
+	    cbi = *(thead = THead(sh, t));
+	    if (cbi) {
+		do {
+		    cb = itocb(cbi);
+		    cbi = cb->tnext;
+		    ViceLog(8,
+			    ("CCB: deleting timed out call back %x (%s:%d), (%" AFS_VOLID_FMT ",%u,%u)\n",
+			     h_itoh(cb->hhead)->z.host,
+			     afs_inet_ntoa_r(h_itoh(cb->hhead)->z.host, hoststr),
+			     h_itoh(cb->hhead)->z.port,
+			     afs_printable_VolumeId_lu(itofe(cb->fhead)->volid),
+			     itofe(cb->fhead)->vnode, itofe(cb->fhead)->unique));
+		    HDel(sh, cb);
+		    CDel(sh, cb, 1);
+		    ntimedout++;
+		    if (ntimedout > cbstuff.nblks) {
+			ViceLog(0, ("CCB: Internal Error -- shutting down...\n"));
+			DumpCallBackState_r();
+			ShutDownAndCore(PANIC);
+		    }
+		} while (cbi != *thead);
+		*thead = 0;
+	    }
 	}
-	tfirst++;
+	CB_SHARD_UNLOCK(sh);
     }
+    /* only advance once every shard has been swept */
+    tfirst = now + 1;
     cbstuff.CBsTimedOut += ntimedout;
     ViceLog(7, ("CCB: deleted %d timed out callbacks\n", ntimedout));
     return (ntimedout > 0);
 }
 
+/*
+ * Return the index of one of host's callbacks, or 0 if it has none.  The
+ * answer is only a hint unless the shard locks are held.
+ */
+afs_uint32
+FirstHostCallBack(struct host *host)
+{
+    int i;
+
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	if (host->z.cblist[i])
+	    return host->z.cblist[i];
+    }
+    return 0;
+}
+
 /**
  * parameters to pass to lih*_r from h_Enumerate_r when trying to find a host
  * from which to clear callbacks.
@@ -1464,9 +2103,9 @@ lih0_r(struct host *host, void *rock)
     struct lih_params *params = (struct lih_params *)rock;
 
     /* OTHER_MUSTHOLD_LIH is because the h_Enum loop holds us once */
-    if (host->z.cblist
+    if (FirstHostCallBack(host)
 	&& (!(host->z.hostFlags & HOSTDELETED))
-	&& (host->z.refCount < OTHER_MUSTHOLD_LIH)
+	&& (h_RefCount(host) < OTHER_MUSTHOLD_LIH)
 	&& (!params->lih || host->z.ActiveCall < params->lih->z.ActiveCall)
 	&& (!params->lastlih || host->z.ActiveCall > params->lastlih->z.ActiveCall)) {
 
@@ -1486,7 +2125,7 @@ lih1_r(struct host *host, void *rock)
 {
     struct lih_params *params = (struct lih_params *)rock;
 
-    if (host->z.cblist
+    if (FirstHostCallBack(host)
 	&& (!(host->z.hostFlags & HOSTDELETED))
 	&& (!params->lih || host->z.ActiveCall < params->lih->z.ActiveCall)
 	&& (!params->lastlih || host->z.ActiveCall > params->lastlih->z.ActiveCall)) {
@@ -1510,6 +2149,135 @@ lih1_r(struct host *host, void *rock)
 /* third pass: attempt to clear callbacks from 'hostp' */
 /* always called with hostp unlocked */
 
+/*
+ * Reclaim up to want file entries by breaking all the call backs on the
+ * least recently used files, as found by a clock sweep over the FE array:
+ * AddCallBack sets FE_REFERENCED, and the sweep clears it and takes the
+ * files which have not been referenced since it last went past them.
+ *
+ * Files are skipped if any of their call backs are delayed or on a host
+ * that is down, since those hosts could not be told, and if hostp has a
+ * call back on them, as hostp is locked by our caller.  The breaks are not
+ * waited for: they are queued for the break threads, or, if there are
+ * none, kept on cbPool.deferred for BreakEvictedCallBacks_r, since our
+ * caller's host lock must not be held over the RPCs.
+ *
+ * Called with H_LOCK held.  Returns the number of file entries reclaimed.
+ */
+static int
+EvictCallBacks_r(struct host *hostp, int want)
+{
+    struct cbstruct cba[MAX_CB_HOSTS];
+    struct cbShard *sh;
+    struct FileEntry *fe;
+    struct CallBack *cb, *nextcb;
+    struct host *host;
+    AFSFid fid;
+    afs_int32 scanned, limit;
+    int ncbas, freed = 0;
+
+    /* two turns of the clock clear every reference bit */
+    limit = 2 * cbstuff.nblks;
+    for (scanned = 0; freed < want && scanned < limit; scanned++) {
+	if (++cbPool.hand > cbstuff.nblks)
+	    cbPool.hand = 1;
+	fe = itofe(cbPool.hand);
+
+	/* The shard is found from fe itself, so check that fe still belongs
+	 * to it once it is locked */
+	if (fe->status & (FE_FREE | FE_LATER))
+	    continue;
+	sh = FEShard(fe);
+	CB_SHARD_LOCK(sh);
+	if ((fe->status & (FE_FREE | FE_LATER)) || FEShard(fe) != sh) {
+	    CB_SHARD_UNLOCK(sh);
+	    continue;
+	}
+	if (fe->status & FE_REFERENCED) {
+	    fe->status &= ~FE_REFERENCED;
+	    CB_SHARD_UNLOCK(sh);
+	    continue;
+	}
+	if (fe->ncbs > MAX_CB_HOSTS) {
+	    CB_SHARD_UNLOCK(sh);
+	    continue;
+	}
+	for (cb = itocb(fe->firstcb); cb; cb = itocb(cb->cnext)) {
+	    host = h_itoh(cb->hhead);
+	    if (cb->status == CB_DELAYED || host == hostp
+		|| (host->z.hostFlags & VENUSDOWN))
+		break;
+	}
+	if (cb) {
+	    CB_SHARD_UNLOCK(sh);
+	    continue;
+	}
+
+	fid.Volume = fe->volid;
+	fid.Vnode = fe->vnode;
+	fid.Unique = fe->unique;
+	ncbas = 0;
+	for (cb = itocb(fe->firstcb); cb; cb = nextcb) {
+	    nextcb = itocb(cb->cnext);
+	    host = h_itoh(cb->hhead);
+	    if (!(host->z.hostFlags & HOSTDELETED)) {
+		h_Hold_r(host);
+		cba[ncbas].hp = host;
+		cba[ncbas].thead = cb->thead;
+		ncbas++;
+	    }
+	    TDel(sh, cb);
+	    HDel(sh, cb);
+	    CDel(sh, cb, 1);	/* frees fe along with the last one */
+	}
+	CB_SHARD_UNLOCK(sh);
+
+	ViceLog(125, ("GSS: evicting %d callbacks on %u.%u.%u\n", ncbas,
+		      fid.Volume, fid.Vnode, fid.Unique));
+	if (ncbas == 0)
+	    ;
+	else if (cbBreaks.nThreads > 0)
+	    BreakCallBacks_r(cba, ncbas, &fid, NULL);
+	else {
+	    struct cbEvicted *ev;
+
+	    ev = malloc(sizeof(struct cbEvicted) +
+			(ncbas - 1) * sizeof(struct cbstruct));
+	    if (!ev)
+		ViceLogThenPanic(0, ("Failed malloc in EvictCallBacks_r\n"));
+	    ev->fid = fid;
+	    ev->ncbas = ncbas;
+	    memcpy(ev->cba, cba, ncbas * sizeof(struct cbstruct));
+	    ev->next = cbPool.deferred;
+	    cbPool.deferred = ev;
+	}
+	freed++;
+    }
+    cbPool.evicted += freed;
+    return freed;
+}
+
+/*
+ * Send the breaks EvictCallBacks_r left on cbPool.deferred, and release
+ * their host holds.  Called with H_LOCK held and no host locked; H_LOCK is
+ * dropped over the RPCs, so more may be deferred meanwhile, and they are
+ * sent too.
+ */
+static void
+BreakEvictedCallBacks_r(void)
+{
+    struct cbEvicted *ev;
+    struct AFSCBFids tf;
+
+    while ((ev = cbPool.deferred) != NULL) {
+	cbPool.deferred = ev->next;
+	tf.AFSCBFids_len = 1;
+	tf.AFSCBFids_val = &ev->fid;
+	MultiBreakCallBack_r(ev->cba, ev->ncbas, &tf);
+	free(ev);
+    }
+}
+
 /* Note: hostlist is ordered most recently created host first and
  * its order has no relationship to the most recently used. */
 extern struct host *hostList;
@@ -1525,10 +2293,10 @@ GetSomeSpace_r(struct host *hostp, int locked)
 	 * good but don't make things worse by spamming the log. */
 	ViceLog(0, ("We have run out of callback space; forcing callback revocation. "
 	            "This suggests the fileserver is configured with insufficient "
-	            "callbacks; you probably want to increase the -cb fileserver "
+	            "callbacks; you probably want to increase the -cbmax fileserver "
 	            "parameter (current setting: %u). The fileserver will continue "
 	            "to operate, but this may indicate a severe performance problem\n",
-	            cbstuff.nblks));
+	            cbPool.maxblks));
 	ViceLog(0, ("This message is logged at most once; for more information "
 	            "see the OpenAFS documentation and fileserver xstat collection 3\n"));
     }
@@ -1541,6 +2309,10 @@ GetSomeSpace_r(struct host *hostp, int locked)
 	return 0;
     }
 
+    ViceLog(5, ("GSS: Breaking callbacks on least recently used files\n"));
+    if (EvictCallBacks_r(hostp, CB_EVICT_BATCH))
+	return 0;
+
     i = 0;
     params.lastlih = NULL;
 
@@ -1674,25 +2446,50 @@ ClearHostCallbacks_r(struct host *hp, int locked)
 #endif /* INTERPRET_DUMP */
 
 
+/* cbstuff, with the per-shard counters folded in */
+void
+GetCallBackCounters(struct cbcounters *cbc)
+{
+    int i;
+
+    *cbc = cbstuff;
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	cbc->nFEs += cbShards[i].nFEs;
+	cbc->nCBs += cbShards[i].nCBs;
+	cbc->AddCallBacks += cbShards[i].AddCallBacks;
+	cbc->BreakCallBacks += cbShards[i].BreakCallBacks;
+	cbc->DeleteCallBacks += cbShards[i].DeleteCallBacks;
+	cbc->DeleteFiles += cbShards[i].DeleteFiles;
+    }
+}
+
 int
 PrintCallBackStats(void)
 {
+    struct cbcounters cbc;
+
+    GetCallBackCounters(&cbc);
     fprintf(stderr,
 	    "%d add CB, %d break CB, %d del CB, %d del FE, %d CB's timed out, %d space reclaim, %d del host\n",
-	    cbstuff.AddCallBacks, cbstuff.BreakCallBacks,
-	    cbstuff.DeleteCallBacks, cbstuff.DeleteFiles, cbstuff.CBsTimedOut,
-	    cbstuff.GotSomeSpaces, cbstuff.DeleteAllCallBacks);
+	    cbc.AddCallBacks, cbc.BreakCallBacks,
+	    cbc.DeleteCallBacks, cbc.DeleteFiles, cbc.CBsTimedOut,
+	    cbc.GotSomeSpaces, cbc.DeleteAllCallBacks);
     fprintf(stderr, "%d CBs, %d FEs, (%d of total of %d 16-byte blocks)\n",
-	    cbstuff.nCBs, cbstuff.nFEs, cbstuff.nCBs + cbstuff.nFEs,
-	    cbstuff.nblks);
+	    cbc.nCBs, cbc.nFEs, cbc.nCBs + cbc.nFEs,
+	    cbc.nblks);
     fprintf(stderr, "%d GSS1, %d GSS2, %d GSS3, %d GSS4, %d GSS5 (internal counters)\n",
-	    cbstuff.GSS1, cbstuff.GSS2, cbstuff.GSS3, cbstuff.GSS4, cbstuff.GSS5);
+	    cbc.GSS1, cbc.GSS2, cbc.GSS3, cbc.GSS4, cbc.GSS5);
+#ifndef INTERPRET_DUMP
+    fprintf(stderr, "pool of %d entries (limit %d), grown %d times, %d files evicted\n",
+	    cbc.nblks, cbPool.maxblks, cbPool.grows, cbPool.evicted);
+#endif
 
     return 0;
 }
 
 #define MAGIC 0x12345678	/* To check byte ordering of dump when it is read in */
 #define MAGICV2 0x12345679      /* To check byte ordering & version of dump when it is read in */
+#define MAGICV3 0x1234567a      /* As MAGICV2, with per-shard timeouts and free lists */
 
 
 #ifndef INTERPRET_DUMP
@@ -1717,6 +2514,10 @@ static int cb_stateVerifyFEHash(struct fs_dump_state * state);
 static int cb_stateVerifyFE(struct fs_dump_state * state, struct FileEntry * fe);
 static int cb_stateVerifyFCBList(struct fs_dump_state * state, struct FileEntry * fe);
 static int cb_stateVerifyTimeoutQueues(struct fs_dump_state * state);
+static int cb_stateVerifyShardTimeouts(struct fs_dump_state * state,
+				       struct cbShard * sh);
+static int cb_stateVerifyHCBShardList(struct fs_dump_state * state,
+				      struct host * host, int shard);
 
 static int cb_stateFEToDiskEntry(struct FileEntry *, struct FEDiskEntry *);
 static int cb_stateDiskEntryToFE(struct fs_dump_state * state,
@@ -1736,6 +2537,8 @@ cb_stateSave(struct fs_dump_state * state)
 {
     int ret = 0;
 
+    LockAllShards();
+
     AssignInt64(state->eof_offset, &state->hdr->cb_offset);
 
     /* invalidate callback state header */
@@ -1775,6 +2578,7 @@ cb_stateSave(struct fs_dump_state * state)
     }
 
  done:
+    UnlockAllShards();
     return ret;
 }
 
@@ -1828,6 +2632,7 @@ cb_stateRestoreIndices(struct fs_dump_state * state)
     int i, ret = 0;
     struct FileEntry * fe;
     struct CallBack * cb;
+    struct cbShard * sh;
 
     /* restore indices in the FileEntry structures */
     for (i = 1; i < state->fe_map.len; i++) {
@@ -1883,28 +2688,31 @@ cb_stateRestoreIndices(struct fs_dump_state * state)
 		goto done;
 	    }
 
-	    /* restore the cb->hprev entry */
-	    if (cb_OldToNew(state, cb->hprev, &cb->hprev)) {
-		ret = 1;
-		goto done;
-	    }
-
-	    /* restore the cb->hnext entry */
-	    if (cb_OldToNew(state, cb->hnext, &cb->hnext)) {
-		ret = 1;
-		goto done;
-	    }
+	    /* the host lists are rebuilt below, since the host state only
+	     * records a single list head per host */
 	}
     }
 
     /* restore the timeout queue head indices */
     for (i = 0; i < state->cb_timeout_hdr->records; i++) {
-	if (cb_OldToNew(state, timeout[i], &timeout[i])) {
+	sh = &cbShards[i / CB_NUM_TIMEOUT_QUEUES];
+	if (cb_OldToNew(state, sh->timeout[i % CB_NUM_TIMEOUT_QUEUES],
+			&sh->timeout[i % CB_NUM_TIMEOUT_QUEUES])) {
 	    ret = 1;
 	    goto done;
 	}
     }
 
+    /* rebuild the per-shard host lists; the hosts' cblist heads were
+     * cleared by h_stateRestoreIndices */
+    for (i = 1; i < state->cb_map.len; i++) {
+	if (state->cb_map.entries[i].new_idx) {
+	    cb = itocb(state->cb_map.entries[i].new_idx);
+	    fe = itofe(cb->fhead);
+	    HAdd(FEShard(fe), cb, h_itoh(cb->hhead));
+	}
+    }
+
     /* restore the FE hash table queue heads */
     for (i = 0; i < state->cb_fehash_hdr->records; i++) {
 	if (fe_OldToNew(state, HashTable[i], &HashTable[i])) {
@@ -1922,6 +2730,7 @@ cb_stateVerify(struct fs_dump_state * state)
 {
     int ret = 0;
 
+    LockAllShards();
     if (cb_stateVerifyFEHash(state)) {
 	ret = 1;
     }
@@ -1929,6 +2738,7 @@ cb_stateVerify(struct fs_dump_state * state)
     if (cb_stateVerifyTimeoutQueues(state)) {
 	ret = 1;
     }
+    UnlockAllShards();
 
     return ret;
 }
@@ -2032,6 +2842,22 @@ cb_stateVerifyFCBList(struct fs_dump_state * state, struct FileEntry * fe)
 
 int
 cb_stateVerifyHCBList(struct fs_dump_state * state, struct host * host)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	CB_SHARD_LOCK(&cbShards[i]);
+	if (cb_stateVerifyHCBShardList(state, host, i)) {
+	    ret = 1;
+	}
+	CB_SHARD_UNLOCK(&cbShards[i]);
+    }
+    return ret;
+}
+
+static int
+cb_stateVerifyHCBShardList(struct fs_dump_state * state, struct host * host,
+			   int shard)
 {
     int ret = 0;
     afs_uint32 hi, chain_len, cbi;
@@ -2040,10 +2866,10 @@ cb_stateVerifyHCBList(struct fs_dump_state * state, struct host * host)
     hi = h_htoi(host);
     chain_len = 0;
 
-    for (cbi = host->z.cblist, cb = itocb(cbi);
+    for (cbi = host->z.cblist[shard], cb = itocb(cbi);
 	 cb;
 	 cbi = cb->hnext, cb = ncb) {
-	if (chain_len && (host->z.cblist == cbi)) {
+	if (chain_len && (host->z.cblist[shard] == cbi)) {
 	    /* we've wrapped around the circular list, and everything looks ok */
 	    break;
 	}
@@ -2087,10 +2913,24 @@ cb_stateVerifyHCBList(struct fs_dump_state * state, struct host * host)
 
 static int
 cb_stateVerifyTimeoutQueues(struct fs_dump_state * state)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	if (cb_stateVerifyShardTimeouts(state, &cbShards[i])) {
+	    ret = 1;
+	}
+    }
+    return ret;
+}
+
+static int
+cb_stateVerifyShardTimeouts(struct fs_dump_state * state, struct cbShard * sh)
 {
     int ret = 0, i;
     afs_uint32 cbi, chain_len;
     struct CallBack *cb, *ncb;
+    afs_uint32 *timeout = sh->timeout;
 
     for (i = 0; i < CB_NUM_TIMEOUT_QUEUES; i++) {
 	chain_len = 0;
@@ -2107,7 +2947,7 @@ cb_stateVerifyTimeoutQueues(struct fs_dump_state * state)
 		ret = 1;
 		break;
 	    }
-	    if (itot(cb->thead) != &timeout[i]) {
+	    if (itot(sh, cb->thead) != &timeout[i]) {
 		ViceLog(0, ("cb_stateVerifyTimeoutQueues: error: cb->thead points to wrong timeout queue (tindex=%d, cbi=%d, cb->thead=%d)\n",
 			    i, cbi, cb->thead));
 		ret = 1;
@@ -2148,28 +2988,31 @@ cb_stateVerifyTimeoutQueues(struct fs_dump_state * state)
 static int
 cb_stateSaveTimeouts(struct fs_dump_state * state)
 {
-    int ret = 0;
-    struct iovec iov[2];
+    int i, ret = 0;
+    struct iovec iov[1 + CB_NUM_SHARDS];
 
     AssignInt64(state->eof_offset, &state->cb_hdr->timeout_offset);
 
+    /* the timeout queue heads of each shard in turn */
     memset(state->cb_timeout_hdr, 0, sizeof(struct callback_state_fehash_header));
     state->cb_timeout_hdr->magic = CALLBACK_STATE_TIMEOUT_MAGIC;
-    state->cb_timeout_hdr->records = CB_NUM_TIMEOUT_QUEUES;
+    state->cb_timeout_hdr->records = CB_NUM_TIMEOUT_QUEUES * CB_NUM_SHARDS;
     state->cb_timeout_hdr->len = sizeof(struct callback_state_timeout_header) +
 	(state->cb_timeout_hdr->records * sizeof(afs_uint32));
 
     iov[0].iov_base = (char *)state->cb_timeout_hdr;
     iov[0].iov_len = sizeof(struct callback_state_timeout_header);
-    iov[1].iov_base = (char *)timeout;
-    iov[1].iov_len = sizeof(timeout);
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	iov[1 + i].iov_base = (char *)cbShards[i].timeout;
+	iov[1 + i].iov_len = sizeof(cbShards[i].timeout);
+    }
 
     if (fs_stateSeek(state, &state->cb_hdr->timeout_offset)) {
 	ret = 1;
 	goto done;
     }
 
-    if (fs_stateWriteV(state, iov, 2)) {
+    if (fs_stateWriteV(state, iov, 1 + CB_NUM_SHARDS)) {
 	ret = 1;
 	goto done;
     }
@@ -2183,7 +3026,8 @@ cb_stateSaveTimeouts(struct fs_dump_state * state)
 static int
 cb_stateRestoreTimeouts(struct fs_dump_state * state)
 {
-    int ret = 0, len;
+    int i, ret = 0, len;
+    struct iovec iov[CB_NUM_SHARDS];
 
     if (fs_stateReadHeader(state, &state->cb_hdr->timeout_offset,
 			   state->cb_timeout_hdr,
@@ -2196,7 +3040,8 @@ cb_stateRestoreTimeouts(struct fs_dump_state * state)
 	ret = 1;
 	goto done;
     }
-    if (state->cb_timeout_hdr->records != CB_NUM_TIMEOUT_QUEUES) {
+    if (state->cb_timeout_hdr->records !=
+	CB_NUM_TIMEOUT_QUEUES * CB_NUM_SHARDS) {
 	ret = 1;
 	goto done;
     }
@@ -2209,7 +3054,11 @@ cb_stateRestoreTimeouts(struct fs_dump_state * state)
 	goto done;
     }
 
-    if (fs_stateRead(state, timeout, len)) {
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	iov[i].iov_base = (char *)cbShards[i].timeout;
+	iov[i].iov_len = sizeof(cbShards[i].timeout);
+    }
+    if (fs_stateReadV(state, iov, CB_NUM_SHARDS)) {
 	ret = 1;
 	goto done;
     }
@@ -2443,8 +3292,8 @@ cb_stateRestoreFE(struct fs_dump_state * state)
 	goto done;
     }
 
-    fe = GetFE();
-    if (fe == NULL) {
+    fe = NULL;
+    if (!GetEntries(FEShard(&fedsk.fe), NULL, &fe)) {
 	ViceLog(0, ("cb_stateRestoreFE: ran out of free FileEntry structures\n"));
 	ret = 1;
 	goto done;
@@ -2496,7 +3345,8 @@ cb_stateRestoreCBs(struct fs_dump_state * state, struct FileEntry * fe,
 	    continue;
 	}
 
-	if ((cb = GetCB()) == NULL) {
+	cb = NULL;
+	if (!GetEntries(FEShard(fe), &cb, NULL)) {
 	    ViceLog(0, ("cb_stateRestoreCBs: ran out of free CallBack structures\n"));
 	    ret = 1;
 	    goto done;
@@ -2531,7 +3381,8 @@ cb_stateCheckHeader(struct callback_state_header * hdr)
 	ret = 1;
     } else if (hdr->stamp.version != CALLBACK_STATE_VERSION) {
 	ret = 1;
-    } else if ((hdr->nFEs > cbstuff.nblks) || (hdr->nCBs > cbstuff.nblks)) {
+    } else if ((hdr->nFEs > cbPool.maxblks) || (hdr->nCBs > cbPool.maxblks)) {
+	/* anything smaller is restored by growing the pool as needed */
 	ViceLog(0, ("cb_stateCheckHeader: saved callback state larger than callback memory allocation\n"));
 	ret = 1;
     }
@@ -2669,11 +3520,15 @@ cb_OldToNew(struct fs_dump_state * state, afs_uint32 old, afs_uint32 * new)
 
 #define DumpBytes(fd,buf,req) if (write(fd, buf, req) < 0) {} /* don't care */
 
+/* Called with H_LOCK held, and either all of the shard locks or (when
+ * panicking) whatever shard lock the caller happens to have. */
 static int
 DumpCallBackState_r(void)
 {
-    int fd, oflag;
-    afs_uint32 magic = MAGICV2, now = (afs_int32) time(NULL), freelisthead;
+    int fd, oflag, i;
+    afs_uint32 magic = MAGICV3, now = (afs_int32) time(NULL), freelisthead;
+    afs_uint32 nshards = CB_NUM_SHARDS;
+    struct cbcounters cbc;
 
     oflag = O_WRONLY | O_CREAT | O_TRUNC;
 #ifdef AFS_NT40_ENV
@@ -2690,16 +3545,21 @@ DumpCallBackState_r(void)
      * Collect but ignoring the return value of write(2) here,
      * to avoid compiler warnings on some platforms.
      */
+    GetCallBackCounters(&cbc);
     DumpBytes(fd, &magic, sizeof(magic));
     DumpBytes(fd, &now, sizeof(now));
-    DumpBytes(fd, &cbstuff, sizeof(cbstuff));
+    DumpBytes(fd, &cbc, sizeof(cbc));
     DumpBytes(fd, TimeOuts, sizeof(TimeOuts));
-    DumpBytes(fd, timeout, sizeof(timeout));
+    DumpBytes(fd, &nshards, sizeof(nshards));
+    for (i = 0; i < CB_NUM_SHARDS; i++)
+	DumpBytes(fd, cbShards[i].timeout, sizeof(cbShards[i].timeout));
     DumpBytes(fd, &tfirst, sizeof(tfirst));
-    freelisthead = cbtoi((struct CallBack *)CBfree);
-    DumpBytes(fd, &freelisthead, sizeof(freelisthead));	/* This is a pointer */
-    freelisthead = fetoi((struct FileEntry *)FEfree);
-    DumpBytes(fd, &freelisthead, sizeof(freelisthead));	/* This is a pointer */
+    for (i = 0; i < CB_NUM_SHARDS; i++) {
+	freelisthead = cbtoi((struct CallBack *)cbShards[i].CBfree);
+	DumpBytes(fd, &freelisthead, sizeof(freelisthead));	/* This is a pointer */
+	freelisthead = fetoi((struct FileEntry *)cbShards[i].FEfree);
+	DumpBytes(fd, &freelisthead, sizeof(freelisthead));	/* This is a pointer */
+    }
     DumpBytes(fd, HashTable, sizeof(HashTable));
     DumpBytes(fd, &CB[1], sizeof(CB[1]) * cbstuff.nblks);	/* CB stuff */
     DumpBytes(fd, &FE[1], sizeof(FE[1]) * cbstuff.nblks);	/* FE stuff */
@@ -2713,7 +3573,9 @@ DumpCallBackState(void) {
     int rc;
 
     H_LOCK;
+    LockAllShards();
     rc = DumpCallBackState_r();
+    UnlockAllShards();
     H_UNLOCK;
 
     return(rc);
@@ -2744,9 +3606,9 @@ ReadBytes(int fd, void *buf, size_t req)
 time_t
 ReadDump(char *file, int timebits)
 {
-    int fd, oflag;
+    int fd, oflag, i;
     afs_uint32 magic, freelisthead;
-    afs_uint32 now;
+    afs_uint32 now, nshards = 1;
     afs_int64 now64;
 
     oflag = O_RDONLY;
@@ -2759,7 +3621,7 @@ ReadDump(char *file, int timebits)
 	exit(1);
     }
     ReadBytes(fd, &magic, sizeof(magic));
-    if (magic == MAGICV2) {
+    if (magic == MAGICV2 || magic == MAGICV3) {
 	timebits = 32;
     } else {
 	if (magic != MAGIC) {
@@ -2779,16 +3641,28 @@ ReadDump(char *file, int timebits)
 
     ReadBytes(fd, &cbstuff, sizeof(cbstuff));
     ReadBytes(fd, TimeOuts, sizeof(TimeOuts));
-    ReadBytes(fd, timeout, sizeof(timeout));
+    /* older dumps have a single shard */
+    if (magic == MAGICV3) {
+	ReadBytes(fd, &nshards, sizeof(nshards));
+	if (nshards != CB_NUM_SHARDS) {
+	    fprintf(stderr, "Dump has %u callback shards, expected %d\n",
+		    nshards, CB_NUM_SHARDS);
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nshards; i++)
+	ReadBytes(fd, cbShards[i].timeout, sizeof(cbShards[i].timeout));
     ReadBytes(fd, &tfirst, sizeof(tfirst));
-    ReadBytes(fd, &freelisthead, sizeof(freelisthead));
     CB = ((struct CallBack
 	   *)(calloc(cbstuff.nblks, sizeof(struct CallBack)))) - 1;
     FE = ((struct FileEntry
 	   *)(calloc(cbstuff.nblks, sizeof(struct FileEntry)))) - 1;
-    CBfree = (struct CallBack *)itocb(freelisthead);
-    ReadBytes(fd, &freelisthead, sizeof(freelisthead));
-    FEfree = (struct FileEntry *)itofe(freelisthead);
+    for (i = 0; i < nshards; i++) {
+	ReadBytes(fd, &freelisthead, sizeof(freelisthead));
+	cbShards[i].CBfree = (struct CallBack *)itocb(freelisthead);
+	ReadBytes(fd, &freelisthead, sizeof(freelisthead));
+	cbShards[i].FEfree = (struct FileEntry *)itofe(freelisthead);
+    }
     ReadBytes(fd, HashTable, sizeof(HashTable));
     ReadBytes(fd, &CB[1], sizeof(CB[1]) * cbstuff.nblks);	/* CB stuff */
     ReadBytes(fd, &FE[1], sizeof(FE[1]) * cbstuff.nblks);	/* FE stuff */
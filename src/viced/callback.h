@@ -40,6 +40,19 @@ struct cbcounters {
     afs_int32 GSS1, GSS2, GSS3, GSS4, GSS5;
 };
 extern struct cbcounters cbstuff;
+extern void GetCallBackCounters(struct cbcounters *cbc);
+
+/* Statistics from the threads delivering callback breaks */
+struct cbbreakcounters {
+    afs_int32 queued;		/* breaks waiting to be sent */
+    afs_int32 queuedMax;	/* most breaks ever waiting at once */
+    afs_int32 batches;		/* CallBack RPCs sent */
+    afs_int32 fids;		/* fids carried by those RPCs */
+    afs_int32 failed;		/* batches left as delayed callbacks */
+    afs_int32 avgMsec;		/* mean time from queueing to delivery */
+    afs_int32 maxMsec;		/* longest time from queueing to delivery */
+};
+extern void GetCallBackBreakCounters(struct cbbreakcounters *cbb);
 
 struct cbstruct {
     struct host *hp;
@@ -59,6 +72,8 @@ struct FileEntry {
     afs_uint32 spare;
 };
 #define FE_LATER 0x1
+#define FE_REFERENCED 0x2	/* callback granted since the last eviction sweep */
+#define FE_FREE 0x4		/* on a free list */
 
 /* structure MUST be multiple of 8 bytes, otherwise the casts to
  * struct object will have alignment issues on *P64 userspaces */
@@ -87,6 +102,11 @@ struct VCBParams {
 #define FEHASH_MASK (FEHASH_SIZE-1)
 #define FEHash(volume, unique) (((volume)+(unique))&(FEHASH_MASK))
 
+/* callback shards own FE hash buckets; CB_NUM_SHARDS (see host.h) must be
+ * a power of 2 no larger than FEHASH_SIZE */
+#define CB_SHARD_MASK (CB_NUM_SHARDS-1)
+#define CBShardIndex(volume, unique) (FEHash(volume, unique)&(CB_SHARD_MASK))
+
 #define CB_NUM_TIMEOUT_QUEUES 128
 
 
@@ -143,8 +163,8 @@ struct VCBParams {
 /* Convert cbtime to timeout queue index */
 #define TIndex(cbtime)  (((cbtime)&127)+1)
 
-/* Convert cbtime to pointer to timeout queue head */
-#define THead(cbtime)	(&timeout[TIndex(cbtime)-1])
+/* Convert cbtime to pointer to timeout queue head in callback shard sh */
+#define THead(sh, cbtime)	(&(sh)->timeout[TIndex(cbtime)-1])
 
 /* Normalize index into timeout array so that two such indices will be
    ordered correctly, so that they can be compared to see which times
@@ -157,7 +177,7 @@ struct VCBParams {
 
 
 /* Convert pointer to timeout queue head to index, and vice versa */
-#define ttoi(t)		((t-timeout)+1)
-#define itot(i)		((timeout)+(i-1))
+#define ttoi(sh, t)	((t-(sh)->timeout)+1)
+#define itot(sh, i)	(((sh)->timeout)+(i-1))
 
 #endif /* _AFS_VICED_CALLBACK_H */
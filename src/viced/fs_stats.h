@@ -126,10 +126,45 @@ struct afs_PerfStats {
      * Can't count this as an RPC because it breaks the data structure
      */
     afs_int32 fs_nGetCaps;	/* Number of GetCapabilities calls */
+
+    /*
+     * FetchData I/O.  Bytes per read is fs_FetchReadKBytes/fs_nFetchReads;
+     * every byte is copied once by the kernel into an rx packet, plus
+     * once more for each byte in fs_FetchCopyKBytes.
+     */
+    afs_int32 fs_nFetchReads;	/* read syscalls issued by FetchData */
+    afs_int32 fs_FetchReadKBytes;	/* KB read from disk by FetchData */
+    afs_int32 fs_FetchCopyKBytes;	/* KB copied via an interim buffer */
+
+    /*
+     * Callback break delivery.  Breaks per RPC is
+     * fs_nCBBreakFids/fs_nCBBreakBatches.
+     */
+    afs_int32 fs_CBBreakQueued;	/* breaks waiting to be sent */
+    afs_int32 fs_CBBreakQueuedMax;	/* most breaks ever waiting at once */
+    afs_int32 fs_nCBBreakBatches;	/* CallBack RPCs sent by break threads */
+    afs_int32 fs_nCBBreakFids;	/* fids carried by those RPCs */
+    afs_int32 fs_nCBBreakFailed;	/* batches left as delayed callbacks */
+    afs_int32 fs_CBBreakAvgMsec;	/* mean msec from queueing to delivery */
+    afs_int32 fs_CBBreakMaxMsec;	/* max msec from queueing to delivery */
+
+    /*
+     * Volume attach at startup.  On the demand attach fileserver
+     * fs_VolAttached counts pre-attached volumes, and once those are all
+     * done fs_VolAttachETA covers the background attach of the recently
+     * used volumes.
+     */
+    afs_int32 fs_VolAttachFound;	/* volumes found on the partitions */
+    afs_int32 fs_VolAttached;	/* volumes attached */
+    afs_int32 fs_VolAttachFailed;	/* volumes not attached */
+    afs_int32 fs_VolAttachHot;	/* recently used volumes, attached first */
+    afs_int32 fs_VolAttachHotDone;	/* recently used volumes attached */
+    afs_int32 fs_VolAttachSecs;	/* seconds spent attaching so far */
+    afs_int32 fs_VolAttachETA;	/* seconds left; 0 done, -1 unknown */
     /*
      * Spares
      */
-    afs_int32 spare[28];
+    afs_int32 spare[11];
 };
 
 /*
@@ -62,6 +62,7 @@ afsUUID nulluuid;
 int CEs = 0;			/* active clients */
 int CEBlocks = 0;		/* number of blocks of CEs */
 struct client *CEFree = 0;	/* first free client */
+static struct host *HTFree = 0;	/* first free host */
 struct host *hostList = 0;	/* linked list of all hosts */
 int hostCount = 0;		/* number of hosts in hostList */
 int rxcon_ident_key;
@@ -111,6 +112,126 @@ void h_TossStuff_r(struct host *host);
 	((hf) & (HWHO_INPROGRESS | HCPS_INPROGRESS | HCPS_WAITING) \
 	|| !((hf) & ALTADDR))
 
+/*
+ * Lock-free readers.
+ *
+ * An RPC on a connection which already has a client finds it through the
+ * connection's rock, and takes its references without H_LOCK (see
+ * h_FindClientFast).  Such a reader may still be looking at a client or
+ * host while h_TossStuff_r frees it, so freed entries are not reused
+ * straight away.  Each reader publishes the epoch in which it started,
+ * every free advances the epoch, and an entry freed in some epoch is put
+ * back on its free list only once no reader started in that epoch or
+ * earlier is still running.
+ *
+ * A reader must not hold H_LOCK, and must take references before it
+ * trusts anything it has read: h_TossStuff_r marks a client or host
+ * deleted before it checks the refCount, so a reader which takes a
+ * reference and still finds the entry undeleted has kept it from being
+ * freed.  This relies on the rx_atomic read-modify-write operations being
+ * full barriers.
+ */
+struct h_reader {
+    rx_atomic_t epoch;		/* epoch entered, or 0 if not reading */
+    struct h_reader *next;	/* under H_LOCK */
+};
+
+static rx_atomic_t h_epoch = RX_ATOMIC_INIT(1);
+static struct h_reader *h_readers;	/* every thread that has read */
+static pthread_key_t h_reader_key;
+
+#define h_EpochBefore(a, b) ((afs_int32)((afs_uint32)(a) - (afs_uint32)(b)) < 0)
+
+/* Read a refCount for h_TossStuff_r, ordered after the deleted marks */
+#define h_RefCountSync(x) rx_atomic_add_and_read(&(x)->z.refCount, 0)
+
+/* freed entries waiting for the readers which might still see them */
+static struct client *CELimbo, **CELimboTail = &CELimbo;
+static struct host *HTLimbo, **HTLimboTail = &HTLimbo;
+
+static struct h_reader *
+h_ReaderEnter(void)
+{
+    struct h_reader *rd;
+    int epoch, published = 0;
+
+    rd = pthread_getspecific(h_reader_key);
+    if (rd == NULL) {
+	rd = calloc(1, sizeof(*rd));
+	if (rd == NULL)
+	    ViceLogThenPanic(0, ("Failed malloc in h_ReaderEnter\n"));
+	H_LOCK;
+	rd->next = h_readers;
+	h_readers = rd;
+	H_UNLOCK;
+	opr_Verify(pthread_setspecific(h_reader_key, rd) == 0);
+    }
+
+    /* h_ReclaimEntries_r may have missed the epoch we published if the
+     * epoch has moved on since we read it */
+    for (;;) {
+	epoch = rx_atomic_read(&h_epoch);
+	rx_atomic_add(&rd->epoch, epoch - published);
+	published = epoch;
+	if (rx_atomic_read(&h_epoch) == epoch)
+	    break;
+    }
+    return rd;
+}
+
+static void
+h_ReaderExit(struct h_reader *rd)
+{
+    rx_atomic_sub(&rd->epoch, rx_atomic_read(&rd->epoch));
+}
+
+/* Start a new epoch, returning the one entries freed now belong to.
+ * Called with H_LOCK held. */
+static afs_int32
+h_NextEpoch_r(void)
+{
+    int epoch = rx_atomic_read(&h_epoch);
+
+    /* 0 means a reader is idle */
+    if (rx_atomic_inc_and_read(&h_epoch) == 0)
+	rx_atomic_inc(&h_epoch);
+    return epoch;
+}
+
+/* Move the freed entries no reader can see any more onto the free lists.
+ * Called with H_LOCK held. */
+static void
+h_ReclaimEntries_r(void)
+{
+    struct h_reader *rd;
+    struct client *client;
+    struct host *host;
+    int oldest, epoch;
+
+    oldest = rx_atomic_read(&h_epoch);
+    for (rd = h_readers; rd; rd = rd->next) {
+	epoch = rx_atomic_read(&rd->epoch);
+	if (epoch != 0 && h_EpochBefore(epoch, oldest))
+	    oldest = epoch;
+    }
+
+    while ((client = CELimbo) && h_EpochBefore(client->freeEpoch, oldest)) {
+	CELimbo = client->z.next;
+	client->z.next = CEFree;
+	CEFree = client;
+    }
+    if (CELimbo == NULL)
+	CELimboTail = &CELimbo;
+
+    while ((host = HTLimbo) && h_EpochBefore(host->freeEpoch, oldest)) {
+	HTLimbo = host->z.next;
+	host->z.next = HTFree;
+	HTFree = host;
+    }
+    if (HTLimbo == NULL)
+	HTLimboTail = &HTLimbo;
+}
+
 /* get a new block of CEs and chain it on CEFree */
 static void
 GetCEBlock(void)
@@ -142,6 +263,8 @@ GetCE(void)
 {
     struct client *entry;
 
+    if (CEFree == 0 && CELimbo)
+	h_ReclaimEntries_r();
     if (CEFree == 0)
 	GetCEBlock();
     if (CEFree == 0) {
@@ -158,14 +281,16 @@ GetCE(void)
 }				/*GetCE */
 
 
-/* return an entry to the free list */
+/* return an entry to the free list, once no reader can see it */
 static void
 FreeCE(struct client *entry)
 {
     entry->z.VenusEpoch = 0;
     entry->z.sid = 0;
-    entry->z.next = CEFree;
-    CEFree = entry;
+    entry->freeEpoch = h_NextEpoch_r();
+    entry->z.next = NULL;
+    *CELimboTail = entry;
+    CELimboTail = &entry->z.next;
     CEs--;
 
 }				/*FreeCE */
@@ -176,7 +301,6 @@ FreeCE(struct client *entry)
  */
 int HTs = 0;			/* active file entries */
 int HTBlocks = 0;		/* number of blocks of HTs */
-static struct host *HTFree = 0;	/* first free file entry */
 
 /*
  * Hash tables of host pointers. We need two tables, one
@@ -232,6 +356,8 @@ GetHT(void)
 {
     struct host *entry;
 
+    if (HTFree == NULL && HTLimbo)
+	h_ReclaimEntries_r();
     if (HTFree == NULL)
 	GetHTBlock();
     if (HTFree == NULL)
@@ -245,12 +371,15 @@ GetHT(void)
 }				/*GetHT */
 
 
-/* return an entry to the free list */
+/* return an entry to the free list, once no reader can see it */
 static void
 FreeHT(struct host *entry)
 {
-    entry->z.next = HTFree;
-    HTFree = entry;
+    entry->z.hostFlags |= HOSTFREE;
+    entry->freeEpoch = h_NextEpoch_r();
+    entry->z.next = NULL;
+    *HTLimboTail = entry;
+    HTLimboTail = &entry->z.next;
     HTs--;
 
 }				/*FreeHT */
@@ -844,7 +973,7 @@ h_TossStuff_r(struct host *host)
     /* if somebody still has this host held */
     /* we must check this _after_ h_NBLock_r, since h_NBLock_r can drop and
      * reacquire H_LOCK */
-    if (host->z.refCount > 0) {
+    if (h_RefCountSync(host) > 0) {
 	char hoststr[16];
 	if (wasdeleted) {
 	    /* someone grabbed a ref while HOSTDELETED was set; that is bad */
@@ -871,13 +1000,13 @@ h_TossStuff_r(struct host *host)
 		return;
 	    }
 
-	    if (client->z.refCount) {
+	    if (h_RefCountSync(client)) {
 		char hoststr[16];
 		ViceLog(0,
 			("Warning: h_TossStuff_r failed: Host %p (%s:%d) "
 			 "client %p refcount %d.\n",
 			 host, afs_inet_ntoa_r(host->z.host, hoststr),
-			 ntohs(host->z.port), client, client->z.refCount));
+			 ntohs(host->z.port), client, h_RefCount(client)));
 		/* This is the same thing we do if the host is locked */
 		ReleaseWriteLock(&client->lock);
 		return;
@@ -992,9 +1121,7 @@ h_Enumerate(int (*proc) (struct host*, void *), void *param)
     for (i = 0; i < count; i++) {
 	int flags;
 	flags = (*proc) (list[i], param);
-	H_LOCK;
-	h_Release_r(list[i]);
-	H_UNLOCK;
+	h_Release(list[i]);
 	/* bail out of the enumeration early */
 	if (H_ENUMERATE_ISSET_BAIL(flags)) {
 	    break;
@@ -1007,11 +1134,9 @@ h_Enumerate(int (*proc) (struct host*, void *), void *param)
 	/* we bailed out of enumerating hosts early; we still have holds on
 	 * some of the hosts in 'list', so release them */
 	i++;
-	H_LOCK;
 	for ( ; i < count; i++) {
-	    h_Release_r(list[i]);
+	    h_Release(list[i]);
 	}
-	H_UNLOCK;
     }
     free(list);
 }	/* h_Enumerate */
@@ -2423,6 +2548,7 @@ h_InitHostPackage(int hquota)
     memset(&nulluuid, 0, sizeof(afsUUID));
     rxcon_ident_key = rx_KeyCreate((rx_destructor_t) free);
     rxcon_client_key = rx_KeyCreate((rx_destructor_t) 0);
+    opr_Verify(pthread_key_create(&h_reader_key, NULL) == 0);
     opr_mutex_init(&host_glock_mutex);
 }
 
@@ -2473,7 +2599,7 @@ PerHost_EnumerateClient(struct host *host, void *arock)
     for (client = host->z.FirstClient; client; client = client->z.next) {
 	if (!client->z.deleted && client->z.ViceId == args->vid) {
 
-	    client->z.refCount++;
+	    rx_atomic_inc(&client->z.refCount);
 	    H_UNLOCK;
 
 	    code = (*args->proc)(client, args->rock);
@@ -2637,7 +2763,7 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
 	if (a_viceid) {
 	    *a_viceid = client->z.ViceId;
 	}
-	client->z.refCount++;
+	rx_atomic_inc(&client->z.refCount);
 	h_Hold_r(client->z.host);
 	if (client->z.prfail != 2) {
 	    /* Could add shared lock on client here */
@@ -2676,7 +2802,7 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
 	for (client = host->z.FirstClient; client; client = client->z.next) {
 	    if (!client->z.deleted && (client->z.sid == rx_GetConnectionId(tcon))
 		&& (client->z.VenusEpoch == rx_GetConnectionEpoch(tcon))) {
-		client->z.refCount++;
+		rx_atomic_inc(&client->z.refCount);
 		H_UNLOCK;
 		ObtainWriteLock(&client->lock);
 		H_LOCK;
@@ -2703,7 +2829,7 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
 	    created = 1;
 	    client = GetCE();
 	    ObtainWriteLock(&client->lock);
-	    client->z.refCount = 1;
+	    rx_atomic_set(&client->z.refCount, 1);
 	    client->z.host = host;
 	    client->z.InSameNetwork = host->z.InSameNetwork;
 	    client->z.ViceId = viceid;
@@ -2791,13 +2917,13 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
 		client->z.CPS.prlist_len = 0;
 	    }
 	    /* We should perhaps check for 0 here */
-	    client->z.refCount--;
+	    rx_atomic_dec(&client->z.refCount);
 	    ReleaseWriteLock(&client->lock);
 	    if (created) {
 		FreeCE(client);
 		created = 0;
 	    }
-	    oldClient->z.refCount++;
+	    rx_atomic_inc(&oldClient->z.refCount);
 
 	    h_Hold_r(oldClient->z.host);
 	    h_Release_r(client->z.host);
@@ -2811,12 +2937,12 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
 	    ViceLog(0, ("FindClient: deleted client %p(%x ref %d host %p href "
 			"%d) already had conn %p (host %s:%d, cid %x), stolen "
 			"by client %p(%x, ref %d host %p href %d)\n",
-			oldClient, oldClient->z.sid, oldClient->z.refCount,
-			oldClient->z.host, oldClient->z.host->z.refCount, tcon,
+			oldClient, oldClient->z.sid, h_RefCount(oldClient),
+			oldClient->z.host, h_RefCount(oldClient->z.host), tcon,
 			afs_inet_ntoa_r(rxr_HostOf(tcon), hoststr),
 			ntohs(rxr_PortOf(tcon)), rx_GetConnectionId(tcon),
-			client, client->z.sid, client->z.refCount,
-			client->z.host, client->z.host->z.refCount));
+			client, client->z.sid, h_RefCount(client),
+			client->z.host, h_RefCount(client->z.host)));
 	    /* rx_SetSpecific will be done immediately below */
 	}
     }
@@ -2836,7 +2962,7 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
 	    client->z.CPS.prlist_val = NULL;
 	    client->z.CPS.prlist_len = 0;
 
-	    client->z.refCount--;
+	    rx_atomic_dec(&client->z.refCount);
             ReleaseWriteLock(&client->lock);
             FreeCE(client);
             return NULL;
@@ -2857,11 +2983,112 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
 int
 h_ReleaseClient_r(struct client *client)
 {
-    opr_Assert(client->z.refCount > 0);
-    client->z.refCount--;
+    opr_Verify(rx_atomic_dec_and_read(&client->z.refCount) >= 0);
     return 0;
 }
 
+/* Can a reader use client for an RPC on tcon?  See h_ReaderEnter. */
+static int
+h_ClientUsable(struct client *client, struct rx_connection *tcon)
+{
+    struct host *host = client->z.host;
+
+    return client->z.sid == rx_GetConnectionId(tcon)
+	&& client->z.VenusEpoch == rx_GetConnectionEpoch(tcon)
+	&& !client->z.deleted && client->z.CPS.prlist_val != NULL
+	&& host != NULL && !(host->z.hostFlags & HOSTDELETED);
+}
+
+/* Drop a reference on a host, tossing it if it was the last one on a
+ * deleted host.  Called as a reader, without H_LOCK. */
+static void
+h_DropHost(struct host *host)
+{
+    if (rx_atomic_dec_and_read(&host->z.refCount) < 1
+	&& (host->z.hostFlags & (HOSTDELETED | CLIENTDELETED))) {
+	H_LOCK;
+	/* someone else may have held and tossed it since */
+	if (!(host->z.hostFlags & HOSTFREE) && h_RefCount(host) < 1)
+	    h_TossStuff_r(host);
+	H_UNLOCK;
+    }
+}
+
+/*
+ * Take a reference on the client bound to tcon, and on its host if
+ * holdhost is set, without H_LOCK.  Returns NULL, holding nothing, for
+ * anything the H_LOCK paths must deal with: no client yet, a deleted client
+ * or host, or a client whose CPS must be fetched again.
+ */
+static struct client *
+h_HoldClientFast(struct rx_connection *tcon, int holdhost)
+{
+    struct h_reader *rd;
+    struct client *client;
+    struct host *host = NULL;
+
+    rd = h_ReaderEnter();
+    client = (struct client *)rx_GetSpecific(tcon, rxcon_client_key);
+    if (client == NULL || !h_ClientUsable(client, tcon)
+	|| (holdhost && client->z.prfail)) {
+	h_ReaderExit(rd);
+	return NULL;
+    }
+    rx_atomic_inc(&client->z.refCount);
+    if (holdhost) {
+	host = client->z.host;
+	h_Hold_r(host);
+    }
+
+    /* If the client or host was tossed before our references were seen,
+     * it was marked deleted first, and we see that now */
+    if (!h_ClientUsable(client, tcon) || (holdhost && host != client->z.host)) {
+	rx_atomic_dec(&client->z.refCount);
+	if (host)
+	    h_DropHost(host);
+	client = NULL;
+    }
+    h_ReaderExit(rd);
+    return client;
+}
+
+/*
+ * h_FindClient_r for the common case of a connection which already has a
+ * usable client, without taking H_LOCK.  Returns NULL if h_FindClient_r
+ * must be used instead; otherwise the client and its host are held, to be
+ * released with h_ReleaseClient and h_Release.  Must not be called with
+ * H_LOCK held.
+ */
+struct client *
+h_FindClientFast(struct rx_connection *tcon, afs_int32 *a_viceid)
+{
+    struct client *client;
+
+    client = h_HoldClientFast(tcon, 1);
+    if (client && a_viceid)
+	*a_viceid = client->z.ViceId;
+    return client;
+}
+
+/* h_ReleaseClient_r without H_LOCK.  The caller must still hold the
+ * client's host, whose release will toss the client if need be. */
+void
+h_ReleaseClient(struct client *client)
+{
+    opr_Verify(rx_atomic_dec_and_read(&client->z.refCount) >= 0);
+}
+
+/* h_Release_r without H_LOCK */
+void
+h_Release(struct host *host)
+{
+    struct h_reader *rd;
+
+    rd = h_ReaderEnter();
+    h_DropHost(host);
+    h_ReaderExit(rd);
+}
+
 
 /*
  * Sigh:  this one is used to get the client AGAIN within the individual
@@ -2876,8 +3103,18 @@ GetClient(struct rx_connection *tcon, struct client **cp)
     struct client *client;
     char hoststr[16];
 
-    H_LOCK;
     *cp = NULL;
+    client = h_HoldClientFast(tcon, 0);
+    if (client != NULL) {
+	if (!client->z.expTime || client->z.LastCall <= client->z.expTime) {
+	    *cp = client;
+	    return 0;
+	}
+	/* let the slow path complain about the expired token */
+	h_ReleaseClient(client);
+    }
+
+    H_LOCK;
     client = (struct client *)rx_GetSpecific(tcon, rxcon_client_key);
     if (client == NULL) {
 	ViceLog(0,
@@ -2907,14 +3144,14 @@ GetClient(struct rx_connection *tcon, struct client **cp)
 	ViceLog(0, ("GetClient: got deleted client, connection will appear "
 		    "anonymous; tcon %p cid %x client %p ref %d host %p "
 		    "(%s:%d) href %d ViceId %d\n",
-		    tcon, rx_GetConnectionId(tcon), client, client->z.refCount,
+		    tcon, rx_GetConnectionId(tcon), client, h_RefCount(client),
 		    client->z.host,
 		    afs_inet_ntoa_r(client->z.host->z.host, hoststr),
-		    (int)ntohs(client->z.host->z.port), client->z.host->z.refCount,
+		    (int)ntohs(client->z.host->z.port), h_RefCount(client->z.host),
 		    (int)client->z.ViceId));
     }
 
-    client->z.refCount++;
+    rx_atomic_inc(&client->z.refCount);
     *cp = client;
     H_UNLOCK;
     return 0;
@@ -2926,10 +3163,9 @@ PutClient(struct client **cp)
     if (*cp == NULL)
 	return -1;
 
-    H_LOCK;
-    h_ReleaseClient_r(*cp);
+    /* the caller still holds the host, from CallPreamble */
+    h_ReleaseClient(*cp);
     *cp = NULL;
-    H_UNLOCK;
     return 0;
 }				/*PutClient */
 
@@ -3079,7 +3315,7 @@ h_DumpHost(struct host *host, void *rock)
 	     "down:%d del:%d cons:%d cldel:%d\n\t hpfailed:%d hcpsCall:%u "
 	     "hcps [",
 	     afs_inet_ntoa_r(host->z.host, hoststr), ntohs(host->z.port),
-	     host->index, host->z.cblist, CheckLock(&host->lock),
+	     host->index, FirstHostCallBack(host), CheckLock(&host->lock),
 	     host->z.LastCall, host->z.ActiveCall, (host->z.hostFlags & VENUSDOWN),
 	     host->z.hostFlags & HOSTDELETED, host->z.Console,
 	     host->z.hostFlags & CLIENTDELETED, host->z.hcpsfailed,
@@ -3100,7 +3336,7 @@ h_DumpHost(struct host *host, void *rock)
 		     ntohs(host->z.interface->interface[i].port));
 	    (void)STREAM_WRITE(tmpStr, strlen(tmpStr), 1, file);
 	}
-    sprintf(tmpStr, "] refCount:%d hostFlags:%hu\n", host->z.refCount, host->z.hostFlags);
+    sprintf(tmpStr, "] refCount:%d hostFlags:%hu\n", h_RefCount(host), host->z.hostFlags);
     (void)STREAM_WRITE(tmpStr, strlen(tmpStr), 1, file);
 
     H_UNLOCK;
@@ -3271,10 +3507,8 @@ h_stateRestoreIndices(struct fs_dump_state * state)
 static int
 h_stateRestoreIndex(struct host * h, void *rock)
 {
-    struct fs_dump_state *state = (struct fs_dump_state *)rock;
-    if (cb_OldToNew(state, h->z.cblist, &h->z.cblist)) {
-	return H_ENUMERATE_BAIL(0);
-    }
+    /* the per-shard callback lists are rebuilt by cb_stateRestoreIndices */
+    memset(h->z.cblist, 0, sizeof(h->z.cblist));
     return 0;
 }
 
@@ -3707,7 +3941,7 @@ h_hostToDiskEntry_r(struct host * in, struct hostDiskEntry * out)
     out->LastCall = in->z.LastCall;
     out->ActiveCall = in->z.ActiveCall;
     out->cpsCall = in->z.cpsCall;
-    out->cblist = in->z.cblist;
+    out->cblist = FirstHostCallBack(in);	/* informational only */
     out->InSameNetwork = in->z.InSameNetwork;
 
     /* special fields we save, but are not memcpy'd back on restore */
@@ -3728,7 +3962,6 @@ h_diskEntryToHost_r(struct hostDiskEntry * in, struct host * out)
     out->z.LastCall = in->LastCall;
     out->z.ActiveCall = in->ActiveCall;
     out->z.cpsCall = in->cpsCall;
-    out->z.cblist = in->cblist;
     out->z.InSameNetwork = in->InSameNetwork;
 }
 
@@ -4016,7 +4249,7 @@ CheckHost_r(struct host *host, void *dummy)
 
     /* Host is held by h_Enumerate_r */
     for (client = host->z.FirstClient; client; client = client->z.next) {
-	if (client->z.refCount == 0 && client->z.LastCall < clientdeletetime) {
+	if (h_RefCount(client) == 0 && client->z.LastCall < clientdeletetime) {
 	    client->z.deleted = 1;
 	    host->z.hostFlags |= CLIENTDELETED;
 	}
@@ -4060,7 +4293,7 @@ CheckHost_r(struct host *host, void *dummy)
 		     */
 		}
 	    } else {
-		if (!(host->z.hostFlags & VENUSDOWN) && host->z.cblist) {
+		if (!(host->z.hostFlags & VENUSDOWN) && FirstHostCallBack(host)) {
 		    char hoststr[16];
 		    (void)afs_inet_ntoa_r(host->z.host, hoststr);
 		    if (host->z.interface) {
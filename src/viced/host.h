@@ -22,6 +22,7 @@
  * precedence is host_listlock_mutex, host->mutex, host_glock_mutex.
  */
 #include <rx/rx_globals.h>
+#include <rx/rx_atomic.h>
 #include <pthread.h>
 extern pthread_mutex_t host_glock_mutex;
 #define H_LOCK opr_mutex_enter(&host_glock_mutex)
@@ -34,6 +35,8 @@ extern pthread_key_t viced_uclient_key;
 #define h_HTSPERBLOCK 512	/* Power of 2 */
 #define h_HTSHIFT 9		/* log base 2 of HTSPERBLOCK */
 
+#define CB_NUM_SHARDS 16	/* callback table shards; see callback.c */
+
 struct Identity {
     char valid;			/* zero if UUID is unknown */
     afsUUID uuid;
@@ -55,7 +58,7 @@ struct Interface {
 struct host_to_zero {
     struct host *next, *prev;	/* linked list of all hosts */
     struct rx_connection *callback_rxcon;	/* rx callback connection */
-    afs_uint32 refCount;     	/* reference count */
+    rx_atomic_t refCount;     	/* reference count */
     afs_uint32 host;	 	/* IP address of host interface that is
 				 * currently being used, in network
 				 * byte order */
@@ -72,8 +75,9 @@ struct host_to_zero {
     struct client *FirstClient;	/* first connection from host */
     afs_uint32 cpsCall;	 	/* time of last cps call from this host */
     struct Interface *interface;/* all alternate addr for client */
-    afs_uint32 cblist;	 	/* index of a cb in the per-host circular CB
-				 * list */
+    afs_uint32 cblist[CB_NUM_SHARDS];	/* index of a cb in each of the
+					 * per-host circular CB lists, one
+					 * per callback shard */
 
     unsigned int n_tmays;    	/* how many successful TellMeAboutYourself
 				 * calls have we made against this host? */
@@ -90,6 +94,7 @@ struct host {
     struct Lock lock;		/* Write lock for synchronization of
 				 * VenusDown flag */
     pthread_cond_t cond;	/* used to wait on hcpsValid */
+    afs_int32 freeEpoch;	/* reader epoch when freed; see h_ReaderEnter */
 };
 
 struct h_AddrHashChain {
@@ -116,7 +121,7 @@ struct client_to_zero {
 				 * venus.  Actually, now an extension of the
 				 * sid, which is why it moved.
 				 */
-    afs_int32 refCount;		/* reference count */
+    rx_atomic_t refCount;	/* reference count */
     char deleted;		/* True if this client should be deleted
 				 * when there are no more users of the
 				 * structure */
@@ -130,6 +135,7 @@ struct client {
     struct client_to_zero z;
     struct Lock lock;		/* lock to ensure CPS valid if entry
 				 * on host's clients list. */
+    afs_int32 freeEpoch;	/* reader epoch when freed; see h_ReaderEnter */
 };
 
 
@@ -148,34 +154,36 @@ extern int h_Lock_r(struct host *host);
 #define h_Unlock(host)  ReleaseWriteLock(&(host)->lock)
 #define h_Unlock_r(host)  ReleaseWriteLock(&(host)->lock)
 
-#define	AddCallBack(host, fid)	AddCallBack1((host), (fid), (afs_uint32 *)0, 1/*CB_NORMAL*/, 0)
-#define	AddVolCallBack(host, fid) AddCallBack1((host), (fid), (afs_uint32 *)0, 3/*CB_VOLUME*/, 0)
-#define	AddBulkCallBack(host, fid) AddCallBack1((host), (fid), (afs_uint32 *)0, 4/*CB_BULK*/, 0)
+#define	AddCallBack(host, fid)	AddCallBack1((host), (fid), 0, 1/*CB_NORMAL*/, 0)
+#define	AddVolCallBack(host, fid) AddCallBack1((host), (fid), 0, 3/*CB_VOLUME*/, 0)
+#define	AddBulkCallBack(host, fid) AddCallBack1((host), (fid), 0, 4/*CB_BULK*/, 0)
 
 /* A simple refCount replaces per-thread hold mechanism.  The former
  * hold semantics are not different from refcounting, except with respect
- * to cross-thread assertions.  In this change, refcount is protected by
- * H_LOCK, just like former hold bitmap.  A future change will replace locks
- * th lock-free operations.  */
+ * to cross-thread assertions.  Host and client refcounts are atomic, so
+ * that RPCs on connections which already have a client (see
+ * h_FindClientFast) can take and drop their references without H_LOCK;
+ * tossing a host or client still happens under H_LOCK.  */
 
 #define h_Hold_r(x) \
 do { \
-	++((x)->z.refCount); \
+	rx_atomic_inc(&(x)->z.refCount); \
 } while(0)
 
 #define h_Decrement_r(x) \
 do { \
-	--((x)->z.refCount); \
+	rx_atomic_dec(&(x)->z.refCount); \
 } while (0)
 
 #define h_Release_r(x) \
 do { \
-	h_Decrement_r(x); \
-	if (((x)->z.refCount < 1) && \
+	if ((rx_atomic_dec_and_read(&(x)->z.refCount) < 1) && \
 		(((x)->z.hostFlags & HOSTDELETED) || \
 		 ((x)->z.hostFlags & CLIENTDELETED))) h_TossStuff_r((x));	 \
 } while(0)
 
+#define h_RefCount(x)	rx_atomic_read(&(x)->z.refCount)
+
 /* operations on the global linked list of hosts */
 #define h_InsertList_r(h) 	(h)->z.next =  hostList;			\
 				(h)->z.prev = 0;				\
@@ -192,8 +200,9 @@ extern int DeleteAllCallBacks_r(struct host *host, int deletefe);
 extern int DeleteCallBack(struct host *host, AFSFid * fid);
 extern int MultiProbeAlternateAddress_r(struct host *host);
 extern int BreakDelayedCallBacks_r(struct host *host);
-extern int AddCallBack1(struct host *host, AFSFid * fid, afs_uint32 * thead, int type,
+extern int AddCallBack1(struct host *host, AFSFid * fid, afs_uint32 thead, int type,
 	     int locked);
+extern afs_uint32 FirstHostCallBack(struct host *host);
 extern int BreakCallBack(struct host *xhost, AFSFid * fid, int flag);
 extern int DeleteFileCallBacks(AFSFid * fid);
 extern int CleanupTimedOutCallBacks(void);
@@ -213,6 +222,10 @@ extern void h_Enumerate_r(int (*proc) (struct host *, void *), struct host *enum
 extern struct host *h_GetHost_r(struct rx_connection *tcon);
 extern struct client *h_FindClient_r(struct rx_connection *tcon, afs_int32 *viceid);
 extern int h_ReleaseClient_r(struct client *client);
+extern struct client *h_FindClientFast(struct rx_connection *tcon,
+				       afs_int32 *viceid);
+extern void h_ReleaseClient(struct client *client);
+extern void h_Release(struct host *host);
 extern void h_TossStuff_r(struct host *host);
 extern void h_EnumerateClients(VolumeId vid,
                                int (*proc)(struct client *client, void *rock),
@@ -279,4 +292,5 @@ struct host *(hosttableptrs[h_MAXHOSTTABLES]);	/* Used by h_itoh */
 #define HERRORTRANS                    0x100	/* do error translation */
 #define HWHO_INPROGRESS                0x200    /* set when WhoAreYou running */
 #define HCBREAK                        0x400    /* flag for a multi CB break */
+#define HOSTFREE                       0x800    /* tossed; waiting for reuse */
 #endif /* _AFS_VICED_HOST_H */
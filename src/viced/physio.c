@@ -22,6 +22,7 @@
 #include <sys/file.h>
 #endif
 
+#include <opr/jhash.h>
 #include <rx/rx_queue.h>
 #include <afs/nfs.h>
 #include <lwp.h>
@@ -162,6 +163,12 @@ FidEq(DirHandle * afile, DirHandle * bfile)
     return 1;
 }
 
+afs_uint32
+FidHash(DirHandle * file)
+{
+    return opr_jhash_int2(file->dirh_vnode, file->dirh_unique, file->dirh_vid);
+}
+
 int
 FidVolEq(DirHandle * afile, VolumeId vid)
 {
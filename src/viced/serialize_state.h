@@ -26,7 +26,7 @@
 #define HOST_STATE_ENTRY_MAGIC 0xA8B9CADB
 
 #define CALLBACK_STATE_MAGIC 0x89DE67BC
-#define CALLBACK_STATE_VERSION 1
+#define CALLBACK_STATE_VERSION 2
 
 #define CALLBACK_STATE_TIMEOUT_MAGIC 0x99DD5511
 #define CALLBACK_STATE_FEHASH_MAGIC 0x77BB33FF
@@ -892,16 +892,21 @@ dump_cb_timeout(void)
 	fprintf(stderr, "* magic check failed\n");
     }
 
+    if (hdrs.timeout_hdr.records == 0) {
+	return;
+    }
+
+    /* CB_NUM_TIMEOUT_QUEUES heads for each callback shard in turn */
     DPFOFF(hdrs.timeout_p);
     DPFAO0("timeout");
-    for (i = 0; i < 127; i++) {
+    for (i = 0; i < hdrs.timeout_hdr.records - 1; i++) {
 	DPFAE("u", hdrs.timeout[i]);
 	if ((i % 8) == 7) {
 	    DPFAN;
 	    DPFA1;
 	}
     }
-    DPFALE("u", hdrs.timeout[127]);
+    DPFALE("u", hdrs.timeout[hdrs.timeout_hdr.records - 1]);
     DPFAC0;
 }
 
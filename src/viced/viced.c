@@ -154,13 +154,18 @@ int nSmallVns = 400;		/* 200 */
 int large = 400;		/* 200 */
 int volcache = 400;		/* 400 */
 int numberofcbs = 60000;	/* 60000 */
+static int breakThreads = 8;	/* threads delivering callback breaks */
+static int maxcbs = 0;		/* callback pool limit; 0 means 4 * numberofcbs */
 int lwps = 9;			/* 6 */
 int buffs = 90;			/* 70 */
 int novbc = 0;			/* Enable Volume Break calls */
 int busy_threshold = 600;
 int abort_threshold = 10;
 int udpBufSize = 0;		/* UDP buffer size for receive */
+int udpBatchSize = 0;		/* packets per batched UDP system call */
+int rxListeners = 0;		/* rx listener threads for the port */
 int sendBufSize = 16384;	/* send buffer size */
+static int storeThreads = 0;	/* threads writing pipelined stores */
 int saneacls = 0;		/* Sane ACLs Flag */
 static int unsafe_attach = 0;   /* avoid inUse check on vol attach? */
 static int offline_timeout = -1; /* -offline-timeout option */
@@ -419,6 +424,9 @@ FiveMinuteCheckLWP(void *unused)
 	    ViceLog(5, ("Timed out callbacks deleted\n"));
 	ViceLog(2, ("Set disk usage statistics\n"));
 	VSetDiskUsage();
+	ViceLog(2, ("Save VLRU state\n"));
+	if (VSaveVLRUState() < 0)
+	    ViceLog(0, ("Unable to save VLRU state\n"));
 	if (FS_registered == 1)
 	    Do_VLRegisterRPC();
 	/* Force wakeup in case we missed something; pthreads does timedwait */
@@ -893,11 +901,16 @@ enum optionsList {
     OPT_readonly,
     OPT_saneacls,
     OPT_buffers,
+    OPT_maxbuffers,
+    OPT_dirindex,
     OPT_callbacks,
+    OPT_cbthreads,
+    OPT_maxcallbacks,
     OPT_vcsize,
     OPT_lvnodes,
     OPT_svnodes,
     OPT_sendsize,
+    OPT_storethreads,
     OPT_minspare,
     OPT_spare,
     OPT_pctspare,
@@ -942,6 +955,8 @@ enum optionsList {
     OPT_rxpck,
     OPT_rxmaxmtu,
     OPT_udpsize,
+    OPT_udpbatch,
+    OPT_rxlisteners,
     OPT_dotted,
     OPT_realm,
     OPT_sync,
@@ -989,8 +1004,16 @@ ParseArgs(int argc, char *argv[])
 
     cmd_AddParmAtOffset(opts, OPT_buffers, "-b", CMD_SINGLE,
 			CMD_OPTIONAL, "buffers");
+    cmd_AddParmAtOffset(opts, OPT_maxbuffers, "-bmax", CMD_SINGLE,
+			CMD_OPTIONAL, "maximum number of buffers");
+    cmd_AddParmAtOffset(opts, OPT_dirindex, "-dirindex", CMD_SINGLE,
+			CMD_OPTIONAL, "pages in smallest indexed directory");
     cmd_AddParmAtOffset(opts, OPT_callbacks, "-cb", CMD_SINGLE,
 			CMD_OPTIONAL, "number of callbacks");
+    cmd_AddParmAtOffset(opts, OPT_cbthreads, "-cbthreads", CMD_SINGLE,
+			CMD_OPTIONAL, "number of threads breaking callbacks");
+    cmd_AddParmAtOffset(opts, OPT_maxcallbacks, "-cbmax", CMD_SINGLE,
+			CMD_OPTIONAL, "maximum number of callbacks");
     cmd_AddParmAtOffset(opts, OPT_vcsize, "-vc", CMD_SINGLE,
 			CMD_OPTIONAL, "volume cachesize");
     cmd_AddParmAtOffset(opts, OPT_lvnodes, "-l", CMD_SINGLE,
@@ -999,6 +1022,8 @@ ParseArgs(int argc, char *argv[])
 			CMD_OPTIONAL, "small vnodes");
     cmd_AddParmAtOffset(opts, OPT_sendsize, "-sendsize", CMD_SINGLE,
 			CMD_OPTIONAL, "size of send buffer in bytes");
+    cmd_AddParmAtOffset(opts, OPT_storethreads, "-storethreads", CMD_SINGLE,
+			CMD_OPTIONAL, "number of threads writing stored data");
 
 #if defined(AFS_AIX32_ENV)
     cmd_AddParmAtOffset(opts, OPT_minspare, "-m", CMD_SINGLE,
@@ -1113,6 +1138,10 @@ ParseArgs(int argc, char *argv[])
 			CMD_OPTIONAL, "maximum MTU for RX");
     cmd_AddParmAtOffset(opts, OPT_udpsize, "-udpsize", CMD_SINGLE,
 			CMD_OPTIONAL, "size of socket buffer in bytes");
+    cmd_AddParmAtOffset(opts, OPT_udpbatch, "-udpbatch", CMD_SINGLE,
+			CMD_OPTIONAL, "packets per batched UDP system call");
+    cmd_AddParmAtOffset(opts, OPT_rxlisteners, "-rxlisteners", CMD_SINGLE,
+			CMD_OPTIONAL, "number of rx listener threads");
 
     /* rxkad options */
     cmd_AddParmAtOffset(opts, OPT_dotted, "-allow-dotted-principals",
@@ -1187,6 +1216,22 @@ ParseArgs(int argc, char *argv[])
     cmd_OptionAsFlag(opts, OPT_readonly, &readonlyServer);
     cmd_OptionAsFlag(opts, OPT_saneacls, &saneacls);
     cmd_OptionAsInt(opts, OPT_buffers, &buffs);
+    if (cmd_OptionAsInt(opts, OPT_maxbuffers, &afs_dir_maxBuffers) == 0) {
+	if (afs_dir_maxBuffers < buffs) {
+	    printf("maximum number of buffers %d invalid; "
+		   "must be at least %d\n", afs_dir_maxBuffers, buffs);
+	    return -1;
+	}
+    } else {
+	afs_dir_maxBuffers = 4 * buffs;
+    }
+    if (cmd_OptionAsInt(opts, OPT_dirindex, &afs_dir_indexPages) == 0) {
+	if (afs_dir_indexPages < 0) {
+	    printf("directory index threshold %d invalid; "
+		   "must be 0 or more\n", afs_dir_indexPages);
+	    return -1;
+	}
+    }
 
     if (cmd_OptionAsInt(opts, OPT_callbacks, &numberofcbs) == 0) {
 	if ((numberofcbs < 10000) || (numberofcbs > 2147483647)) {
@@ -1195,6 +1240,24 @@ ParseArgs(int argc, char *argv[])
 	    return -1;
 	}
     }
+    if (cmd_OptionAsInt(opts, OPT_maxcallbacks, &maxcbs) == 0) {
+	if ((maxcbs < numberofcbs) || (maxcbs > 2147483647)) {
+	    printf("maximum number of cbs %d invalid; "
+		   "must be between %d and 2147483647\n", maxcbs, numberofcbs);
+	    return -1;
+	}
+    } else {
+	afs_int64 defmax = 4 * (afs_int64)numberofcbs;
+
+	maxcbs = defmax > 2147483647 ? 2147483647 : (int)defmax;
+    }
+    if (cmd_OptionAsInt(opts, OPT_cbthreads, &breakThreads) == 0) {
+	if (breakThreads < 0 || breakThreads > 64) {
+	    printf("number of callback break threads %d invalid; "
+		   "must be between 0 and 64\n", breakThreads);
+	    return -1;
+	}
+    }
 
     cmd_OptionAsInt(opts, OPT_vcsize, &volcache);
     cmd_OptionAsInt(opts, OPT_lvnodes, &large);
@@ -1206,6 +1269,13 @@ ParseArgs(int argc, char *argv[])
 	} else
 	    sendBufSize = optval;
     }
+    if (cmd_OptionAsInt(opts, OPT_storethreads, &storeThreads) == 0) {
+	if (storeThreads < 0 || storeThreads > 64) {
+	    printf("number of store threads %d invalid; "
+		   "must be between 0 and 64\n", storeThreads);
+	    return -1;
+	}
+    }
 
 #if defined(AFS_AIX32_ENV)
     if (cmd_OptionAsInt(opts, OPT_minspare, &aixlow_water) == 0) {
@@ -1400,6 +1470,9 @@ ParseArgs(int argc, char *argv[])
 	    udpBufSize = optval;
     }
 
+    cmd_OptionAsInt(opts, OPT_udpbatch, &udpBatchSize);
+    cmd_OptionAsInt(opts, OPT_rxlisteners, &rxListeners);
+
     /* rxkad options */
     cmd_OptionAsFlag(opts, OPT_dotted, &rxkadDisableDotCheck);
     if (cmd_OptionAsList(opts, OPT_realm, &optlist) == 0) {
@@ -2003,6 +2076,10 @@ main(int argc, char *argv[])
 #endif
     if (udpBufSize)
 	rx_SetUdpBufSize(udpBufSize);	/* set the UDP buffer size for receive */
+    if (udpBatchSize)
+	rx_SetUdpBatchSize(udpBatchSize);
+    if (rxListeners)
+	rx_SetListenerThreads(rxListeners);
     rx_bindhost = SetupVL();
 
     if (rx_InitHost(rx_bindhost, (int)htons(7000)) < 0) {
@@ -2063,7 +2140,9 @@ main(int argc, char *argv[])
 
     init_sys_error_to_et();	/* Set up error table translation */
     h_InitHostPackage(host_thread_quota); /* set up local cellname and realmname */
-    InitCallBack(numberofcbs);
+    InitCallBack(numberofcbs, maxcbs);
+    InitCallBackBreakers(breakThreads);
+    InitStoreWriters(storeThreads);
     ClearXStatValues();
 
     code = InitVL(confDir);
@@ -2173,6 +2252,7 @@ main(int argc, char *argv[])
      * of the file descriptor cache.
      */
     ih_UseLargeCache();
+    ih_StartReaper();
 
     ViceLog(5, ("Starting pthreads\n"));
     opr_Verify(pthread_attr_init(&tattr) == 0);
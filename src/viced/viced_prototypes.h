@@ -17,9 +17,11 @@ void init_sys_error_to_et(void);
 /* afsfileprocs.c */
 extern afs_int32 BlocksSpare;
 extern afs_int32 PctSpare;
+extern void InitStoreWriters(int);
 
 /* callback.c */
-extern int InitCallBack(int);
+extern int InitCallBack(int, int);
+extern void InitCallBackBreakers(int);
 extern int BreakLaterCallBacks(void);
 extern int BreakVolumeCallBacksLater(VolumeId);
 
@@ -146,6 +146,7 @@ enum optionsList {
     OPT_database,
     OPT_logfile,
     OPT_threads,
+    OPT_ubikbuffers,
 #ifdef HAVE_SYSLOG
     OPT_syslog,
 #endif
@@ -248,6 +249,8 @@ main(int argc, char **argv)
 		        CMD_OPTIONAL, "location of logfile");
     cmd_AddParmAtOffset(opts, OPT_threads, "-p", CMD_SINGLE, CMD_OPTIONAL,
 		        "number of threads");
+    cmd_AddParmAtOffset(opts, OPT_ubikbuffers, "-ubikbuffers", CMD_SINGLE,
+		        CMD_OPTIONAL, "number of ubik database page buffers");
 #ifdef HAVE_SYSLOG
     cmd_AddParmAtOffset(opts, OPT_syslog, "-syslog", CMD_SINGLE_OR_FLAG,
 		        CMD_OPTIONAL, "log to syslog");
@@ -323,6 +326,14 @@ main(int argc, char **argv)
 	}
     }
 
+    if (cmd_OptionAsInt(opts, OPT_ubikbuffers, &ubik_nBuffers) == 0) {
+	if (ubik_nBuffers < 512) {
+	    printf("Warning: '-ubikbuffers %d' is too small; using %d instead\n",
+		   ubik_nBuffers, 512);
+	    ubik_nBuffers = 512;
+	}
+    }
+
     cmd_OptionAsInt(opts, OPT_debug, &logopts.lopt_logLevel);
 #ifdef HAVE_SYSLOG
     if (cmd_OptionPresent(opts, OPT_syslog)) {
@@ -484,7 +495,6 @@ main(int argc, char **argv)
     }
     rx_SetRxDeadTime(50);
 
-    ubik_nBuffers = 512;
     ubik_SetClientSecurityProcs(afsconf_ClientAuth, afsconf_UpToDate, tdir);
     ubik_SetServerSecurityProcs(afsconf_BuildServerSecurityObjects,
 				afsconf_CheckAuth, tdir);
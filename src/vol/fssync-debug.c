@@ -1237,6 +1237,12 @@ print_vol_stats_general(VolPkgStats * stats)
 	   stats->salvages);
     printf("\tvol_ops = %"AFS_INT64_FMT"\n",
 	   stats->vol_ops);
+    printf("\tvnode_fast_gets = %"AFS_INT64_FMT"\n",
+	   stats->vnode_fast_gets);
+    printf("\tvnode_fast_puts = %"AFS_INT64_FMT"\n",
+	   stats->vnode_fast_puts);
+    printf("\tvnode_lock_waits = %"AFS_INT64_FMT"\n",
+	   stats->vnode_lock_waits);
 #endif
     printf("\thdr_loads = %"AFS_INT64_FMT"\n",
 	   stats->hdr_loads);
@@ -1853,6 +1853,10 @@ FSYNC_com_StatsOpGeneral(FSSYNC_StatsOp_command * scom, SYNC_response * res)
 {
     afs_int32 code = SYNC_OK;
 
+#ifdef AFS_DEMAND_ATTACH_FS
+    VnGetLockStats(&VStats.vnode_fast_gets, &VStats.vnode_fast_puts,
+		   &VStats.vnode_lock_waits);
+#endif
     memcpy(res->payload.buf, &VStats, sizeof(VStats));
     res->hdr.response_len += sizeof(VStats);
 
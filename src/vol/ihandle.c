@@ -39,22 +39,50 @@ pthread_once_t ih_glock_once = PTHREAD_ONCE_INIT;
 pthread_mutex_t ih_glock_mutex;
 #endif /* AFS_PTHREAD_ENV */
 
-/* Linked list of available inode handles */
-IHandle_t *ihAvailHead;
-IHandle_t *ihAvailTail;
+/* Inode handles and their file descriptors are split into stripes by
+ * inode hash bucket, so that opens and closes of unrelated files do not
+ * contend on a single lock.  A stripe lock protects the hash chains of
+ * its buckets, the reference counts, flags and descriptor lists of the
+ * inode handles hashed there, the descriptor handles attached to them,
+ * and the stripe's own free lists and descriptor LRU.  IH_LOCK is only
+ * taken to account for descriptors actually opened and closed, and for
+ * the stream handle free list.  When both are needed, the stripe lock is
+ * taken first; no thread ever holds two stripe locks.
+ */
+#define IH_NSTRIPES	64	/* power of 2, at most I_HANDLE_HASH_SIZE */
+#define IH_STRIPE(ihash)	(&ihStripes[(ihash) & (IH_NSTRIPES - 1)])
+#define IH_STRIPE_OF(ihP) \
+    IH_STRIPE(IH_HASH((ihP)->ih_dev, (ihP)->ih_vid, (ihP)->ih_ino))
 
-/* Linked list of available file descriptor handles */
-FdHandle_t *fdAvailHead;
-FdHandle_t *fdAvailTail;
+typedef struct IHStripe_s {
+#ifdef AFS_PTHREAD_ENV
+    pthread_mutex_t ihs_lock;
+#endif
+    /* Linked list of available inode handles */
+    IHandle_t *ihs_ihAvailHead;
+    IHandle_t *ihs_ihAvailTail;
+    /* Linked list of available file descriptor handles */
+    FdHandle_t *ihs_fdAvailHead;
+    FdHandle_t *ihs_fdAvailTail;
+    /* LRU list for cached, unused file descriptor handles */
+    FdHandle_t *ihs_fdLruHead;
+    FdHandle_t *ihs_fdLruTail;
+} IHStripe_t;
+
+static IHStripe_t ihStripes[IH_NSTRIPES];
+
+#ifdef AFS_PTHREAD_ENV
+# define IH_STRIPE_LOCK(st)	opr_mutex_enter(&(st)->ihs_lock)
+# define IH_STRIPE_UNLOCK(st)	opr_mutex_exit(&(st)->ihs_lock)
+#else
+# define IH_STRIPE_LOCK(st)	((void)(st))
+# define IH_STRIPE_UNLOCK(st)	((void)(st))
+#endif
 
 /* Linked list of available stream descriptor handles */
 StreamHandle_t *streamAvailHead;
 StreamHandle_t *streamAvailTail;
 
-/* LRU list for file descriptor handles */
-FdHandle_t *fdLruHead;
-FdHandle_t *fdLruTail;
-
 int ih_Inited = 0;
 int ih_PkgDefaultsSet = 0;
 
@@ -69,13 +97,31 @@ int ih_PkgDefaultsSet = 0;
 int fdMaxCacheSize = 0;
 int fdCacheSize = 0;
 
-/* Number of in use file descriptors */
+/* Number of in use file descriptors; protected by IH_LOCK, but read
+ * without it where an approximate value will do */
 int fdInUseCount = 0;
 
 /* Hash table for inode handles */
 IHashBucket_t ihashTable[I_HANDLE_HASH_SIZE];
 
-static int _ih_release_r(IHandle_t * ihP);
+/* Cached descriptors are closed to keep fdInUseCount within the cache
+ * size.  Programs that run the reaper thread (see ih_StartReaper) have
+ * it trim the cache to IH_REAP_LOWAT whenever IH_REAP_HIWAT is crossed,
+ * so that opens don't have to close anything themselves; other programs
+ * close the least recently used descriptor inline, as soon as the cache
+ * is full. */
+#define IH_REAP_HIWAT(size)	((size) - ((size) >> 4))
+#define IH_REAP_LOWAT(size)	((size) - ((size) >> 3))
+
+static int ih_reaperRunning;
+static int ih_reapNeeded;
+static unsigned int ih_trimCursor;	/* next stripe to trim; IH_LOCK */
+#ifdef AFS_PTHREAD_ENV
+static opr_cv_t ih_reaper_cv;
+#endif
+
+static int _ih_release_r(IHStripe_t * st, IHandle_t * ihP);
+static void ih_fdcheck(void);
 
 /* start-time configurable I/O limits */
 ih_init_params vol_io_params;
@@ -125,11 +171,17 @@ ih_SetSyncBehavior(const char *behavior)
 }
 
 #ifdef AFS_PTHREAD_ENV
-/* Initialize the global ihandle mutex */
+/* Initialize the global ihandle mutex and the stripe locks */
 void
 ih_glock_init(void)
 {
+    int i;
+
     opr_mutex_init(&ih_glock_mutex);
+    opr_cv_init(&ih_reaper_cv);
+    for (i = 0; i < IH_NSTRIPES; i++) {
+	opr_mutex_init(&ihStripes[i].ihs_lock);
+    }
 }
 #endif /* AFS_PTHREAD_ENV */
 
@@ -139,10 +191,13 @@ ih_Initialize(void)
 {
     int i;
     opr_Assert(!ih_Inited);
-    ih_Inited = 1;
-    DLL_INIT_LIST(ihAvailHead, ihAvailTail);
-    DLL_INIT_LIST(fdAvailHead, fdAvailTail);
-    DLL_INIT_LIST(fdLruHead, fdLruTail);
+    for (i = 0; i < IH_NSTRIPES; i++) {
+	DLL_INIT_LIST(ihStripes[i].ihs_ihAvailHead,
+		      ihStripes[i].ihs_ihAvailTail);
+	DLL_INIT_LIST(ihStripes[i].ihs_fdAvailHead,
+		      ihStripes[i].ihs_fdAvailTail);
+	DLL_INIT_LIST(ihStripes[i].ihs_fdLruHead, ihStripes[i].ihs_fdLruTail);
+    }
     for (i = 0; i < I_HANDLE_HASH_SIZE; i++) {
 	DLL_INIT_LIST(ihashTable[i].ihash_head, ihashTable[i].ihash_tail);
     }
@@ -180,6 +235,24 @@ ih_Initialize(void)
     }
 #endif
     fdCacheSize = min(fdMaxCacheSize, vol_io_params.fd_initial_cachesize);
+    ih_Inited = 1;
+}
+
+/* Initialize the package on first use */
+static void
+ih_EnsureInit(void)
+{
+    if (!ih_PkgDefaultsSet) {
+        ih_PkgDefaults();
+    }
+
+    if (!ih_Inited) {
+	IH_LOCK;
+	if (!ih_Inited) {
+	    ih_Initialize();
+	}
+	IH_UNLOCK;
+    }
 }
 
 /* Make the file descriptor cache as big as possible. Don't this call
@@ -205,19 +278,20 @@ ih_UseLargeCache(void)
     IH_UNLOCK;
 }
 
-/* Allocate a chunk of inode handles */
-void
-iHandleAllocateChunk(void)
+/* Allocate a chunk of inode handles for a stripe */
+static void
+iHandleAllocateChunk(IHStripe_t * st)
 {
     int i;
     IHandle_t *ihP;
 
-    opr_Assert(ihAvailHead == NULL);
+    opr_Assert(st->ihs_ihAvailHead == NULL);
     ihP = malloc(I_HANDLE_MALLOCSIZE * sizeof(IHandle_t));
     opr_Assert(ihP != NULL);
     for (i = 0; i < I_HANDLE_MALLOCSIZE; i++) {
 	ihP[i].ih_refcnt = 0;
-	DLL_INSERT_TAIL(&ihP[i], ihAvailHead, ihAvailTail, ih_next, ih_prev);
+	DLL_INSERT_TAIL(&ihP[i], st->ihs_ihAvailHead, st->ihs_ihAvailTail,
+			ih_next, ih_prev);
     }
 }
 
@@ -226,33 +300,30 @@ IHandle_t *
 ih_init(int dev, int vid, Inode ino)
 {
     int ihash = IH_HASH(dev, vid, ino);
+    IHStripe_t *st = IH_STRIPE(ihash);
     IHandle_t *ihP;
 
-    if (!ih_PkgDefaultsSet) {
-        ih_PkgDefaults();
-    }
+    ih_EnsureInit();
 
-    IH_LOCK;
-    if (!ih_Inited) {
-        ih_Initialize();
-    }
+    IH_STRIPE_LOCK(st);
 
     /* Do we already have a handle for this Inode? */
     for (ihP = ihashTable[ihash].ihash_head; ihP; ihP = ihP->ih_next) {
 	if (ihP->ih_ino == ino && ihP->ih_vid == vid && ihP->ih_dev == dev) {
 	    ihP->ih_refcnt++;
-	    IH_UNLOCK;
+	    IH_STRIPE_UNLOCK(st);
 	    return ihP;
 	}
     }
 
     /* Allocate and initialize a new Inode handle */
-    if (ihAvailHead == NULL) {
-	iHandleAllocateChunk();
+    if (st->ihs_ihAvailHead == NULL) {
+	iHandleAllocateChunk(st);
     }
-    ihP = ihAvailHead;
+    ihP = st->ihs_ihAvailHead;
     opr_Assert(ihP->ih_refcnt == 0);
-    DLL_DELETE(ihP, ihAvailHead, ihAvailTail, ih_next, ih_prev);
+    DLL_DELETE(ihP, st->ihs_ihAvailHead, st->ihs_ihAvailTail, ih_next,
+	       ih_prev);
     ihP->ih_dev = dev;
     ihP->ih_vid = vid;
     ihP->ih_ino = ino;
@@ -262,7 +333,7 @@ ih_init(int dev, int vid, Inode ino)
     DLL_INIT_LIST(ihP->ih_fdhead, ihP->ih_fdtail);
     DLL_INSERT_TAIL(ihP, ihashTable[ihash].ihash_head,
 		    ihashTable[ihash].ihash_tail, ih_next, ih_prev);
-    IH_UNLOCK;
+    IH_STRIPE_UNLOCK(st);
     return ihP;
 }
 
@@ -270,22 +341,24 @@ ih_init(int dev, int vid, Inode ino)
 IHandle_t *
 ih_copy(IHandle_t * ihP)
 {
-    IH_LOCK;
+    IHStripe_t *st = IH_STRIPE_OF(ihP);
+
+    IH_STRIPE_LOCK(st);
     opr_Assert(ih_Inited);
     opr_Assert(ihP->ih_refcnt > 0);
     ihP->ih_refcnt++;
-    IH_UNLOCK;
+    IH_STRIPE_UNLOCK(st);
     return ihP;
 }
 
-/* Allocate a chunk of file descriptor handles */
-void
-fdHandleAllocateChunk(void)
+/* Allocate a chunk of file descriptor handles for a stripe */
+static void
+fdHandleAllocateChunk(IHStripe_t * st)
 {
     int i;
     FdHandle_t *fdP;
 
-    opr_Assert(fdAvailHead == NULL);
+    opr_Assert(st->ihs_fdAvailHead == NULL);
     fdP = malloc(FD_HANDLE_MALLOCSIZE * sizeof(FdHandle_t));
     opr_Assert(fdP != NULL);
     for (i = 0; i < FD_HANDLE_MALLOCSIZE; i++) {
@@ -295,7 +368,8 @@ fdHandleAllocateChunk(void)
 	fdP[i].fd_fd = INVALID_FD;
         fdP[i].fd_ihnext = NULL;
         fdP[i].fd_ihprev = NULL;
-	DLL_INSERT_TAIL(&fdP[i], fdAvailHead, fdAvailTail, fd_next, fd_prev);
+	DLL_INSERT_TAIL(&fdP[i], st->ihs_fdAvailHead, st->ihs_fdAvailTail,
+			fd_next, fd_prev);
     }
 }
 
@@ -318,57 +392,151 @@ streamHandleAllocateChunk(void)
 }
 
 /*
- * Get a file descriptor handle given an Inode handle
- * Takes the given file descriptor, and creates a new FdHandle_t for it,
- * attached to the given IHandle_t. If fdLruHead is not NULL, fd can be
- * INVALID_FD, indicating that the caller failed to open the relevant file
- * because we had too many FDs open; ih_attachfd_r will then just evict/close
- * an existing fd in the cache, and return NULL. You must not call this
- * function with an invalid fd while fdLruHead is NULL; instead, error out.
+ * Close the least recently used cached file descriptor of a stripe.
+ * Called with no locks held. Returns 1 if a descriptor was closed, 0 if
+ * the stripe had none cached.
  */
-static FdHandle_t *
-ih_attachfd_r(IHandle_t *ihP, FD_t fd)
+static int
+ih_fdevict(IHStripe_t * st)
 {
-    FD_t closeFd;
     FdHandle_t *fdP;
+    FD_t closeFd;
 
-    /* If the given fd is invalid, we must have an available fd to close.
-     * Otherwise, the caller must have realized this before calling
-     * ih_attachfd_r and yielded an error before getting here. */
-    opr_Assert(fd != INVALID_FD || fdLruHead != NULL);
-
-    /* fdCacheSize limits the size of the descriptor cache, but
-     * we permit the number of open files to exceed fdCacheSize.
-     * We only recycle open file descriptors when the number
-     * of open files reaches the size of the cache */
-    if ((fdInUseCount > fdCacheSize || fd == INVALID_FD)  && fdLruHead != NULL) {
-	fdP = fdLruHead;
-	opr_Assert(fdP->fd_status == FD_HANDLE_OPEN);
-	DLL_DELETE(fdP, fdLruHead, fdLruTail, fd_next, fd_prev);
-	DLL_DELETE(fdP, fdP->fd_ih->ih_fdhead, fdP->fd_ih->ih_fdtail,
-		   fd_ihnext, fd_ihprev);
-	closeFd = fdP->fd_fd;
-	if (fd == INVALID_FD) {
-	    fdCacheSize--;          /* reduce in order to not run into here too often */
-	    DLL_INSERT_TAIL(fdP, fdAvailHead, fdAvailTail, fd_next, fd_prev);
-	    fdP->fd_status = FD_HANDLE_AVAIL;
-	    fdP->fd_ih = NULL;
-	    fdP->fd_fd = INVALID_FD;
-	    IH_UNLOCK;
-	    OS_CLOSE(closeFd);
+    IH_STRIPE_LOCK(st);
+    fdP = st->ihs_fdLruHead;
+    if (fdP == NULL) {
+	IH_STRIPE_UNLOCK(st);
+	return 0;
+    }
+    opr_Assert(fdP->fd_status == FD_HANDLE_OPEN);
+    DLL_DELETE(fdP, st->ihs_fdLruHead, st->ihs_fdLruTail, fd_next, fd_prev);
+    DLL_DELETE(fdP, fdP->fd_ih->ih_fdhead, fdP->fd_ih->ih_fdtail,
+	       fd_ihnext, fd_ihprev);
+    closeFd = fdP->fd_fd;
+    fdP->fd_status = FD_HANDLE_AVAIL;
+    fdP->fd_ih = NULL;
+    fdP->fd_fd = INVALID_FD;
+    DLL_INSERT_TAIL(fdP, st->ihs_fdAvailHead, st->ihs_fdAvailTail, fd_next,
+		    fd_prev);
+    IH_STRIPE_UNLOCK(st);
+
+    OS_CLOSE(closeFd);
+
+    IH_LOCK;
+    fdInUseCount -= 1;
+    IH_UNLOCK;
+    return 1;
+}
+
+/*
+ * Close cached file descriptors, least recently used first within each
+ * stripe, until no more than target descriptors are open or none are
+ * left to close. Called with no locks held.
+ */
+static void
+ih_fdtrim(int target)
+{
+    unsigned int i, idle;
+
+    for (idle = 0; fdInUseCount > target && idle < IH_NSTRIPES;) {
+	IH_LOCK;
+	i = ih_trimCursor++;
+	IH_UNLOCK;
+	if (ih_fdevict(&ihStripes[i & (IH_NSTRIPES - 1)]))
+	    idle = 0;
+	else
+	    idle++;
+    }
+}
+
+/*
+ * Called after opening a file descriptor, with no locks held. Makes room
+ * in the cache once it fills up, or has the reaper do so.
+ */
+static void
+ih_fdcheck(void)
+{
+    if (ih_reaperRunning) {
+	if (fdInUseCount > IH_REAP_HIWAT(fdCacheSize) && !ih_reapNeeded) {
 	    IH_LOCK;
-	    fdInUseCount -= 1;
-	    return NULL;
+	    ih_reapNeeded = 1;
+#ifdef AFS_PTHREAD_ENV
+	    opr_cv_signal(&ih_reaper_cv);
+#endif
+	    IH_UNLOCK;
 	}
-    } else {
-	if (fdAvailHead == NULL) {
-	    fdHandleAllocateChunk();
+    } else if (fdInUseCount > fdCacheSize) {
+	ih_fdtrim(fdCacheSize);
+    }
+}
+
+#ifdef AFS_PTHREAD_ENV
+/* Body of the reaper thread. */
+static void *
+ih_reaper(void *rock)
+{
+    afs_pthread_setname_self("fd reaper");
+
+    IH_LOCK;
+    for (;;) {
+	while (!ih_reapNeeded) {
+	    opr_cv_wait(&ih_reaper_cv, &ih_glock_mutex);
 	}
-	fdP = fdAvailHead;
-	opr_Assert(fdP->fd_status == FD_HANDLE_AVAIL);
-	DLL_DELETE(fdP, fdAvailHead, fdAvailTail, fd_next, fd_prev);
-	closeFd = INVALID_FD;
+	IH_UNLOCK;
+	ih_fdtrim(IH_REAP_LOWAT(fdCacheSize));
+	IH_LOCK;
+	ih_reapNeeded = 0;
     }
+    AFS_UNREACHED(return(NULL));
+}
+#endif /* AFS_PTHREAD_ENV */
+
+/*
+ * Start a thread to close cached file descriptors in the background,
+ * instead of closing them inline when an open finds the cache full.
+ * Does nothing in programs without pthreads.
+ */
+void
+ih_StartReaper(void)
+{
+#ifdef AFS_PTHREAD_ENV
+    pthread_t tid;
+    pthread_attr_t tattr;
+
+    ih_EnsureInit();
+
+    IH_LOCK;
+    if (!ih_reaperRunning) {
+	opr_Verify(pthread_attr_init(&tattr) == 0);
+	opr_Verify(pthread_attr_setdetachstate(&tattr,
+					       PTHREAD_CREATE_DETACHED) == 0);
+	opr_Verify(pthread_create(&tid, &tattr, ih_reaper, NULL) == 0);
+	ih_reaperRunning = 1;
+    }
+    IH_UNLOCK;
+#endif /* AFS_PTHREAD_ENV */
+}
+
+/*
+ * Get a file descriptor handle given an Inode handle
+ * Takes the given, valid file descriptor and creates a new FdHandle_t for
+ * it, attached to the given IHandle_t. Called with the stripe lock of the
+ * IHandle_t held; the descriptor must already be counted in fdInUseCount.
+ */
+static FdHandle_t *
+ih_attachfd_r(IHStripe_t * st, IHandle_t *ihP, FD_t fd)
+{
+    FdHandle_t *fdP;
+
+    opr_Assert(fd != INVALID_FD);
+
+    if (st->ihs_fdAvailHead == NULL) {
+	fdHandleAllocateChunk(st);
+    }
+    fdP = st->ihs_fdAvailHead;
+    opr_Assert(fdP->fd_status == FD_HANDLE_AVAIL);
+    DLL_DELETE(fdP, st->ihs_fdAvailHead, st->ihs_fdAvailTail, fd_next,
+	       fd_prev);
 
     fdP->fd_status = FD_HANDLE_INUSE;
     fdP->fd_fd = fd;
@@ -381,19 +549,13 @@ ih_attachfd_r(IHandle_t *ihP, FD_t fd)
     DLL_INSERT_TAIL(fdP, ihP->ih_fdhead, ihP->ih_fdtail, fd_ihnext,
 		    fd_ihprev);
 
-    if (closeFd != INVALID_FD) {
-	IH_UNLOCK;
-	OS_CLOSE(closeFd);
-	IH_LOCK;
-	fdInUseCount -= 1;
-    }
-
     return fdP;
 }
 
 FdHandle_t *
 ih_attachfd(IHandle_t *ihP, FD_t fd)
 {
+    IHStripe_t *st;
     FdHandle_t *fdP;
 
     if (fd == INVALID_FD) {
@@ -401,13 +563,15 @@ ih_attachfd(IHandle_t *ihP, FD_t fd)
     }
 
     IH_LOCK;
-
     fdInUseCount += 1;
+    IH_UNLOCK;
 
-    fdP = ih_attachfd_r(ihP, fd);
-    opr_Assert(fdP);
+    st = IH_STRIPE_OF(ihP);
+    IH_STRIPE_LOCK(st);
+    fdP = ih_attachfd_r(st, ihP, fd);
+    IH_STRIPE_UNLOCK(st);
 
-    IH_UNLOCK;
+    ih_fdcheck();
 
     return fdP;
 }
@@ -418,13 +582,16 @@ ih_attachfd(IHandle_t *ihP, FD_t fd)
 FdHandle_t *
 ih_open(IHandle_t * ihP)
 {
+    IHStripe_t *st;
     FdHandle_t *fdP;
     FD_t fd;
+    unsigned int i;
 
     if (!ihP)			/* XXX should log here in the fileserver */
 	return NULL;
 
-    IH_LOCK;
+    st = IH_STRIPE_OF(ihP);
+    IH_STRIPE_LOCK(st);
 
     /* Do we already have an open file handle for this Inode? */
     for (fdP = ihP->ih_fdtail; fdP != NULL; fdP = fdP->fd_ihprev) {
@@ -449,35 +616,52 @@ ih_open(IHandle_t * ihP)
 	fdP->fd_refcnt++;
 	if (fdP->fd_status == FD_HANDLE_OPEN) {
 	    fdP->fd_status = FD_HANDLE_INUSE;
-	    DLL_DELETE(fdP, fdLruHead, fdLruTail, fd_next, fd_prev);
+	    DLL_DELETE(fdP, st->ihs_fdLruHead, st->ihs_fdLruTail, fd_next,
+		       fd_prev);
 	}
 	ihP->ih_refcnt++;
-	IH_UNLOCK;
+	IH_STRIPE_UNLOCK(st);
 	return fdP;
     }
+    IH_STRIPE_UNLOCK(st);
 
     /*
      * Try to open the Inode, return NULL on error.
      */
+    IH_LOCK;
     fdInUseCount += 1;
     IH_UNLOCK;
+    i = 0;
 ih_open_retry:
     fd = OS_IOPEN(ihP);
-    IH_LOCK;
-    if (fd == INVALID_FD && (errno != EMFILE || fdLruHead == NULL) ) {
+    if (fd == INVALID_FD) {
+	int save_errno = errno;
+
+	/* Too many files open; close a cached descriptor, from whichever
+	 * stripe has one, and shrink the cache so we don't run into this
+	 * too often. */
+	if (save_errno == EMFILE) {
+	    for (; i < IH_NSTRIPES; i++) {
+		if (ih_fdevict(&ihStripes[i])) {
+		    IH_LOCK;
+		    fdCacheSize--;
+		    IH_UNLOCK;
+		    goto ih_open_retry;
+		}
+	    }
+	}
+	IH_LOCK;
 	fdInUseCount -= 1;
 	IH_UNLOCK;
+	errno = save_errno;
 	return NULL;
     }
 
-    fdP = ih_attachfd_r(ihP, fd);
-    if (!fdP) {
-	opr_Assert(fd == INVALID_FD);
-	IH_UNLOCK;
-	goto ih_open_retry;
-    }
+    IH_STRIPE_LOCK(st);
+    fdP = ih_attachfd_r(st, ihP, fd);
+    IH_STRIPE_UNLOCK(st);
 
-    IH_UNLOCK;
+    ih_fdcheck();
 
     return fdP;
 }
@@ -488,19 +672,20 @@ ih_open_retry:
 int
 fd_close(FdHandle_t * fdP)
 {
+    IHStripe_t *st;
     IHandle_t *ihP;
 
     if (!fdP)
 	return 0;
 
-    IH_LOCK;
+    ihP = fdP->fd_ih;
+    st = IH_STRIPE_OF(ihP);
+
+    IH_STRIPE_LOCK(st);
     opr_Assert(ih_Inited);
-    opr_Assert(fdInUseCount > 0);
     opr_Assert(fdP->fd_status == FD_HANDLE_INUSE ||
                fdP->fd_status == FD_HANDLE_CLOSING);
 
-    ihP = fdP->fd_ih;
-
     /* Call fd_reallyclose to really close the unused file handles if
      * the previous attempt to close (ih_reallyclose()) all file handles
      * failed (this is determined by checking the ihandle for the flag
@@ -508,7 +693,7 @@ fd_close(FdHandle_t * fdP)
      */
     if (fdP->fd_status == FD_HANDLE_CLOSING ||
         ihP->ih_flags & IH_REALLY_CLOSED || fdInUseCount > fdCacheSize) {
-	IH_UNLOCK;
+	IH_STRIPE_UNLOCK(st);
 	return fd_reallyclose(fdP);
     }
 
@@ -516,7 +701,8 @@ fd_close(FdHandle_t * fdP)
     if (fdP->fd_refcnt == 0) {
 	/* Put this descriptor back into the cache */
 	fdP->fd_status = FD_HANDLE_OPEN;
-	DLL_INSERT_TAIL(fdP, fdLruHead, fdLruTail, fd_next, fd_prev);
+	DLL_INSERT_TAIL(fdP, st->ihs_fdLruHead, st->ihs_fdLruTail, fd_next,
+			fd_prev);
     }
 
     /* If this is not the only reference to the Inode then we can decrement
@@ -525,9 +711,9 @@ fd_close(FdHandle_t * fdP)
     if (ihP->ih_refcnt > 1)
 	ihP->ih_refcnt--;
     else
-	_ih_release_r(ihP);
+	_ih_release_r(st, ihP);
 
-    IH_UNLOCK;
+    IH_STRIPE_UNLOCK(st);
 
     return 0;
 }
@@ -539,25 +725,29 @@ fd_close(FdHandle_t * fdP)
 int
 fd_reallyclose(FdHandle_t * fdP)
 {
+    IHStripe_t *st;
     FD_t closeFd;
     IHandle_t *ihP;
 
     if (!fdP)
 	return 0;
 
-    IH_LOCK;
+    ihP = fdP->fd_ih;
+    st = IH_STRIPE_OF(ihP);
+
+    IH_STRIPE_LOCK(st);
     opr_Assert(ih_Inited);
     opr_Assert(fdInUseCount > 0);
     opr_Assert(fdP->fd_status == FD_HANDLE_INUSE ||
                fdP->fd_status == FD_HANDLE_CLOSING);
 
-    ihP = fdP->fd_ih;
     closeFd = fdP->fd_fd;
     fdP->fd_refcnt--;
 
     if (fdP->fd_refcnt == 0) {
 	DLL_DELETE(fdP, ihP->ih_fdhead, ihP->ih_fdtail, fd_ihnext, fd_ihprev);
-	DLL_INSERT_TAIL(fdP, fdAvailHead, fdAvailTail, fd_next, fd_prev);
+	DLL_INSERT_TAIL(fdP, st->ihs_fdAvailHead, st->ihs_fdAvailTail,
+			fd_next, fd_prev);
 
 	fdP->fd_status = FD_HANDLE_AVAIL;
 	fdP->fd_refcnt = 0;
@@ -588,10 +778,12 @@ fd_reallyclose(FdHandle_t * fdP)
     }
 
     if (fdP->fd_refcnt == 0) {
-	IH_UNLOCK;
+	IH_STRIPE_UNLOCK(st);
 	OS_CLOSE(closeFd);
 	IH_LOCK;
 	fdInUseCount -= 1;
+	IH_UNLOCK;
+	IH_STRIPE_LOCK(st);
     }
 
     /* If this is not the only reference to the Inode then we can decrement
@@ -599,9 +791,9 @@ fd_reallyclose(FdHandle_t * fdP)
     if (ihP->ih_refcnt > 1)
 	ihP->ih_refcnt--;
     else
-	_ih_release_r(ihP);
+	_ih_release_r(st, ihP);
 
-    IH_UNLOCK;
+    IH_STRIPE_UNLOCK(st);
 
     return 0;
 }
@@ -842,12 +1034,12 @@ stream_close(StreamHandle_t * streamP, int reallyClose)
 }
 
 /* Close all unused file descriptors associated with the inode
- * handle. Called with IH_LOCK held. May drop and reacquire
- * IH_LOCK. Sets the IH_REALLY_CLOSED flag in the inode handle
- * if it fails to close all file handles.
+ * handle. Called with the handle's stripe lock held. May drop and
+ * reacquire the stripe lock. Sets the IH_REALLY_CLOSED flag in the inode
+ * handle if it fails to close all file handles.
  */
 static int
-ih_fdclose(IHandle_t * ihP)
+ih_fdclose(IHStripe_t * st, IHandle_t * ihP)
 {
     int closeCount, closedAll;
     FdHandle_t *fdP, *head, *tail, *next;
@@ -876,7 +1068,8 @@ ih_fdclose(IHandle_t * ihP)
 	     * off here. */
 	    DLL_DELETE(fdP, ihP->ih_fdhead, ihP->ih_fdtail, fd_ihnext,
 		       fd_ihprev);
-	    DLL_DELETE(fdP, fdLruHead, fdLruTail, fd_next, fd_prev);
+	    DLL_DELETE(fdP, st->ihs_fdLruHead, st->ihs_fdLruTail, fd_next,
+		       fd_prev);
 	    DLL_INSERT_TAIL(fdP, head, tail, fd_next, fd_prev);
 	} else {
 	    closedAll = 0;
@@ -898,7 +1091,7 @@ ih_fdclose(IHandle_t * ihP)
 	return 0;		/* No file descriptors closed */
     }
 
-    IH_UNLOCK;
+    IH_STRIPE_UNLOCK(st);
     /*
      * Close the file descriptors
      */
@@ -915,17 +1108,20 @@ ih_fdclose(IHandle_t * ihP)
     IH_LOCK;
     opr_Assert(fdInUseCount >= closeCount);
     fdInUseCount -= closeCount;
+    IH_UNLOCK;
+
+    IH_STRIPE_LOCK(st);
 
     /*
      * Append the temporary queue to the list of available descriptors
      */
-    if (fdAvailHead == NULL) {
-	fdAvailHead = head;
-	fdAvailTail = tail;
+    if (st->ihs_fdAvailHead == NULL) {
+	st->ihs_fdAvailHead = head;
+	st->ihs_fdAvailTail = tail;
     } else {
-	fdAvailTail->fd_next = head;
-	head->fd_prev = fdAvailTail;
-	fdAvailTail = tail;
+	st->ihs_fdAvailTail->fd_next = head;
+	head->fd_prev = st->ihs_fdAvailTail;
+	st->ihs_fdAvailTail = tail;
     }
 
     return 0;
@@ -935,17 +1131,21 @@ ih_fdclose(IHandle_t * ihP)
 int
 ih_reallyclose(IHandle_t * ihP)
 {
+    IHStripe_t *st;
+
     if (!ihP)
 	return 0;
 
-    IH_LOCK;
+    st = IH_STRIPE_OF(ihP);
+
+    IH_STRIPE_LOCK(st);
     ihP->ih_refcnt++;   /* must not disappear over unlock */
     if (ihP->ih_synced) {
 	FdHandle_t *fdP;
 	opr_Assert(vol_io_params.sync_behavior != IH_SYNC_ALWAYS);
 	opr_Assert(vol_io_params.sync_behavior != IH_SYNC_NEVER);
         ihP->ih_synced = 0;
-	IH_UNLOCK;
+	IH_STRIPE_UNLOCK(st);
 
 	fdP = IH_OPEN(ihP);
 	if (fdP) {
@@ -953,19 +1153,19 @@ ih_reallyclose(IHandle_t * ihP)
 	    FDH_CLOSE(fdP);
 	}
 
-	IH_LOCK;
+	IH_STRIPE_LOCK(st);
     }
 
     opr_Assert(ihP->ih_refcnt > 0);
 
-    ih_fdclose(ihP);
+    ih_fdclose(st, ihP);
 
     if (ihP->ih_refcnt > 1)
 	ihP->ih_refcnt--;
     else
-	_ih_release_r(ihP);
+	_ih_release_r(st, ihP);
 
-    IH_UNLOCK;
+    IH_STRIPE_UNLOCK(st);
     return 0;
 }
 
@@ -973,7 +1173,7 @@ ih_reallyclose(IHandle_t * ihP)
  * inode are closed when the last reference to this handle is released
  */
 static int
-_ih_release_r(IHandle_t * ihP)
+_ih_release_r(IHStripe_t * st, IHandle_t * ihP)
 {
     int ihash;
 
@@ -991,11 +1191,12 @@ _ih_release_r(IHandle_t * ihP)
     DLL_DELETE(ihP, ihashTable[ihash].ihash_head,
 	       ihashTable[ihash].ihash_tail, ih_next, ih_prev);
 
-    ih_fdclose(ihP);
+    ih_fdclose(st, ihP);
 
     ihP->ih_refcnt--;
 
-    DLL_INSERT_TAIL(ihP, ihAvailHead, ihAvailTail, ih_next, ih_prev);
+    DLL_INSERT_TAIL(ihP, st->ihs_ihAvailHead, st->ihs_ihAvailTail, ih_next,
+		    ih_prev);
 
     return 0;
 }
@@ -1006,14 +1207,16 @@ _ih_release_r(IHandle_t * ihP)
 int
 ih_release(IHandle_t * ihP)
 {
+    IHStripe_t *st;
     int ret;
 
     if (!ihP)
 	return 0;
 
-    IH_LOCK;
-    ret = _ih_release_r(ihP);
-    IH_UNLOCK;
+    st = IH_STRIPE_OF(ihP);
+    IH_STRIPE_LOCK(st);
+    ret = _ih_release_r(st, ihP);
+    IH_STRIPE_UNLOCK(st);
     return ret;
 }
 
@@ -327,6 +327,7 @@ extern FD_t *ih_fdopen(FdHandle_t * h, char *fdperms);
 extern void ih_PkgDefaults(void);
 extern void ih_Initialize(void);
 extern void ih_UseLargeCache(void);
+extern void ih_StartReaper(void);
 extern int ih_SetSyncBehavior(const char *behavior);
 extern IHandle_t *ih_init(int /*@alt Device@ */ dev, int /*@alt VolId@ */ vid,
 			  Inode ino);
@@ -569,6 +570,10 @@ extern afs_sfsize_t ih_size(FD_t);
 # define FDH_WRITEV(H, I, N) writev((H)->fd_fd, I, N)
 #endif
 
+#ifdef HAVE_POSIX_FADVISE
+# define FDH_ADVISE(H, O, L, A) posix_fadvise((H)->fd_fd, O, L, A)
+#endif
+
 #ifdef HAVE_PIOV
 # ifdef O_LARGEFILE
 #  define FDH_PREADV(H, I, N, O) preadv64((H)->fd_fd, I, N, O)
@@ -27,6 +27,8 @@
 #include <winnt.h>
 #include <winbase.h>
 #include <direct.h>
+#else
+#include <sys/wait.h>
 #endif
 
 #include <afs/opr.h>
@@ -1738,6 +1740,14 @@ namei_UnlockLinkCount(FdHandle_t * fdP, Inode ino)
 static int DecodeInode(char *dpath, char *name, struct ViceInodeInfo *info,
 		       IHandle_t *myIH);
 static int DecodeVolumeName(char *name, VolumeId *vid);
+#ifndef AFS_NT40_ENV
+static int namei_ListAFSDirs(IHandle_t *ih, char *path,
+			     int (*writeFun) (FD_t, struct ViceInodeInfo *,
+					      char *, char *), FD_t fp,
+			     int (*judgeFun) (struct ViceInodeInfo *,
+					      VolumeId, void *),
+			     void *rock, int share, int nshares);
+#endif
 static int namei_ListAFSSubDirs(IHandle_t * dirIH,
 				int (*write_fun) (FD_t,
 						  struct ViceInodeInfo *,
@@ -1780,6 +1790,133 @@ VerifyDirPerms(char *path)
     }
 }
 
+#ifndef AFS_NT40_ENV
+/* Number of processes a full partition ListViceInodes is split across. */
+static int namei_listParallel = 1;
+
+/**
+ * set the number of processes ListViceInodes may use for a full partition.
+ *
+ * The top-level inode directories are shared out among that many forked
+ * children.  Only a caller that is free to fork, such as the standalone
+ * salvager, should set this above 1.
+ *
+ * @param[in] nprocs  number of scanning processes
+ */
+void
+namei_SetListParallel(int nprocs)
+{
+    namei_listParallel = (nprocs < 1 ? 1 : nprocs);
+}
+
+/**
+ * list a whole partition's inodes into inodeFile from several processes.
+ *
+ * Each child lists one share of the top-level inode directories and
+ * appends its records to inodeFile.  The file is switched to append mode
+ * for the duration, so records from different children land whole but in
+ * no particular order; the salvager sorts them afterwards anyway.  Each
+ * child reports how many inodes it wrote back through a pipe.
+ *
+ * @param[in] mountedOn  vice partition mount point
+ * @param[in] inodeFile  result file
+ * @param[in] judgeFun   inode filter function pointer, or NULL
+ * @param[in] rock       opaque pointer passed to judgeFun
+ * @param[in] nprocs     number of children to fork
+ *
+ * @return operation status
+ *    @retval <0 error
+ *    @retval >=0 number of matching files found
+ *
+ * @internal
+ */
+static int
+namei_ListAFSFilesParallel(char *mountedOn, FD_t inodeFile,
+			   int (*judgeFun) (struct ViceInodeInfo *, VolumeId,
+					    void *),
+			   void *rock, int nprocs)
+{
+    IHandle_t ih;
+    namei_t name;
+    pid_t *pids, pid;
+    int fds[2];
+    int flags, status = 0, count, i;
+    int nkids = 0, nreports = 0;
+    int ninodes = 0, ret = 0;
+    ssize_t n;
+
+    pids = calloc(nprocs, sizeof(*pids));
+    if (pids == NULL)
+	return -1;
+    if (pipe(fds) < 0) {
+	free(pids);
+	return -1;
+    }
+    flags = fcntl(inodeFile, F_GETFL);
+    if (flags == -1 || fcntl(inodeFile, F_SETFL, flags | O_APPEND) == -1) {
+	close(fds[0]);
+	close(fds[1]);
+	free(pids);
+	return -1;
+    }
+
+    memset(&ih, 0, sizeof(ih));
+    ih.ih_dev = volutil_GetPartitionID(mountedOn);
+    namei_HandleToInodeDir(&name, &ih);
+
+    for (i = 0; i < nprocs; i++) {
+	pids[i] = fork();
+	if (pids[i] == 0) {
+	    close(fds[0]);
+	    count = namei_ListAFSDirs(&ih, name.n_path, WriteInodeInfo,
+				      inodeFile, judgeFun, rock, i, nprocs);
+	    n = write(fds[1], &count, sizeof(count));
+	    _exit(n == sizeof(count) ? 0 : 1);
+	}
+	if (pids[i] < 0) {
+	    Log("namei_ListAFSFilesParallel: fork failed, errno = %d\n", errno);
+	    ret = -1;
+	    break;
+	}
+	nkids++;
+    }
+    close(fds[1]);
+
+    /* reads see EOF once every child has exited */
+    for (;;) {
+	n = read(fds[0], &count, sizeof(count));
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n != sizeof(count))
+	    break;
+	nreports++;
+	if (count < 0)
+	    ret = count;
+	else
+	    ninodes += count;
+    }
+    close(fds[0]);
+
+    for (i = 0; i < nkids; i++) {
+	do {
+	    pid = waitpid(pids[i], &status, 0);
+	} while (pid == -1 && errno == EINTR);
+	if (pid == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	    Log("namei_ListAFSFilesParallel: inode scan process %d failed "
+		"(status %d)\n", (int)pids[i], status);
+	    ret = -1;
+	}
+    }
+    free(pids);
+
+    if (fcntl(inodeFile, F_SETFL, flags) == -1)
+	ret = -1;
+    if (ret == 0 && nreports != nkids)
+	ret = -1;
+    return (ret < 0 ? ret : ninodes);
+}
+#endif /* !AFS_NT40_ENV */
+
 /**
  * Fill the results file with the requested inode information.
  *
@@ -1820,6 +1957,14 @@ ListViceInodes(char *devname, char *mountedOn, FD_t inodeFile,
     mode_errors = 0;
     VerifyDirPerms(mountedOn);
 
+#ifndef AFS_NT40_ENV
+    if (namei_listParallel > 1 && inodeFile != INVALID_FD
+	&& !singleVolumeNumber)
+	ninodes =
+	    namei_ListAFSFilesParallel(mountedOn, inodeFile, judgeInode,
+				       rock, namei_listParallel);
+    else
+#endif
     ninodes =
 	namei_ListAFSFiles(mountedOn, WriteInodeInfo, inodeFile, judgeInode,
 			   singleVolumeNumber, rock);
@@ -1881,12 +2026,9 @@ namei_ListAFSFiles(char *dev,
     IHandle_t ih;
     namei_t name;
     int ninodes = 0;
+#ifdef AFS_NT40_ENV
     DIR *dirp1;
     struct dirent *dp1;
-#ifndef AFS_NT40_ENV
-    DIR *dirp2;
-    struct dirent *dp2;
-    char path2[512];
 #endif
 #ifdef DELETE_ZLC
     static void FreeZLCList(void);
@@ -1910,39 +2052,24 @@ namei_ListAFSFiles(char *dev,
     } else {
 	/* Find all volume data directories and descend through them. */
 	namei_HandleToInodeDir(&name, &ih);
+#ifdef AFS_NT40_ENV
 	ninodes = 0;
 	dirp1 = opendir(name.n_path);
 	if (!dirp1)
 	    return 0;
 	while ((dp1 = readdir(dirp1))) {
-#ifdef AFS_NT40_ENV
 	    /* Heirarchy is one level on Windows */
 	    if (!DecodeVolumeName(dp1->d_name, &ih.ih_vid)) {
 		ninodes +=
 		    namei_ListAFSSubDirs(&ih, writeFun, fp, judgeFun,
 					 0, rock);
 	    }
-#else
-	    if (*dp1->d_name == '.')
-		continue;
-	    snprintf(path2, sizeof(path2), "%s" OS_DIRSEP "%s", name.n_path,
-		     dp1->d_name);
-	    dirp2 = opendir(path2);
-	    if (dirp2) {
-		while ((dp2 = readdir(dirp2))) {
-		    if (*dp2->d_name == '.')
-			continue;
-		    if (!DecodeVolumeName(dp2->d_name, &ih.ih_vid)) {
-			ninodes +=
-			    namei_ListAFSSubDirs(&ih, writeFun, fp, judgeFun,
-						 0, rock);
-		    }
-		}
-		closedir(dirp2);
-	    }
-#endif
 	}
 	closedir(dirp1);
+#else
+	ninodes = namei_ListAFSDirs(&ih, name.n_path, writeFun, fp,
+				    judgeFun, rock, 0, 1);
+#endif
     }
 #ifdef DELETE_ZLC
     FreeZLCList();
@@ -1950,6 +2077,76 @@ namei_ListAFSFiles(char *dev,
     return ninodes;
 }
 
+#ifndef AFS_NT40_ENV
+/**
+ * list the volume directories below a share of the top-level inode
+ * directories.
+ *
+ * Each top-level directory falls in the share given by a hash of its name
+ * modulo nshares, so nshares callers with distinct shares between them
+ * cover the partition exactly once whatever order readdir returns.
+ *
+ * @param[in] ih        handle naming the partition; ih_vid is overwritten
+ * @param[in] path      path of the partition's inode directory
+ * @param[in] writeFun  as for namei_ListAFSFiles
+ * @param[in] fp        as for namei_ListAFSFiles
+ * @param[in] judgeFun  as for namei_ListAFSFiles
+ * @param[in] rock      as for namei_ListAFSFiles
+ * @param[in] share     which share to list
+ * @param[in] nshares   number of shares
+ *
+ * @return number of matching files found
+ *
+ * @internal
+ */
+static int
+namei_ListAFSDirs(IHandle_t *ih, char *path,
+		  int (*writeFun) (FD_t, struct ViceInodeInfo *, char *,
+				   char *),
+		  FD_t fp,
+		  int (*judgeFun) (struct ViceInodeInfo *, VolumeId, void *),
+		  void *rock, int share, int nshares)
+{
+    int ninodes = 0;
+    DIR *dirp1, *dirp2;
+    struct dirent *dp1, *dp2;
+    char path2[512];
+    unsigned int hash;
+    char *p;
+
+    dirp1 = opendir(path);
+    if (!dirp1)
+	return 0;
+    while ((dp1 = readdir(dirp1))) {
+	if (*dp1->d_name == '.')
+	    continue;
+	if (nshares > 1) {
+	    for (hash = 0, p = dp1->d_name; *p; p++)
+		hash = hash * 31 + (unsigned char)*p;
+	    if ((int)(hash % nshares) != share)
+		continue;
+	}
+	snprintf(path2, sizeof(path2), "%s" OS_DIRSEP "%s", path,
+		 dp1->d_name);
+	dirp2 = opendir(path2);
+	if (dirp2) {
+	    while ((dp2 = readdir(dirp2))) {
+		if (*dp2->d_name == '.')
+		    continue;
+		if (!DecodeVolumeName(dp2->d_name, &ih->ih_vid)) {
+		    ninodes +=
+			namei_ListAFSSubDirs(ih, writeFun, fp, judgeFun,
+					     0, rock);
+		}
+	    }
+	    closedir(dirp2);
+	}
+    }
+    closedir(dirp1);
+    return ninodes;
+}
+#endif /* !AFS_NT40_ENV */
+
 #ifdef DELETE_ZLC
 static void AddToZLCDeleteList(char dir, char *name);
 static void DeleteZLCFiles(char *path);
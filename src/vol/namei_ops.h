@@ -51,6 +51,9 @@ int ListViceInodes(char *devname, char *mountedOn, FD_t inodeFile,
 				      void *rock),
 		   VolumeId singleVolumeNumber, int *forcep, int forceR,
 		   char *wpath, void *rock);
+#ifndef AFS_NT40_ENV
+extern void namei_SetListParallel(int nprocs);
+#endif
 
 #define NAMEI_LCOMP_LEN 32
 #define NAMEI_PATH_LEN 256
@@ -23,6 +23,7 @@
 #include <sys/file.h>
 #endif
 
+#include <opr/jhash.h>
 #include <rx/xdr.h>
 #include <afs/afsint.h>
 #include <afs/afssyscalls.h>
@@ -136,6 +137,14 @@ FidEq(DirHandle * afile, DirHandle * bfile)
     return 1;
 }
 
+afs_uint32
+FidHash(DirHandle * file)
+{
+    return opr_jhash_int2((afs_uint32)file->dirh_inode,
+			  (afs_uint32)((afs_uint64)file->dirh_inode >> 32),
+			  file->dirh_volume);
+}
+
 int
 FidVolEq(DirHandle * afile, VolumeId vid)
 {
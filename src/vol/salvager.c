@@ -238,6 +238,23 @@ handleit(struct cmd_syndesc *as, void *arock)
 	    }
 	}
     }
+    if ((ti = as->parms[22].items)) {	/* -groupparallel # */
+	GroupParallel = atoi(ti->data);
+	if (GroupParallel < 1)
+	    GroupParallel = 1;
+	if (GroupParallel > MAXPARALLEL) {
+	    printf("Setting parallel volume group salvages to maximum of %d \n",
+		   MAXPARALLEL);
+	    GroupParallel = MAXPARALLEL;
+	}
+#if !defined(AFS_NT40_ENV) && !defined(AFS_IHANDLE_PIO_ENV)
+	/* concurrent volume groups share the offset of the inode file */
+	if (GroupParallel > 1) {
+	    printf("Parallel volume group salvages are not supported on this platform\n");
+	    GroupParallel = 1;
+	}
+#endif
+    }
     if ((ti = as->parms[11].items)) {	/* -tmpdir */
 	DIR *dirp;
 
@@ -544,6 +561,8 @@ main(int argc, char **argv)
 #endif /* FAST_RESTART */
     cmd_Seek(ts, 21); /* skip DontSalvage and forceDAFS if needed */
     cmd_AddParm(ts, "-f", CMD_FLAG, CMD_OPTIONAL, "Alias for -force");
+    cmd_AddParm(ts, "-groupparallel", CMD_SINGLE, CMD_OPTIONAL,
+		"# of max parallel volume group salvaging per partition");
     err = cmd_Dispatch(argc, argv);
     Exit(err);
     return 0; /* not reached */
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/* ihstress
+ * Measure how many IH_OPEN/FDH_CLOSE pairs per second the file descriptor
+ * cache sustains as the number of threads grows.  Each thread opens
+ * randomly chosen "inodes", reads a byte from each and closes it again,
+ * the way the fileserver does for small-file traffic.  The inodes are
+ * plain files in a scratch directory, so no vice partition is needed.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#ifdef AFS_NAMEI_ENV
+#include <pthread.h>
+
+#include <afs/opr.h>
+#include <afs/afsutil.h>
+#include <afs/nfs.h>
+#include <afs/afsint.h>
+#include <afs/ihandle.h>
+
+char *prog = "ihstress";
+
+static char *dir;		/* scratch directory holding the inodes */
+static int nfiles = 4096;	/* number of inodes */
+static int seconds = 2;		/* length of each run */
+static volatile int stop;
+
+struct worker {
+    pthread_t tid;
+    unsigned int seed;
+    afs_uint64 opens;
+    int errors;
+};
+
+void
+Usage(void)
+{
+    printf("Usage: %s [-dir scratchdir] [-files n] [-seconds n] "
+	   "[-maxthreads n] [-smallcache] [-noreaper]\n", prog);
+    exit(1);
+}
+
+/* Stand-in for the namei package: inode ino is file ino in dir. */
+FD_t
+namei_iopen(IHandle_t * h)
+{
+    char path[MAXPATHLEN];
+
+    snprintf(path, sizeof(path), "%s/%llu", dir,
+	     (unsigned long long)h->ih_ino);
+    return open(path, O_RDWR);
+}
+
+static void *
+worker(void *rock)
+{
+    struct worker *w = rock;
+    IHandle_t *ihP;
+    FdHandle_t *fdP;
+    char c;
+
+    while (!stop) {
+	Inode ino = 1 + rand_r(&w->seed) % nfiles;
+
+	IH_INIT(ihP, 0, 1, ino);
+	fdP = IH_OPEN(ihP);
+	if (fdP == NULL) {
+	    w->errors++;
+	} else {
+	    if (FDH_PREAD(fdP, &c, 1, 0) != 1)
+		w->errors++;
+	    FDH_CLOSE(fdP);
+	}
+	IH_RELEASE(ihP);
+	w->opens++;
+    }
+    return NULL;
+}
+
+static int
+run(int nthreads)
+{
+    struct worker *w;
+    struct timeval start, end;
+    afs_uint64 opens = 0;
+    double elapsed;
+    int i, errors = 0;
+
+    w = calloc(nthreads, sizeof(*w));
+    opr_Assert(w != NULL);
+
+    stop = 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+	w[i].seed = i + 1;
+	opr_Verify(pthread_create(&w[i].tid, NULL, worker, &w[i]) == 0);
+    }
+    sleep(seconds);
+    stop = 1;
+    for (i = 0; i < nthreads; i++) {
+	opr_Verify(pthread_join(w[i].tid, NULL) == 0);
+	opens += w[i].opens;
+	errors += w[i].errors;
+    }
+    gettimeofday(&end, NULL);
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+	(end.tv_usec - start.tv_usec) / 1000000.0;
+    printf("%3d threads: %12.0f opens/sec (%llu opens, %d errors)\n",
+	   nthreads, opens / elapsed, (unsigned long long)opens, errors);
+
+    free(w);
+    return errors;
+}
+
+int
+main(int argc, char **argv)
+{
+    char template[] = "/tmp/ihstressXXXXXX";
+    char path[MAXPATHLEN];
+    int maxthreads = 64;
+    int smallcache = 0, reaper = 1;
+    int i, fd, errors = 0;
+
+    for (i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc) {
+	    dir = argv[++i];
+	} else if (strcmp(argv[i], "-files") == 0 && i + 1 < argc) {
+	    nfiles = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) {
+	    seconds = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-maxthreads") == 0 && i + 1 < argc) {
+	    maxthreads = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-smallcache") == 0) {
+	    smallcache = 1;
+	} else if (strcmp(argv[i], "-noreaper") == 0) {
+	    reaper = 0;
+	} else {
+	    Usage();
+	}
+    }
+    if (nfiles <= 0 || seconds <= 0 || maxthreads <= 0)
+	Usage();
+
+    if (dir == NULL) {
+	dir = mkdtemp(template);
+	if (dir == NULL) {
+	    perror("mkdtemp");
+	    exit(1);
+	}
+    }
+    for (i = 1; i <= nfiles; i++) {
+	snprintf(path, sizeof(path), "%s/%d", dir, i);
+	fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (fd < 0 || write(fd, "x", 1) != 1) {
+	    perror(path);
+	    exit(1);
+	}
+	close(fd);
+    }
+
+    if (!smallcache)
+	ih_UseLargeCache();
+    if (reaper)
+	ih_StartReaper();
+
+    printf("%d inodes in %s, %s cache, %s\n", nfiles, dir,
+	   smallcache ? "small" : "large",
+	   reaper ? "reaper thread" : "inline eviction");
+    for (i = 1; i <= maxthreads; i *= 2)
+	errors += run(i);
+
+    for (i = 1; i <= nfiles; i++) {
+	snprintf(path, sizeof(path), "%s/%d", dir, i);
+	unlink(path);
+    }
+    if (dir == template)
+	rmdir(dir);
+
+    return errors ? 1 : 0;
+}
+
+#else /* AFS_NAMEI_ENV */
+
+int
+main(int argc, char **argv)
+{
+    printf("ihstress needs a namei fileserver build.\n");
+    return 1;
+}
+
+#endif /* AFS_NAMEI_ENV */
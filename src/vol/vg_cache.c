@@ -84,16 +84,19 @@ VVGCache_PkgInit(void)
     int code = 0;
     int i;
 
-    /* allocate hash table */
+    /* allocate hash table.  it is sized like the volume hash table, but
+     * does not grow with it */
+    VVGCache_hash_table.size = VolumeHashTable.Size;
+    VVGCache_hash_table.mask = VolumeHashTable.Mask;
     VVGCache_hash_table.hash_buckets =
-	malloc(VolumeHashTable.Size * sizeof(struct rx_queue));
+	malloc(VVGCache_hash_table.size * sizeof(struct rx_queue));
     if (VVGCache_hash_table.hash_buckets == NULL) {
 	code = ENOMEM;
 	goto error;
     }
 
     /* setup hash chain heads */
-    for (i = 0; i < VolumeHashTable.Size; i++) {
+    for (i = 0; i < VVGCache_hash_table.size; i++) {
 	queue_Init(&VVGCache_hash_table.hash_buckets[i]);
     }
 
@@ -1104,7 +1107,7 @@ _VVGC_flush_part_r(struct DiskPartition64 * part)
     int i;
     VVGCache_hash_entry_t * ent, * nent;
 
-    for (i = 0; i < VolumeHashTable.Size; i++) {
+    for (i = 0; i < VVGCache_hash_table.size; i++) {
 	for (queue_Scan(&VVGCache_hash_table.hash_buckets[i],
 			ent,
 			nent,
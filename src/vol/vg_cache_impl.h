@@ -34,6 +34,6 @@ extern int _VVGC_dlist_add_r(struct DiskPartition64 *dp,
 extern int _VVGC_dlist_del_r(struct DiskPartition64 *dp,
                              VolumeId parent, VolumeId child);
 
-#define VVGC_HASH(volumeId) (volumeId&(VolumeHashTable.Mask))
+#define VVGC_HASH(volumeId) (volumeId&(VVGCache_hash_table.mask))
 
 #endif /* _AFS_VOL_VG_CACHE_H */
@@ -39,6 +39,8 @@ typedef struct VVGCache_entry {
 typedef struct VVGCache_hash_table {
     struct rx_queue * hash_buckets;      /**< variable-length array of
 					  *   hash buckets */
+    int size;                            /**< number of hash buckets */
+    int mask;                            /**< hash mask */
 } VVGCache_hash_table_t;
 
 /**
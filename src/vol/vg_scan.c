@@ -389,12 +389,12 @@ _VVGC_scan_start(struct DiskPartition64 * dp)
 
     /* initialize partition's to-delete list */
     VVGCache.part[dp->index].dlist_hash_buckets =
-	malloc(VolumeHashTable.Size * sizeof(struct rx_queue));
+	malloc(VVGCache_hash_table.size * sizeof(struct rx_queue));
     if (!VVGCache.part[dp->index].dlist_hash_buckets) {
 	code = -1;
 	goto error;
     }
-    for (i = 0; i < VolumeHashTable.Size; i++) {
+    for (i = 0; i < VVGCache_hash_table.size; i++) {
 	queue_Init(&VVGCache.part[dp->index].dlist_hash_buckets[i]);
     }
 
@@ -476,7 +476,7 @@ _VVGC_flush_dlist(struct DiskPartition64 *dp)
     int i;
     VVGCache_dlist_entry_t *ent, *nent;
 
-    for (i = 0; i < VolumeHashTable.Size; i++) {
+    for (i = 0; i < VVGCache_hash_table.size; i++) {
 	for (queue_Scan(&VVGCache.part[dp->index].dlist_hash_buckets[i],
 	                ent, nent,
 	                VVGCache_dlist_entry)) {
@@ -95,10 +95,51 @@ private Vnode *VnodeHashTable[VNODE_HASH_TABLE_SIZE];
 #define VNODE_HASH(volumeptr,vnodenumber)\
     (opr_jhash_int((vnodenumber), V_id((volumeptr))) & VNODE_HASH_TABLE_MASK)
 
+#ifdef AFS_DEMAND_ATTACH_FS
+struct VnodeLockStripe VnodeLockStripes[VNODE_LOCK_STRIPES];
+static int VnodeLockStripesInit = 0;
+
+/* Usage bumps a volume collects from VnGetFast before they are folded
+ * into its dayUse under VOL_LOCK. */
+#define VNODE_FAST_USAGE_BUMPS 32
+#endif
+
 
 
 #define BAD_IGET	-1000
 
+/* Vnode index read-ahead.  Directory listings, BulkStatus and the like
+ * load runs of neighbouring vnodes, so VnLoad reads the whole index page
+ * holding the vnode it wants and keeps the most recent pages of each
+ * vnode class around to serve the neighbours without another read.
+ * Records are a power of 2 in size, so they never straddle a page.
+ * VnStore writes through to any cached copy, and a volume's pages are
+ * dropped along with its vnodes when it goes offline.  All of this is
+ * protected by VOL_LOCK. */
+
+#define VNODE_RA_PAGE_SHIFT 13
+#define VNODE_RA_PAGE_SIZE (1 << VNODE_RA_PAGE_SHIFT)
+#define VNODE_RA_PAGE_MASK (VNODE_RA_PAGE_SIZE - 1)
+#define VNODE_RA_PAGES 32	/* cached pages per vnode class */
+
+struct VnodeRaPage {
+    Volume *vp;			/* owning volume; NULL if the slot is free */
+    afs_foff_t base;		/* index file offset of the page */
+    int len;			/* bytes of the page read from disk */
+    afs_uint32 lastUse;		/* LRU stamp */
+    byte *buf;
+};
+
+private struct VnodeReadAhead {
+    struct VnodeRaPage pages[VNODE_RA_PAGES];
+    afs_uint32 stores;		/* bumped as each VnStore in this class
+				 * starts and again once its write is
+				 * done; a page read across either may
+				 * be stale */
+    int storing;		/* VnStores in this class still writing */
+    afs_uint32 clock;
+} VnodeReadAhead[nVNODECLASSES];
+
 /* There are two separate vnode queue types defined here:
  * Each hash conflict chain -- is singly linked, with a single head
  * pointer. New entries are added at the beginning. Old
@@ -139,7 +180,8 @@ AddToVVnList(Volume * vp, Vnode * vnp)
 /**
  * delete a vnode from the volume's vnode list.
  *
- * @pre VOL_LOCK held
+ * @pre VOL_LOCK held.
+ *      DAFS: vnode's lock stripe held if the vnode is hashed.
  *
  * @internal volume package internal use only
  */
@@ -161,6 +203,9 @@ DeleteFromVVnList(Vnode * vnp)
  * @param[in] vcp  vnode class info object pointer
  * @param[in] vnp  vnode object pointer
  *
+ * @pre VOL_LOCK held.
+ *      DAFS: vnode's lock stripe held.
+ *
  * @internal vnode package internal use only
  */
 void
@@ -195,6 +240,9 @@ AddToVnLRU(struct VnodeClassInfo * vcp, Vnode * vnp)
  * @param[in] vcp  vnode class info object pointer
  * @param[in] vnp  vnode object pointer
  *
+ * @pre VOL_LOCK held.
+ *      DAFS: vnode's lock stripe held.
+ *
  * @internal vnode package internal use only
  */
 void
@@ -222,7 +270,9 @@ DeleteFromVnLRU(struct VnodeClassInfo * vcp, Vnode * vnp)
  *
  * @param[in] vnp  vnode object pointer
  *
- * @pre VOL_LOCK held
+ * @pre VOL_LOCK held.
+ *      DAFS: vnode's lock stripe not held; the new chain's stripe is
+ *      acquired here.
  *
  * @post vnode on hash
  *
@@ -235,11 +285,13 @@ AddToVnHash(Vnode * vnp)
 
     if (!(Vn_stateFlags(vnp) & VN_ON_HASH)) {
 	newHash = VNODE_HASH(Vn_volume(vnp), Vn_id(vnp));
+	vnp->hashIndex = newHash;
+	VnLockStripe(vnp);
 	vnp->hashNext = VnodeHashTable[newHash];
 	VnodeHashTable[newHash] = vnp;
-	vnp->hashIndex = newHash;
 
 	Vn_stateFlags(vnp) |= VN_ON_HASH;
+	VnUnlockStripe(vnp);
     }
 }
 
@@ -249,9 +301,11 @@ AddToVnHash(Vnode * vnp)
  * @param[in] vnp
  * @param[in] hash
  *
- * @pre VOL_LOCK held
+ * @pre VOL_LOCK held.
+ *      DAFS: vnode's lock stripe held.
  *
- * @post vnode removed from hash
+ * @post vnode removed from hash.  hashIndex is left alone; it still
+ *       names the vnode's lock stripe.
  *
  * @internal vnode package internal use only
  */
@@ -272,7 +326,6 @@ DeleteFromVnHash(Vnode * vnp)
 	}
 
 	vnp->hashNext = NULL;
-	vnp->hashIndex = 0;
 	Vn_stateFlags(vnp) &= ~(VN_ON_HASH);
     }
 }
@@ -294,14 +347,16 @@ DeleteFromVnHash(Vnode * vnp)
 void
 VInvalidateVnode_r(struct Vnode *avnode)
 {
+    VnLockStripe(avnode);
     avnode->changed_newTime = 0;	/* don't let it get flushed out again */
     avnode->changed_oldTime = 0;
     avnode->delete = 0;		/* it isn't deleted, really */
     avnode->cacheCheck = 0;	/* invalid: prevents future vnode searches from working */
     DeleteFromVnHash(avnode);
 #ifdef AFS_DEMAND_ATTACH_FS
-    VnChangeState_r(avnode, VN_STATE_INVALID);
+    VnChangeStateLocked(avnode, VN_STATE_INVALID);
 #endif
+    VnUnlockStripe(avnode);
 }
 
 
@@ -326,6 +381,7 @@ VInitVnodes(VnodeClass class, int nVnodes)
     struct VnodeClassInfo *vcp = &VnodeClassInfo[class];
 
     vcp->allocs = vcp->gets = vcp->reads = vcp->writes = 0;
+    vcp->readaheads = 0;
     vcp->cacheSize = nVnodes;
     switch (class) {
     case vSmall:
@@ -350,6 +406,15 @@ VInitVnodes(VnodeClass class, int nVnodes)
 	vcp->logSize = n;
     }
 
+#ifdef AFS_DEMAND_ATTACH_FS
+    if (!VnodeLockStripesInit) {
+	int i;
+	for (i = 0; i < VNODE_LOCK_STRIPES; i++)
+	    opr_mutex_init(&VnodeLockStripes[i].lock);
+	VnodeLockStripesInit = 1;
+    }
+#endif
+
     if (nVnodes == 0)
 	return 0;
 
@@ -417,6 +482,10 @@ VInitVnodes(VnodeClass class, int nVnodes)
  *       nUsers should be 0.  Things shouldn't be in lruq unless no one is
  *       using them.
  *
+ * @note DAFS: the exception is vnodes read through VnGetFast, which are
+ *       left on the lru.  Those, and vnodes referenced that way since the
+ *       last pass, are moved to the head of the lru and passed over.
+ *
  * @warning DAFS: VOL_LOCK is dropped while doing inode handle release
  *
  * @warning for non-DAFS, the vnode is _not_ hashed on the vnode hash table;
@@ -429,13 +498,24 @@ VGetFreeVnode_r(struct VnodeClassInfo * vcp, struct Volume *vp,
                 VnodeId vnodeNumber)
 {
     Vnode *vnp;
-
-    vnp = vcp->lruHead->lruPrev;
 #ifdef AFS_DEMAND_ATTACH_FS
-    if (Vn_refcount(vnp) != 0 || VnIsExclusiveState(Vn_state(vnp)) ||
-	Vn_readers(vnp) != 0)
+    int passed = 0;
+
+    for (;;) {
+	vnp = vcp->lruHead->lruPrev;
+	VnLockStripe(vnp);
+	if (Vn_refcount(vnp) == 0 && !vnp->vn_referenced)
+	    break;
+	vnp->vn_referenced = 0;
+	VnUnlockStripe(vnp);
+	vcp->lruHead = vnp;
+	if (++passed > 2 * vcp->cacheSize)
+	    Abort("VGetFreeVnode_r: no unused vnode in lruq");
+    }
+    if (VnIsExclusiveState(Vn_state(vnp)) || Vn_readers(vnp) != 0)
 	Abort("VGetFreeVnode_r: in-use vnode in lruq");
 #else
+    vnp = vcp->lruHead->lruPrev;
     if (Vn_refcount(vnp) != 0 || CheckLock(&vnp->lock))
 	Abort("VGetFreeVnode_r: locked vnode in lruq");
 #endif
@@ -452,6 +532,7 @@ VGetFreeVnode_r(struct VnodeClassInfo * vcp, struct Volume *vp,
     if (Vn_volume(vnp)) {
 	DeleteFromVVnList(vnp);
     }
+    VnUnlockStripe(vnp);
 
     /* we must re-hash the vnp _before_ we drop the glock again; otherwise,
      * someone else might try to grab the same vnode id, and we'll both alloc
@@ -497,7 +578,8 @@ VGetFreeVnode_r(struct VnodeClassInfo * vcp, struct Volume *vp,
  * @param[in] vp       pointer to volume object
  * @param[in] vnodeId  vnode id
  *
- * @pre VOL_LOCK held
+ * @pre VOL_LOCK held, or (DAFS) the lock stripe covering the hash
+ *      chain of vnodeId
  *
  * @post matching vnode object or NULL is returned
  *
@@ -689,8 +771,7 @@ VAllocVnode_r(Error * ec, Volume * vp, VnodeType type, VnodeId in_vnode, Unique
 	 * so we may have to wait for it below */
 	VNLog(3, 2, vnodeNumber, (intptr_t)vnp, 0, 0);
 
-	VnCreateReservation_r(vnp);
-	if (Vn_refcount(vnp) == 1) {
+	if (VnCreateReservation_r(vnp) == 1) {
 	    /* we're the only user */
 	    /* This won't block */
 	    VnLock(vnp, WRITE_LOCK, VOL_LOCK_HELD, WILL_NOT_DEADLOCK);
@@ -888,6 +969,739 @@ VAllocVnode_r(Error * ec, Volume * vp, VnodeType type, VnodeId in_vnode, Unique
     return vnp;
 }
 
+/**
+ * look up a cached vnode index page.
+ *
+ * @param[in] vp     volume object pointer
+ * @param[in] class  vnode class enumeration
+ * @param[in] base   index file offset of the page
+ *
+ * @return cached page, or NULL if the page is not cached
+ *
+ * @pre VOL_LOCK held
+ *
+ * @internal vnode package internal use only
+ */
+static struct VnodeRaPage *
+VnRaFind_r(Volume * vp, VnodeClass class, afs_foff_t base)
+{
+    struct VnodeReadAhead *ra = &VnodeReadAhead[class];
+    int i;
+
+    for (i = 0; i < VNODE_RA_PAGES; i++) {
+	if (ra->pages[i].vp == vp && ra->pages[i].base == base)
+	    return &ra->pages[i];
+    }
+    return NULL;
+}
+
+/**
+ * copy a vnode disk record out of the read-ahead pages.
+ *
+ * @param[in]  vp      volume object pointer
+ * @param[in]  vcp     vnode class info object pointer
+ * @param[in]  class   vnode class enumeration
+ * @param[in]  offset  index file offset of the record
+ * @param[out] vdo     vnode disk object to fill in
+ *
+ * @return whether the record was cached
+ *
+ * @pre VOL_LOCK held
+ *
+ * @internal vnode package internal use only
+ */
+static int
+VnRaGet_r(Volume * vp, struct VnodeClassInfo * vcp, VnodeClass class,
+	  afs_foff_t offset, VnodeDiskObject * vdo)
+{
+    struct VnodeRaPage *page;
+    int skip = offset & VNODE_RA_PAGE_MASK;
+
+    page = VnRaFind_r(vp, class, offset - skip);
+    if (page == NULL || skip + vcp->diskSize > page->len)
+	return 0;
+    memcpy(vdo, page->buf + skip, vcp->diskSize);
+    page->lastUse = ++VnodeReadAhead[class].clock;
+    vcp->readaheads++;
+    return 1;
+}
+
+/**
+ * add a freshly read vnode index page to the read-ahead pages.
+ *
+ * @param[in] vp      volume object pointer
+ * @param[in] class   vnode class enumeration
+ * @param[in] base    index file offset of the page
+ * @param[in] buf     page contents; ownership passes to the cache
+ * @param[in] len     number of valid bytes in buf
+ * @param[in] stores  store count sampled before the page was read
+ *
+ * @pre VOL_LOCK held
+ *
+ * @note the page is discarded if any store of a vnode of this class
+ *       began or finished while it was being read, or is still being
+ *       written, since it may predate that store.
+ *
+ * @internal vnode package internal use only
+ */
+static void
+VnRaInsert_r(Volume * vp, VnodeClass class, afs_foff_t base, byte * buf,
+	     int len, afs_uint32 stores)
+{
+    struct VnodeReadAhead *ra = &VnodeReadAhead[class];
+    struct VnodeRaPage *page;
+    int i;
+
+    if (stores != ra->stores || ra->storing > 0
+	|| VnRaFind_r(vp, class, base) != NULL) {
+	free(buf);
+	return;
+    }
+
+    page = &ra->pages[0];
+    for (i = 1; i < VNODE_RA_PAGES && page->vp != NULL; i++) {
+	if (ra->pages[i].vp == NULL || ra->pages[i].lastUse < page->lastUse)
+	    page = &ra->pages[i];
+    }
+
+    free(page->buf);
+    page->vp = vp;
+    page->base = base;
+    page->len = len;
+    page->buf = buf;
+    page->lastUse = ++ra->clock;
+}
+
+/**
+ * write a vnode disk record through to the read-ahead pages.
+ *
+ * @param[in] vp      volume object pointer
+ * @param[in] vcp     vnode class info object pointer
+ * @param[in] class   vnode class enumeration
+ * @param[in] offset  index file offset of the record
+ * @param[in] vdo     vnode disk object being stored
+ *
+ * @pre VOL_LOCK held
+ *
+ * @note VnRaStoreDone_r must be called once the record is on disk, since
+ *       a VnLoad may have read the page since this was called.
+ *
+ * @internal vnode package internal use only
+ */
+static void
+VnRaStore_r(Volume * vp, struct VnodeClassInfo * vcp, VnodeClass class,
+	    afs_foff_t offset, VnodeDiskObject * vdo)
+{
+    struct VnodeRaPage *page;
+    int skip = offset & VNODE_RA_PAGE_MASK;
+
+    VnodeReadAhead[class].stores++;
+    VnodeReadAhead[class].storing++;
+    page = VnRaFind_r(vp, class, offset - skip);
+    if (page != NULL && skip + vcp->diskSize <= page->len)
+	memcpy(page->buf + skip, vdo, vcp->diskSize);
+}
+
+/**
+ * note that a store begun by VnRaStore_r is finished.
+ *
+ * Until then no page of the class is inserted, as it may have been read
+ * before the record was written; and bumping the store count here stops
+ * the insert of any page whose read overlapped the write.
+ *
+ * @param[in] class   vnode class enumeration
+ *
+ * @pre VOL_LOCK held
+ *
+ * @internal vnode package internal use only
+ */
+static void
+VnRaStoreDone_r(VnodeClass class)
+{
+    VnodeReadAhead[class].stores++;
+    VnodeReadAhead[class].storing--;
+}
+
+/**
+ * drop all read-ahead pages belonging to a volume.
+ *
+ * @param[in] vp  volume object pointer
+ *
+ * @pre VOL_LOCK held
+ *
+ * @internal vnode package internal use only
+ */
+static void
+VnRaInvalidateVolume_r(Volume * vp)
+{
+    int class, i;
+
+    for (class = 0; class < nVNODECLASSES; class++) {
+	struct VnodeReadAhead *ra = &VnodeReadAhead[class];
+
+	for (i = 0; i < VNODE_RA_PAGES; i++) {
+	    if (ra->pages[i].vp == vp) {
+		free(ra->pages[i].buf);
+		ra->pages[i].buf = NULL;
+		ra->pages[i].vp = NULL;
+	    }
+	}
+    }
+}
+
+/**
+ * read a vnode disk record along with the rest of its index page.
+ *
+ * @param[in]  fdP       file handle for the vnode index
+ * @param[in]  vcp       vnode class info object pointer
+ * @param[in]  offset    index file offset of the record
+ * @param[out] vdo       vnode disk object to fill in
+ * @param[out] page_out  the whole page, for VnRaInsert_r; NULL if only
+ *                       the record itself could be read
+ * @param[out] len_out   number of valid bytes in *page_out
+ *
+ * @return number of bytes of the record read, as FDH_PREAD would
+ *
+ * @note if the page read comes up short of the record (e.g. an
+ *       unallocated vnode past the end of the index), the record is read
+ *       on its own so the caller sees the same result and errno as a
+ *       plain read.
+ *
+ * @internal vnode package internal use only
+ */
+static ssize_t
+VnReadIndexPage(FdHandle_t * fdP, struct VnodeClassInfo * vcp,
+		afs_foff_t offset, VnodeDiskObject * vdo,
+		byte ** page_out, int * len_out)
+{
+    int skip = offset & VNODE_RA_PAGE_MASK;
+    byte *buf;
+    ssize_t nBytes;
+
+    *page_out = NULL;
+    *len_out = 0;
+
+    buf = malloc(VNODE_RA_PAGE_SIZE);
+    if (buf != NULL) {
+	nBytes = FDH_PREAD(fdP, buf, VNODE_RA_PAGE_SIZE, offset - skip);
+	if (nBytes >= skip + vcp->diskSize) {
+	    memcpy(vdo, buf + skip, vcp->diskSize);
+	    *page_out = buf;
+	    *len_out = nBytes;
+	    return vcp->diskSize;
+	}
+	free(buf);
+    }
+    return FDH_PREAD(fdP, vdo, vcp->diskSize, offset);
+}
+
+/***************************************************/
+/* changed-vnode log                               */
+/***************************************************/
+
+/*
+ * Each read/write volume keeps a log, in a VCHGFORMAT file beside its
+ * header, of the vnodes stored since a given time, and of when each was
+ * last stored.  An incremental dump from time T of the volume, or of a
+ * clone made from it, need only look at the vnodes stored at T or later,
+ * as long as the log reaches back to T.
+ *
+ * While the volume is attached, the vnodes stored are kept in
+ * vp->changeLog, and are merged into the file when the volume's vnodes are
+ * released.  The file is marked open before the first of those stores, so a
+ * log left behind by a crash is never believed.  The salvager and restores
+ * throw away the log of any volume they change.
+ */
+#define VCL_MAGIC	0x56434c47	/* "VCLG" */
+#define VCL_VERSION	1
+
+/* states of the log file; also of vp->changeLog, where 0 means unused */
+#define VCL_OPENING	1		/* file being marked open */
+#define VCL_OPEN	2
+#define VCL_CLEAN	3
+
+struct VnChangeLogHeader {
+    afs_uint32 magic;
+    afs_uint32 version;
+    afs_uint32 state;		/* VCL_OPEN or VCL_CLEAN */
+    afs_uint32 since;		/* every vnode stored since is listed */
+    afs_uint32 mark;		/* update date of the last release clone */
+    afs_uint32 count;		/* entries which follow, by vnode number */
+};
+
+static void
+VnChangeLogPath(char *path, size_t len, struct DiskPartition64 *dp,
+		VolumeId volid)
+{
+    snprintf(path, len, "%s" OS_DIRSEP VCHGFORMAT, VPartitionPath(dp),
+	     afs_printable_VolumeId_lu(volid));
+}
+
+/**
+ * read a changed-vnode log file.
+ *
+ * @param[in]  fd       open log file
+ * @param[out] hdr      log file header
+ * @param[out] entries  hdr->count entries, to be freed by the caller;
+ *                      NULL to read just the header
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval -1 not a log file we understand
+ *
+ * @internal vnode package internal use only
+ */
+static int
+VnChangeLogRead(int fd, struct VnChangeLogHeader *hdr,
+		struct VnChangeLogEntry **entries)
+{
+    size_t len;
+
+    if (entries != NULL)
+	*entries = NULL;
+    if (lseek(fd, 0, SEEK_SET) != 0
+	|| read(fd, hdr, sizeof(*hdr)) != sizeof(*hdr)
+	|| hdr->magic != VCL_MAGIC || hdr->version != VCL_VERSION)
+	return -1;
+    if (entries == NULL || hdr->count == 0)
+	return 0;
+
+    len = hdr->count * sizeof(**entries);
+    *entries = malloc(len);
+    if (*entries == NULL || read(fd, *entries, len) != len) {
+	free(*entries);
+	*entries = NULL;
+	return -1;
+    }
+    return 0;
+}
+
+/**
+ * rewrite a changed-vnode log file.
+ *
+ * The file is marked open until all of the entries are written.
+ *
+ * @param[in] fd       open log file
+ * @param[in] hdr      log file header; state and count are filled in
+ * @param[in] entries  entries, sorted by vnode number
+ * @param[in] count    number of entries
+ *
+ * @return operation status
+ *    @retval 0 success
+ *
+ * @internal vnode package internal use only
+ */
+static int
+VnChangeLogWrite(int fd, struct VnChangeLogHeader *hdr,
+		 struct VnChangeLogEntry *entries, afs_uint32 count)
+{
+    size_t len = count * sizeof(*entries);
+
+    hdr->magic = VCL_MAGIC;
+    hdr->version = VCL_VERSION;
+    hdr->state = VCL_OPEN;
+    hdr->count = count;
+    if (lseek(fd, 0, SEEK_SET) != 0
+	|| write(fd, hdr, sizeof(*hdr)) != sizeof(*hdr))
+	return -1;
+    if (len > 0 && write(fd, entries, len) != len)
+	return -1;
+    if (ftruncate(fd, sizeof(*hdr) + len) != 0)
+	return -1;
+    hdr->state = VCL_CLEAN;
+    if (lseek(fd, 0, SEEK_SET) != 0
+	|| write(fd, hdr, sizeof(*hdr)) != sizeof(*hdr))
+	return -1;
+    return 0;
+}
+
+static int
+VnChangeLogCompare(const void *a, const void *b)
+{
+    const struct VnChangeLogEntry *ea = a, *eb = b;
+
+    if (ea->vnode < eb->vnode)
+	return -1;
+    return ea->vnode > eb->vnode;
+}
+
+/**
+ * note that a vnode was stored at a given time.
+ *
+ * @param[in] cl       in-memory log
+ * @param[in] vnode    vnode number
+ * @param[in] time     when it was stored
+ * @param[in] replace  whether to replace the time of a vnode already noted
+ *
+ * @note if the table can't be grown, the log is marked lost.
+ *
+ * @internal vnode package internal use only
+ */
+static void
+VnChangeLogAdd(struct VnChangeLog *cl, VnodeId vnode, afs_uint32 time,
+	       int replace)
+{
+    struct VnChangeLogEntry *e;
+    afs_uint32 i, mask;
+
+    if (cl->lost)
+	return;
+    if ((cl->nEntries + 1) * 2 > cl->nSlots) {
+	struct VnChangeLogEntry *old = cl->slots;
+	afs_uint32 oldSlots = cl->nSlots;
+	afs_uint32 nSlots = oldSlots ? oldSlots * 2 : 64;
+
+	cl->slots = calloc(nSlots, sizeof(*cl->slots));
+	if (cl->slots == NULL) {
+	    cl->slots = old;
+	    cl->lost = 1;
+	    return;
+	}
+	cl->nSlots = nSlots;
+	cl->nEntries = 0;
+	for (i = 0; i < oldSlots; i++) {
+	    if (old[i].vnode)
+		VnChangeLogAdd(cl, old[i].vnode, old[i].time, 1);
+	}
+	free(old);
+    }
+
+    mask = cl->nSlots - 1;
+    for (i = vnode & mask;; i = (i + 1) & mask) {
+	e = &cl->slots[i];
+	if (e->vnode == vnode) {
+	    if (replace)
+		e->time = time;
+	    return;
+	}
+	if (e->vnode == 0)
+	    break;
+    }
+    e->vnode = vnode;
+    e->time = time;
+    cl->nEntries++;
+}
+
+/**
+ * note that a vnode of a read/write volume is being stored.
+ *
+ * @param[in] vp     volume object pointer
+ * @param[in] vnode  vnode number
+ *
+ * @return whether the caller must mark the log file open, with
+ *         VnChangeLogOpen, before the vnode reaches the index
+ *
+ * @pre VOL_LOCK held
+ *
+ * @internal vnode package internal use only
+ */
+static int
+VnChangeLogNote_r(Volume * vp, VnodeId vnode)
+{
+    struct VnChangeLog *cl = &vp->changeLog;
+    afs_uint32 now = FT_ApproxTime();
+    int opening = 0;
+
+    if (cl->state == 0) {
+	cl->state = VCL_OPENING;
+	cl->since = now;
+	opening = 1;
+    }
+    VnChangeLogAdd(cl, vnode, now, 1);
+    return opening;
+}
+
+/**
+ * mark the log file of a volume open, the first time one of its vnodes
+ * is stored since it was attached.
+ *
+ * @param[in] vp  volume object pointer
+ *
+ * @pre VOL_LOCK is NOT held; vp->changeLog.state is VCL_OPENING
+ *
+ * @post the log file is marked open, and vp->changeLog says whether it
+ *       was a clean log to be added to
+ *
+ * @internal vnode package internal use only
+ */
+static void
+VnChangeLogOpen(Volume * vp)
+{
+    char path[MAXPATHLEN];
+    struct VnChangeLogHeader hdr;
+    int fd, fresh = 1, lost = 0;
+
+    VnChangeLogPath(path, sizeof(path), vp->partition, vp->hashid);
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+	Log("VnChangeLogOpen: can't open %s, error %d\n", path, errno);
+	lost = 1;
+    } else {
+	if (VnChangeLogRead(fd, &hdr, NULL) == 0 && hdr.state == VCL_CLEAN)
+	    fresh = 0;
+	else
+	    memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = VCL_MAGIC;
+	hdr.version = VCL_VERSION;
+	hdr.state = VCL_OPEN;
+	if (lseek(fd, 0, SEEK_SET) != 0
+	    || write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+	    Log("VnChangeLogOpen: can't write %s, error %d\n", path, errno);
+	    lost = 1;
+	}
+	close(fd);
+    }
+
+    VOL_LOCK;
+    if (vp->changeLog.state == VCL_OPENING) {
+	if (!fresh)
+	    vp->changeLog.since = hdr.since;
+	vp->changeLog.fresh = fresh;
+	if (lost)
+	    vp->changeLog.lost = 1;
+	vp->changeLog.state = VCL_OPEN;
+    }
+    VOL_UNLOCK;
+}
+
+/**
+ * merge the vnodes a volume stored while it was attached into its log file.
+ *
+ * @param[in] dp     partition
+ * @param[in] volid  volume id
+ * @param[in] cl     vnodes stored; freed here
+ *
+ * @note if any stored vnode was lost, the log file is removed instead.
+ *
+ * @internal vnode package internal use only
+ */
+static void
+VnChangeLogMerge(struct DiskPartition64 *dp, VolumeId volid,
+		 struct VnChangeLog *cl)
+{
+    char path[MAXPATHLEN];
+    struct VnChangeLogHeader hdr;
+    struct VnChangeLogEntry *old = NULL, *entries = NULL;
+    afs_uint32 i, n;
+    int fd = -1;
+
+    VnChangeLogPath(path, sizeof(path), dp, volid);
+    if (cl->lost)
+	goto fail;
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+	goto fail;
+
+    memset(&hdr, 0, sizeof(hdr));
+    if (!cl->fresh) {
+	if (VnChangeLogRead(fd, &hdr, &old) != 0)
+	    goto fail;
+	for (i = 0; i < hdr.count; i++)
+	    VnChangeLogAdd(cl, old[i].vnode, old[i].time, 0);
+	if (cl->lost)
+	    goto fail;
+    }
+    hdr.since = cl->since;
+
+    entries = malloc(cl->nEntries * sizeof(*entries) + 1);
+    if (entries == NULL)
+	goto fail;
+    for (i = 0, n = 0; i < cl->nSlots; i++) {
+	if (cl->slots[i].vnode)
+	    entries[n++] = cl->slots[i];
+    }
+    qsort(entries, n, sizeof(*entries), VnChangeLogCompare);
+    if (VnChangeLogWrite(fd, &hdr, entries, n) != 0)
+	goto fail;
+    goto done;
+
+  fail:
+    Log("VnChangeLogMerge: changed-vnode log of volume %" AFS_VOLID_FMT
+	" lost\n", afs_printable_VolumeId_lu(volid));
+    unlink(path);
+  done:
+    if (fd >= 0)
+	close(fd);
+    free(old);
+    free(entries);
+    free(cl->slots);
+}
+
+/**
+ * take the vnodes a volume stored while it was attached, to be merged into
+ * its log file.
+ *
+ * @param[in]  vp  volume object pointer
+ * @param[out] cl  vnodes stored
+ *
+ * @return whether any were stored
+ *
+ * @pre VOL_LOCK held; no vnode of the volume can be stored
+ *
+ * @internal vnode package internal use only
+ */
+static int
+VnChangeLogTake_r(Volume * vp, struct VnChangeLog *cl)
+{
+    *cl = vp->changeLog;
+    memset(&vp->changeLog, 0, sizeof(vp->changeLog));
+    return cl->state != 0;
+}
+
+/* merge the vnodes stored by a volume attached by this program */
+static void
+VnChangeLogFlush(Volume * vp)
+{
+    struct VnChangeLog cl;
+    int stored;
+
+    VOL_LOCK;
+    stored = VnChangeLogTake_r(vp, &cl);
+    VOL_UNLOCK;
+    if (stored)
+	VnChangeLogMerge(vp->partition, vp->hashid, &cl);
+}
+
+/**
+ * find the vnodes of a volume stored at or after a given time.
+ *
+ * @param[in]  vp        volume object pointer
+ * @param[in]  fromtime  time of interest
+ * @param[out] vnodes    vnode numbers, in order, to be freed by the caller
+ * @param[out] nVnodes   number of vnodes
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval -1 the log of the volume does not reach back to fromtime
+ *
+ * @note the vnodes found are a superset of those with a serverModifyTime
+ *       of fromtime or later, and include those deleted since fromtime.
+ */
+int
+VChangeLogQuery(Volume * vp, afs_uint32 fromtime, VnodeId ** vnodes,
+		afs_uint32 * nVnodes)
+{
+    char path[MAXPATHLEN];
+    struct VnChangeLogHeader hdr;
+    struct VnChangeLogEntry *entries;
+    afs_uint32 i, n;
+    int fd, code = -1;
+
+    *vnodes = NULL;
+    *nVnodes = 0;
+
+    VnChangeLogFlush(vp);
+
+    VnChangeLogPath(path, sizeof(path), vp->partition, V_id(vp));
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return -1;
+    if (VnChangeLogRead(fd, &hdr, &entries) != 0)
+	goto done;
+    if (hdr.state != VCL_CLEAN || hdr.since > fromtime)
+	goto done;
+
+    *vnodes = malloc(hdr.count * sizeof(**vnodes) + 1);
+    if (*vnodes == NULL)
+	goto done;
+    for (i = 0, n = 0; i < hdr.count; i++) {
+	if (entries[i].time >= fromtime)
+	    (*vnodes)[n++] = entries[i].vnode;
+    }
+    *nVnodes = n;
+    code = 0;
+
+  done:
+    free(entries);
+    close(fd);
+    return code;
+}
+
+/**
+ * give a new clone of a volume a copy of its changed-vnode log.
+ *
+ * @param[in] vp       read/write volume object pointer
+ * @param[in] clonevp  clone volume object pointer
+ * @param[in] release  whether the clone is for a release
+ *
+ * @note a release clone forgets the vnodes stored before the previous
+ *       release clone was made, since the read-only sites were all brought
+ *       up to that one before this release began, and it marks the log
+ *       with the date of this one.  Incremental dumps from earlier than
+ *       that simply scan the whole index.
+ */
+void
+VChangeLogClone(Volume * vp, Volume * clonevp, int release)
+{
+    char path[MAXPATHLEN], clonePath[MAXPATHLEN];
+    struct VnChangeLogHeader hdr;
+    struct VnChangeLogEntry *entries = NULL;
+    afs_uint32 i, n;
+    int fd, cfd = -1, ok = 0;
+
+    VnChangeLogFlush(vp);
+
+    VnChangeLogPath(path, sizeof(path), vp->partition, V_id(vp));
+    VnChangeLogPath(clonePath, sizeof(clonePath), clonevp->partition,
+		    V_id(clonevp));
+    fd = open(path, O_RDWR);
+    if (fd < 0)
+	goto done;
+    if (VnChangeLogRead(fd, &hdr, &entries) != 0 || hdr.state != VCL_CLEAN)
+	goto done;
+
+    if (release) {
+	if (hdr.mark > hdr.since) {
+	    for (i = 0, n = 0; i < hdr.count; i++) {
+		if (entries[i].time >= hdr.mark)
+		    entries[n++] = entries[i];
+	    }
+	    hdr.count = n;
+	    hdr.since = hdr.mark;
+	}
+	hdr.mark = V_updateDate(vp);
+	if (VnChangeLogWrite(fd, &hdr, entries, hdr.count) != 0) {
+	    unlink(path);
+	    goto done;
+	}
+    }
+
+    cfd = open(clonePath, O_RDWR | O_CREAT, 0600);
+    if (cfd < 0)
+	goto done;
+    hdr.mark = 0;
+    if (VnChangeLogWrite(cfd, &hdr, entries, hdr.count) == 0)
+	ok = 1;
+
+  done:
+    if (!ok)
+	unlink(clonePath);
+    if (fd >= 0)
+	close(fd);
+    if (cfd >= 0)
+	close(cfd);
+    free(entries);
+}
+
+/**
+ * remove the changed-vnode log of a volume.
+ *
+ * @param[in] dp     partition
+ * @param[in] volid  volume id
+ *
+ * @note used when a volume's vnodes are changed other than by VnStore,
+ *       and when the volume is destroyed.
+ */
+void
+VChangeLogDestroy(struct DiskPartition64 *dp, VolumeId volid)
+{
+    char path[MAXPATHLEN];
+
+    VnChangeLogPath(path, sizeof(path), dp, volid);
+    if (unlink(path) != 0 && errno != ENOENT)
+	Log("VChangeLogDestroy: can't remove %s, error %d\n", path, errno);
+}
+
 /**
  * load a vnode from disk.
  *
@@ -915,8 +1729,12 @@ VnLoad(Error * ec, Volume * vp, Vnode * vnp,
     int dosalv = 1;
     ssize_t nBytes;
     IHandle_t *ihP = vp->vnodeIndex[class].handle;
-    FdHandle_t *fdP;
+    FdHandle_t *fdP = NULL;
     afs_ino_str_t stmp;
+    afs_foff_t offset;
+    afs_uint32 stores;
+    byte *page;
+    int pageLen;
 
     *ec = 0;
     vcp->reads++;
@@ -928,6 +1746,11 @@ VnLoad(Error * ec, Volume * vp, Vnode * vnp,
     /* This will never block */
     VnLock(vnp, WRITE_LOCK, VOL_LOCK_HELD, WILL_NOT_DEADLOCK);
 
+    offset = vnodeIndexOffset(vcp, Vn_id(vnp));
+    if (VnRaGet_r(vp, vcp, class, offset, &vnp->disk))
+	goto check;
+    stores = VnodeReadAhead[class].stores;
+
     VOL_UNLOCK;
     fdP = IH_OPEN(ihP);
     if (fdP == NULL) {
@@ -935,7 +1758,8 @@ VnLoad(Error * ec, Volume * vp, Vnode * vnp,
 	    PrintInode(stmp, vp->vnodeIndex[class].handle->ih_ino));
 	*ec = VIO;
 	goto error_encountered_nolock;
-    } else if ((nBytes = FDH_PREAD(fdP, (char *)&vnp->disk, vcp->diskSize, vnodeIndexOffset(vcp, Vn_id(vnp))))
+    } else if ((nBytes = VnReadIndexPage(fdP, vcp, offset, &vnp->disk,
+					 &page, &pageLen))
 	       != vcp->diskSize) {
 	/* Don't take volume off line if the inumber is out of range
 	 * or the inode table is full. */
@@ -959,7 +1783,11 @@ VnLoad(Error * ec, Volume * vp, Vnode * vnp,
     }
     FDH_CLOSE(fdP);
     VOL_LOCK;
+    if (page != NULL)
+	VnRaInsert_r(vp, class, offset - (offset & VNODE_RA_PAGE_MASK), page,
+		     pageLen, stores);
 
+ check:
     /* Quick check to see that the data is reasonable */
     if (vnp->disk.vnodeMagic != vcp->magic || vnp->disk.type == vNull) {
 	if (vnp->disk.type == vNull) {
@@ -1046,6 +1874,7 @@ VnStore(Error * ec, Volume * vp, Vnode * vnp,
     IHandle_t *ihP = vp->vnodeIndex[class].handle;
     FdHandle_t *fdP;
     afs_ino_str_t stmp;
+    int openLog = 0;
 #ifdef AFS_DEMAND_ATTACH_FS
     VnState vn_state_save;
 #endif
@@ -1057,7 +1886,12 @@ VnStore(Error * ec, Volume * vp, Vnode * vnp,
 #endif
 
     offset = vnodeIndexOffset(vcp, Vn_id(vnp));
+    VnRaStore_r(vp, vcp, class, offset, &vnp->disk);
+    if (V_type(vp) == readwriteVolume)
+	openLog = VnChangeLogNote_r(vp, Vn_id(vnp));
     VOL_UNLOCK;
+    if (openLog)
+	VnChangeLogOpen(vp);
     fdP = IH_OPEN(ihP);
     if (fdP == NULL) {
 	Log("VnStore: can't open index file!\n");
@@ -1075,6 +1909,9 @@ VnStore(Error * ec, Volume * vp, Vnode * vnp,
 			   vp->vnodeIndex[class].handle->ih_ino));
 	    *ec = VIO;
 	    VOL_LOCK;
+	    VnRaStoreDone_r(class);
+	    /* the read-ahead pages now hold a record that never made it */
+	    VnRaInvalidateVolume_r(vp);
 #ifdef AFS_DEMAND_ATTACH_FS
 	    VnChangeState_r(vnp, VN_STATE_ERROR);
 #endif
@@ -1084,6 +1921,7 @@ VnStore(Error * ec, Volume * vp, Vnode * vnp,
 	    goto error_encountered;
 #else
 	    VOL_LOCK;
+	    VnRaStoreDone_r(class);
 	    VForceOffline_r(vp, 0);
 	    *ec = VSALVAGE;
 #endif
@@ -1094,6 +1932,7 @@ VnStore(Error * ec, Volume * vp, Vnode * vnp,
     }
 
     VOL_LOCK;
+    VnRaStoreDone_r(class);
 #ifdef AFS_DEMAND_ATTACH_FS
     VnChangeState_r(vnp, vn_state_save);
 #endif
@@ -1106,6 +1945,7 @@ VnStore(Error * ec, Volume * vp, Vnode * vnp,
     if (fdP)
 	FDH_CLOSE(fdP);
     VOL_LOCK;
+    VnRaStoreDone_r(class);
     VnChangeState_r(vnp, VN_STATE_ERROR);
     VRequestSalvage_r(ec, vp, SALVSYNC_ERROR, 0);
 #else
@@ -1125,10 +1965,160 @@ VnStore(Error * ec, Volume * vp, Vnode * vnp,
  *
  * @see VGetVnode_r
  */
+#ifdef AFS_DEMAND_ATTACH_FS
+/**
+ * get a read ref on a cached vnode without VOL_LOCK.
+ *
+ * @param[in] vp           volume object
+ * @param[in] vnodeNumber  vnode id
+ *
+ * @return vnode object pointer
+ *   @retval NULL  vnode is not cached, or not in a state this path can
+ *                 handle; caller must use VGetVnode_r
+ *
+ * @pre VOL_LOCK not held.
+ *      heavyweight ref held on volume object.
+ *
+ * @post read ref held on vnode; volume usage bumped
+ *
+ * @note a ref is only taken when every existing ref on the vnode is a read
+ *       ref.  Slow path callers hold a reservation from the time they wait
+ *       on the vnode state until they change it, which keeps this path off
+ *       the vnode in the meantime.  Vnodes found here stay on the lru.
+ *
+ * @note the volume attach state and inUse flag are read without VOL_LOCK;
+ *       the caller's ref on the volume keeps them from changing under a
+ *       vnode get, and a busy volume just takes the slow path.
+ *
+ * @internal vnode package internal use only
+ */
+static Vnode *
+VnGetFast(Volume * vp, VnodeId vnodeNumber)
+{
+    struct VnodeLockStripe *stripe;
+    Vnode *vnp;
+    int fold = 0;
+
+    if (vnodeNumber == 0 ||
+	VIsExclusiveState(V_attachState(vp)) ||
+	VIsErrorState(V_attachState(vp)) ||
+	(programType == fileServer && !V_inUse(vp)))
+	return NULL;
+
+    stripe = &VnodeLockStripes[VNODE_HASH(vp, vnodeNumber) &
+			       (VNODE_LOCK_STRIPES - 1)];
+    VnEnterStripe(stripe);
+    vnp = VLookupVnode(vp, vnodeNumber);
+    if (!vnp || Vn_refcount(vnp) != Vn_readers(vnp) ||
+	(Vn_state(vnp) != VN_STATE_ONLINE && Vn_state(vnp) != VN_STATE_READ) ||
+	vnp->disk.type == vNull) {
+	opr_mutex_exit(&stripe->lock);
+	return NULL;
+    }
+    Vn_refcount(vnp)++;
+    VnBeginReadLocked(vnp);
+    vnp->vn_referenced = 1;
+    stripe->fastGets++;
+    opr_mutex_exit(&stripe->lock);
+
+    /* Count the usage bump on the volume, and every so often take
+     * VOL_LOCK to fold the pending ones into dayUse. */
+    if (programType == fileServer) {
+	opr_mutex_enter(&vp->usage_lock);
+	if (vp->usage_bumps_fast + 1 < VNODE_FAST_USAGE_BUMPS) {
+	    vp->usage_bumps_fast++;
+	} else {
+	    fold = 1;
+	}
+	opr_mutex_exit(&vp->usage_lock);
+	if (fold) {
+	    VOL_LOCK;
+	    VBumpVolumeUsage_r(vp);
+	    VOL_UNLOCK;
+	}
+    }
+    return vnp;
+}
+
+/**
+ * drop a read ref on a vnode without VOL_LOCK.
+ *
+ * @param[in] vnp  vnode object pointer
+ *
+ * @return whether the ref was dropped
+ *   @retval 0  caller must use VPutVnode_r
+ *
+ * @pre VOL_LOCK not held.
+ *      ref held on vnode.
+ *
+ * @note only a read ref which is not the last ref, or is the last ref on
+ *       a vnode that is still on the lru, can be dropped here
+ *
+ * @internal vnode package internal use only
+ */
+static int
+VnPutFast(Vnode * vnp)
+{
+    struct VnodeLockStripe *stripe;
+    int done = 0;
+
+    if (vnp->changed_newTime || vnp->changed_oldTime || vnp->delete)
+	return 0;
+
+    stripe = VnStripe(vnp);
+    VnEnterStripe(stripe);
+    if (Vn_state(vnp) == VN_STATE_READ &&
+	(Vn_refcount(vnp) > 1 ||
+	 (TrustVnodeCacheEntry && (Vn_stateFlags(vnp) & VN_ON_LRU)))) {
+	opr_Assert(vnp->disk.vnodeMagic == Vn_class(vnp)->magic);
+	VnEndReadLocked(vnp);
+	Vn_refcount(vnp)--;
+	stripe->fastPuts++;
+	done = 1;
+    }
+    opr_mutex_exit(&stripe->lock);
+    return done;
+}
+
+/**
+ * sum the vnode lock stripe statistics.
+ *
+ * @param[out] fastGets  read refs taken without VOL_LOCK
+ * @param[out] fastPuts  read refs dropped without VOL_LOCK
+ * @param[out] waits     times a stripe lock was found held
+ */
+void
+VnGetLockStats(afs_uint64 * fastGets, afs_uint64 * fastPuts,
+	       afs_uint64 * waits)
+{
+    int i;
+
+    *fastGets = *fastPuts = *waits = 0;
+    for (i = 0; i < VNODE_LOCK_STRIPES; i++) {
+	struct VnodeLockStripe *stripe = &VnodeLockStripes[i];
+
+	opr_mutex_enter(&stripe->lock);
+	*fastGets += stripe->fastGets;
+	*fastPuts += stripe->fastPuts;
+	*waits += stripe->waits;
+	opr_mutex_exit(&stripe->lock);
+    }
+}
+#endif /* AFS_DEMAND_ATTACH_FS */
+
 Vnode *
 VGetVnode(Error * ec, Volume * vp, VnodeId vnodeNumber, int locktype)
 {				/* READ_LOCK or WRITE_LOCK, as defined in lock.h */
     Vnode *retVal;
+#ifdef AFS_DEMAND_ATTACH_FS
+    if (locktype == READ_LOCK) {
+	retVal = VnGetFast(vp, vnodeNumber);
+	if (retVal) {
+	    *ec = 0;
+	    return retVal;
+	}
+    }
+#endif
     VOL_LOCK;
     retVal = VGetVnode_r(ec, vp, vnodeNumber, locktype);
     VOL_UNLOCK;
@@ -1323,6 +2313,12 @@ int TrustVnodeCacheEntry = 1;
 void
 VPutVnode(Error * ec, Vnode * vnp)
 {
+#ifdef AFS_DEMAND_ATTACH_FS
+    if (VnPutFast(vnp)) {
+	*ec = 0;
+	return;
+    }
+#endif
     VOL_LOCK;
     VPutVnode_r(ec, vnp);
     VOL_UNLOCK;
@@ -1607,6 +2603,8 @@ VInvalidateVnodesByVolume_r(Volume * vp,
     size_t i = 0, vec_len;
     IHandle_t **ih_vec, **ih_vec_new;
 
+    VnRaInvalidateVolume_r(vp);
+
 #ifdef AFS_DEMAND_ATTACH_FS
     VOL_UNLOCK;
 #endif /* AFS_DEMAND_ATTACH_FS */
@@ -1656,7 +2654,9 @@ restart_traversal:
 	    ih_vec[i++] = vnp->handle;
 	    vnp->handle = NULL;
 	}
+	VnLockStripe(vnp);
 	DeleteFromVVnList(vnp);
+	VnUnlockStripe(vnp);
 	VInvalidateVnode_r(vnp);
     }
 
@@ -1679,6 +2679,8 @@ VCloseVnodeFiles_r(Volume * vp)
 #endif
     IHandle_t ** ih_vec;
     size_t i, vec_len;
+    struct VnChangeLog cl;
+    int stored;
 
 #ifdef AFS_DEMAND_ATTACH_FS
     vol_state_save = VChangeState_r(vp, VOL_STATE_VNODE_CLOSE);
@@ -1687,6 +2689,7 @@ VCloseVnodeFiles_r(Volume * vp)
     /* XXX need better error handling here */
     opr_Verify(VInvalidateVnodesByVolume_r(vp, &ih_vec,
 					   &vec_len) == 0);
+    stored = VnChangeLogTake_r(vp, &cl);
 
     /*
      * DAFS:
@@ -1704,6 +2707,9 @@ VCloseVnodeFiles_r(Volume * vp)
 
     free(ih_vec);
 
+    if (stored)
+	VnChangeLogMerge(vp->partition, vp->hashid, &cl);
+
 #ifdef AFS_DEMAND_ATTACH_FS
     VOL_LOCK;
     VChangeState_r(vp, vol_state_save);
@@ -1743,6 +2749,8 @@ VReleaseVnodeFiles_r(Volume * vp)
 #endif
     IHandle_t ** ih_vec;
     size_t i, vec_len;
+    struct VnChangeLog cl;
+    int stored;
 
 #ifdef AFS_DEMAND_ATTACH_FS
     vol_state_save = VChangeState_r(vp, VOL_STATE_VNODE_RELEASE);
@@ -1751,6 +2759,7 @@ VReleaseVnodeFiles_r(Volume * vp)
     /* XXX need better error handling here */
     opr_Verify(VInvalidateVnodesByVolume_r(vp, &ih_vec,
 					   &vec_len) == 0);
+    stored = VnChangeLogTake_r(vp, &cl);
 
     /*
      * DAFS:
@@ -1767,6 +2776,9 @@ VReleaseVnodeFiles_r(Volume * vp)
 
     free(ih_vec);
 
+    if (stored)
+	VnChangeLogMerge(vp->partition, vp->hashid, &cl);
+
 #ifdef AFS_DEMAND_ATTACH_FS
     VOL_LOCK;
     VChangeState_r(vp, vol_state_save);
@@ -22,6 +22,7 @@
 #define Date afs_uint32
 
 struct Volume;			/* Potentially forward definition. */
+struct DiskPartition64;		/* Potentially forward definition. */
 
 typedef struct ViceLock {
     int lockCount;
@@ -80,10 +81,34 @@ struct VnodeClassInfo {
     int gets, reads;		/* Number of VGetVnodes and corresponding
 				 * reads */
     int writes;			/* Number of vnode writes */
+    int readaheads;		/* Reads served from the index read-ahead
+				 * pages instead of the disk */
 };
 
 extern struct VnodeClassInfo VnodeClassInfo[nVNODECLASSES];
 
+#ifdef AFS_DEMAND_ATTACH_FS
+/*
+ * Vnode lock stripes.  Each vnode hash chain is covered by one of these
+ * locks, chosen by its hash index.  The stripe protects the chain itself
+ * (which is only changed with VOL_LOCK held as well), and a cached vnode's
+ * refcount, reader count, state and state flags.  This lets VGetVnode and
+ * VPutVnode take and drop read references on a cached vnode without
+ * VOL_LOCK; see VnGetFast in vnode.c.  VOL_LOCK, when needed, is always
+ * acquired before a stripe lock.
+ */
+#define VNODE_LOCK_STRIPES 64	/* must be a power of 2 */
+
+struct VnodeLockStripe {
+    pthread_mutex_t lock;
+    afs_uint64 fastGets;	/* read refs taken without VOL_LOCK */
+    afs_uint64 fastPuts;	/* read refs dropped without VOL_LOCK */
+    afs_uint64 waits;		/* times the lock was found held */
+};
+
+extern struct VnodeLockStripe VnodeLockStripes[VNODE_LOCK_STRIPES];
+#endif /* AFS_DEMAND_ATTACH_FS */
+
 /**
  * Return the vnode class (large or small) of this vnode type.
  */
@@ -254,6 +279,8 @@ typedef struct Vnode {
     bit32 nReaders;             /**< number of read locks held */
     VnState vn_state;           /**< vnode state */
     pthread_cond_t vn_state_cv; /**< state change notification cv */
+    byte vn_referenced;         /**< read without VOL_LOCK since the lru
+				 *   last passed over it */
 #else /* !AFS_DEMAND_ATTACH_FS */
     struct Lock lock;		/* Internal lock */
 #endif /* !AFS_DEMAND_ATTACH_FS */
@@ -271,6 +298,25 @@ typedef struct Vnode {
 	(sizeof(struct Vnode) - sizeof(VnodeDiskObject) + SIZEOF_LARGEDISKVNODE)
 #define SIZEOF_SMALLVNODE	(sizeof (struct Vnode))
 
+/*
+ * Vnodes stored to a read/write volume since it was attached, to be merged
+ * into its changed-vnode log (see vnode.c) when its vnodes are released.
+ */
+struct VnChangeLogEntry {
+    VnodeId vnode;
+    afs_uint32 time;		/* when it was last stored */
+};
+
+struct VnChangeLog {
+    byte state;			/* VCL_* in vnode.c */
+    byte fresh;			/* ignore what the log file held before */
+    byte lost;			/* an entry could not be kept */
+    afs_uint32 since;		/* every vnode stored since is listed */
+    afs_uint32 nEntries;
+    afs_uint32 nSlots;		/* size of slots, a power of two */
+    struct VnChangeLogEntry *slots;	/* open addressed by vnode number */
+};
+
 
 /*
  * struct Vnode accessor abstraction
@@ -345,6 +391,16 @@ extern Vnode *VAllocVnode_r(Error * ec, struct Volume *vp, VnodeType type,
 extern Vnode *VGetFreeVnode_r(struct VnodeClassInfo *vcp, struct Volume *vp,
                               VnodeId vnodeNumber);
 extern Vnode *VLookupVnode(struct Volume * vp, VnodeId vnodeId);
+#ifdef AFS_DEMAND_ATTACH_FS
+extern void VnGetLockStats(afs_uint64 * fastGets, afs_uint64 * fastPuts,
+			   afs_uint64 * waits);
+#endif
+
+extern int VChangeLogQuery(struct Volume * vp, afs_uint32 fromtime,
+			   VnodeId ** vnodes, afs_uint32 * nVnodes);
+extern void VChangeLogClone(struct Volume * vp, struct Volume * clonevp,
+			    int release);
+extern void VChangeLogDestroy(struct DiskPartition64 * dp, VolumeId volid);
 
 extern void AddToVVnList(struct Volume * vp, Vnode * vnp);
 extern void DeleteFromVVnList(Vnode * vnp);
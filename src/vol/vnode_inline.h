@@ -16,6 +16,50 @@
 /* demand attach vnode state machine routines      */
 /***************************************************/
 
+#ifdef AFS_DEMAND_ATTACH_FS
+/**
+ * get the lock stripe covering a vnode.
+ *
+ * @param[in] vnp  vnode object pointer
+ *
+ * @note a vnode only moves to another stripe when it is put on a new hash
+ *       chain, which happens with VOL_LOCK held
+ *
+ * @note DEMAND_ATTACH_FS only
+ *
+ * @internal vnode package internal use only
+ */
+static_inline struct VnodeLockStripe *
+VnStripe(Vnode * vnp)
+{
+    return &VnodeLockStripes[vnp->hashIndex & (VNODE_LOCK_STRIPES - 1)];
+}
+
+/**
+ * acquire a vnode lock stripe, counting contention.
+ *
+ * @param[in] stripe  lock stripe
+ *
+ * @note DEMAND_ATTACH_FS only
+ *
+ * @internal vnode package internal use only
+ */
+static_inline void
+VnEnterStripe(struct VnodeLockStripe *stripe)
+{
+    if (!opr_mutex_tryenter(&stripe->lock)) {
+	opr_mutex_enter(&stripe->lock);
+	stripe->waits++;
+    }
+}
+
+#define VnLockStripe(vnp)    VnEnterStripe(VnStripe(vnp))
+#define VnUnlockStripe(vnp)  opr_mutex_exit(&VnStripe(vnp)->lock)
+#else /* !AFS_DEMAND_ATTACH_FS */
+#define VnLockStripe(vnp)
+#define VnUnlockStripe(vnp)
+#endif /* !AFS_DEMAND_ATTACH_FS */
+
 /**
  * get a reference to a vnode object.
  *
@@ -25,17 +69,25 @@
  *
  * @pre VOL_LOCK must be held
  *
- * @post vnode refcount incremented
+ * @post vnode refcount incremented; vnode is off the lru
+ *
+ * @return new refcount
+ *
+ * @note DAFS: a vnode with read refs taken by VnGetFast stays on the lru,
+ *       so it may be on the lru with a nonzero refcount
  *
  * @see VnCancelReservation_r
  */
-static_inline void
+static_inline int
 VnCreateReservation_r(Vnode * vnp)
 {
-    Vn_refcount(vnp)++;
-    if (Vn_refcount(vnp) == 1) {
-	DeleteFromVnLRU(Vn_class(vnp), vnp);
-    }
+    int refs;
+
+    VnLockStripe(vnp);
+    refs = ++Vn_refcount(vnp);
+    DeleteFromVnLRU(Vn_class(vnp), vnp);
+    VnUnlockStripe(vnp);
+    return refs;
 }
 
 extern int TrustVnodeCacheEntry;
@@ -56,6 +108,7 @@ extern int TrustVnodeCacheEntry;
 static_inline void
 VnCancelReservation_r(Vnode * vnp)
 {
+    VnLockStripe(vnp);
     if (--Vn_refcount(vnp) == 0) {
 	AddToVnLRU(Vn_class(vnp), vnp);
 
@@ -65,6 +118,7 @@ VnCancelReservation_r(Vnode * vnp)
 	    DeleteFromVVnList(vnp);
 	}
     }
+    VnUnlockStripe(vnp);
 }
 
 #ifdef AFS_PTHREAD_ENV
@@ -152,7 +206,7 @@ VnUnlock(Vnode * vnp, int type)
  * @param[in] vnp        pointer to vnode object
  * @param[in] new_state  new vnode state value
  *
- * @pre VOL_LOCK held
+ * @pre vnode's lock stripe held
  *
  * @post vnode state changed
  *
@@ -163,7 +217,7 @@ VnUnlock(Vnode * vnp, int type)
  * @internal vnode package internal use only
  */
 static_inline VnState
-VnChangeState_r(Vnode * vnp, VnState new_state)
+VnChangeStateLocked(Vnode * vnp, VnState new_state)
 {
     VnState old_state = Vn_state(vnp);
 
@@ -172,6 +226,34 @@ VnChangeState_r(Vnode * vnp, VnState new_state)
     return old_state;
 }
 
+/**
+ * change state, and notify other threads,
+ * return previous state to caller.
+ *
+ * @param[in] vnp        pointer to vnode object
+ * @param[in] new_state  new vnode state value
+ *
+ * @pre VOL_LOCK held
+ *
+ * @post vnode state changed
+ *
+ * @return previous vnode state
+ *
+ * @note DEMAND_ATTACH_FS only
+ *
+ * @internal vnode package internal use only
+ */
+static_inline VnState
+VnChangeState_r(Vnode * vnp, VnState new_state)
+{
+    VnState old_state;
+
+    VnLockStripe(vnp);
+    old_state = VnChangeStateLocked(vnp, new_state);
+    VnUnlockStripe(vnp);
+    return old_state;
+}
+
 /**
  * tells caller whether or not the current state requires
  * exclusive access without holding glock.
@@ -243,6 +325,32 @@ VnIsValidState(VnState state)
     return 0;
 }
 
+/**
+ * wait for a state change notification on a vnode.
+ *
+ * @param[in] vnp  vnode object pointer
+ *
+ * @pre VOL_LOCK and vnode's lock stripe held
+ *
+ * @post VOL_LOCK and vnode's lock stripe held
+ *
+ * @note VOL_LOCK is dropped while waiting, and the stripe is dropped
+ *       while VOL_LOCK is reacquired, to keep the lock order
+ *
+ * @note DEMAND_ATTACH_FS only
+ *
+ * @internal vnode package internal use only
+ */
+static_inline void
+VnWaitLocked(Vnode * vnp)
+{
+    VOL_UNLOCK;
+    opr_cv_wait(&Vn_stateCV(vnp), &VnStripe(vnp)->lock);
+    VnUnlockStripe(vnp);
+    VOL_LOCK;
+    VnLockStripe(vnp);
+}
+
 /**
  * wait for the vnode to change states.
  *
@@ -257,12 +365,15 @@ VnIsValidState(VnState state)
 static_inline void
 VnWaitStateChange_r(Vnode * vnp)
 {
-    VnState state_save = Vn_state(vnp);
+    VnState state_save;
 
+    VnLockStripe(vnp);
+    state_save = Vn_state(vnp);
     opr_Assert(Vn_refcount(vnp));
     do {
-	VOL_CV_WAIT(&Vn_stateCV(vnp));
+	VnWaitLocked(vnp);
     } while (Vn_state(vnp) == state_save);
+    VnUnlockStripe(vnp);
     opr_Assert(!(Vn_stateFlags(vnp) & VN_ON_LRU));
 }
 
@@ -280,10 +391,12 @@ VnWaitStateChange_r(Vnode * vnp)
 static_inline void
 VnWaitExclusiveState_r(Vnode * vnp)
 {
+    VnLockStripe(vnp);
     opr_Assert(Vn_refcount(vnp));
     while (VnIsExclusiveState(Vn_state(vnp))) {
-	VOL_CV_WAIT(&Vn_stateCV(vnp));
+	VnWaitLocked(vnp);
     }
+    VnUnlockStripe(vnp);
     opr_Assert(!(Vn_stateFlags(vnp) & VN_ON_LRU));
 }
 
@@ -301,11 +414,13 @@ VnWaitExclusiveState_r(Vnode * vnp)
 static_inline void
 VnWaitQuiescent_r(Vnode * vnp)
 {
+    VnLockStripe(vnp);
     opr_Assert(Vn_refcount(vnp));
     while (VnIsExclusiveState(Vn_state(vnp)) ||
 	   Vn_readers(vnp)) {
-	VOL_CV_WAIT(&Vn_stateCV(vnp));
+	VnWaitLocked(vnp);
     }
+    VnUnlockStripe(vnp);
     opr_Assert(!(Vn_stateFlags(vnp) & VN_ON_LRU));
 }
 
@@ -314,7 +429,7 @@ VnWaitQuiescent_r(Vnode * vnp)
  *
  * @param[in] vnp  vnode object pointer
  *
- * @pre VOL_LOCK held.
+ * @pre vnode's lock stripe held.
  *      ref held on vnode.
  *      vnode in VN_STATE_READ or VN_STATE_ONLINE
  *
@@ -326,23 +441,47 @@ VnWaitQuiescent_r(Vnode * vnp)
  * @internal vnode package internal use only
  */
 static_inline void
-VnBeginRead_r(Vnode * vnp)
+VnBeginReadLocked(Vnode * vnp)
 {
     if (!Vn_readers(vnp)) {
 	opr_Assert(Vn_state(vnp) == VN_STATE_ONLINE);
-	VnChangeState_r(vnp, VN_STATE_READ);
+	VnChangeStateLocked(vnp, VN_STATE_READ);
     }
     Vn_readers(vnp)++;
     opr_Assert(Vn_state(vnp) == VN_STATE_READ);
 }
 
 /**
- * deregister a reader on a vnode.
+ * register a new reader on a vnode.
  *
  * @param[in] vnp  vnode object pointer
  *
  * @pre VOL_LOCK held.
  *      ref held on vnode.
+ *      vnode in VN_STATE_READ or VN_STATE_ONLINE
+ *
+ * @post refcount incremented.
+ *       state set to VN_STATE_READ.
+ *
+ * @note DEMAND_ATTACH_FS only
+ *
+ * @internal vnode package internal use only
+ */
+static_inline void
+VnBeginRead_r(Vnode * vnp)
+{
+    VnLockStripe(vnp);
+    VnBeginReadLocked(vnp);
+    VnUnlockStripe(vnp);
+}
+
+/**
+ * deregister a reader on a vnode.
+ *
+ * @param[in] vnp  vnode object pointer
+ *
+ * @pre vnode's lock stripe held.
+ *      ref held on vnode.
  *      read ref held on vnode.
  *      vnode in VN_STATE_READ.
  *
@@ -354,16 +493,40 @@ VnBeginRead_r(Vnode * vnp)
  * @internal vnode package internal use only
  */
 static_inline void
-VnEndRead_r(Vnode * vnp)
+VnEndReadLocked(Vnode * vnp)
 {
     opr_Assert(Vn_readers(vnp) > 0);
     Vn_readers(vnp)--;
     if (!Vn_readers(vnp)) {
-	opr_cv_broadcast(&Vn_stateCV(vnp));
-	VnChangeState_r(vnp, VN_STATE_ONLINE);
+	VnChangeStateLocked(vnp, VN_STATE_ONLINE);
     }
 }
 
+/**
+ * deregister a reader on a vnode.
+ *
+ * @param[in] vnp  vnode object pointer
+ *
+ * @pre VOL_LOCK held.
+ *      ref held on vnode.
+ *      read ref held on vnode.
+ *      vnode in VN_STATE_READ.
+ *
+ * @post refcount decremented.
+ *       when count reaches zero, state set to VN_STATE_ONLINE.
+ *
+ * @note DEMAND_ATTACH_FS only
+ *
+ * @internal vnode package internal use only
+ */
+static_inline void
+VnEndRead_r(Vnode * vnp)
+{
+    VnLockStripe(vnp);
+    VnEndReadLocked(vnp);
+    VnUnlockStripe(vnp);
+}
+
 #endif /* AFS_DEMAND_ATTACH_FS */
 
 #endif /* _AFS_VOL_VNODE_INLINE_H */
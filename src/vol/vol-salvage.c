@@ -205,6 +205,7 @@ int ShowRootFiles;		/* -r flag */
 int RebuildDirs;		/* -sal flag */
 int Parallel = 4;		/* -para X flag */
 int PartsPerDisk = 8;		/* Salvage up to 8 partitions on same disk sequentially */
+int GroupParallel = 1;		/* -groupparallel X flag */
 int forceR = 0;			/* -b flag */
 int ShowLog = 0;		/* -showlog flag */
 char *ShowLogFilename = NULL;    /* log file name for -showlog */
@@ -284,6 +285,8 @@ static int AskVolumeSummary(struct SalvInfo *salvinfo,
                             VolumeId singleVolumeNumber);
 static void MaybeAskOnline(struct SalvInfo *salvinfo, VolumeId volumeId);
 static void AskError(struct SalvInfo *salvinfo, VolumeId volumeId);
+static int ForkVolumeGroup(void);
+static void WaitVolumeGroups(void);
 
 #ifdef AFS_DEMAND_ATTACH_FS
 static int LockVolume(struct SalvInfo *salvinfo, VolumeId volumeId);
@@ -697,6 +700,24 @@ get_DevName(char *pbuffer, char *wpath)
 	return NULL;
 }
 
+/* A volume group queued for salvage when -groupparallel is in effect. */
+struct VolumeGroupSpan {
+    int first;			/* index of the group in inodeSummary */
+    int nVols;			/* number of volumes in the group */
+    afs_uint64 nInodes;		/* inodes across the group; its rough cost */
+};
+
+static int
+CompareVolumeGroups(const void *_p1, const void *_p2)
+{
+    const struct VolumeGroupSpan *p1 = _p1;
+    const struct VolumeGroupSpan *p2 = _p2;
+
+    if (p1->nInodes != p2->nInodes)
+	return (p1->nInodes > p2->nInodes ? -1 : 1);
+    return p1->first - p2->first;
+}
+
 void
 SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
 {
@@ -706,11 +727,13 @@ SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
     static char tmpDevName[100];
     static char wpath[100];
     struct VolumeSummary *vsp, *esp;
-    int i, j;
+    int i, j, k;
     int code;
     int tries = 0;
     struct SalvInfo l_salvinfo;
     struct SalvInfo *salvinfo = &l_salvinfo;
+    struct VolumeGroupSpan *groups = NULL;
+    int nGroups = 0;
 
  retry:
     memset(salvinfo, 0, sizeof(*salvinfo));
@@ -881,6 +904,12 @@ SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
 	canfork = 0;
     }
 
+    if (GroupParallel > 1 && canfork && !debug && salvinfo->nVolumesInInodeFile) {
+	groups = calloc(salvinfo->nVolumesInInodeFile, sizeof(*groups));
+	if (!groups)
+	    Log("Unable to allocate volume group list; salvaging groups in order\n");
+    }
+
     for (i = j = 0, vsp = salvinfo->volumeSummaryp, esp = vsp + salvinfo->nVolumes;
 	 i < salvinfo->nVolumesInInodeFile; i = j) {
 	VolumeId rwvid = salvinfo->inodeSummary[i].RWvolumeId;
@@ -908,6 +937,16 @@ SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
 		}
 	    }
 	}
+	if (groups) {
+	    /* salvaged below, once every group is known */
+	    groups[nGroups].first = i;
+	    groups[nGroups].nVols = j - i;
+	    groups[nGroups].nInodes = 0;
+	    for (k = i; k < j; k++)
+		groups[nGroups].nInodes += salvinfo->inodeSummary[k].nInodes;
+	    nGroups++;
+	    continue;
+	}
 	/* Salvage the group of volumes (several read-only + 1 read/write)
 	 * starting with the current read-only volume we're looking at.
 	 */
@@ -919,6 +958,19 @@ SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
 
     }
 
+    if (groups) {
+	/* Hand out the biggest groups first, so that one huge volume group
+	 * starts early rather than holding up the end of the run while the
+	 * other slots sit idle. */
+	qsort(groups, nGroups, sizeof(*groups), CompareVolumeGroups);
+	for (i = 0; i < nGroups; i++)
+	    DoSalvageVolumeGroup(salvinfo,
+				 &salvinfo->inodeSummary[groups[i].first],
+				 groups[i].nVols);
+	free(groups);
+    }
+    WaitVolumeGroups();
+
     /* Delete any additional volumes that were listed in the partition but which didn't have any corresponding inodes */
     for (; vsp < esp; vsp++) {
 	if (vsp->unused)
@@ -1177,6 +1229,12 @@ GetInodeSummary(struct SalvInfo *salvinfo, FD_t inodeFile, VolumeId singleVolume
     int deleted = 0;
     afs_sfsize_t st_size;
 
+#if defined(AFS_NAMEI_ENV) && !defined(AFS_NT40_ENV)
+    /* a full partition scan may be shared among as many processes as we
+     * are allowed volume group children */
+    namei_SetListParallel((canfork && !debug && !singleVolumeNumber)
+			  ? GroupParallel : 1);
+#endif
     /* This file used to come from vfsck; cobble it up ourselves now... */
     if ((err =
 	 ListViceInodes(dev, salvinfo->fileSysPath, inodeFile,
@@ -1992,10 +2050,8 @@ DoSalvageVolumeGroup(struct SalvInfo *salvinfo, struct InodeSummary *isp, int nV
     }
     if (ShowMounts && !haveRWvolume)
 	return;
-    if (canfork && !debug && Fork() != 0) {
-	(void)Wait("Salvage volume group");
+    if (canfork && !debug && ForkVolumeGroup() != 0)
 	return;
-    }
     for (i = 0, totalInodes = 0; i < nVols; i++)
 	totalInodes += isp[i].nInodes;
     size = totalInodes * sizeof(struct ViceInodeInfo);
@@ -2003,10 +2059,9 @@ DoSalvageVolumeGroup(struct SalvInfo *salvinfo, struct InodeSummary *isp, int nV
     allInodes = inodes - isp->index;	/* this would the base of all the inodes
 					 * for the partition, if all the inodes
 					 * had been read into memory */
-    opr_Verify(OS_SEEK
-	   (salvinfo->inodeFd, isp->index * sizeof(struct ViceInodeInfo),
-	    SEEK_SET) != -1);
-    opr_Verify(OS_READ(salvinfo->inodeFd, inodes, size) == size);
+    /* other volume groups may be reading the same inode file at once */
+    opr_Verify(OS_PREAD(salvinfo->inodeFd, inodes, size,
+			isp->index * sizeof(struct ViceInodeInfo)) == size);
 
     /* Don't try to salvage a read write volume if there isn't one on this
      * partition */
@@ -2099,6 +2154,9 @@ DoSalvageVolumeGroup(struct SalvInfo *salvinfo, struct InodeSummary *isp, int nV
 	if (!Showmode)
 	    Log("%s VOLUME %" AFS_VOLID_FMT "%s.\n", rw ? "SALVAGING" : "CHECKING CLONED",
 		afs_printable_VolumeId_lu(lisp->volumeId), (Testing ? "(READONLY mode)" : ""));
+	/* The vnodes we fix won't be in the volume's changed-vnode log */
+	if (!Testing)
+	    VChangeLogDestroy(salvinfo->fileSysPartition, lisp->volumeId);
 	/* Check inodes twice.  The second time do things seriously.  This
 	 * way the whole RO volume can be deleted, below, if anything goes wrong */
 	for (check = 1; check >= 0; check--) {
@@ -4775,6 +4833,46 @@ Fork(void)
     return f;
 }
 
+/* Number of volume group children of this partition salvage still running. */
+static int nGroupJobs = 0;
+
+/**
+ * fork a child to salvage a volume group.
+ *
+ * The parent goes on to the next volume group straight away while fewer
+ * than GroupParallel children are running; otherwise it first waits for
+ * one of them to finish.
+ *
+ * @return Fork() result: 0 in the child, the child's pid in the parent
+ */
+static int
+ForkVolumeGroup(void)
+{
+    int f;
+
+    f = Fork();
+    if (f != 0) {
+	nGroupJobs++;
+	if (nGroupJobs >= GroupParallel) {
+	    (void)Wait("Salvage volume group");
+	    nGroupJobs--;
+	}
+    }
+    return f;
+}
+
+/**
+ * wait for every outstanding volume group child to finish.
+ */
+static void
+WaitVolumeGroups(void)
+{
+    while (nGroupJobs > 0) {
+	(void)Wait("Salvage volume group");
+	nGroupJobs--;
+    }
+}
+
 static void
 QuietExit(int code)
 {
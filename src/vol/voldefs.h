@@ -68,6 +68,9 @@
 #endif
 #define	VHDRNAMELEN (VFORMATDIGITS + 1 + sizeof(VHDREXT) - 1) /* must match VFORMAT */
 
+/* Changed-vnode log of a volume, kept beside its header; see vnode.c */
+#define VCHGFORMAT "V%010" AFS_VOLID_FMT ".chg"
+
 /* Maximum length (including trailing NUL) of a volume external path name. */
 #define VMAXPATHLEN 64
 
@@ -163,6 +163,7 @@ static void ReleaseVolumeHeader(struct volHeader *hd);
 static void FreeVolumeHeader(Volume * vp);
 static void AddVolumeToHashTable(Volume * vp, VolumeId hashid);
 static void DeleteVolumeFromHashTable(Volume * vp);
+static void VGrowVolumeHash_r(void);
 #if 0
 static int VHold(Volume * vp);
 #endif
@@ -201,6 +202,13 @@ pthread_t vol_glock_holder = 0;
 #define VOLUME_HASH(volumeId) \
     (opr_jhash_int(volumeId, 0) & VolumeHashTable.Mask)
 
+/*
+ * the hash table doubles in size whenever the average chain grows longer
+ * than this, up to 2^VOLUME_HASH_MAX_BITS buckets
+ */
+#define VOLUME_HASH_MAX_LOAD 4
+#define VOLUME_HASH_MAX_BITS 28
+
 /*
  * turn volume hash chains into partially ordered lists.
  * when the threshold is exceeded between two adjacent elements,
@@ -232,13 +240,66 @@ pthread_t vol_glock_holder = 0;
 VolumeHashTable_t VolumeHashTable = {
     DEFAULT_VOLUME_HASH_SIZE,
     DEFAULT_VOLUME_HASH_MASK,
-    NULL
+    NULL,
+    0,
+    0
 };
 
 
 static void VInitVolumeHash(void);
 
 
+/*
+ * VLRU state, saved at shutdown and every few minutes while the
+ * fileserver runs.  The next startup attaches the volumes listed here
+ * ahead of everything else on the partitions, then loads the vnodes they
+ * had cached.  The file is a VLRU_DiskHeader, then num_records
+ * VLRU_DiskEntry records, most recently used volume first, then the
+ * num_vnodes vnode ids of those volumes, in the same order.
+ */
+#define VLRU_DISK_MAGIC      0x7a8b9cad        /**< vlru disk entry magic number */
+#define VLRU_DISK_VERSION    2                 /**< vlru disk entry version number */
+
+/** vlru default expiration time */
+#define VLRU_DUMP_EXPIRATION_TIME   (60*60*24*7)  /* expire vlru data after 1 week */
+
+struct VLRU_DiskHeader {
+    struct versionStamp stamp;            /* magic and structure version number */
+    afs_uint32 mtime;                     /* time of dump to disk */
+    afs_uint32 num_records;               /* number of VLRU_DiskEntry records */
+    afs_uint32 num_vnodes;                /* number of vnode ids after them */
+};
+
+struct VLRU_DiskEntry {
+    VolumeId vid;                         /* volume ID */
+    afs_uint32 part;                      /* partition index */
+    afs_uint32 idx;                       /* generation */
+    afs_uint32 last_get;                  /* timestamp of last get */
+    afs_uint32 num_vnodes;                /* number of cached vnode ids */
+};
+
+static int VSaveVLRUState_r(void);
+static void VShutdownSaveVLRUState_r(void);
+
+/**
+ * startup attach progress, reported by VGetAttachStats.
+ *
+ * protected by VOL_LOCK
+ */
+static struct {
+    afs_int32 found;        /**< volumes found on the partitions */
+    afs_int32 done;         /**< volumes attached (DAFS: preattached) */
+    afs_int32 failed;       /**< volumes which were not attached */
+    afs_int32 hot;          /**< volumes queued from the saved VLRU state */
+    afs_int32 hotDone;      /**< hot volumes attached */
+    afs_int32 hotFailed;    /**< hot volumes which were not attached */
+    int scanning;           /**< partition scan still running */
+    int background;         /**< DAFS: attaching hot volumes after VInit 2 */
+    afs_uint32 start;       /**< time the attach began */
+    afs_uint32 phaseStart;  /**< time the background attach began */
+    afs_uint32 end;         /**< time the attach finished */
+} vinit_attach_stats;
+
 #ifdef AFS_PTHREAD_ENV
 /**
  * disk partition queue element
@@ -248,18 +309,6 @@ typedef struct diskpartition_queue_t {
     struct DiskPartition64 *diskP;     /**< disk partition table entry */
 } diskpartition_queue_t;
 
-#ifndef AFS_DEMAND_ATTACH_FS
-
-typedef struct vinitvolumepackage_thread_t {
-    struct rx_queue queue;
-    pthread_cond_t thread_done_cv;
-    int n_threads_complete;
-} vinitvolumepackage_thread_t;
-static void * VInitVolumePackageThread(void * args);
-
-#else  /* !AFS_DEMAND_ATTTACH_FS */
-#define VINIT_BATCH_MAX_SIZE 512
-
 /**
  * disk partition work queue
  */
@@ -269,6 +318,67 @@ struct partition_queue {
     pthread_cond_t cv;
 };
 
+/**
+ * volume attach work item
+ */
+struct vinit_attach_item {
+    VolumeId vid;                      /**< volume id */
+    struct DiskPartition64 *diskP;     /**< partition holding the volume */
+    afs_uint32 idx;                    /**< saved VLRU generation */
+    afs_uint32 last_get;               /**< saved VLRU access time */
+    VnodeId *vnodes;                   /**< vnodes cached at the last save */
+    int nvnodes;                       /**< number of cached vnodes */
+};
+
+/**
+ * volume attach work queue.  Volumes from the saved VLRU state are handed
+ * out first, most recently used first; then the volumes found by the
+ * partition scan, in the order they were found.
+ */
+struct vinit_attach_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;                 /**< work queued, or scan over */
+    pthread_cond_t done_cv;            /**< a thread finished */
+    struct vinit_attach_item *hot;     /**< volumes from the saved VLRU state */
+    struct vinit_attach_item *hotById; /**< hot, sorted by volume id */
+    int nhot;                          /**< number of hot volumes */
+    int nexthot;                       /**< next hot volume to attach */
+    VnodeId *vnodes;                   /**< vnode ids of all hot volumes */
+    struct vinit_attach_item *found;   /**< other volumes found by the scan */
+    int nfound;                        /**< number of found volumes */
+    int maxfound;                      /**< allocated size of found */
+    int nextfound;                     /**< next found volume to attach */
+    int scanners;                      /**< partition scan threads running */
+    int workers;                       /**< attach threads running */
+};
+static struct vinit_attach_queue vinit_attach_queue;
+
+static struct DiskPartition64 *VInitNextPartition(struct partition_queue *pq);
+static int VInitLoadAttachOrder(struct vinit_attach_queue *aq);
+static int VInitIsHot(struct vinit_attach_queue *aq, VolumeId vid,
+		      struct DiskPartition64 *diskP);
+static void VInitFreeAttachQueue(struct vinit_attach_queue *aq);
+static void VInitStartPreloadThreads(void);
+static void *VInitPreloadThread(void *args);
+static int vinit_attach_workers = 0;	/* background preload threads running */
+static int vinit_vnode_preloads[nVNODECLASSES]; /* vnodes preloaded */
+static pthread_cond_t vlru_save_cond;	/* signalled when a save finishes */
+
+#ifndef AFS_DEMAND_ATTACH_FS
+
+/**
+ * volume init partition scan thread parameters
+ */
+typedef struct vinitvolumepackage_thread_t {
+    struct partition_queue *pq;        /**< partitions to scan */
+    struct vinit_attach_queue *aq;     /**< queue of volumes to attach */
+} vinitvolumepackage_thread_t;
+static void * VInitVolumePackageThread(void * args);
+static void * VInitAttachThread(void * args);
+
+#else  /* !AFS_DEMAND_ATTTACH_FS */
+#define VINIT_BATCH_MAX_SIZE 512
+
 /**
  * volumes parameters for preattach
  */
@@ -297,49 +407,31 @@ struct vinitvolumepackage_thread_param {
     int thread;                          /**< thread number for this worker thread */
     struct partition_queue *pq;          /**< queue partitions to scan */
     struct volume_init_queue *vq;        /**< queue of volume to preattach */
+    struct vinit_attach_queue *aq;       /**< hot volumes, preattached first */
 };
 
 static void *VInitVolumePackageThread(void *args);
-static struct DiskPartition64 *VInitNextPartition(struct partition_queue *pq);
 static VolumeId VInitNextVolumeId(DIR *dirp);
+static Volume *VInitNewVolume(struct DiskPartition64 *partition, VolumeId vid);
+static int VInitPreAttachVolume_r(Volume *vp);
+static void VInitPreAttachHotVolumes(struct vinit_attach_queue *aq);
 static int VInitPreAttachVolumes(int nthreads, struct volume_init_queue *vq);
 
 #endif /* !AFS_DEMAND_ATTACH_FS */
 #endif /* AFS_PTHREAD_ENV */
 
-#ifndef AFS_DEMAND_ATTACH_FS
+static int vinit_preload_done = 0;	/* hot volumes all brought up */
+static int vlru_saving = 0;		/* VSaveVLRUState_r in progress */
+
+#if !defined(AFS_PTHREAD_ENV)
 static int VAttachVolumesByPartition(struct DiskPartition64 *diskP,
 				     int * nAttached, int * nUnattached);
-#endif /* AFS_DEMAND_ATTACH_FS */
+#endif /* !AFS_PTHREAD_ENV */
 
 
 #ifdef AFS_DEMAND_ATTACH_FS
 /* demand attach fileserver extensions */
 
-/* XXX
- * in the future we will support serialization of VLRU state into the fs_state
- * disk dumps
- *
- * these structures are the beginning of that effort
- */
-struct VLRU_DiskHeader {
-    struct versionStamp stamp;            /* magic and structure version number */
-    afs_uint32 mtime;                     /* time of dump to disk */
-    afs_uint32 num_records;               /* number of VLRU_DiskEntry records */
-};
-
-struct VLRU_DiskEntry {
-    VolumeId vid;                       /* volume ID */
-    afs_uint32 idx;                       /* generation */
-    afs_uint32 last_get;                  /* timestamp of last get */
-};
-
-struct VLRU_StartupQueue {
-    struct VLRU_DiskEntry * entry;
-    int num_entries;
-    int next_idx;
-};
-
 typedef struct vshutdown_thread_t {
     struct rx_queue q;
     pthread_mutex_t lock;
@@ -414,6 +506,9 @@ static int VCheckSoftDetach(Volume * vp, afs_uint32 thresh);
 static int VCheckSoftDetachCandidate(Volume * vp, afs_uint32 thresh);
 static int VSoftDetachVolume_r(Volume * vp, afs_uint32 thresh);
 
+/* usage bumps from vnode gets made without VOL_LOCK */
+static int VTakeFastUsage_r(Volume * vp);
+
 
 pthread_key_t VThread_key;
 VThreadOptions_t VThread_defaults = {
@@ -582,6 +677,9 @@ VInitVolumePackage2(ProgramType pt, VolumePackageOptions * opts)
     opr_cv_init(&vol_sleep_cond);
     opr_cv_init(&vol_init_attach_cond);
     opr_cv_init(&vol_vinit_cond);
+#ifdef AFS_PTHREAD_ENV
+    opr_cv_init(&vlru_save_cond);
+#endif
 #ifndef AFS_PTHREAD_ENV
     IOMGR_Initialize();
 #endif /* AFS_PTHREAD_ENV */
@@ -669,6 +767,7 @@ VInitAttachVolumes(ProgramType pt)
     opr_Assert(VInit==1);
     if (pt == fileServer) {
 	struct DiskPartition64 *diskP;
+	vinit_attach_stats.start = time(NULL);
 	/* Attach all the volumes in this partition */
 	for (diskP = DiskPartitionList; diskP; diskP = diskP->next) {
 	    int nAttached = 0, nUnattached = 0;
@@ -676,8 +775,10 @@ VInitAttachVolumes(ProgramType pt)
 						 &nAttached, &nUnattached)
 			    == 0);
 	}
+	vinit_attach_stats.end = time(NULL);
     }
     VOL_LOCK;
+    vinit_preload_done = 1;		/* nothing is preloaded without threads */
     VSetVInit_r(2);			/* Initialized, and all volumes have been attached */
     LWP_NoYieldSignal(VInitAttachVolumes);
     VOL_UNLOCK;
@@ -685,6 +786,359 @@ VInitAttachVolumes(ProgramType pt)
 }
 #endif /* !AFS_PTHREAD_ENV */
 
+#ifdef AFS_PTHREAD_ENV
+/**
+ * Read next element from the pre-populated partition list.
+ */
+static struct DiskPartition64*
+VInitNextPartition(struct partition_queue *pq)
+{
+    struct DiskPartition64 *partition;
+    struct diskpartition_queue_t *dp; /* queue element */
+
+    if (vinit_attach_abort) {
+        Log("Aborting volume preattach thread.\n");
+        return NULL;
+    }
+
+    /* get next partition to scan */
+    opr_mutex_enter(&pq->mutex);
+    if (queue_IsEmpty(pq)) {
+	opr_mutex_exit(&pq->mutex);
+        return NULL;
+    }
+    dp = queue_First(pq, diskpartition_queue_t);
+    queue_Remove(dp);
+    opr_mutex_exit(&pq->mutex);
+
+    opr_Assert(dp);
+    opr_Assert(dp->diskP);
+
+    partition = dp->diskP;
+    free(dp);
+    return partition;
+}
+
+static int
+VInitCompareItems(const void *a, const void *b)
+{
+    const struct vinit_attach_item *ia = a;
+    const struct vinit_attach_item *ib = b;
+
+    if (ia->vid != ib->vid)
+	return ia->vid < ib->vid ? -1 : 1;
+    if (ia->diskP->index != ib->diskP->index)
+	return ia->diskP->index < ib->diskP->index ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Does a volume header exist for this volume on this partition?
+ */
+static int
+VInitHeaderExists(struct DiskPartition64 *diskP, VolumeId vid)
+{
+    char path[VMAXPATHLEN];
+    struct afs_stat_st status;
+
+    snprintf(path, sizeof(path), "%s" OS_DIRSEP VFORMAT,
+	     VPartitionPath(diskP), afs_printable_VolumeId_lu(vid));
+    return afs_stat(path, &status) == 0;
+}
+
+/**
+ * Read the VLRU state saved by the last fileserver, and queue the volumes
+ * it lists to be attached ahead of the partition scan, most recently
+ * used first, along with the vnodes they had cached.
+ *
+ * Volumes on partitions we do not have, and volumes whose header is gone,
+ * are left out.  A missing, stale or damaged state file just means that no
+ * volumes are attached ahead of the rest.
+ *
+ * @param[in] aq  attach work queue
+ *
+ * @return number of volumes queued
+ */
+static int
+VInitLoadAttachOrder(struct vinit_attach_queue *aq)
+{
+    const char *path = AFSDIR_SERVER_VLRUSTATE_FILEPATH;
+    struct VLRU_DiskHeader hdr;
+    struct VLRU_DiskEntry *entries = NULL;
+    struct afs_stat_st status;
+    VnodeId *vnodes;
+    afs_uint64 nvnodes;
+    size_t len, vlen;
+    int fd, n = 0;
+    afs_uint32 i;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return 0;
+
+    if (afs_fstat(fd, &status) < 0
+	|| read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	|| hdr.stamp.magic != VLRU_DISK_MAGIC
+	|| hdr.stamp.version != VLRU_DISK_VERSION
+	|| status.st_size != sizeof(hdr) +
+		(afs_uint64)hdr.num_records * sizeof(struct VLRU_DiskEntry) +
+		(afs_uint64)hdr.num_vnodes * sizeof(VnodeId)) {
+	Log("VInitVolumePackage: %s is not a valid VLRU state file; "
+	    "ignoring it\n", path);
+	goto done;
+    }
+    if (hdr.num_records == 0)
+	goto done;
+    if (hdr.mtime + VLRU_DUMP_EXPIRATION_TIME < time(NULL)) {
+	Log("VInitVolumePackage: %s is more than a week old; ignoring it\n",
+	    path);
+	goto done;
+    }
+
+    len = hdr.num_records * sizeof(struct VLRU_DiskEntry);
+    vlen = hdr.num_vnodes * sizeof(VnodeId);
+    entries = malloc(len);
+    aq->hot = malloc(hdr.num_records * sizeof(struct vinit_attach_item));
+    aq->vnodes = malloc(vlen ? vlen : 1);
+    opr_Assert(entries != NULL && aq->hot != NULL && aq->vnodes != NULL);
+    if (read(fd, entries, len) != len
+	|| (vlen > 0 && read(fd, aq->vnodes, vlen) != vlen)) {
+	Log("VInitVolumePackage: error reading %s, errno=%d; ignoring it\n",
+	    path, errno);
+	goto done;
+    }
+    for (nvnodes = 0, i = 0; i < hdr.num_records; i++) {
+	nvnodes += entries[i].num_vnodes;
+    }
+    if (nvnodes != hdr.num_vnodes) {
+	Log("VInitVolumePackage: %s is not a valid VLRU state file; "
+	    "ignoring it\n", path);
+	goto done;
+    }
+
+    for (vnodes = aq->vnodes, i = 0; i < hdr.num_records;
+	 vnodes += entries[i].num_vnodes, i++) {
+	struct DiskPartition64 *diskP;
+
+	for (diskP = DiskPartitionList; diskP; diskP = diskP->next) {
+	    if (diskP->index == entries[i].part)
+		break;
+	}
+	if (diskP == NULL || !VInitHeaderExists(diskP, entries[i].vid))
+	    continue;
+	aq->hot[n].vid = entries[i].vid;
+	aq->hot[n].diskP = diskP;
+	aq->hot[n].idx = entries[i].idx;
+	aq->hot[n].last_get = entries[i].last_get;
+	aq->hot[n].vnodes = vnodes;
+	aq->hot[n].nvnodes = entries[i].num_vnodes;
+	n++;
+    }
+
+    if (n > 0) {
+	/* sorted copy, so the partition scan can skip the hot volumes */
+	aq->hotById = malloc(n * sizeof(struct vinit_attach_item));
+	opr_Assert(aq->hotById != NULL);
+	memcpy(aq->hotById, aq->hot, n * sizeof(struct vinit_attach_item));
+	qsort(aq->hotById, n, sizeof(struct vinit_attach_item),
+	      VInitCompareItems);
+    }
+    Log("VInitVolumePackage: %d of %u recently used volumes will be "
+	"attached first\n", n, hdr.num_records);
+
+  done:
+    close(fd);
+    free(entries);
+    if (n == 0) {
+	free(aq->hot);
+	free(aq->vnodes);
+	aq->hot = NULL;
+	aq->vnodes = NULL;
+    }
+    aq->nhot = n;
+
+    VOL_LOCK;
+    vinit_attach_stats.hot = n;
+    VOL_UNLOCK;
+    return n;
+}
+
+/**
+ * Is this volume one of the hot volumes already queued from the saved
+ * VLRU state?
+ */
+static int
+VInitIsHot(struct vinit_attach_queue *aq, VolumeId vid,
+	   struct DiskPartition64 *diskP)
+{
+    struct vinit_attach_item key;
+
+    if (aq->nhot == 0)
+	return 0;
+    key.vid = vid;
+    key.diskP = diskP;
+    return bsearch(&key, aq->hotById, aq->nhot,
+		   sizeof(struct vinit_attach_item), VInitCompareItems) != NULL;
+}
+
+/**
+ * Free the work lists of an attach work queue.
+ */
+static void
+VInitFreeAttachQueue(struct vinit_attach_queue *aq)
+{
+    free(aq->hot);
+    free(aq->hotById);
+    free(aq->found);
+    free(aq->vnodes);
+    aq->hot = aq->hotById = aq->found = NULL;
+    aq->vnodes = NULL;
+    aq->nhot = aq->nexthot = 0;
+    aq->nfound = aq->maxfound = aq->nextfound = 0;
+}
+
+/**
+ * Start bringing the hot volumes up in the background, most recently used
+ * first, so they are ready before clients come back for them.  Each one
+ * is attached if need be, the way a client request would attach it, and
+ * the vnodes it had cached are loaded again.
+ */
+static void
+VInitStartPreloadThreads(void)
+{
+    struct vinit_attach_queue *aq = &vinit_attach_queue;
+    int i, threads;
+    pthread_t tid;
+    pthread_attr_t attrs;
+
+    threads = min(aq->nhot, max(vol_attach_threads, 1));
+
+    VOL_LOCK;
+    if (threads == 0 || vinit_attach_abort) {
+	if (vinit_attach_stats.end == 0)
+	    vinit_attach_stats.end = time(NULL);
+	if (!vinit_attach_abort)
+	    vinit_preload_done = 1;
+	VOL_UNLOCK;
+	VInitFreeAttachQueue(aq);
+	opr_cv_destroy(&aq->done_cv);
+	opr_cv_destroy(&aq->cv);
+	opr_mutex_destroy(&aq->mutex);
+	return;
+    }
+#ifdef AFS_DEMAND_ATTACH_FS
+    vinit_attach_stats.background = 1;
+    vinit_attach_stats.phaseStart = time(NULL);
+#endif
+    vinit_attach_workers = threads;
+    VOL_UNLOCK;
+
+    Log("VInitVolumePackage: using %d threads to preload %d recently used "
+	"volumes\n", threads, aq->nhot);
+
+    aq->nexthot = 0;
+    opr_Verify(pthread_attr_init(&attrs) == 0);
+    opr_Verify(pthread_attr_setdetachstate(&attrs,
+					   PTHREAD_CREATE_DETACHED) == 0);
+    for (i = 0; i < threads; i++) {
+	AFS_SIGSET_DECL;
+	AFS_SIGSET_CLEAR();
+	opr_Verify(pthread_create(&tid, &attrs, &VInitPreloadThread, aq) == 0);
+	AFS_SIGSET_RESTORE();
+    }
+    opr_Verify(pthread_attr_destroy(&attrs) == 0);
+}
+
+/**
+ * Load the vnodes a hot volume had cached when the VLRU state was saved,
+ * as long as the vnode caches have room for them.
+ *
+ * @pre VOL_LOCK held, and a reference held on vp
+ */
+static void
+VInitPreloadVnodes_r(Volume *vp, struct vinit_attach_item *item)
+{
+    Vnode *vnp;
+    Error ec;
+    int i;
+
+    for (i = 0; i < item->nvnodes && !vinit_attach_abort; i++) {
+	VnodeClass class = vnodeIdToClass(item->vnodes[i]);
+
+	if (vinit_vnode_preloads[class] >= VnodeClassInfo[class].cacheSize)
+	    continue;
+	vnp = VGetVnode_r(&ec, vp, item->vnodes[i], READ_LOCK);
+	if (vnp == NULL)
+	    continue;
+	VPutVnode_r(&ec, vnp);
+	vinit_vnode_preloads[class]++;
+    }
+}
+
+/**
+ * Background preload thread.  Work through the hot volumes until they
+ * have all been brought up or the fileserver shuts down.  The last thread
+ * out frees the work queue.
+ */
+static void *
+VInitPreloadThread(void *args)
+{
+    struct vinit_attach_queue *aq = (struct vinit_attach_queue *)args;
+    struct vinit_attach_item item;
+    Volume *vp;
+    Error ec;
+
+    opr_mutex_enter(&aq->mutex);
+    while (!vinit_attach_abort && aq->nexthot < aq->nhot) {
+	item = aq->hot[aq->nexthot++];
+	opr_mutex_exit(&aq->mutex);
+
+	VOL_LOCK;
+	vp = VGetVolume_r(&ec, item.vid);
+	if (vp) {
+#ifdef AFS_DEMAND_ATTACH_FS
+	    vinit_attach_stats.hotDone++;
+	    /* our get is not a use; keep the access time that was saved */
+	    if (item.last_get)
+		vp->stats.last_get = item.last_get;
+#endif
+	    VInitPreloadVnodes_r(vp, &item);
+	    VPutVolume_r(vp);
+	} else {
+#ifdef AFS_DEMAND_ATTACH_FS
+	    vinit_attach_stats.hotFailed++;
+#endif
+	    if (GetLogLevel() >= 5)
+		Log("VInitPreloadThread: volume %" AFS_VOLID_FMT " not "
+		    "available, error=%d\n",
+		    afs_printable_VolumeId_lu(item.vid), ec);
+	}
+	VOL_UNLOCK;
+
+	opr_mutex_enter(&aq->mutex);
+    }
+    opr_mutex_exit(&aq->mutex);
+
+    VOL_LOCK;
+    if (--vinit_attach_workers == 0) {
+	if (vinit_attach_stats.end == 0)
+	    vinit_attach_stats.end = time(NULL);
+	if (!vinit_attach_abort)
+	    vinit_preload_done = 1;
+	Log("VInitVolumePackage: preloaded recently used volumes, with %d "
+	    "large and %d small vnodes\n",
+	    vinit_vnode_preloads[vLarge], vinit_vnode_preloads[vSmall]);
+	VInitFreeAttachQueue(aq);
+	opr_cv_destroy(&aq->done_cv);
+	opr_cv_destroy(&aq->cv);
+	opr_mutex_destroy(&aq->mutex);
+    }
+    opr_cv_broadcast(&vol_init_attach_cond);
+    VOL_UNLOCK;
+    return NULL;
+}
+#endif /* AFS_PTHREAD_ENV */
+
 #if defined(AFS_PTHREAD_ENV) && !defined(AFS_DEMAND_ATTACH_FS)
 /**
  * Attach volumes in vice partitions
@@ -692,7 +1146,10 @@ VInitAttachVolumes(ProgramType pt)
  * @param[in]  pt         calling program type
  *
  * @return 0
- * @note Threaded version of attach parititions.
+ * @note Threaded version of attach parititions.  Scan threads, at most
+ *       one per partition, queue the volume headers they find; a pool of
+ *       vol_attach_threads attach threads works through the queue.  The
+ *       volumes in use at the last shutdown are attached first.
  *
  * @post VInit state is 2
  */
@@ -701,28 +1158,46 @@ VInitAttachVolumes(ProgramType pt)
 {
     opr_Assert(VInit==1);
     if (pt == fileServer) {
-	struct DiskPartition64 *diskP;
+	struct vinit_attach_queue *aq = &vinit_attach_queue;
 	struct vinitvolumepackage_thread_t params;
-	struct diskpartition_queue_t * dpq;
-	int i, threads, parts;
+	struct partition_queue pq;
+	struct DiskPartition64 *diskP;
+	int i, parts, scanners, workers;
 	pthread_t tid;
 	pthread_attr_t attrs;
 
-	opr_cv_init(&params.thread_done_cv);
-	queue_Init(&params);
-	params.n_threads_complete = 0;
-
 	/* create partition work queue */
-	for (parts=0, diskP = DiskPartitionList; diskP; diskP = diskP->next, parts++) {
+	queue_Init(&pq);
+	opr_cv_init(&pq.cv);
+	opr_mutex_init(&pq.mutex);
+	for (parts = 0, diskP = DiskPartitionList; diskP; diskP = diskP->next, parts++) {
+	    struct diskpartition_queue_t *dpq;
 	    dpq = malloc(sizeof(struct diskpartition_queue_t));
 	    opr_Assert(dpq != NULL);
 	    dpq->diskP = diskP;
-	    queue_Append(&params,dpq);
+	    queue_Append(&pq, dpq);
 	}
 
-	threads = min(parts, vol_attach_threads);
+	/* create volume work queue, starting with the hot volumes */
+	opr_mutex_init(&aq->mutex);
+	opr_cv_init(&aq->cv);
+	opr_cv_init(&aq->done_cv);
+	VOL_LOCK;
+	vinit_attach_stats.start = time(NULL);
+	vinit_attach_stats.scanning = 1;
+	VOL_UNLOCK;
+	VInitLoadAttachOrder(aq);
+	VOL_LOCK;
+	vinit_attach_stats.found += aq->nhot;
+	VOL_UNLOCK;
+
+	params.pq = &pq;
+	params.aq = aq;
+
+	scanners = min(parts, vol_attach_threads);
+	workers = max(vol_attach_threads, 1);
 
-	if (threads > 1) {
+	if (workers > 1) {
 	    /* spawn off a bunch of initialization threads */
 	    opr_Verify(pthread_attr_init(&attrs) == 0);
 	    opr_Verify(pthread_attr_setdetachstate(&attrs,
@@ -730,23 +1205,30 @@ VInitAttachVolumes(ProgramType pt)
 			    == 0);
 
 	    Log("VInitVolumePackage: beginning parallel fileserver startup\n");
-	    Log("VInitVolumePackage: using %d threads to attach volumes on %d partitions\n",
-		threads, parts);
+	    Log("VInitVolumePackage: using %d threads to scan %d partitions "
+		"and %d threads to attach volumes\n", scanners, parts, workers);
 
-	    VOL_LOCK;
-	    for (i=0; i < threads; i++) {
+	    aq->scanners = scanners;
+	    aq->workers = workers;
+	    for (i = 0; i < scanners + workers; i++) {
                 AFS_SIGSET_DECL;
                 AFS_SIGSET_CLEAR();
-		opr_Verify(pthread_create(&tid, &attrs,
-					  &VInitVolumePackageThread,
-					  &params) == 0);
+		if (i < scanners) {
+		    opr_Verify(pthread_create(&tid, &attrs,
+					      &VInitVolumePackageThread,
+					      &params) == 0);
+		} else {
+		    opr_Verify(pthread_create(&tid, &attrs,
+					      &VInitAttachThread, aq) == 0);
+		}
                 AFS_SIGSET_RESTORE();
 	    }
 
-	    while(params.n_threads_complete < threads) {
-		VOL_CV_WAIT(&params.thread_done_cv);
+	    opr_mutex_enter(&aq->mutex);
+	    while (aq->scanners > 0 || aq->workers > 0) {
+		opr_cv_wait(&aq->done_cv, &aq->mutex);
 	    }
-	    VOL_UNLOCK;
+	    opr_mutex_exit(&aq->mutex);
 
 	    opr_Verify(pthread_attr_destroy(&attrs) == 0);
 	} else {
@@ -756,54 +1238,192 @@ VInitAttachVolumes(ProgramType pt)
 	    Log("VInitVolumePackage: using 1 thread to attach volumes on %d partition(s)\n",
 		parts);
 
+	    aq->scanners = 1;
+	    aq->workers = 1;
 	    VInitVolumePackageThread(&params);
+	    VInitAttachThread(aq);
 	}
 
-	opr_cv_destroy(&params.thread_done_cv);
+	VOL_LOCK;
+	vinit_attach_stats.end = time(NULL);
+	Log("VInitVolumePackage: attached %d volumes; %d volumes not attached\n",
+	    vinit_attach_stats.done, vinit_attach_stats.failed);
+	VOL_UNLOCK;
+
+	/* the hot volumes are kept for the preload threads */
+	free(aq->found);
+	aq->found = NULL;
+	aq->nfound = aq->maxfound = aq->nextfound = 0;
+	opr_cv_destroy(&pq.cv);
+	opr_mutex_destroy(&pq.mutex);
     }
     VOL_LOCK;
     VSetVInit_r(2);			/* Initialized, and all volumes have been attached */
     opr_cv_broadcast(&vol_init_attach_cond);
     VOL_UNLOCK;
+
+    if (pt == fileServer) {
+	VInitStartPreloadThreads();
+    }
     return 0;
 }
 
+/**
+ * Volume package initialization scan thread.  Queue the volume headers
+ * found on each partition for the attach threads, leaving out the hot
+ * volumes, which are queued already.
+ */
 static void *
 VInitVolumePackageThread(void * args) {
 
+    struct vinitvolumepackage_thread_t *params;
+    struct vinit_attach_queue *aq;
     struct DiskPartition64 *diskP;
-    struct vinitvolumepackage_thread_t * params;
-    struct diskpartition_queue_t * dpq;
+    int last;
 
     params = (vinitvolumepackage_thread_t *) args;
+    aq = params->aq;
 
+    while ((diskP = VInitNextPartition(params->pq))) {
+	DIR *dirp;
+	struct dirent *dp;
+	int nFound = 0;
 
-    VOL_LOCK;
-    /* Attach all the volumes in this partition */
-    while (queue_IsNotEmpty(params)) {
-        int nAttached = 0, nUnattached = 0;
+	Log("Partition %s: scanning for volumes\n", diskP->name);
+	dirp = opendir(VPartitionPath(diskP));
+	if (!dirp) {
+	    Log("opendir on Partition %s failed!\n", diskP->name);
+	    continue;
+	}
 
-        if (vinit_attach_abort) {
-            Log("Aborting initialization\n");
-            goto done;
-        }
+	while ((dp = readdir(dirp))) {
+	    char *p;
+	    VolumeId vid;
 
-        dpq = queue_First(params,diskpartition_queue_t);
-	queue_Remove(dpq);
+	    if (vinit_attach_abort) {
+		Log("Partition %s: abort attach volumes\n", diskP->name);
+		break;
+	    }
+
+	    p = strrchr(dp->d_name, '.');
+	    if (p == NULL || strcmp(p, VHDREXT) != 0)
+		continue;
+	    vid = VolumeNumber(dp->d_name);
+	    if (!vid) {
+		Log("Warning: bogus volume header file: %s\n", dp->d_name);
+		continue;
+	    }
+	    if (VInitIsHot(aq, vid, diskP))
+		continue;
+
+	    opr_mutex_enter(&aq->mutex);
+	    if (aq->nfound == aq->maxfound) {
+		aq->maxfound = aq->maxfound ? aq->maxfound * 2 : 1024;
+		aq->found = realloc(aq->found,
+				    aq->maxfound * sizeof(struct vinit_attach_item));
+		opr_Assert(aq->found != NULL);
+	    }
+	    aq->found[aq->nfound].vid = vid;
+	    aq->found[aq->nfound].diskP = diskP;
+	    aq->nfound++;
+	    opr_cv_signal(&aq->cv);
+	    opr_mutex_exit(&aq->mutex);
+	    nFound++;
+	}
+	closedir(dirp);
+
+	Log("Partition %s: queued %d volumes to attach\n", diskP->name, nFound);
+	VOL_LOCK;
+	vinit_attach_stats.found += nFound;
 	VOL_UNLOCK;
-	diskP = dpq->diskP;
-	free(dpq);
+    }
 
-	opr_Verify(VAttachVolumesByPartition(diskP, &nAttached,
-					     &nUnattached) == 0);
+    opr_mutex_enter(&aq->mutex);
+    last = (--aq->scanners == 0);
+    if (last) {
+	/* wake idle attach threads so they can see the queue is complete */
+	opr_cv_broadcast(&aq->cv);
+    }
+    opr_cv_signal(&aq->done_cv);
+    opr_mutex_exit(&aq->mutex);
 
+    if (last) {
 	VOL_LOCK;
+	vinit_attach_stats.scanning = 0;
+	VOL_UNLOCK;
     }
+    return NULL;
+}
 
-done:
-    params->n_threads_complete++;
-    opr_cv_signal(&params->thread_done_cv);
+/**
+ * Attach one queued volume.
+ */
+static void
+VInitAttachVolume(struct vinit_attach_item *item, int hot)
+{
+    char name[VMAXPATHLEN];
+    Error error;
+    Volume *vp;
+
+    VolumeExternalName_r(item->vid, name, sizeof(name));
+
+    VOL_LOCK;
+    vp = VAttachVolumeByName_r(&error, item->diskP->name, name, V_VOLUPD);
+    if (vp) {
+	vinit_attach_stats.done++;
+	vinit_attach_stats.hotDone += hot;
+    } else {
+	vinit_attach_stats.failed++;
+	vinit_attach_stats.hotFailed += hot;
+    }
+    if (error == VOFFLINE)
+	Log("Volume %" AFS_VOLID_FMT " stays offline (/vice/offline/%s exists)\n",
+	    afs_printable_VolumeId_lu(item->vid), name);
+    else if (GetLogLevel() >= 5) {
+	Log("Partition %s: attached volume %" AFS_VOLID_FMT " (%s)\n",
+	    item->diskP->name, afs_printable_VolumeId_lu(item->vid), name);
+    }
+    if (vp) {
+	VPutVolume_r(vp);
+    }
     VOL_UNLOCK;
+}
+
+/**
+ * Volume package initialization attach thread.  Attach queued volumes,
+ * hot volumes first, until the partition scan is over and the queue has
+ * been drained.
+ */
+static void *
+VInitAttachThread(void * args)
+{
+    struct vinit_attach_queue *aq = (struct vinit_attach_queue *)args;
+    struct vinit_attach_item item;
+    int hot;
+
+    opr_mutex_enter(&aq->mutex);
+    while (!vinit_attach_abort) {
+	if (aq->nexthot < aq->nhot) {
+	    item = aq->hot[aq->nexthot++];
+	    hot = 1;
+	} else if (aq->nextfound < aq->nfound) {
+	    item = aq->found[aq->nextfound++];
+	    hot = 0;
+	} else if (aq->scanners > 0) {
+	    opr_cv_wait(&aq->cv, &aq->mutex);
+	    continue;
+	} else {
+	    break;
+	}
+	opr_mutex_exit(&aq->mutex);
+
+	VInitAttachVolume(&item, hot);
+
+	opr_mutex_enter(&aq->mutex);
+    }
+    aq->workers--;
+    opr_cv_signal(&aq->done_cv);
+    opr_mutex_exit(&aq->mutex);
     return NULL;
 }
 #endif /* AFS_PTHREAD_ENV && !AFS_DEMAND_ATTACH_FS */
@@ -815,7 +1435,9 @@ done:
  * @param[in]  pt         calling program type
  *
  * @return 0
- * @note Threaded version of attach partitions.
+ * @note Threaded version of attach partitions.  The volumes in use at the
+ *       last shutdown are preattached first, and attached in the
+ *       background once the rest have been preattached.
  *
  * @post VInit state is 2
  */
@@ -828,6 +1450,7 @@ VInitAttachVolumes(ProgramType pt)
 	struct DiskPartition64 *diskP;
 	struct partition_queue pq;
         struct volume_init_queue vq;
+	struct vinit_attach_queue *aq = &vinit_attach_queue;
 
 	int i, threads, parts;
 	pthread_t tid;
@@ -853,6 +1476,16 @@ VInitAttachVolumes(ProgramType pt)
 	opr_cv_init(&vq.cv);
 	opr_mutex_init(&vq.mutex);
 
+	/* hot volumes, from the saved VLRU state */
+	opr_mutex_init(&aq->mutex);
+	opr_cv_init(&aq->cv);
+	opr_cv_init(&aq->done_cv);
+	VOL_LOCK;
+	vinit_attach_stats.start = time(NULL);
+	vinit_attach_stats.scanning = 1;
+	VOL_UNLOCK;
+	VInitLoadAttachOrder(aq);
+
         opr_Verify(pthread_attr_init(&attrs) == 0);
         opr_Verify(pthread_attr_setdetachstate(&attrs,
 					       PTHREAD_CREATE_DETACHED) == 0);
@@ -870,6 +1503,7 @@ VInitAttachVolumes(ProgramType pt)
             opr_Assert(params);
             params->pq = &pq;
             params->vq = &vq;
+            params->aq = aq;
             params->nthreads = threads;
             params->thread = i+1;
 
@@ -880,6 +1514,7 @@ VInitAttachVolumes(ProgramType pt)
             AFS_SIGSET_RESTORE();
 	}
 
+        VInitPreAttachHotVolumes(aq);
         VInitPreAttachVolumes(threads, &vq);
 
         opr_Verify(pthread_attr_destroy(&attrs) == 0);
@@ -887,6 +1522,12 @@ VInitAttachVolumes(ProgramType pt)
 	opr_mutex_destroy(&pq.mutex);
 	opr_cv_destroy(&vq.cv);
 	opr_mutex_destroy(&vq.mutex);
+
+	VOL_LOCK;
+	vinit_attach_stats.scanning = 0;
+	Log("VInitVolumePackage: pre-attached %d volumes; %d volumes not "
+	    "pre-attached\n", vinit_attach_stats.done, vinit_attach_stats.failed);
+	VOL_UNLOCK;
     }
 
     VOL_LOCK;
@@ -894,9 +1535,32 @@ VInitAttachVolumes(ProgramType pt)
     opr_cv_broadcast(&vol_init_attach_cond);
     VOL_UNLOCK;
 
+    if (pt == fileServer) {
+	VInitStartPreloadThreads();
+    }
+
     return 0;
 }
 
+/**
+ * Allocate a volume object for preattach.
+ */
+static Volume *
+VInitNewVolume(struct DiskPartition64 *partition, VolumeId vid)
+{
+    Volume *vp = calloc(1, sizeof(Volume));
+
+    opr_Assert(vp);
+    vp->device = partition->device;
+    vp->partition = partition;
+    vp->hashid = vid;
+    queue_Init(&vp->vnode_list);
+    queue_Init(&vp->rx_call_list);
+    opr_cv_init(&V_attachCV(vp));
+    opr_mutex_init(&vp->usage_lock);
+    return vp;
+}
+
 /**
  * Volume package initialization worker thread. Scan partitions for volume
  * header files. Gather batches of volume ids and dispatch them to
@@ -937,16 +1601,12 @@ VInitVolumePackageThread(void *args)
             continue;
         }
         while ((vid = VInitNextVolumeId(dirp))) {
-            Volume *vp = calloc(1, sizeof(Volume));
-            opr_Assert(vp);
-            vp->device = partition->device;
-            vp->partition = partition;
-            vp->hashid = vid;
-            queue_Init(&vp->vnode_list);
-            queue_Init(&vp->rx_call_list);
-	    opr_cv_init(&V_attachCV(vp));
-
-            vb->batch[vb->size++] = vp;
+            if (VInitIsHot(params->aq, vid, partition)) {
+                /* preattached already */
+                continue;
+            }
+
+            vb->batch[vb->size++] = VInitNewVolume(partition, vid);
             if (vb->size == VINIT_BATCH_MAX_SIZE) {
 		opr_mutex_enter(&vq->mutex);
                 queue_Append(vq, vb);
@@ -974,38 +1634,6 @@ VInitVolumePackageThread(void *args)
     return NULL;
 }
 
-/**
- * Read next element from the pre-populated partition list.
- */
-static struct DiskPartition64*
-VInitNextPartition(struct partition_queue *pq)
-{
-    struct DiskPartition64 *partition;
-    struct diskpartition_queue_t *dp; /* queue element */
-
-    if (vinit_attach_abort) {
-        Log("Aborting volume preattach thread.\n");
-        return NULL;
-    }
-
-    /* get next partition to scan */
-    opr_mutex_enter(&pq->mutex);
-    if (queue_IsEmpty(pq)) {
-	opr_mutex_exit(&pq->mutex);
-        return NULL;
-    }
-    dp = queue_First(pq, diskpartition_queue_t);
-    queue_Remove(dp);
-    opr_mutex_exit(&pq->mutex);
-
-    opr_Assert(dp);
-    opr_Assert(dp->diskP);
-
-    partition = dp->diskP;
-    free(dp);
-    return partition;
-}
-
 /**
  * Find next volume id on the partition.
  */
@@ -1033,6 +1661,73 @@ VInitNextVolumeId(DIR *dirp)
     return vid;
 }
 
+/**
+ * Put a volume found at startup onto the hash table, and bring it up to
+ * the pre-attached state.
+ *
+ * @param[in] vp  volume object from VInitNewVolume
+ *
+ * @return 1 if the volume was pre-attached, 0 otherwise
+ *
+ * @pre VOL_LOCK held
+ */
+static int
+VInitPreAttachVolume_r(Volume *vp)
+{
+    Volume *dup;
+    Error ec = 0;
+
+    dup = VLookupVolume_r(&ec, vp->hashid, NULL);
+    if (ec) {
+        Log("Error looking up volume, code=%d\n", ec);
+        return 0;
+    }
+    if (dup) {
+        Log("Warning: Duplicate volume id %" AFS_VOLID_FMT " detected.\n", afs_printable_VolumeId_lu(vp->hashid));
+        return 0;
+    }
+    AddVolumeToHashTable(vp, vp->hashid);
+    AddVolumeToVByPList_r(vp);
+    VLRU_Init_Node_r(vp);
+    VChangeState_r(vp, VOL_STATE_PREATTACHED);
+    return 1;
+}
+
+/**
+ * Preattach the hot volumes ahead of the volumes found by the partition
+ * scan, a batch at a time, restoring their saved VLRU placement.
+ */
+static void
+VInitPreAttachHotVolumes(struct vinit_attach_queue *aq)
+{
+    int i, j, n, done;
+    Volume *batch[VINIT_BATCH_MAX_SIZE];
+
+    for (i = 0; i < aq->nhot; i += n) {
+	n = min(aq->nhot - i, VINIT_BATCH_MAX_SIZE);
+	for (j = 0; j < n; j++) {
+	    batch[j] = VInitNewVolume(aq->hot[i + j].diskP, aq->hot[i + j].vid);
+	}
+
+	VOL_LOCK;
+	for (done = 0, j = 0; j < n; j++) {
+	    struct vinit_attach_item *item = &aq->hot[i + j];
+
+	    if (!VInitPreAttachVolume_r(batch[j]))
+		continue;
+	    done++;
+	    /* put the volume back where it was in the VLRU when it attaches */
+	    batch[j]->stats.last_get = item->last_get;
+	    if (item->idx <= VLRU_QUEUE_OLD)
+		batch[j]->vlru.idx = item->idx;
+	}
+	vinit_attach_stats.found += n;
+	vinit_attach_stats.done += done;
+	vinit_attach_stats.failed += n - done;
+	VOL_UNLOCK;
+    }
+}
+
 /**
  * Preattach volumes in batches to avoid lock contention.
  */
@@ -1040,7 +1735,7 @@ static int
 VInitPreAttachVolumes(int nthreads, struct volume_init_queue *vq)
 {
     struct volume_init_batch *vb;
-    int i;
+    int i, done;
 
     while (nthreads) {
         /* dequeue next volume */
@@ -1054,28 +1749,12 @@ VInitPreAttachVolumes(int nthreads, struct volume_init_queue *vq)
 
         if (vb->size) {
             VOL_LOCK;
-            for (i = 0; i<vb->size; i++) {
-                Volume *vp;
-                Volume *dup;
-                Error ec = 0;
-
-                vp = vb->batch[i];
-	        dup = VLookupVolume_r(&ec, vp->hashid, NULL);
-                if (ec) {
-                    Log("Error looking up volume, code=%d\n", ec);
-                }
-                else if (dup) {
-                    Log("Warning: Duplicate volume id %" AFS_VOLID_FMT " detected.\n", afs_printable_VolumeId_lu(vp->hashid));
-                }
-                else {
-                    /* put pre-attached volume onto the hash table
-                     * and bring it up to the pre-attached state */
-                    AddVolumeToHashTable(vp, vp->hashid);
-                    AddVolumeToVByPList_r(vp);
-                    VLRU_Init_Node_r(vp);
-                    VChangeState_r(vp, VOL_STATE_PREATTACHED);
-                }
+            for (done = 0, i = 0; i < vb->size; i++) {
+                done += VInitPreAttachVolume_r(vb->batch[i]);
             }
+            vinit_attach_stats.found += vb->size;
+            vinit_attach_stats.done += done;
+            vinit_attach_stats.failed += vb->size - done;
             VOL_UNLOCK;
         }
 
@@ -1088,7 +1767,7 @@ VInitPreAttachVolumes(int nthreads, struct volume_init_queue *vq)
 }
 #endif /* AFS_DEMAND_ATTACH_FS */
 
-#if !defined(AFS_DEMAND_ATTACH_FS)
+#if !defined(AFS_PTHREAD_ENV)
 /*
  * attach all volumes on a given disk partition
  */
@@ -1121,6 +1800,8 @@ VAttachVolumesByPartition(struct DiskPartition64 *diskP, int * nAttached, int *
       vp = VAttachVolumeByName(&error, diskP->name, dp->d_name,
 			       V_VOLUPD);
       (*(vp ? nAttached : nUnattached))++;
+      vinit_attach_stats.found++;
+      (*(vp ? &vinit_attach_stats.done : &vinit_attach_stats.failed))++;
       if (error == VOFFLINE)
 	Log("Volume %d stays offline (/vice/offline/%s exists)\n", VolumeNumber(dp->d_name), dp->d_name);
       else if (GetLogLevel() >= 5) {
@@ -1139,7 +1820,57 @@ done:
   closedir(dirp);
   return ret;
 }
-#endif /* !AFS_DEMAND_ATTACH_FS */
+#endif /* !AFS_PTHREAD_ENV */
+
+/**
+ * Report the progress of the volume attach at startup.
+ *
+ * The estimate of the time left assumes volumes keep attaching at the
+ * rate seen so far; it is unknown until the partition scan is over.  On
+ * the demand attach fileserver, once everything has been pre-attached it
+ * covers the background attach of the recently used volumes.
+ *
+ * @param[out] stats  attach progress
+ */
+void
+VGetAttachStats(struct VAttachStats *stats)
+{
+    afs_uint32 now = time(NULL);
+    afs_uint32 since;
+    afs_int32 total, completed;
+
+    VOL_LOCK;
+    stats->found = vinit_attach_stats.found;
+    stats->attached = vinit_attach_stats.done;
+    stats->failed = vinit_attach_stats.failed;
+    stats->hot = vinit_attach_stats.hot;
+    stats->hotAttached = vinit_attach_stats.hotDone;
+    if (vinit_attach_stats.start == 0) {
+	stats->elapsed = 0;
+	stats->eta = -1;
+    } else if (vinit_attach_stats.end != 0) {
+	stats->elapsed = vinit_attach_stats.end - vinit_attach_stats.start;
+	stats->eta = 0;
+    } else {
+	stats->elapsed = now - vinit_attach_stats.start;
+	if (vinit_attach_stats.background) {
+	    total = vinit_attach_stats.hot;
+	    completed = vinit_attach_stats.hotDone + vinit_attach_stats.hotFailed;
+	    since = vinit_attach_stats.phaseStart;
+	} else {
+	    total = vinit_attach_stats.found;
+	    completed = vinit_attach_stats.done + vinit_attach_stats.failed;
+	    since = vinit_attach_stats.start;
+	}
+	if (vinit_attach_stats.scanning || completed == 0) {
+	    stats->eta = -1;
+	} else {
+	    stats->eta = (afs_int32)((double)(total - completed) *
+				     (now - since) / completed);
+	}
+    }
+    VOL_UNLOCK;
+}
 
 /***************************************************/
 /* Shutdown routines                               */
@@ -1216,6 +1947,15 @@ VShutdown_r(void)
         Log("VShutdown:  aborting attach volumes\n");
         vinit_attach_abort = 1;
         VOL_CV_WAIT(&vol_init_attach_cond);
+    } else {
+	if (vinit_attach_workers > 0) {
+	    Log("VShutdown:  aborting preload of recently used volumes\n");
+	    vinit_attach_abort = 1;
+	    while (vinit_attach_workers > 0) {
+		VOL_CV_WAIT(&vol_init_attach_cond);
+	    }
+	}
+	VShutdownSaveVLRUState_r();
     }
 
     for (params.n_parts=0, diskP = DiskPartitionList;
@@ -1345,6 +2085,17 @@ VShutdown_r(void)
 #else
         LWP_WaitProcess(VInitAttachVolumes);
 #endif /* AFS_PTHREAD_ENV */
+    } else {
+#ifdef AFS_PTHREAD_ENV
+	if (vinit_attach_workers > 0) {
+	    Log("VShutdown:  aborting preload of recently used volumes\n");
+	    vinit_attach_abort = 1;
+	    while (vinit_attach_workers > 0) {
+		VOL_CV_WAIT(&vol_init_attach_cond);
+	    }
+	}
+#endif /* AFS_PTHREAD_ENV */
+	VShutdownSaveVLRUState_r();
     }
 
     Log("VShutdown:  shutting down on-line volumes...\n");
@@ -1368,6 +2119,215 @@ VShutdown_r(void)
 #endif /* AFS_DEMAND_ATTACH_FS */
 
 
+/**
+ * a volume being saved to the VLRU state file, and where its vnode ids
+ * start in the vnode id list
+ */
+struct VSaveRecord {
+    struct VLRU_DiskEntry e;
+    afs_uint32 first;
+};
+
+static int
+VSaveCompareEntries(const void *a, const void *b)
+{
+    const struct VLRU_DiskEntry *ea = &((const struct VSaveRecord *)a)->e;
+    const struct VLRU_DiskEntry *eb = &((const struct VSaveRecord *)b)->e;
+
+    if (ea->last_get != eb->last_get)
+	return ea->last_get > eb->last_get ? -1 : 1;
+    if (ea->idx != eb->idx)
+	return ea->idx > eb->idx ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Save the volumes in use, and the vnodes they have cached, to the VLRU
+ * state file, most recently used first, so the next startup can bring
+ * them up ahead of the rest.
+ *
+ * On the demand attach fileserver these are the volumes used since they
+ * were attached, ordered by their last VGetVolume.  Otherwise they are
+ * the volumes whose headers are cached, ordered by access date.
+ *
+ * The volumes are collected under VOL_LOCK, which is then dropped while
+ * they are sorted and written out; saves are made one at a time.
+ *
+ * @return number of volumes saved, or -1 on error
+ *
+ * @pre VOL_LOCK held
+ */
+static int
+VSaveVLRUState_r(void)
+{
+    const char *path = AFSDIR_SERVER_VLRUSTATE_FILEPATH;
+    char tmp[AFSDIR_PATH_MAX];
+    struct VLRU_DiskHeader hdr;
+    struct VSaveRecord *records = NULL;
+    struct VLRU_DiskEntry *entries = NULL;
+    VnodeId *vnodes = NULL, *sorted = NULL;
+    size_t len, vlen;
+    int i, fd, n = 0, max = 0, code = -1;
+    afs_uint32 nvnodes = 0, maxvnodes = 0, j;
+    Volume *vp, *np;
+    Vnode *vnp, *nvnp;
+
+    if (programType != fileServer)
+	return 0;
+
+#ifdef AFS_PTHREAD_ENV
+    while (vlru_saving)
+	VOL_CV_WAIT(&vlru_save_cond);
+#endif
+    vlru_saving = 1;
+
+    for (i = 0; i < VolumeHashTable.Size; i++) {
+#ifdef AFS_DEMAND_ATTACH_FS
+	VHashWait_r(&VolumeHashTable.Table[i]);
+#endif
+	for (queue_Scan(&VolumeHashTable.Table[i], vp, np, Volume)) {
+	    struct VSaveRecord *r;
+
+	    if (!vp->partition)
+		continue;
+#ifdef AFS_DEMAND_ATTACH_FS
+	    if (!vp->stats.last_get)
+		continue;
+#else
+	    if (!vp->header)
+		continue;
+#endif
+	    if (n == max) {
+		max = max ? max * 2 : 1024;
+		records = realloc(records, max * sizeof(struct VSaveRecord));
+		opr_Assert(records != NULL);
+	    }
+	    r = &records[n++];
+	    r->e.vid = vp->hashid;
+	    r->e.part = vp->partition->index;
+#ifdef AFS_DEMAND_ATTACH_FS
+	    r->e.idx = vp->vlru.idx;
+	    r->e.last_get = vp->stats.last_get;
+#else
+	    r->e.idx = 0;
+	    r->e.last_get = V_accessDate(vp);
+#endif
+	    r->e.num_vnodes = 0;
+	    r->first = nvnodes;
+
+	    for (queue_Scan(&vp->vnode_list, vnp, nvnp, Vnode)) {
+		if (Vn_cacheCheck(vnp) != vp->cacheCheck
+		    || vnp->disk.type == vNull || vnp->delete)
+		    continue;
+#ifdef AFS_DEMAND_ATTACH_FS
+		if (Vn_state(vnp) == VN_STATE_INVALID
+		    || Vn_state(vnp) == VN_STATE_ERROR)
+		    continue;
+#endif
+		if (nvnodes == maxvnodes) {
+		    maxvnodes = maxvnodes ? maxvnodes * 2 : 4096;
+		    vnodes = realloc(vnodes, maxvnodes * sizeof(VnodeId));
+		    opr_Assert(vnodes != NULL);
+		}
+		vnodes[nvnodes++] = Vn_id(vnp);
+		r->e.num_vnodes++;
+	    }
+	}
+    }
+    VOL_UNLOCK;
+
+    if (n > 1)
+	qsort(records, n, sizeof(struct VSaveRecord), VSaveCompareEntries);
+
+    /* lay the records and their vnode ids out in file order */
+    len = n * sizeof(struct VLRU_DiskEntry);
+    vlen = nvnodes * sizeof(VnodeId);
+    entries = malloc(len ? len : 1);
+    sorted = malloc(vlen ? vlen : 1);
+    opr_Assert(entries != NULL && sorted != NULL);
+    for (nvnodes = 0, i = 0; i < n; i++) {
+	entries[i] = records[i].e;
+	for (j = 0; j < records[i].e.num_vnodes; j++) {
+	    sorted[nvnodes++] = vnodes[records[i].first + j];
+	}
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.stamp.magic = VLRU_DISK_MAGIC;
+    hdr.stamp.version = VLRU_DISK_VERSION;
+    hdr.mtime = time(NULL);
+    hdr.num_records = n;
+    hdr.num_vnodes = nvnodes;
+
+    snprintf(tmp, sizeof(tmp), "%s.new", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+	Log("VSaveVLRUState:  unable to create %s, errno=%d\n", tmp, errno);
+	goto done;
+    }
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	|| (len > 0 && write(fd, entries, len) != len)
+	|| (vlen > 0 && write(fd, sorted, vlen) != vlen)) {
+	Log("VSaveVLRUState:  error writing %s, errno=%d\n", tmp, errno);
+	close(fd);
+	unlink(tmp);
+	goto done;
+    }
+    if (close(fd) < 0 || rename(tmp, path) < 0) {
+	Log("VSaveVLRUState:  unable to save %s, errno=%d\n", path, errno);
+	unlink(tmp);
+	goto done;
+    }
+    code = n;
+
+  done:
+    free(records);
+    free(entries);
+    free(vnodes);
+    free(sorted);
+
+    VOL_LOCK;
+    vlru_saving = 0;
+#ifdef AFS_PTHREAD_ENV
+    opr_cv_broadcast(&vlru_save_cond);
+#endif
+    return code;
+}
+
+static void
+VShutdownSaveVLRUState_r(void)
+{
+    int n;
+
+    if (!vinit_preload_done) {
+	/* the hot volumes not yet brought up would be left out */
+	Log("VShutdown:  preload incomplete, keeping the saved VLRU state\n");
+	return;
+    }
+    n = VSaveVLRUState_r();
+    if (n > 0)
+	Log("VShutdown:  saved %d recently used volumes to %s\n", n,
+	    AFSDIR_SERVER_VLRUSTATE_FILEPATH);
+}
+
+/**
+ * Save the VLRU state now, so that a fileserver which goes down without a
+ * clean shutdown still starts up warm.  Called every few minutes by the
+ * fileserver.  Nothing is saved until the hot volumes from the last save
+ * have been preloaded, as until then most of them would be left out.
+ */
+int
+VSaveVLRUState(void)
+{
+    int code = 0;
+
+    VOL_LOCK;
+    if (VInit >= 2 && vinit_preload_done && !vol_shutting_down)
+	code = VSaveVLRUState_r();
+    VOL_UNLOCK;
+    return code;
+}
+
 void
 VShutdown(void)
 {
@@ -2260,6 +3220,7 @@ VPreAttachVolumeByVp_r(Error * ec,
 	queue_Init(&vp->vnode_list);
 	queue_Init(&vp->rx_call_list);
 	opr_cv_init(&V_attachCV(vp));
+	opr_mutex_init(&vp->usage_lock);
     }
 
     /* link the volume with its associated vice partition */
@@ -2491,6 +3452,7 @@ VAttachVolumeByName_r(Error * ec, char *partition, char *name, int mode)
       queue_Init(&vp->rx_call_list);
 #ifdef AFS_DEMAND_ATTACH_FS
       opr_cv_init(&V_attachCV(vp));
+      opr_mutex_init(&vp->usage_lock);
 #endif /* AFS_DEMAND_ATTACH_FS */
     }
 
@@ -4928,6 +5890,9 @@ VUpdateVolume_r(Error * ec, Volume * vp, int flags)
 
     *ec = 0;
     if (programType == fileServer) {
+#ifdef AFS_DEMAND_ATTACH_FS
+	V_dayUse(vp) += VTakeFastUsage_r(vp);
+#endif
 	if (!V_inUse(vp)) {
 	    V_uniquifier(vp) = V_nextVnodeUnique(vp);
 	} else {
@@ -5048,6 +6013,7 @@ ReallyFreeVolume(Volume * vp)
     VChangeState_r(vp, VOL_STATE_FREED);
     if (vp->pending_vol_op)
 	free(vp->pending_vol_op);
+    opr_mutex_destroy(&vp->usage_lock);
 #endif /* AFS_DEMAND_ATTACH_FS */
     for (i = 0; i < nVNODECLASSES; i++)
 	if (vp->vnodeIndex[i].bitmap)
@@ -6840,10 +7806,41 @@ VAdjustVolumeStatistics(Volume * vp)
     return retVal;
 }
 
+#ifdef AFS_DEMAND_ATTACH_FS
+/**
+ * take the usage bumps counted by vnode gets made without VOL_LOCK.
+ *
+ * @param[in] vp  volume object pointer
+ *
+ * @return number of bumps taken
+ *
+ * @pre VOL_LOCK held
+ *
+ * @see VnGetFast
+ */
+static int
+VTakeFastUsage_r(Volume * vp)
+{
+    int bumps;
+
+    if (programType != fileServer)
+	return 0;
+    opr_mutex_enter(&vp->usage_lock);
+    bumps = vp->usage_bumps_fast;
+    vp->usage_bumps_fast = 0;
+    opr_mutex_exit(&vp->usage_lock);
+    return bumps;
+}
+#endif /* AFS_DEMAND_ATTACH_FS */
+
 void
 VBumpVolumeUsage_r(Volume * vp)
 {
     unsigned int now = FT_ApproxTime();
+    int bumps = 1;
+#ifdef AFS_DEMAND_ATTACH_FS
+    bumps += VTakeFastUsage_r(vp);
+#endif
     V_accessDate(vp) = now;
     if (now - V_dayUseDate(vp) > OneDay)
 	VAdjustVolumeStatistics_r(vp);
@@ -6851,8 +7848,8 @@ VBumpVolumeUsage_r(Volume * vp)
      * Save the volume header image to disk after a threshold of bumps to dayUse,
      * at most every usage_rate_limit seconds.
      */
-    V_dayUse(vp)++;
-    vp->usage_bumps_outstanding++;
+    V_dayUse(vp) += bumps;
+    vp->usage_bumps_outstanding += bumps;
     if (vp->usage_bumps_outstanding >= vol_opts.usage_threshold
 	&& vp->usage_bumps_next_write <= now) {
 	Error error;
@@ -7088,13 +8085,6 @@ typedef enum {
     VLRU_SCANNER_STATE_PAUSED         = 4     /**< vlru scanner thread is paused */
 } vlru_thread_state_t;
 
-/* vlru disk data header stuff */
-#define VLRU_DISK_MAGIC      0x7a8b9cad        /**< vlru disk entry magic number */
-#define VLRU_DISK_VERSION    1                 /**< vlru disk entry version number */
-
-/** vlru default expiration time (for eventual fs state serialization of vlru data) */
-#define VLRU_DUMP_EXPIRATION_TIME   (60*60*24*7)  /* expire vlru data after 1 week */
-
 
 /** minimum volume inactivity (in seconds) before a volume becomes eligible for
  *  soft detachment. */
@@ -8414,12 +9404,15 @@ FreeVolumeHeader(Volume * vp)
  * @pre MUST be called prior to VInitVolumePackage2
  *
  * @post Volume Hash Table will have 2^logsize buckets
+ *
+ * @note this only sets the initial size.  The table grows on its own when
+ *       the average hash chain gets too long.
  */
 int
 VSetVolHashSize(int logsize)
 {
     /* 64 to 268435456 hash buckets seems like a reasonable range */
-    if ((logsize < 6 ) || (logsize > 28)) {
+    if ((logsize < 6 ) || (logsize > VOLUME_HASH_MAX_BITS)) {
         return -1;
     }
 
@@ -8468,7 +9461,7 @@ VInitVolumeHash(void)
  * @pre VOL_LOCK is held.  For DAFS, caller must hold a lightweight
  *      reference on vp.
  *
- * @post volume is added to hash chain.
+ * @post volume is added to hash chain.  the hash table may have grown.
  *
  * @internal volume package internal use only.
  *
@@ -8496,6 +9489,10 @@ AddVolumeToHashTable(Volume * vp, VolumeId hashid)
     head->len++;
     vp->hashid = hashid;
     queue_Append(head, vp);
+
+    if (++VolumeHashTable.Count > VolumeHashTable.Size * VOLUME_HASH_MAX_LOAD) {
+	VGrowVolumeHash_r();
+    }
 }
 
 /**
@@ -8532,12 +9529,100 @@ DeleteVolumeFromHashTable(Volume * vp)
 #endif /* AFS_DEMAND_ATTACH_FS */
 
     head->len--;
+    VolumeHashTable.Count--;
     queue_Remove(vp);
     /* do NOT reset hashid to zero, as the online
      * salvager package may need to know the volume id
      * after the volume is removed from the hash */
 }
 
+/**
+ * double the size of the volume hash table.
+ *
+ * Every volume is moved onto its chain in a new table, in the order it had
+ * on its old chain, so frequently used volumes stay near the front.  The
+ * per-chain statistics start over.
+ *
+ * @pre VOL_LOCK is held.
+ *
+ * @post the hash table has twice as many buckets, unless it is already as
+ *       large as it may get, the volume package is shutting down, or (for
+ *       DAFS) a hash chain is busy or being waited for, in which case the
+ *       table is left alone and a later add will try again.
+ *
+ * @internal volume package internal use only.
+ */
+static void
+VGrowVolumeHash_r(void)
+{
+    VolumeHashChainHead *table, *head;
+    Volume *vp, *np;
+    int i, size, mask;
+#ifdef AFS_DEMAND_ATTACH_FS
+    int cacheCheck = 0;
+#endif
+
+    if (VolumeHashTable.Size >= opr_jhash_size(VOLUME_HASH_MAX_BITS)
+	|| vol_shutting_down) {
+	return;
+    }
+#ifdef AFS_DEMAND_ATTACH_FS
+    /* a thread may be working on a chain with VOL_LOCK dropped, or be
+     * asleep on a chain's condvar; the chains must stay where they are */
+    if (VolumeHashTable.Busy) {
+	return;
+    }
+#endif /* AFS_DEMAND_ATTACH_FS */
+
+    size = VolumeHashTable.Size * 2;
+    mask = (VolumeHashTable.Mask << 1) | 1;
+    table = calloc(size, sizeof(VolumeHashChainHead));
+    if (table == NULL) {
+	return;
+    }
+
+#ifdef AFS_DEMAND_ATTACH_FS
+    /* start the new chains past every old cacheCheck, so no volume that has
+     * left the table can short circuit a lookup on its stale value */
+    for (i = 0; i < VolumeHashTable.Size; i++) {
+	if (VolumeHashTable.Table[i].cacheCheck > cacheCheck) {
+	    cacheCheck = VolumeHashTable.Table[i].cacheCheck;
+	}
+    }
+#endif /* AFS_DEMAND_ATTACH_FS */
+    for (i = 0; i < size; i++) {
+	queue_Init(&table[i]);
+#ifdef AFS_DEMAND_ATTACH_FS
+	table[i].cacheCheck = cacheCheck + 1;
+	opr_cv_init(&table[i].chain_busy_cv);
+#endif /* AFS_DEMAND_ATTACH_FS */
+    }
+
+    for (i = 0; i < VolumeHashTable.Size; i++) {
+	for (queue_Scan(&VolumeHashTable.Table[i], vp, np, Volume)) {
+	    queue_Remove(vp);
+	    head = &table[opr_jhash_int(vp->hashid, 0) & mask];
+	    head->len++;
+#ifdef AFS_DEMAND_ATTACH_FS
+	    vp->chainCacheCheck = ++head->cacheCheck;
+#endif /* AFS_DEMAND_ATTACH_FS */
+	    queue_Append(head, vp);
+	}
+#ifdef AFS_DEMAND_ATTACH_FS
+	opr_cv_destroy(&VolumeHashTable.Table[i].chain_busy_cv);
+#endif /* AFS_DEMAND_ATTACH_FS */
+    }
+
+    free(VolumeHashTable.Table);
+    VolumeHashTable.Table = table;
+    VolumeHashTable.Size = size;
+    VolumeHashTable.Mask = mask;
+    VolumeHashTable.Resizes++;
+
+    Log("VGrowVolumeHash: %d volumes; volume hash table now has %d "
+	"buckets\n", VolumeHashTable.Count, size);
+}
+
 /**
  * lookup a volume object in the hash table given a volume id.
  *
@@ -8593,9 +9678,14 @@ VLookupVolume_r(Error * ec, VolumeId volumeId, Volume * hint)
     }
 #endif /* AFS_DEMAND_ATTACH_FS */
 
-    /* someday we need to either do per-chain locks, RWlocks,
-     * or both for volhash access.
-     * (and move to a data structure with better cache locality) */
+    /* The lookup stays under VOL_LOCK.  The fileserver's client lookup
+     * (h_FindClientFast) runs without H_LOCK, deferring frees until no
+     * reader can still see the entry, but only because its readers need
+     * nothing more than an atomic refCount.  Every caller here goes on to
+     * take a reservation or set volume state, which need VOL_LOCK anyway;
+     * the chains are plain queues relinked by VReorderHash_r and
+     * VGrowVolumeHash_r; and the lookup itself updates the stats and the
+     * chain order.  Chain length is bounded by VGrowVolumeHash_r instead. */
 
     /* search the chain for this volume id */
     for(queue_Scan(head, vp, np, Volume)) {
@@ -8724,6 +9814,7 @@ VHashBeginExclusive_r(VolumeHashChainHead * head)
 {
     opr_Assert(head->busy == 0);
     head->busy = 1;
+    VolumeHashTable.Busy++;
 }
 
 /**
@@ -8748,6 +9839,7 @@ VHashEndExclusive_r(VolumeHashChainHead * head)
 {
     opr_Assert(head->busy);
     head->busy = 0;
+    VolumeHashTable.Busy--;
     opr_cv_broadcast(&head->chain_busy_cv);
 }
 
@@ -8778,8 +9870,13 @@ VHashEndExclusive_r(VolumeHashChainHead * head)
 static void
 VHashWait_r(VolumeHashChainHead * head)
 {
-    while (head->busy) {
-	VOL_CV_WAIT(&head->chain_busy_cv);
+    if (head->busy) {
+	/* keep the table from growing under us while we sleep */
+	VolumeHashTable.Busy++;
+	while (head->busy) {
+	    VOL_CV_WAIT(&head->chain_busy_cv);
+	}
+	VolumeHashTable.Busy--;
     }
 }
 #endif /* AFS_DEMAND_ATTACH_FS */
@@ -8957,12 +10054,20 @@ VPrintCacheStats_r(void)
 {
     struct VnodeClassInfo *vcp;
     vcp = &VnodeClassInfo[vLarge];
-    Log("Large vnode cache, %d entries, %d allocs, %d gets (%d reads), %d writes\n", vcp->cacheSize, vcp->allocs, vcp->gets, vcp->reads, vcp->writes);
+    Log("Large vnode cache, %d entries, %d allocs, %d gets (%d reads, %d from read-ahead), %d writes\n", vcp->cacheSize, vcp->allocs, vcp->gets, vcp->reads, vcp->readaheads, vcp->writes);
     vcp = &VnodeClassInfo[vSmall];
-    Log("Small vnode cache,%d entries, %d allocs, %d gets (%d reads), %d writes\n", vcp->cacheSize, vcp->allocs, vcp->gets, vcp->reads, vcp->writes);
+    Log("Small vnode cache,%d entries, %d allocs, %d gets (%d reads, %d from read-ahead), %d writes\n", vcp->cacheSize, vcp->allocs, vcp->gets, vcp->reads, vcp->readaheads, vcp->writes);
     Log("Volume header cache, %d entries, %"AFS_INT64_FMT" gets, "
         "%"AFS_INT64_FMT" replacements\n",
 	VStats.hdr_cache_size, VStats.hdr_gets, VStats.hdr_loads);
+#ifdef AFS_DEMAND_ATTACH_FS
+    VnGetLockStats(&VStats.vnode_fast_gets, &VStats.vnode_fast_puts,
+		   &VStats.vnode_lock_waits);
+    Log("Vnode lock stripes, %"AFS_INT64_FMT" gets and %"AFS_INT64_FMT" puts "
+	"without VOL_LOCK, %"AFS_INT64_FMT" waits\n",
+	VStats.vnode_fast_gets, VStats.vnode_fast_puts,
+	VStats.vnode_lock_waits);
+#endif
 }
 
 void
@@ -9265,7 +10370,8 @@ VPrintExtendedCacheStats_r(int flags)
     reorders.avg = reorders.sum / ((double)VolumeHashTable.Size);
 
     /* dump global stats */
-    Log("Volume hash summary: %d buckets\n", VolumeHashTable.Size);
+    Log("Volume hash summary: %d buckets, %d volumes, grown %d times\n",
+	VolumeHashTable.Size, VolumeHashTable.Count, VolumeHashTable.Resizes);
     Log(" chain length : min=%s, max=%s, avg=%s, total=%s\n",
 	DoubleToPrintable(len.min, pr_buf[0], sizeof(pr_buf[0])),
 	DoubleToPrintable(len.max, pr_buf[1], sizeof(pr_buf[1])),
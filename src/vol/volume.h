@@ -502,6 +502,9 @@ typedef struct VolPkgStats {
     afs_uint64 hash_reorders;        /**< number of hash chain reorders */
     afs_uint64 salvages;             /**< online salvages since fileserver start */
     afs_uint64 vol_ops;              /**< volume operations since fileserver start */
+    afs_uint64 vnode_fast_gets;      /**< vnode read refs taken without VOL_LOCK */
+    afs_uint64 vnode_fast_puts;      /**< vnode read refs dropped without VOL_LOCK */
+    afs_uint64 vnode_lock_waits;     /**< vnode lock stripe contention */
 #endif /* AFS_DEMAND_ATTACH_FS */
 
     afs_uint64 hdr_loads;            /**< header loads from disk */
@@ -553,6 +556,11 @@ typedef struct VolumeHashTable {
     int Size;
     int Mask;
     VolumeHashChainHead * Table;
+    int Count;              /**< volumes in the table */
+    int Resizes;            /**< times the table has grown */
+#ifdef AFS_DEMAND_ATTACH_FS
+    int Busy;               /**< chains busy or being waited for */
+#endif
 } VolumeHashTable_t;
 extern VolumeHashTable_t VolumeHashTable;
 
@@ -688,6 +696,7 @@ typedef struct Volume {
 				 * volume list--the list of volumes that will be
 				 * salvaged should the file server crash */
     struct rx_queue vnode_list; /**< linked list of cached vnodes for this volume */
+    struct VnChangeLog changeLog; /**< vnodes stored since attach (RW only) */
     struct rx_queue rx_call_list; /**< linked list of split RX calls using this
                                    *   volume (fileserver only) */
 #ifdef AFS_DEMAND_ATTACH_FS
@@ -702,6 +711,9 @@ typedef struct Volume {
     VolumeStats stats;            /* per-volume statistics */
     VolumeVLRUState vlru;         /* state specific to the VLRU */
     FSSYNC_VolOp_info * pending_vol_op;  /* fssync command info for any pending vol ops */
+    pthread_mutex_t usage_lock;   /**< protects usage_bumps_fast */
+    int usage_bumps_fast;         /**< usage bumps from vnode gets made without
+				   *   VOL_LOCK, not yet added to dayUse */
 #endif /* AFS_DEMAND_ATTACH_FS */
     int usage_bumps_outstanding; /**< to rate limit the usage update i/o by accesses */
     int usage_bumps_next_write;  /**< to rate limit the usage update i/o by time */
@@ -781,6 +793,17 @@ struct volHeader {
 #define VOLUME_BITMAP_OFFSET(Volume)	\
 	(sizeof (VolumeDiskData) + (Volume)->disk.mountTableSize)
 
+/* Progress of the volume attach at fileserver startup */
+struct VAttachStats {
+    afs_int32 found;		/* volumes found on the vice partitions */
+    afs_int32 attached;		/* volumes attached (DAFS: pre-attached) */
+    afs_int32 failed;		/* volumes not attached */
+    afs_int32 hot;		/* recently used volumes, attached first */
+    afs_int32 hotAttached;	/* recently used volumes attached */
+    afs_int32 elapsed;		/* seconds since the attach began */
+    afs_int32 eta;		/* seconds left; 0 when done, -1 if unknown */
+};
+
 
 extern char *VSalvageMessage;	/* Canonical message when a volume is forced
 				 * offline */
@@ -834,6 +857,8 @@ extern void VBumpVolumeUsage(Volume * vp);
 extern void VBumpVolumeUsage_r(Volume * vp);
 extern void VSetDiskUsage(void);
 extern void VPrintCacheStats(void);
+extern void VGetAttachStats(struct VAttachStats *stats);
+extern int VSaveVLRUState(void);
 extern void VReleaseVnodeFiles_r(Volume * vp);
 extern void VCloseVnodeFiles_r(Volume * vp);
 extern struct DiskPartition64 *VGetPartition(char *name, int abortp);
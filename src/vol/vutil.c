@@ -693,6 +693,7 @@ VDestroyVolumeDiskHeader(struct DiskPartition64 * dp,
 	Log("VDestroyVolumeDiskHeader: Couldn't unlink disk header, error = %d\n", errno);
 	goto done;
     }
+    VChangeLogDestroy(dp, volid);
 
 #ifdef AFS_DEMAND_ATTACH_FS
     memset(&res, 0, sizeof(res));
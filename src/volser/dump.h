@@ -26,6 +26,12 @@
 
 #define D_MAX		20
 
+/* Dump header tag, always preceded by the critical tag marker 0x7e: the
+ * dump lists only the vnodes changed or deleted since its from time, and
+ * vnodes it doesn't list are left alone by the restore.  Deleted vnodes
+ * are sent as a vnode of type vNull. */
+#define D_CHANGEDONLY	'{'
+
 #define MAXDUMPTIMES	50
 
 /* DumpHeader:
@@ -40,6 +46,7 @@ struct DumpHeader {
     struct {
 	afs_int32 from, to;
     } dumpTimes[MAXDUMPTIMES];
+    int changedOnly;		/* D_CHANGEDONLY was seen */
 };
 
 
@@ -31,6 +31,10 @@
 #include <afs/acl.h>
 #include <afs/com_err.h>
 #include <afs/vol_prototypes.h>
+#ifdef AFS_PTHREAD_ENV
+#include <opr/lock.h>
+#include <afs/afsutil.h>
+#endif
 
 #include "dump.h"
 #include "volser.h"
@@ -52,17 +56,65 @@
 extern int DoLogging;
 extern int DoPreserveVolumeStats;
 
+/*
+ * Dumps read the files of the vnodes they are about to send ahead of time.
+ * While the thread serving the call writes the vnodes out in index order,
+ * a pool of reader threads opens the inodes of the next DUMP_MAXAHEAD
+ * vnodes to be dumped and reads up to DUMP_PREFETCH bytes of each, so that
+ * the disk and the network are kept busy at the same time.  The rest of a
+ * bigger file is read by the dumping thread itself, once the readers have
+ * asked the kernel to start on the next DUMP_READAHEAD bytes of it.
+ */
+#define DUMP_MAXAHEAD	32
+#define DUMP_PREFETCH	(256 * 1024)
+#define DUMP_READAHEAD	(4 * 1024 * 1024)
+
+struct dumpRead {
+    struct opr_queue q;
+    struct dumpPipe *pipe;
+    int ready;			/* the readers are done with it */
+    int vnodeNumber;
+    int dumpEverything;
+    IHandle_t *ihP;
+    FdHandle_t *fdP;		/* NULL if the inode couldn't be opened */
+    int openErrno;		/* why not */
+    afs_sfsize_t diskLen;
+    char *data;			/* DUMP_PREFETCH bytes, allocated on first use */
+    ssize_t nData;		/* how much of the file was read into data */
+    char vnode[SIZEOF_LARGEDISKVNODE];
+};
+
+#ifdef AFS_PTHREAD_ENV
+struct dumpPipe {
+    pthread_cond_t cv;		/* signalled as each read completes */
+    struct dumpRead reads[DUMP_MAXAHEAD];
+};
+
+/* Protects the read queue, and the ready flags of every dumpPipe */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+    struct opr_queue queue;
+    int nThreads;
+} dumpReaders;
+#endif
+
 
 /* Forward Declarations */
 static int DumpDumpHeader(struct iod *iodp, Volume * vp,
-			  afs_int32 fromtime);
+			  afs_int32 fromtime, int changedOnly);
 static int DumpPartial(struct iod *iodp, Volume * vp,
 		       afs_int32 fromtime, int dumpAllDirs);
+static int DumpChanged(struct iod *iodp, Volume * vp, VnodeId * vnodes,
+		       afs_uint32 nVnodes);
 static int DumpVnodeIndex(struct iod *iodp, Volume * vp,
 			  VnodeClass class, afs_int32 fromtime,
 			  int forcedump);
 static int DumpVnode(struct iod *iodp, struct VnodeDiskObject *v,
-		     VolumeId volid, int vnodeNumber, int dumpEverything);
+		     VolumeId volid, int vnodeNumber, int dumpEverything,
+		     struct dumpRead *ahead);
+static int DoRestoreVolume(struct iod *iodp, Volume * avp, int incremental,
+			   struct restoreCookie *cookie);
 static int ReadDumpHeader(struct iod *iodp, struct DumpHeader *hp);
 static int ReadVnodes(struct iod *iodp, Volume * vp, int incremental,
 		      afs_foff_t * Lbuf, afs_int32 s1, afs_foff_t * Sbuf,
@@ -129,6 +181,345 @@ initNonStandardTags(void)
     oldtagsInited = 1;
 }
 
+#ifdef AFS_PTHREAD_ENV
+/*
+ * A dump sent to several calls, whether by DumpVolMulti or by a restore
+ * passing the dump on down a release tree, is copied into chunks of
+ * DUMP_FANCHUNK bytes, and a thread for each call writes the chunks to it.
+ * Each site has its own queue of up to DUMP_FANWINDOW chunks (4 MB).  A
+ * site which falls further behind than that has the rest of the dump
+ * spilled to a temporary file, which its thread sends from once its queue
+ * is empty, and goes back to the queue once it has caught up.  So a slow
+ * site does not hold up the dump, or the other sites; only if its spill
+ * file cannot be written does the dump wait for it.  A site whose call
+ * fails just drops out.
+ */
+#define DUMP_FANCHUNK	(64 * 1024)
+#define DUMP_FANWINDOW	64
+
+struct fanChunk {
+    struct fanChunk *next;	/* on the free list */
+    int refs;			/* queues it is on, and the dump while adding */
+    afs_int32 len;
+    char data[DUMP_FANCHUNK];
+};
+
+struct fanSite {
+    struct dumpFan *fan;
+    struct rx_call *call;
+    int *code;			/* set if the call fails */
+    struct fanChunk *queue[DUMP_FANWINDOW];
+    afs_uint32 qhead;		/* number of the next chunk to send */
+    afs_uint32 qtail;		/* number of the next chunk to queue */
+    int failed;			/* the call has failed; send it nothing */
+    FILE *spill;		/* chunks past a full queue, or NULL */
+    int spillerror;		/* the spill file can't be used */
+    int nspilled;		/* chunks in the spill file not yet sent */
+    off_t spillread;		/* where the next of them starts */
+    off_t spillwrite;		/* where to spill the next chunk */
+    char *spillbuf;		/* a spilled chunk being sent */
+    pthread_t tid;
+};
+
+struct dumpFan {
+    pthread_mutex_t lock;
+    pthread_cond_t cv;		/* signalled as chunks are added and sent */
+    struct fanChunk *cur;	/* being filled, not yet added */
+    struct fanChunk *free;
+    int live;			/* sites still taking the dump */
+    int done;			/* no more chunks will be added */
+    int nsites;
+    struct fanSite *sites;
+};
+
+/* Drop a reference to a chunk.  Call with the fan lock held. */
+static void
+FanRelease(struct dumpFan *fan, struct fanChunk *chunk)
+{
+    if (--chunk->refs == 0) {
+	chunk->next = fan->free;
+	fan->free = chunk;
+	opr_cv_broadcast(&fan->cv);	/* for FanGetChunk */
+    }
+}
+
+/*
+ * Spill a chunk to the end of a site's spill file, creating the file the
+ * first time.  Call with the fan lock held; the site's thread only reads
+ * the file up to what is counted in nspilled.  Returns nonzero if the file
+ * can't be used.
+ */
+static int
+FanSpill(struct fanSite *site, struct fanChunk *chunk)
+{
+    int fd;
+
+    if (site->spillerror)
+	return 1;
+    if (site->spill == NULL) {
+	site->spillbuf = malloc(DUMP_FANCHUNK);
+	if (site->spillbuf == NULL || (site->spill = tmpfile()) == NULL)
+	    goto fail;
+	site->spillread = site->spillwrite = 0;
+    }
+    fd = fileno(site->spill);
+    if (pwrite(fd, &chunk->len, sizeof(chunk->len), site->spillwrite)
+	    != sizeof(chunk->len)
+	|| pwrite(fd, chunk->data, chunk->len,
+		  site->spillwrite + sizeof(chunk->len)) != chunk->len)
+	goto fail;
+    site->spillwrite += sizeof(chunk->len) + chunk->len;
+    site->nspilled++;
+    return 0;
+
+  fail:
+    /* What was spilled before still gets sent */
+    Log("1 Volser: DumpFan: unable to spill dump for a slow site; "
+	"waiting for it\n");
+    site->spillerror = 1;
+    return 1;
+}
+
+/* Read the next spilled chunk into spillbuf; returns its length, or -1 */
+static int
+FanUnspill(struct fanSite *site, off_t offset)
+{
+    int fd = fileno(site->spill);
+    afs_int32 len;
+
+    if (pread(fd, &len, sizeof(len), offset) != sizeof(len)
+	|| len < 0 || len > DUMP_FANCHUNK
+	|| pread(fd, site->spillbuf, len, offset + sizeof(len)) != len)
+	return -1;
+    return len;
+}
+
+static void *
+FanSiteThread(void *rock)
+{
+    struct fanSite *site = rock;
+    struct dumpFan *fan = site->fan;
+    struct fanChunk *chunk;
+    off_t offset;
+    int len, sent;
+
+    afs_pthread_setname_self("DumpFan");
+    opr_mutex_enter(&fan->lock);
+    while (1) {
+	while (site->qhead == site->qtail && site->nspilled == 0
+	       && !fan->done)
+	    opr_cv_wait(&fan->cv, &fan->lock);
+
+	/* The queue always holds the chunks before any that are spilled */
+	if (site->qhead != site->qtail) {
+	    chunk = site->queue[site->qhead % DUMP_FANWINDOW];
+	    site->qhead++;
+	    opr_cv_broadcast(&fan->cv);
+	    opr_mutex_exit(&fan->lock);
+
+	    sent = (rx_Write(site->call, chunk->data, chunk->len)
+		    == chunk->len);
+
+	    opr_mutex_enter(&fan->lock);
+	    FanRelease(fan, chunk);
+	} else if (site->nspilled > 0) {
+	    offset = site->spillread;
+	    opr_mutex_exit(&fan->lock);
+
+	    len = FanUnspill(site, offset);
+	    sent = (len >= 0
+		    && rx_Write(site->call, site->spillbuf, len) == len);
+
+	    opr_mutex_enter(&fan->lock);
+	    site->spillread = offset + sizeof(afs_int32) + len;
+	    if (--site->nspilled == 0) {
+		/* Caught up; reuse the file from the start */
+		site->spillread = site->spillwrite = 0;
+		opr_cv_broadcast(&fan->cv);
+	    }
+	} else {
+	    break;
+	}
+
+	if (!sent) {
+	    *site->code = VOLSERDUMPERROR;
+	    site->failed = 1;
+	    fan->live--;
+	    while (site->qhead != site->qtail) {
+		FanRelease(fan, site->queue[site->qhead % DUMP_FANWINDOW]);
+		site->qhead++;
+	    }
+	    site->nspilled = 0;
+	    opr_cv_broadcast(&fan->cv);
+	    break;
+	}
+    }
+    opr_mutex_exit(&fan->lock);
+    return NULL;
+}
+
+/*
+ * Start sending to those of calls whose codes are clear.  Returns NULL,
+ * having sent nothing, if there isn't the memory.
+ */
+static struct dumpFan *
+FanCreate(struct rx_call **calls, int ncalls, int *codes)
+{
+    struct dumpFan *fan;
+    struct fanSite *site;
+    int i;
+
+    fan = calloc(1, sizeof(*fan));
+    if (fan == NULL)
+	return NULL;
+    fan->sites = calloc(ncalls, sizeof(*fan->sites));
+    /* FanGetChunk needs one to start with */
+    fan->free = malloc(sizeof(struct fanChunk));
+    if (fan->sites == NULL || fan->free == NULL) {
+	free(fan->free);
+	free(fan->sites);
+	free(fan);
+	return NULL;
+    }
+    fan->free->next = NULL;
+    opr_mutex_init(&fan->lock);
+    opr_cv_init(&fan->cv);
+
+    for (i = 0; i < ncalls; i++) {
+	if (calls[i] == NULL || codes[i] != 0)
+	    continue;
+	site = &fan->sites[fan->nsites];
+	site->fan = fan;
+	site->call = calls[i];
+	site->code = &codes[i];
+	if (pthread_create(&site->tid, NULL, FanSiteThread, site) != 0) {
+	    codes[i] = VOLSERDUMPERROR;
+	    continue;
+	}
+	fan->nsites++;
+    }
+    fan->live = fan->nsites;
+    return fan;
+}
+
+/*
+ * Get an empty chunk to fill.  Chunks are allocated as the queues need
+ * them; if there isn't the memory, wait for one to be sent.  There is
+ * always a chunk on a queue or the free list, so this can't wait forever.
+ */
+static struct fanChunk *
+FanGetChunk(struct dumpFan *fan)
+{
+    struct fanChunk *chunk;
+
+    opr_mutex_enter(&fan->lock);
+    if (fan->free == NULL) {
+	opr_mutex_exit(&fan->lock);
+	chunk = malloc(sizeof(*chunk));
+	if (chunk != NULL) {
+	    chunk->len = 0;
+	    return chunk;
+	}
+	opr_mutex_enter(&fan->lock);
+	while (fan->free == NULL)
+	    opr_cv_wait(&fan->cv, &fan->lock);
+    }
+    chunk = fan->free;
+    fan->free = chunk->next;
+    opr_mutex_exit(&fan->lock);
+    chunk->len = 0;
+    return chunk;
+}
+
+/* Hand the chunk being filled to the sites */
+static void
+FanAdd(struct dumpFan *fan)
+{
+    struct fanChunk *chunk = fan->cur;
+    struct fanSite *site;
+    int i;
+
+    fan->cur = NULL;
+    opr_mutex_enter(&fan->lock);
+    chunk->refs = 1;		/* ours, until it is on every queue */
+    for (i = 0; i < fan->nsites; i++) {
+	site = &fan->sites[i];
+	while (!site->failed) {
+	    if (site->nspilled == 0
+		&& site->qtail - site->qhead < DUMP_FANWINDOW) {
+		site->queue[site->qtail % DUMP_FANWINDOW] = chunk;
+		site->qtail++;
+		chunk->refs++;
+		break;
+	    }
+	    if (FanSpill(site, chunk) == 0)
+		break;
+	    /* Nowhere to put it; wait for the site to catch up */
+	    opr_cv_wait(&fan->cv, &fan->lock);
+	}
+    }
+    FanRelease(fan, chunk);
+    opr_cv_broadcast(&fan->cv);
+    opr_mutex_exit(&fan->lock);
+}
+
+/* Returns nbytes while any site is still taking the dump, else 0 */
+static int
+FanWrite(struct dumpFan *fan, char *buf, int nbytes)
+{
+    int n, left = nbytes;
+
+    while (left > 0) {
+	if (fan->cur == NULL)
+	    fan->cur = FanGetChunk(fan);
+	n = MIN(left, DUMP_FANCHUNK - fan->cur->len);
+	memcpy(fan->cur->data + fan->cur->len, buf, n);
+	fan->cur->len += n;
+	buf += n;
+	left -= n;
+	if (fan->cur->len == DUMP_FANCHUNK)
+	    FanAdd(fan);
+    }
+    return (fan->live > 0 ? nbytes : 0);
+}
+
+/* Send what is left, and wait for every site to have it all */
+static void
+FanFinish(struct dumpFan *fan)
+{
+    struct fanChunk *chunk;
+    struct fanSite *site;
+    int i;
+
+    if (fan->cur != NULL && fan->cur->len > 0)
+	FanAdd(fan);
+    opr_mutex_enter(&fan->lock);
+    fan->done = 1;
+    opr_cv_broadcast(&fan->cv);
+    opr_mutex_exit(&fan->lock);
+    for (i = 0; i < fan->nsites; i++) {
+	site = &fan->sites[i];
+	opr_Verify(pthread_join(site->tid, NULL) == 0);
+	if (site->spill != NULL)
+	    fclose(site->spill);
+	free(site->spillbuf);
+    }
+
+    if (fan->cur != NULL) {
+	fan->cur->next = fan->free;
+	fan->free = fan->cur;
+    }
+    while ((chunk = fan->free) != NULL) {
+	fan->free = chunk->next;
+	free(chunk);
+    }
+    opr_cv_destroy(&fan->cv);
+    opr_mutex_destroy(&fan->lock);
+    free(fan->sites);
+    free(fan);
+}
+#endif /* AFS_PTHREAD_ENV */
+
 static void
 iod_Init(struct iod *iodp, struct rx_call *call)
 {
@@ -136,6 +527,8 @@ iod_Init(struct iod *iodp, struct rx_call *call)
     iodp->haveOldChar = 0;
     iodp->ncalls = 1;
     iodp->calls = (struct rx_call **)0;
+    iodp->nio = iodp->curio = iodp->rleft = 0;
+    iodp->fan = NULL;
 }
 
 static void
@@ -148,10 +541,118 @@ iod_InitMulti(struct iod *iodp, struct rx_call **calls, int ncalls,
     iodp->ncalls = ncalls;
     iodp->codes = codes;
     iodp->call = (struct rx_call *)0;
+    iodp->nio = iodp->curio = iodp->rleft = 0;
+    iodp->fan = NULL;
+#ifdef AFS_PTHREAD_ENV
+    /* Without the memory, write to each call in turn */
+    iodp->fan = FanCreate(calls, ncalls, codes);
+#endif
+}
+
+/* Wait for a multiple dump to reach every call */
+static void
+iod_FinishMulti(struct iod *iodp)
+{
+#ifdef AFS_PTHREAD_ENV
+    if (iodp->fan)
+	FanFinish(iodp->fan);
+    iodp->fan = NULL;
+#endif
+}
+
+/* how much to ask rx_Readv for at once; it stops sooner if it runs out of
+ * iovecs */
+#define IOD_READSIZE	(64 * 1024)
+
+/*
+ * Move on to the next unread piece of the dump, reading another batch of
+ * packets from the call once the last one is used up.  rx_Readv frees the
+ * packets of the last batch, so nothing may still point into them.
+ *
+ * Returns 0 at the end of the dump or on error.
+ */
+static int
+iod_Fill(struct iod *iodp)
+{
+    opr_Assert(iodp->call);
+
+    while (iodp->rleft == 0) {
+	if (++iodp->curio >= iodp->nio) {
+	    iodp->curio = 0;
+	    if (rx_Readv(iodp->call, iodp->iov, &iodp->nio, RX_MAXIOVECS,
+			 IOD_READSIZE) <= 0) {
+		iodp->nio = 0;
+		return 0;
+	    }
+#ifdef AFS_PTHREAD_ENV
+	    if (iodp->fan) {
+		int i;
+
+		for (i = 0; i < iodp->nio; i++)
+		    FanWrite(iodp->fan, iodp->iov[i].iov_base,
+			     iodp->iov[i].iov_len);
+	    }
+#endif
+	}
+	iodp->rpos = iodp->iov[iodp->curio].iov_base;
+	iodp->rleft = iodp->iov[iodp->curio].iov_len;
+    }
+    return 1;
 }
 
 /* N.B. iod_Read doesn't check for oldchar (see previous comment) */
-#define iod_Read(iodp, buf, nbytes) rx_Read((iodp)->call, buf, nbytes)
+static int
+iod_Read(struct iod *iodp, char *buf, int nbytes)
+{
+    int n, total = 0;
+
+    while (nbytes > 0) {
+	if (iodp->rleft == 0 && !iod_Fill(iodp))
+	    break;
+	n = MIN(nbytes, iodp->rleft);
+	memcpy(buf, iodp->rpos, n);
+	iodp->rpos += n;
+	iodp->rleft -= n;
+	buf += n;
+	nbytes -= n;
+	total += n;
+    }
+    return total;
+}
+
+/*
+ * Like iod_Read, but rather than copying the data, point *tnio entries of
+ * tiov at it.  They are only good until the next read from iodp.
+ */
+static int
+iod_Readv(struct iod *iodp, struct iovec *tiov, int *tnio, int nbytes)
+{
+    int n, total = 0;
+
+    *tnio = 0;
+    if (iodp->rleft == 0 && !iod_Fill(iodp))
+	return 0;
+    while (nbytes > 0 && *tnio < RX_MAXIOVECS) {
+	n = MIN(nbytes, iodp->rleft);
+	tiov[*tnio].iov_base = iodp->rpos;
+	tiov[*tnio].iov_len = n;
+	(*tnio)++;
+	iodp->rpos += n;
+	iodp->rleft -= n;
+	nbytes -= n;
+	total += n;
+
+	/* stay within this batch */
+	if (iodp->rleft == 0) {
+	    if (iodp->curio + 1 >= iodp->nio)
+		break;
+	    iodp->curio++;
+	    iodp->rpos = iodp->iov[iodp->curio].iov_base;
+	    iodp->rleft = iodp->iov[iodp->curio].iov_len;
+	}
+    }
+    return total;
+}
 
 /* For the single dump case, it's ok to just return the "bytes written"
  * that rx_Write returns, since all the callers of iod_Write abort when
@@ -172,6 +673,10 @@ iod_Write(struct iod *iodp, char *buf, int nbytes)
 	code = rx_Write(iodp->call, buf, nbytes);
 	return code;
     }
+#ifdef AFS_PTHREAD_ENV
+    if (iodp->fan)
+	return FanWrite(iodp->fan, buf, nbytes);
+#endif
 
     for (i = 0; i < iodp->ncalls; i++) {
 	if (iodp->calls[i] && !iodp->codes[i]) {
@@ -207,9 +712,11 @@ iod_getc(struct iod *iodp)
 	iodp->haveOldChar = 0;
 	return iodp->oldChar;
     }
-    if (iod_Read(iodp, (char *) &t, 1) == 1)
-	return t;
-    return EOF;
+    if (iodp->rleft == 0 && !iod_Fill(iodp))
+	return EOF;
+    t = *iodp->rpos++;
+    iodp->rleft--;
+    return t;
 }
 
 static int
@@ -700,8 +1207,13 @@ DumpStandardTagLen(struct iod *iodp, char tag, afs_uint32 section,
     return 0;
 }
 
+/*
+ * Dump the contents of a file.  The first nAhead bytes of it have already
+ * been read into ahead.
+ */
 static int
-DumpFile(struct iod *iodp, int vnode, FdHandle_t * handleP)
+DumpFile(struct iod *iodp, int vnode, FdHandle_t * handleP, char *ahead,
+	 ssize_t nAhead)
 {
     int code = 0, error = 0;
     afs_int32 pad = 0;
@@ -770,13 +1282,21 @@ DumpFile(struct iod *iodp, int vnode, FdHandle_t * handleP)
 	return VOLSERDUMPERROR;
     }
 
+    if (nAhead > howBig)
+	nAhead = howBig;
+    if (nAhead > 0 && iod_Write(iodp, ahead, nAhead) != nAhead)
+	return VOLSERDUMPERROR;
+    if (nAhead == howBig)
+	return 0;
+    howFar = nAhead;
+
     p = malloc(howMany);
     if (!p) {
 	Log("1 Volser: DumpFile: not enough memory to allocate %u bytes\n", (unsigned)howMany);
 	return VOLSERDUMPERROR;
     }
 
-    for (nbytes = howBig; (nbytes && !error); nbytes -= howMany) {
+    for (nbytes = howBig - nAhead; (nbytes && !error); nbytes -= howMany) {
 	if (nbytes < howMany)
 	    howMany = nbytes;
 
@@ -926,7 +1446,7 @@ DumpVolume(struct rx_call *call, Volume * vp,
     iod_Init(iodp, call);
 
     if (!code)
-	code = DumpDumpHeader(iodp, vp, fromtime);
+	code = DumpDumpHeader(iodp, vp, fromtime, 0);
 
     if (!code)
 	code = DumpPartial(iodp, vp, fromtime, dumpAllDirs);
@@ -943,21 +1463,39 @@ DumpVolume(struct rx_call *call, Volume * vp,
     return code;
 }
 
-/* Dump a volume to multiple places*/
+/*
+ * Dump a volume to multiple places.  If changedOnly is set, the receivers
+ * all understand D_CHANGEDONLY, and the volume's changed-vnode log reaches
+ * back to fromtime, only the vnodes in the log are sent.
+ */
 int
 DumpVolMulti(struct rx_call **calls, int ncalls, Volume * vp,
-	     afs_int32 fromtime, int dumpAllDirs, int *codes)
+	     afs_int32 fromtime, int dumpAllDirs, int changedOnly,
+	     int *codes)
 {
     struct iod iod;
     int code = 0;
+    VnodeId *vnodes = NULL;
+    afs_uint32 nVnodes = 0;
     iod_InitMulti(&iod, calls, ncalls, codes);
 
+    if (changedOnly && (fromtime == 0 || dumpAllDirs
+			|| VChangeLogQuery(vp, fromtime, &vnodes,
+					   &nVnodes) != 0))
+	changedOnly = 0;
+
     if (!code)
-	code = DumpDumpHeader(&iod, vp, fromtime);
-    if (!code)
-	code = DumpPartial(&iod, vp, fromtime, dumpAllDirs);
+	code = DumpDumpHeader(&iod, vp, fromtime, changedOnly);
+    if (!code) {
+	if (changedOnly)
+	    code = DumpChanged(&iod, vp, vnodes, nVnodes);
+	else
+	    code = DumpPartial(&iod, vp, fromtime, dumpAllDirs);
+    }
     if (!code)
 	code = DumpEnd(&iod);
+    iod_FinishMulti(&iod);
+    free(vnodes);
     return code;
 }
 
@@ -976,6 +1514,230 @@ DumpPartial(struct iod *iodp, Volume * vp,
     return code;
 }
 
+/* Tell a D_CHANGEDONLY restore that a vnode no longer exists */
+static int
+DumpDeletedVnode(struct iod *iodp, int vnodeNumber)
+{
+    int code = 0;
+
+    if (!code)
+	code = DumpDouble(iodp, D_VNODE, vnodeNumber, 0);
+    if (!code)
+	code = DumpByte(iodp, 't', (byte) vNull);
+    return code;
+}
+
+/*
+ * A partial dump of just the vnodes given, which the volume's changed-vnode
+ * log says were stored since the dump's from time.  Each is dumped in full,
+ * or as deleted if it is no longer in use.
+ */
+static int
+DumpChanged(struct iod *iodp, Volume * vp, VnodeId * vnodes,
+	    afs_uint32 nVnodes)
+{
+    char buf[SIZEOF_LARGEDISKVNODE];
+    struct VnodeDiskObject *vnode = (struct VnodeDiskObject *)buf;
+    struct VnodeClassInfo *vcp;
+    FdHandle_t *fdP[nVNODECLASSES];
+    VnodeClass class;
+    afs_uint32 i;
+    int code = 0;
+
+    for (class = 0; class < nVNODECLASSES; class++) {
+	fdP[class] = IH_OPEN(vp->vnodeIndex[class].handle);
+	opr_Assert(fdP[class] != NULL);
+    }
+
+    if (!code)
+	code = DumpVolumeHeader(iodp, vp);
+    for (i = 0; i < nVnodes && !code; i++) {
+	class = vnodeIdToClass(vnodes[i]);
+	vcp = &VnodeClassInfo[class];
+	if (FDH_PREAD(fdP[class], vnode, vcp->diskSize,
+		      vnodeIndexOffset(vcp, vnodes[i])) != vcp->diskSize
+	    || vnode->type == vNull)
+	    code = DumpDeletedVnode(iodp, vnodes[i]);
+	else
+	    code = DumpVnode(iodp, vnode, V_id(vp), vnodes[i], 1, NULL);
+    }
+
+    for (class = 0; class < nVNODECLASSES; class++)
+	FDH_CLOSE(fdP[class]);
+    return code;
+}
+
+#ifdef AFS_PTHREAD_ENV
+/* Open the file of a vnode about to be dumped, and read the start of it */
+static void
+DumpReadAhead(struct dumpRead *r)
+{
+    struct VnodeDiskObject *v = (struct VnodeDiskObject *)r->vnode;
+    afs_sfsize_t indexLen, want;
+    ssize_t n;
+
+    r->fdP = IH_OPEN(r->ihP);
+    if (r->fdP == NULL) {
+	r->openErrno = errno;
+	return;
+    }
+    r->diskLen = FDH_SIZE(r->fdP);
+    VNDISK_GET_LEN(indexLen, v);
+    if (indexLen != r->diskLen)
+	return;			/* DumpVnode will complain */
+
+    if (r->data == NULL)
+	r->data = malloc(DUMP_PREFETCH);
+    if (r->data == NULL)
+	return;			/* DumpFile can read it all itself */
+    want = MIN(r->diskLen, DUMP_PREFETCH);
+    while (r->nData < want) {
+	n = FDH_PREAD(r->fdP, r->data + r->nData, want - r->nData, r->nData);
+	if (n <= 0)
+	    break;		/* DumpFile will retry, and pad if need be */
+	r->nData += n;
+    }
+#ifdef FDH_ADVISE
+    if (r->diskLen > DUMP_PREFETCH)
+	FDH_ADVISE(r->fdP, DUMP_PREFETCH, DUMP_READAHEAD, POSIX_FADV_WILLNEED);
+#endif
+}
+
+static void *
+DumpReaderThread(void *unused)
+{
+    struct dumpRead *r;
+
+    afs_pthread_setname_self("DumpReader");
+    opr_mutex_enter(&dumpReaders.lock);
+    while (1) {
+	while (opr_queue_IsEmpty(&dumpReaders.queue))
+	    opr_cv_wait(&dumpReaders.cv, &dumpReaders.lock);
+	r = opr_queue_First(&dumpReaders.queue, struct dumpRead, q);
+	opr_queue_Remove(&r->q);
+	opr_mutex_exit(&dumpReaders.lock);
+
+	DumpReadAhead(r);
+
+	opr_mutex_enter(&dumpReaders.lock);
+	r->ready = 1;
+	opr_cv_signal(&r->pipe->cv);
+    }
+    AFS_UNREACHED(return(NULL));
+}
+
+/*
+ * Start the threads which read ahead for dumps.  With no threads, dumps
+ * read each file as they come to it.
+ */
+void
+InitDumpReaders(int nThreads)
+{
+    pthread_t tid;
+    pthread_attr_t tattr;
+    int i;
+
+    opr_mutex_init(&dumpReaders.lock);
+    opr_cv_init(&dumpReaders.cv);
+    opr_queue_Init(&dumpReaders.queue);
+
+    opr_Verify(pthread_attr_init(&tattr) == 0);
+    opr_Verify(pthread_attr_setdetachstate(&tattr,
+					   PTHREAD_CREATE_DETACHED) == 0);
+    for (i = 0; i < nThreads; i++)
+	opr_Verify(pthread_create(&tid, &tattr, DumpReaderThread, NULL) == 0);
+    dumpReaders.nThreads = nThreads;
+}
+
+/*
+ * Dump the nVnodes vnodes left in file, an index of class, handing the
+ * files of the next DUMP_MAXAHEAD vnodes to the readers while the earlier
+ * ones are written out.
+ */
+static int
+DumpVnodeIndex_Pipelined(struct iod *iodp, Volume * vp, VnodeClass class,
+			 StreamHandle_t * file, afs_sfsize_t nVnodes,
+			 afs_int32 fromtime, int forcedump)
+{
+    struct VnodeClassInfo *vcp = &VnodeClassInfo[class];
+    struct dumpPipe *pipe;
+    struct dumpRead *r;
+    struct VnodeDiskObject *vnode;
+    int head = 0;		/* next read to dump */
+    int tail = 0;		/* next read to fill in */
+    int vnodeIndex = 0;
+    int code = 0, i;
+
+    pipe = calloc(1, sizeof(*pipe));
+    if (pipe == NULL) {
+	Log("1 Volser: DumpVnodeIndex: not enough memory\n");
+	return VOLSERDUMPERROR;
+    }
+    opr_cv_init(&pipe->cv);
+    for (i = 0; i < DUMP_MAXAHEAD; i++)
+	pipe->reads[i].pipe = pipe;
+
+    while (1) {
+	/* Queue up the reads for the next few vnodes to dump */
+	while (!code && nVnodes > 0 && tail - head < DUMP_MAXAHEAD) {
+	    r = &pipe->reads[tail % DUMP_MAXAHEAD];
+	    vnode = (struct VnodeDiskObject *)r->vnode;
+	    if (STREAM_READ(vnode, vcp->diskSize, 1, file) != 1) {
+		nVnodes = 0;
+		break;
+	    }
+	    nVnodes--;
+	    r->vnodeNumber = bitNumberToVnodeNumber(vnodeIndex, class);
+	    vnodeIndex++;
+	    if (vnode->type == vNull)
+		continue;
+	    r->dumpEverything = forcedump
+		|| (vnode->serverModifyTime >= fromtime);
+	    r->ihP = NULL;
+	    r->fdP = NULL;
+	    r->openErrno = 0;
+	    r->nData = 0;
+	    tail++;
+	    if (r->dumpEverything && VNDISK_GET_INO(vnode)) {
+		IH_INIT(r->ihP, iodp->device, iodp->parentId,
+			VNDISK_GET_INO(vnode));
+		opr_mutex_enter(&dumpReaders.lock);
+		r->ready = 0;
+		opr_queue_Append(&dumpReaders.queue, &r->q);
+		opr_cv_signal(&dumpReaders.cv);
+		opr_mutex_exit(&dumpReaders.lock);
+	    } else {
+		r->ready = 1;
+	    }
+	}
+	if (head == tail)
+	    break;
+
+	r = &pipe->reads[head % DUMP_MAXAHEAD];
+	opr_mutex_enter(&dumpReaders.lock);
+	while (!r->ready)
+	    opr_cv_wait(&pipe->cv, &dumpReaders.lock);
+	opr_mutex_exit(&dumpReaders.lock);
+
+	/* After an error, just clean up after the reads already queued */
+	if (!code)
+	    code = DumpVnode(iodp, (struct VnodeDiskObject *)r->vnode,
+			     V_id(vp), r->vnodeNumber, r->dumpEverything, r);
+	if (r->fdP)
+	    FDH_CLOSE(r->fdP);
+	if (r->ihP)
+	    IH_RELEASE(r->ihP);
+	head++;
+    }
+
+    for (i = 0; i < DUMP_MAXAHEAD; i++)
+	free(pipe->reads[i].data);
+    opr_cv_destroy(&pipe->cv);
+    free(pipe);
+    return code;
+}
+#endif /* AFS_PTHREAD_ENV */
+
 static int
 DumpVnodeIndex(struct iod *iodp, Volume * vp, VnodeClass class,
 	       afs_int32 fromtime, int forcedump)
@@ -1002,6 +1764,12 @@ DumpVnodeIndex(struct iod *iodp, Volume * vp, VnodeClass class,
 	opr_Assert(STREAM_ASEEK(file, vcp->diskSize) == 0);
     } else
 	nVnodes = 0;
+#ifdef AFS_PTHREAD_ENV
+    if (dumpReaders.nThreads > 0)
+	code = DumpVnodeIndex_Pipelined(iodp, vp, class, file, nVnodes,
+					fromtime, forcedump);
+    else
+#endif
     for (vnodeIndex = 0;
 	 nVnodes && STREAM_READ(vnode, vcp->diskSize, 1, file) == 1 && !code;
 	 nVnodes--, vnodeIndex++) {
@@ -1012,7 +1780,8 @@ DumpVnodeIndex(struct iod *iodp, Volume * vp, VnodeClass class,
 	if (!code)
 	    code =
 		DumpVnode(iodp, vnode, V_id(vp),
-			  bitNumberToVnodeNumber(vnodeIndex, class), flag);
+			  bitNumberToVnodeNumber(vnodeIndex, class), flag,
+			  NULL);
 #ifndef AFS_PTHREAD_ENV
 	if (!flag)
 	    IOMGR_Poll();	/* if we dont' xfr data, but scan instead, could lose conn */
@@ -1025,7 +1794,7 @@ DumpVnodeIndex(struct iod *iodp, Volume * vp, VnodeClass class,
 
 static int
 DumpDumpHeader(struct iod *iodp, Volume * vp,
-	       afs_int32 fromtime)
+	       afs_int32 fromtime, int changedOnly)
 {
     int code = 0;
     int UseLatestReadOnlyClone = 1;
@@ -1059,12 +1828,24 @@ DumpDumpHeader(struct iod *iodp, Volume * vp,
     }
     if (!code)
 	code = DumpArrayInt32(iodp, 't', (afs_uint32 *) dumpTimes, 2);
+    if (changedOnly) {
+	/* A restore which doesn't know this would delete everything else */
+	if (!code)
+	    code = DumpTag(iodp, 0x7e);
+	if (!code)
+	    code = DumpTag(iodp, D_CHANGEDONLY);
+    }
     return code;
 }
 
+/*
+ * Dump a vnode, and the contents of its file if dumpEverything is set.  If
+ * ahead is given, the readers have already opened and started reading the
+ * file.
+ */
 static int
 DumpVnode(struct iod *iodp, struct VnodeDiskObject *v, VolumeId volid,
-	  int vnodeNumber, int dumpEverything)
+	  int vnodeNumber, int dumpEverything, struct dumpRead *ahead)
 {
     int code = 0;
     IHandle_t *ihP;
@@ -1110,19 +1891,34 @@ DumpVnode(struct iod *iodp, struct VnodeDiskObject *v, VolumeId volid,
     }
     if (VNDISK_GET_INO(v)) {
 	afs_sfsize_t indexlen, disklen;
-	IH_INIT(ihP, iodp->device, iodp->parentId, VNDISK_GET_INO(v));
-	fdP = IH_OPEN(ihP);
+	int openErrno;
+
+	if (ahead) {
+	    /* the inode was opened for us; it's ours to close now */
+	    ihP = ahead->ihP;
+	    fdP = ahead->fdP;
+	    openErrno = ahead->openErrno;
+	    ahead->ihP = NULL;
+	    ahead->fdP = NULL;
+	} else {
+	    IH_INIT(ihP, iodp->device, iodp->parentId, VNDISK_GET_INO(v));
+	    fdP = IH_OPEN(ihP);
+	    openErrno = errno;
+	}
 	if (fdP == NULL) {
 	    Log("1 Volser: DumpVnode: dump: Unable to open inode %s "
 		"for vnode %u (volume %" AFS_VOLID_FMT "); "
 		"not dumped, error %d\n",
 		PrintInode(stmp, VNDISK_GET_INO(v)), vnodeNumber,
-		afs_printable_VolumeId_lu(volid), errno);
+		afs_printable_VolumeId_lu(volid), openErrno);
 	    IH_RELEASE(ihP);
 	    return VOLSERREAD_DUMPERROR;
 	}
 	VNDISK_GET_LEN(indexlen, v);
-	disklen = FDH_SIZE(fdP);
+	if (ahead)
+	    disklen = ahead->diskLen;
+	else
+	    disklen = FDH_SIZE(fdP);
 	if (indexlen != disklen) {
 	    FDH_REALLYCLOSE(fdP);
 	    IH_RELEASE(ihP);
@@ -1133,7 +1929,11 @@ DumpVnode(struct iod *iodp, struct VnodeDiskObject *v, VolumeId volid,
 		(unsigned long)indexlen, (unsigned long)disklen);
 	    return VOLSERREAD_DUMPERROR;
 	}
-	code = DumpFile(iodp, vnodeNumber, fdP);
+	if (ahead)
+	    code = DumpFile(iodp, vnodeNumber, fdP, ahead->data,
+			    ahead->nData);
+	else
+	    code = DumpFile(iodp, vnodeNumber, fdP, NULL, 0);
 	FDH_CLOSE(fdP);
 	IH_RELEASE(ihP);
     }
@@ -1235,21 +2035,65 @@ ProcessIndex(Volume * vp, VnodeClass class, afs_foff_t ** Bufp, int *sizep,
 int
 RestoreVolume(struct rx_call *call, Volume * avp, int incremental,
 	      struct restoreCookie *cookie)
+{
+    struct iod iod;
+
+    iod_Init(&iod, call);
+    return DoRestoreVolume(&iod, avp, incremental, cookie);
+}
+
+/*
+ * Restore a volume, passing the dump on to the calls, each to a restore
+ * on some other site, as it is read.  Those of calls with codes set are
+ * skipped, and codes is set for any which fail along the way.  The rest of
+ * the dump is still passed on if the restore here fails.
+ */
+int
+RestoreVolumeForward(struct rx_call *call, Volume * avp, int incremental,
+		     struct restoreCookie *cookie, struct rx_call **calls,
+		     int ncalls, int *codes)
+{
+    struct iod iod;
+    int code, i, fanError = 0;
+
+    iod_Init(&iod, call);
+#ifdef AFS_PTHREAD_ENV
+    iod.fan = FanCreate(calls, ncalls, codes);
+    if (iod.fan == NULL)
+	fanError = ENOMEM;
+#else
+    fanError = VOLSERBADOP;
+#endif
+    for (i = 0; fanError && i < ncalls; i++)
+	if (!codes[i])
+	    codes[i] = fanError;
+    code = DoRestoreVolume(&iod, avp, incremental, cookie);
+#ifdef AFS_PTHREAD_ENV
+    if (iod.fan) {
+	if (code) {
+	    while (iod_Fill(&iod))
+		iod.rleft = 0;
+	}
+	FanFinish(iod.fan);
+    }
+#endif
+    return code;
+}
+
+static int
+DoRestoreVolume(struct iod *iodp, Volume * avp, int incremental,
+		struct restoreCookie *cookie)
 {
     VolumeDiskData vol;
     struct DumpHeader header;
     afs_uint32 endMagic;
     Error error = 0, vupdate;
     Volume *vp;
-    struct iod iod;
-    struct iod *iodp = &iod;
     afs_foff_t *b1 = NULL, *b2 = NULL;
     int s1 = 0, s2 = 0, delo = 0, tdelo;
     int tag;
     VolumeDiskData saved_header;
 
-    iod_Init(iodp, call);
-
     vp = avp;
 
     if (DoPreserveVolumeStats) {
@@ -1267,6 +2111,9 @@ RestoreVolume(struct rx_call *call, Volume * avp, int incremental,
     if (ReadVolumeHeader(iodp, &vol) == VOLSERREAD_DUMPERROR)
 	return VOLSERREAD_DUMPERROR;
 
+    /* Vnodes missing from such a dump are unchanged, not deleted */
+    if (header.changedOnly)
+	delo = 1;
     if (!delo)
 	delo = ProcessIndex(vp, vLarge, &b1, &s1, 0);
     if (!delo)
@@ -1524,6 +2371,8 @@ ReadVnodes(struct iod *iodp, Volume * vp, int incremental,
 
 	if (haveStuff) {
 	    FdHandle_t *fdP = IH_OPEN(vp->vnodeIndex[class].handle);
+	    if (vnode->type == vNull)	/* deleted; see DumpDeletedVnode */
+		memset(vnode, 0, vcp->diskSize);
 	    if (fdP == NULL) {
 		Log("1 Volser: ReadVnodes: Error opening vnode index: %s; restore aborted\n",
 		    afs_error_message(errno));
@@ -1537,7 +2386,8 @@ ReadVnodes(struct iod *iodp, Volume * vp, int incremental,
 			   V_parentId(vp));
 		}
 	    }
-	    vnode->vnodeMagic = vcp->magic;
+	    if (vnode->type != vNull)
+		vnode->vnodeMagic = vcp->magic;
 	    if (FDH_PWRITE(fdP, vnode, vcp->diskSize, vnodeIndexOffset(vcp, vnodeNumber)) != vcp->diskSize) {
 		Log("1 Volser: ReadVnodes: Error writing vnode index: %s; restore aborted\n",
 		    afs_error_message(errno));
@@ -1565,14 +2415,16 @@ static afs_fsize_t
 volser_WriteFile(int vn, struct iod *iodp, FdHandle_t * handleP, int tag,
 		 Error * status)
 {
-    afs_int32 code;
     ssize_t nBytes;
     afs_fsize_t filesize;
     afs_fsize_t written = 0;
-    size_t size = 8192;
+    int size;
     afs_fsize_t nbytes;
-    unsigned char *p;
-
+    struct iovec tiov[RX_MAXIOVECS];
+    int tnio;
+#ifndef HAVE_PIOV
+    int i;
+#endif
 
     *status = 0;
     {
@@ -1589,22 +2441,28 @@ volser_WriteFile(int vn, struct iod *iodp, FdHandle_t * handleP, int tag,
 	}
 	FillInt64(filesize, filesize_high, filesize_low);
     }
-    p = malloc(size);
-    if (p == NULL) {
-	*status = 2;
-	return (0);
-    }
+    /* write the file out straight from the packets it came in */
     for (nbytes = filesize; nbytes; nbytes -= size) {
-	if (nbytes < size)
-	    size = nbytes;
-
-	if ((code = iod_Read(iodp, (char *) p, size)) != size) {
-	    Log("1 Volser: WriteFile: Error reading dump file %d size=%llu nbytes=%u (%d of %u): %s; restore aborted\n", vn, (afs_uintmax_t) filesize, nbytes, code, (unsigned)size, afs_error_message(errno));
+	size = iod_Readv(iodp, tiov, &tnio,
+			 nbytes < IOD_READSIZE ? nbytes : IOD_READSIZE);
+	if (size <= 0) {
+	    Log("1 Volser: WriteFile: Error reading dump file %d size=%llu nbytes=%llu: %s; restore aborted\n", vn, (afs_uintmax_t) filesize, (afs_uintmax_t) nbytes, afs_error_message(errno));
 	    *status = 3;
 	    break;
 	}
 	if (handleP) {
-	    nBytes = FDH_PWRITE(handleP, p, size, written);
+#ifdef HAVE_PIOV
+	    nBytes = FDH_PWRITEV(handleP, tiov, tnio, written);
+#else
+	    for (nBytes = 0, i = 0; i < tnio; i++) {
+		ssize_t n = FDH_PWRITE(handleP, tiov[i].iov_base,
+				       tiov[i].iov_len, written + nBytes);
+		if (n > 0)
+		    nBytes += n;
+		if (n != (ssize_t)tiov[i].iov_len)
+		    break;
+	    }
+#endif
 	    if (nBytes > 0)
 		written += nBytes;
 	    if (nBytes != size) {
@@ -1614,7 +2472,6 @@ volser_WriteFile(int vn, struct iod *iodp, FdHandle_t * handleP, int tag,
 	    }
 	}
     }
-    free(p);
     return (written);
 }
 
@@ -1630,6 +2487,7 @@ ReadDumpHeader(struct iod *iodp, struct DumpHeader *hp)
 	return 0;
     hp->volumeId = 0;
     hp->nDumpTimes = 0;
+    hp->changedOnly = 0;
     while ((tag = iod_getc(iodp)) > D_MAX) {
 	unsigned short arrayLength;
 	int i;
@@ -1652,6 +2510,9 @@ ReadDumpHeader(struct iod *iodp, struct DumpHeader *hp)
 		    || !ReadInt32(iodp, (afs_uint32 *) & hp->dumpTimes[i].to))
 		    return 0;
 	    break;
+	case D_CHANGEDONLY:
+	    hp->changedOnly = 1;
+	    break;
         case 0x7e:
             critical = 2;
             break;
@@ -18,6 +18,12 @@
  * we should define a volume format that doesn't require the pushing back
  * of characters (i.e. characters should not double both as an end marker
  * and a begin marker)
+ *
+ * A restore reads the dump a batch of rx packets at a time with rx_Readv,
+ * and parses it straight out of the packets; iov holds the batch.
+ *
+ * A dump to several calls, or a restore which passes what it reads on to
+ * further calls, hands the data to a dumpFan; see dumpstuff.c.
  */
 struct iod {
     struct rx_call *call;	/* call to which to write, might be an array */
@@ -29,14 +35,26 @@ struct iod {
     int *codes;			/* one return code for each call */
     char haveOldChar;		/* state for pushing back a character */
     char oldChar;
+    struct iovec iov[RX_MAXIOVECS];	/* last batch read from call */
+    int nio;			/* how many of iov are in use */
+    int curio;			/* which of iov we are reading */
+    char *rpos;			/* next unread byte in iov[curio] */
+    int rleft;			/* unread bytes at rpos */
+    struct dumpFan *fan;	/* sends the dump on to calls, or NULL */
 };
 
 extern int DumpVolume(struct rx_call *call, Volume *vp, afs_int32, int);
 extern int DumpVolMulti(struct rx_call **, int, Volume *, afs_int32, int,
-		        int *);
+		        int, int *);
 extern int RestoreVolume(struct rx_call *, Volume *, int,
 			 struct restoreCookie *);
+extern int RestoreVolumeForward(struct rx_call *, Volume *, int,
+				struct restoreCookie *, struct rx_call **,
+				int, int *);
 extern int SizeDumpVolume(struct rx_call *, Volume *, afs_int32, int,
 			  struct volintSize *);
+#ifdef AFS_PTHREAD_ENV
+extern void InitDumpReaders(int nThreads);
+#endif
 
 #endif
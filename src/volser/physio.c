@@ -12,6 +12,7 @@
 
 #include <roken.h>
 
+#include <opr/jhash.h>
 #include <rx/xdr.h>
 #include <rx/rx.h>
 #include <afs/afsint.h>
@@ -125,6 +126,14 @@ FidEq(DirHandle * afile, DirHandle * bfile)
     return 1;
 }
 
+afs_uint32
+FidHash(DirHandle * file)
+{
+    return opr_jhash_int2((afs_uint32)file->dirh_inode,
+			  (afs_uint32)((afs_uint64)file->dirh_inode >> 32),
+			  file->dirh_volume);
+}
+
 int
 FidVolEq(DirHandle * afile, afs_int32 vid)
 {
@@ -0,0 +1,367 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Benchmark for restoring volume dumps.
+ *
+ * Restores a dump into a scratch volume on a local partition the way the
+ * volserver does for "vos restore": the dump is sent over an rx call on the
+ * loopback interface and RestoreVolume() reads it off the call.  Without
+ * -file, a synthetic dump of many small files is written first, since that
+ * is where the cost of parsing the dump shows most.  The scratch volume is
+ * removed again afterwards.
+ *
+ * Like "vol-bless -nofssync", this does not talk to the fileserver, so it
+ * should not be pointed at a partition a fileserver is using.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <afs/cmd.h>
+#include <rx/xdr.h>
+#include <rx/rx_queue.h>
+#include <rx/rx.h>
+#include <rx/rx_null.h>
+#include <rx/rx_globals.h>
+#include <afs/afsint.h>
+#include <afs/nfs.h>
+#include <afs/errors.h>
+#include <lock.h>
+#include <lwp.h>
+#include <afs/ihandle.h>
+#include <afs/vnode.h>
+#include <afs/volume.h>
+#include <afs/partition.h>
+#include <afs/acl.h>
+#include <afs/prs_fs.h>
+#include <afs/afsutil.h>
+#include <afs/vol_prototypes.h>
+
+#include "volser.h"
+#include "volint.h"
+#include "dump.h"
+#include "dumpstuff.h"
+
+#define afs_putint32(p, v)  *p++ = v>>24, *p++ = v>>16, *p++ = v>>8, *p++ = v
+#define afs_putshort(p, v) *p++ = v>>8, *p++ = v
+
+#define RESTOREBENCH_SERVICE	4
+
+int DoLogging = 0;
+int DoPreserveVolumeStats = 0;
+int VolumeChanged;		/* needed by physio - leave alone */
+
+static Volume *benchVolume;
+
+/* Writing the synthetic dump */
+
+static void
+PutTag(FILE *f, char tag)
+{
+    putc(tag, f);
+}
+
+static void
+PutShort(FILE *f, char tag, unsigned short value)
+{
+    unsigned char buf[3], *p = buf;
+
+    *p++ = tag;
+    afs_putshort(p, value);
+    fwrite(buf, 1, sizeof(buf), f);
+}
+
+static void
+PutInt32(FILE *f, char tag, afs_uint32 value)
+{
+    unsigned char buf[5], *p = buf;
+
+    *p++ = tag;
+    afs_putint32(p, value);
+    fwrite(buf, 1, sizeof(buf), f);
+}
+
+static void
+PutString(FILE *f, char tag, char *s)
+{
+    putc(tag, f);
+    fwrite(s, 1, strlen(s) + 1, f);
+}
+
+static void
+PutFile(FILE *f, char *data, afs_uint32 size)
+{
+    PutInt32(f, 'f', size);
+    fwrite(data, 1, size, f);
+}
+
+static int
+WriteDump(char *fileName, VolumeId volid, int nFiles, int fileSize)
+{
+    FILE *f;
+    afs_int32 acl[(SIZEOF_LARGEDISKVNODE - SIZEOF_SMALLDISKVNODE) / 4];
+    char *data;
+    int i;
+
+    f = fopen(fileName, "w");
+    if (f == NULL) {
+	perror(fileName);
+	return -1;
+    }
+    data = malloc(fileSize + 1);
+    opr_Assert(data != NULL);
+    memset(data, 'x', fileSize);
+
+    /* dump header */
+    PutInt32(f, D_DUMPHEADER, DUMPBEGINMAGIC);
+    fwrite("\0\0\0\1", 1, 4, f);	/* DUMPVERSION */
+    PutInt32(f, 'v', volid);
+    PutString(f, 'n', "restorebench");
+    PutShort(f, 't', 2);
+    fwrite("\0\0\0\0\0\0\0\0", 1, 8, f);
+
+    /* volume header */
+    PutTag(f, D_VOLUMEHEADER);
+    PutInt32(f, 'i', volid);
+    PutInt32(f, 'v', VOLUMEINFOVERSION);
+    PutString(f, 'n', "restorebench");
+    putc('s', f);
+    putc(1, f);
+    putc('b', f);
+    putc(1, f);
+    PutInt32(f, 'u', 2 * nFiles + 2);
+    putc('t', f);
+    putc(readwriteVolume, f);
+    PutInt32(f, 'p', volid);
+    PutInt32(f, 'c', 0);
+    PutInt32(f, 'q', 0);
+
+    /* the root directory, with an acl giving system:administrators all */
+    memset(acl, 0, sizeof(acl));
+    acl[0] = htonl(sizeof(struct acl_accessList));
+    acl[1] = htonl(ACL_ACLVERSION);
+    acl[2] = htonl(1);		/* total */
+    acl[3] = htonl(1);		/* positive */
+    acl[4] = htonl(0);		/* negative */
+    acl[5] = htonl(-204);
+    acl[6] = htonl(PRSFS_READ | PRSFS_WRITE | PRSFS_INSERT | PRSFS_LOOKUP
+		   | PRSFS_DELETE | PRSFS_LOCK | PRSFS_ADMINISTER);
+    PutInt32(f, D_VNODE, 1);
+    fwrite("\0\0\0\1", 1, 4, f);	/* uniquifier */
+    putc('t', f);
+    putc(vDirectory, f);
+    PutShort(f, 'l', 2);
+    PutInt32(f, 'v', 1);
+    PutShort(f, 'b', 0755);
+    PutInt32(f, 'p', 1);
+    putc('A', f);
+    fwrite(acl, 1, sizeof(acl), f);
+    PutFile(f, data, 0);
+
+    /* and lots of small files */
+    for (i = 0; i < nFiles; i++) {
+	PutInt32(f, D_VNODE, 2 * i + 2);
+	fwrite("\0\0\0\1", 1, 4, f);
+	putc('t', f);
+	putc(vFile, f);
+	PutShort(f, 'l', 1);
+	PutInt32(f, 'v', 1);
+	PutInt32(f, 'm', 0);
+	PutInt32(f, 's', 0);
+	PutInt32(f, 'a', 0);
+	PutInt32(f, 'o', 0);
+	PutInt32(f, 'g', 0);
+	PutShort(f, 'b', 0644);
+	PutInt32(f, 'p', 1);
+	PutFile(f, data, fileSize);
+    }
+
+    PutInt32(f, D_DUMPEND, DUMPENDMAGIC);
+    free(data);
+    if (fclose(f) != 0) {
+	perror(fileName);
+	return -1;
+    }
+    return 0;
+}
+
+/* The volserver end */
+
+static afs_int32
+RestoreProc(struct rx_call *call)
+{
+    struct restoreCookie cookie;
+
+    memset(&cookie, 0, sizeof(cookie));
+    strlcpy(cookie.name, "restorebench", sizeof(cookie.name));
+    cookie.type = RWVOL;
+    cookie.parent = V_id(benchVolume);
+    return RestoreVolume(call, benchVolume, 0, &cookie);
+}
+
+/* The vos end */
+
+static int
+SendDump(struct rx_connection *conn, char *fileName, afs_int64 *sizep)
+{
+    struct rx_call *call;
+    char *buf;
+    int fd, n, code = 0;
+
+    *sizep = 0;
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+	perror(fileName);
+	return -1;
+    }
+    buf = malloc(64 * 1024);
+    opr_Assert(buf != NULL);
+    call = rx_NewCall(conn);
+    while ((n = read(fd, buf, 64 * 1024)) > 0) {
+	if (rx_Write(call, buf, n) != n) {
+	    code = rx_Error(call);
+	    break;
+	}
+	*sizep += n;
+    }
+    if (n < 0)
+	code = errno;
+    code = rx_EndCall(call, code);
+    free(buf);
+    close(fd);
+    return code;
+}
+
+static int
+handleit(struct cmd_syndesc *as, void *arock)
+{
+    struct DiskPartition64 *partP;
+    struct rx_securityClass *sc;
+    struct rx_connection *conn;
+    struct timeval start, end;
+    char fileName[MAXPATHLEN];
+    char *partName = as->parms[0].items->data;
+    VolumeId volid = 536999999;
+    int nFiles = 100000, fileSize = 64, runs = 3;
+    int synthetic = 1, i, code;
+    afs_int64 size;
+    Error error;
+    double secs;
+
+    if (as->parms[1].items)
+	volid = strtoul(as->parms[1].items->data, NULL, 10);
+    if (as->parms[2].items) {
+	strlcpy(fileName, as->parms[2].items->data, sizeof(fileName));
+	synthetic = 0;
+    }
+    if (as->parms[3].items)
+	nFiles = atoi(as->parms[3].items->data);
+    if (as->parms[4].items)
+	fileSize = atoi(as->parms[4].items->data);
+    if (as->parms[5].items)
+	runs = atoi(as->parms[5].items->data);
+
+    if (VAttachPartitions())
+	fprintf(stderr, "some partitions had errors during attach\n");
+    partP = VGetPartition(partName, 0);
+    if (partP == NULL) {
+	fprintf(stderr, "%s is not an AFS partition on this server\n",
+		partName);
+	return 1;
+    }
+
+    if (synthetic) {
+	snprintf(fileName, sizeof(fileName), "%s/restorebench.%d.dump",
+		 gettmpdir(), (int)getpid());
+	if (WriteDump(fileName, volid, nFiles, fileSize))
+	    return 1;
+    }
+
+    if (rx_Init(0) < 0) {
+	fprintf(stderr, "rx_Init failed\n");
+	return 1;
+    }
+    sc = rxnull_NewServerSecurityObject();
+    if (rx_NewService(0, RESTOREBENCH_SERVICE, "restorebench", &sc, 1,
+		      RestoreProc) == NULL) {
+	fprintf(stderr, "could not create rx service\n");
+	return 1;
+    }
+    rx_StartServer(0);
+    conn = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port,
+			    RESTOREBENCH_SERVICE,
+			    rxnull_NewClientSecurityObject(), 0);
+
+    for (i = 0; i < runs; i++) {
+	benchVolume = VCreateVolume(&error, VPartitionPath(partP), volid,
+				    volid);
+	if (error) {
+	    fprintf(stderr, "could not create volume %lu: %d\n",
+		    afs_printable_VolumeId_lu(volid), error);
+	    break;
+	}
+	V_inService(benchVolume) = V_blessed(benchVolume) = 1;
+	V_type(benchVolume) = readwriteVolume;
+	VUpdateVolume(&error, benchVolume);
+
+	gettimeofday(&start, NULL);
+	code = SendDump(conn, fileName, &size);
+	gettimeofday(&end, NULL);
+
+	VDetachVolume(&error, benchVolume);
+	nuke(VPartitionPath(partP), volid);
+	if (code) {
+	    fprintf(stderr, "restore failed: %d\n", code);
+	    break;
+	}
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+	printf("run %d: %lld bytes in %.3f s, %.1f MB/s", i + 1,
+	       (long long)size, secs, size / secs / (1024 * 1024));
+	if (synthetic)
+	    printf(", %.0f vnodes/s", (nFiles + 1) / secs);
+	printf("\n");
+    }
+
+    if (synthetic)
+	unlink(fileName);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct cmd_syndesc *ts;
+    VolumePackageOptions opts;
+
+    VOptDefaults(salvager, &opts);
+    if (VInitVolumePackage2(salvager, &opts)) {
+	fprintf(stderr, "errors encountered initializing volume package, but "
+			"trying to continue anyway\n");
+    }
+
+    ts = cmd_CreateSyntax(NULL, handleit, NULL, 0,
+			  "Time restoring a dump into a scratch volume");
+    cmd_AddParm(ts, "-partition", CMD_SINGLE, CMD_REQUIRED,
+		"AFS partition to restore onto");
+    cmd_AddParm(ts, "-volumeid", CMD_SINGLE, CMD_OPTIONAL,
+		"id of the scratch volume");
+    cmd_AddParm(ts, "-file", CMD_SINGLE, CMD_OPTIONAL,
+		"dump to restore, instead of a synthetic one");
+    cmd_AddParm(ts, "-files", CMD_SINGLE, CMD_OPTIONAL,
+		"files in the synthetic dump (default 100000)");
+    cmd_AddParm(ts, "-filesize", CMD_SINGLE, CMD_OPTIONAL,
+		"bytes per file in the synthetic dump (default 64)");
+    cmd_AddParm(ts, "-runs", CMD_SINGLE, CMD_OPTIONAL,
+		"number of restores (default 3)");
+    return cmd_Dispatch(argc, argv);
+}
@@ -53,6 +53,7 @@
 #include "volser.h"
 #include "volint.h"
 #include "volser_internal.h"
+#include "dumpstuff.h"
 
 #define VolserVersion "2.0"
 #define N_SECURITY_OBJECTS 3
@@ -72,6 +73,8 @@ int debuglevel = 0;
 #define MAXLWP 128
 int lwps = 9;
 int udpBufSize = 0;		/* UDP buffer size for receive */
+int rxListeners = 0;		/* rx listener threads for the port */
+static int dumpThreads = 4;	/* threads reading ahead for dumps */
 int restrictedQueryLevel = RESTRICTED_QUERY_ANYUSER;
 
 int rxBind = 0;
@@ -241,6 +244,8 @@ enum optionsList {
     OPT_rxmaxmtu,
     OPT_sleep,
     OPT_udpsize,
+    OPT_rxlisteners,
+    OPT_dumpthreads,
     OPT_peer,
     OPT_process,
     OPT_preserve_vol_stats,
@@ -290,6 +295,10 @@ ParseArgs(int argc, char **argv) {
 	    CMD_OPTIONAL, "maximum MTU for RX");
     cmd_AddParmAtOffset(opts, OPT_udpsize, "-udpsize", CMD_SINGLE,
 	    CMD_OPTIONAL, "size of socket buffer in bytes");
+    cmd_AddParmAtOffset(opts, OPT_rxlisteners, "-rxlisteners", CMD_SINGLE,
+	    CMD_OPTIONAL, "number of rx listener threads");
+    cmd_AddParmAtOffset(opts, OPT_dumpthreads, "-dumpthreads", CMD_SINGLE,
+	    CMD_OPTIONAL, "number of threads reading ahead for dumps");
     cmd_AddParmAtOffset(opts, OPT_sleep, "-sleep", CMD_SINGLE,
 	    CMD_OPTIONAL, "make background daemon sleep (LWP only)");
     cmd_AddParmAtOffset(opts, OPT_peer, "-enable_peer_stats", CMD_FLAG,
@@ -377,6 +386,14 @@ ParseArgs(int argc, char **argv) {
 	} else
 	    udpBufSize = optval;
     }
+    cmd_OptionAsInt(opts, OPT_rxlisteners, &rxListeners);
+    if (cmd_OptionAsInt(opts, OPT_dumpthreads, &dumpThreads) == 0) {
+	if (dumpThreads < 0 || dumpThreads > 64) {
+	    printf("number of dump threads %d invalid; "
+		   "must be between 0 and 64\n", dumpThreads);
+	    return -1;
+	}
+    }
     cmd_OptionAsString(opts, OPT_auditlog, &auditFileName);
 
     if (cmd_OptionAsString(opts, OPT_audit_interface, &optstring) == 0) {
@@ -514,6 +531,9 @@ main(int argc, char **argv)
     /* For nuke() */
     Lock_Init(&localLock);
     DInit(40);
+#ifdef AFS_PTHREAD_ENV
+    InitDumpReaders(dumpThreads);
+#endif
 #ifndef AFS_PTHREAD_ENV
     vol_PollProc = IOMGR_Poll;	/* tell vol pkg to poll io system periodically */
 #endif
@@ -523,6 +543,8 @@ main(int argc, char **argv)
     rx_nPackets = rxpackets;	/* set the max number of packets */
     if (udpBufSize)
 	rx_SetUdpBufSize(udpBufSize);	/* set the UDP buffer size for receive */
+    if (rxListeners)
+	rx_SetListenerThreads(rxListeners);
     if (rxBind) {
 	afs_int32 ccode;
         if (AFSDIR_SERVER_NETRESTRICT_FILEPATH ||
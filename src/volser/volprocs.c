@@ -97,7 +97,8 @@ static afs_int32 VolForward(struct rx_call *, afs_int32, afs_int32,
 			    struct restoreCookie *cookie);
 static afs_int32 VolDump(struct rx_call *, afs_int32, afs_int32, afs_int32);
 static afs_int32 VolRestore(struct rx_call *, afs_int32, afs_int32,
-			    struct restoreCookie *);
+			    struct restoreCookie *, int, manyDests *,
+			    afs_int32 *);
 static afs_int32 VolEndTrans(struct rx_call *, afs_int32, afs_int32 *);
 static afs_int32 VolSetForwarding(struct rx_call *, afs_int32, afs_int32);
 static afs_int32 VolGetStatus(struct rx_call *, afs_int32,
@@ -776,6 +777,7 @@ VolClone(struct rx_call *acid, afs_int32 atrans, VolumeId purgeId,
 	LogError(error);
 	goto fail;
     }
+    VChangeLogClone(originalvp, newvp, newType == readonlyVolume);
     if (newType == readonlyVolume) {
 	V_type(newvp) = readonlyVolume;
     } else if (newType == backupVolume) {
@@ -931,6 +933,7 @@ VolReClone(struct rx_call *acid, afs_int32 atrans, VolumeId cloneId)
 	LogError(error);
 	goto fail;
     }
+    VChangeLogClone(originalvp, clonevp, newType == readonlyVolume);
 
     /* fix up volume name and type, CloneVolume just propagated RW's */
     if (newType == readonlyVolume) {
@@ -1338,6 +1341,158 @@ VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
     return code;
 }
 
+/*
+ * A dump sent to several sites goes either straight to each of them or,
+ * with a fanout, down a tree: the destinations are split into at most
+ * fanout groups, and the first site of each group is asked, through
+ * RestoreForward, to pass the dump on to the rest of its group, splitting
+ * them up in turn.  Each volserver then sends at most fanout copies of the
+ * dump, rather than one to every site.  A volserver spills the dump for a
+ * site that falls behind to a temporary file rather than waiting for it
+ * (see dumpstuff.c), so a slow site holds up only the sites below it.
+ */
+struct forwardCalls {
+    int ncalls;
+    struct rx_connection **conns;
+    struct rx_call **calls;
+    int *codes;			/* one for each call */
+    int *first;			/* destination each call is to */
+    int *count;			/* destinations each call reaches */
+};
+
+static void
+ForwardFree(struct forwardCalls *fc)
+{
+    free(fc->conns);
+    free(fc->calls);
+    free(fc->codes);
+    free(fc->first);
+    free(fc->count);
+    memset(fc, 0, sizeof(*fc));
+}
+
+/* Start restores on the destinations, ready for a dump to be sent */
+static afs_int32
+ForwardStart(struct rx_call *acid, manyDests *dests, int fanout,
+	     int incremental, struct restoreCookie *cookie,
+	     struct forwardCalls *fc)
+{
+    afs_int32 securityIndex;
+    struct rx_securityClass *securityObject;
+    struct replica *dest;
+    manyDests group;
+    int ndests = dests->manyDests_len;
+    int i, next;
+    afs_int32 code;
+
+    memset(fc, 0, sizeof(*fc));
+    fc->conns = calloc(ndests, sizeof(*fc->conns));
+    fc->calls = calloc(ndests, sizeof(*fc->calls));
+    fc->codes = calloc(ndests, sizeof(*fc->codes));
+    fc->first = calloc(ndests, sizeof(*fc->first));
+    fc->count = calloc(ndests, sizeof(*fc->count));
+    if (!fc->conns || !fc->calls || !fc->codes || !fc->first
+	|| !fc->count) {
+	ForwardFree(fc);
+	return ENOMEM;
+    }
+
+    /* get auth info for this connection (uses afs from ticket file) */
+    code = MakeClient(acid, &securityObject, &securityIndex);
+    if (code) {
+	ForwardFree(fc);
+	return code;
+    }
+
+    fc->ncalls = (fanout > 0 && fanout < ndests) ? fanout : ndests;
+    for (i = 0, next = 0; i < fc->ncalls; i++) {
+	fc->first[i] = next;
+	fc->count[i] = ndests / fc->ncalls + (i < ndests % fc->ncalls);
+	next += fc->count[i];
+
+	dest = &dests->manyDests_val[fc->first[i]];
+	fc->conns[i] =
+	    rx_NewConnection(htonl(dest->server.destHost),
+			     htons(dest->server.destPort), VOLSERVICE_ID,
+			     securityObject, securityIndex);
+	if (!fc->conns[i]) {
+	    fc->codes[i] = ENOTCONN;
+	    continue;
+	}
+	if (!(fc->calls[i] = rx_NewCall(fc->conns[i]))) {
+	    fc->codes[i] = ENOTCONN;
+	    continue;
+	}
+	if (fc->count[i] == 1) {
+	    fc->codes[i] =
+		StartAFSVolRestore(fc->calls[i], dest->trans, incremental,
+				   cookie);
+	} else {
+	    group.manyDests_len = fc->count[i];
+	    group.manyDests_val = dest;
+	    fc->codes[i] =
+		StartAFSVolRestoreForward(fc->calls[i], incremental, cookie,
+					  fanout, &group);
+	}
+	if (fc->codes[i]) {
+	    (void)rx_EndCall(fc->calls[i], 0);
+	    fc->calls[i] = 0;
+	    rx_DestroyConnection(fc->conns[i]);
+	    fc->conns[i] = 0;
+	}
+    }
+
+    /* Security object will be freed when all connections destroyed */
+    RXS_Close(securityObject);
+    return 0;
+}
+
+/*
+ * Finish the restores begun by ForwardStart, after sending the dump if
+ * sent is set, and set codes, one for each destination.
+ */
+static void
+ForwardEnd(struct forwardCalls *fc, int sent, afs_int32 *codes)
+{
+    manyResults sub;
+    afs_int32 code, endCode, ec;
+    int i, j;
+
+    for (i = 0; i < fc->ncalls; i++) {
+	code = fc->codes[i];
+	memset(&sub, 0, sizeof(sub));
+	if (fc->calls[i]) {
+	    endCode = 0;
+	    if (sent && !code) {
+		if (fc->count[i] == 1)
+		    endCode = EndAFSVolRestore(fc->calls[i]);
+		else
+		    endCode = EndAFSVolRestoreForward(fc->calls[i], &sub);
+	    }
+	    ec = rx_EndCall(fc->calls[i], 0);
+	    if (!code)
+		code = (ec ? ec : endCode);
+	}
+	if (fc->conns[i])
+	    rx_DestroyConnection(fc->conns[i]);	/* done with the connection */
+
+	if (fc->count[i] == 1) {
+	    codes[fc->first[i]] = code;
+	} else {
+	    for (j = 0; j < fc->count[i]; j++) {
+		if (code)
+		    codes[fc->first[i] + j] = code;
+		else if (j < sub.manyResults_len)
+		    codes[fc->first[i] + j] = sub.manyResults_val[j];
+		else
+		    codes[fc->first[i] + j] = VOLSERDUMPERROR;
+	    }
+	}
+	free(sub.manyResults_val);
+    }
+    ForwardFree(fc);
+}
+
 /* Start a dump and send it to multiple places simultaneously.
  * If this returns an error (eg, return ENOENT), it means that
  * none of the releases worked.  If this returns 0, that means
@@ -1346,22 +1501,21 @@ VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
  * This will only do EITHER incremental or full, not both, so it's
  * the caller's responsibility to be sure that all the destinations
  * need just an incremental (and from the same time), if that's
- * what we're doing.
+ * what we're doing.  With VOLFORWARD_CHANGEDONLY in flags, an
+ * incremental may send just the vnodes the volume's changed-vnode log
+ * lists; the caller must know that every destination can restore that.
  */
 afs_int32
 SAFSVolForwardMultiple(struct rx_call *acid, afs_int32 fromTrans, afs_int32
-		       fromDate, manyDests *destinations, afs_int32 spare,
+		       fromDate, manyDests *destinations, afs_int32 flags,
 		       struct restoreCookie *cookie, manyResults *results)
 {
-    afs_int32 securityIndex;
-    struct rx_securityClass *securityObject;
     char caller[MAXKTCNAMELEN];
     struct volser_trans *tt;
-    afs_int32 ec, code, *codes;
-    struct rx_connection **tcons;
-    struct rx_call **tcalls;
+    afs_int32 code, *codes;
+    struct forwardCalls fc;
     struct Volume *vp;
-    int i, is_incremental;
+    int i, is_incremental, fanout;
 
     if (results) {
 	memset(results, 0, sizeof(manyResults));
@@ -1386,78 +1540,29 @@ SAFSVolForwardMultiple(struct rx_call *acid, afs_int32 fromTrans, afs_int32
 
     /* (fromDate == 0) ==> full dump */
     is_incremental = (fromDate ? 1 : 0);
+    fanout = (flags & VOLFORWARD_FANOUTMASK) >> VOLFORWARD_FANOUTSHIFT;
 
-    tcons = malloc(i * sizeof(struct rx_connection *));
-    if (!tcons) {
-	return ENOMEM;
-    }
-    tcalls = malloc(i * sizeof(struct rx_call *));
-    if (!tcalls) {
-	free(tcons);
-	return ENOMEM;
-    }
-
-    /* get auth info for this connection (uses afs from ticket file) */
-    code = MakeClient(acid, &securityObject, &securityIndex);
-    if (code) {
-	goto fail;		/* in order to audit each failure */
+    /* make connections to all the other servers, or the top of the tree */
+    code = ForwardStart(acid, destinations, fanout, is_incremental, cookie,
+			&fc);
+    if (!code) {
+	/* these next calls implictly call rx_Write when writing out data */
+	code = DumpVolMulti(fc.calls, fc.ncalls, vp, fromDate, 0,
+			    (flags & VOLFORWARD_CHANGEDONLY)
+			    && is_incremental, fc.codes);
+	ForwardEnd(&fc, !code, codes);
+    } else {
+	for (i = 0; i < destinations->manyDests_len; i++)
+	    codes[i] = code;
     }
 
-    /* make connections to all the other servers */
     for (i = 0; i < destinations->manyDests_len; i++) {
 	struct replica *dest = &(destinations->manyDests_val[i]);
-	tcons[i] =
-	    rx_NewConnection(htonl(dest->server.destHost),
-			     htons(dest->server.destPort), VOLSERVICE_ID,
-			     securityObject, securityIndex);
-	if (!tcons[i]) {
-	    codes[i] = ENOTCONN;
-	} else {
-	    if (!(tcalls[i] = rx_NewCall(tcons[i])))
-		codes[i] = ENOTCONN;
-	    else {
-		codes[i] =
-		    StartAFSVolRestore(tcalls[i], dest->trans, is_incremental,
-				       cookie);
-		if (codes[i]) {
-		    (void)rx_EndCall(tcalls[i], 0);
-		    tcalls[i] = 0;
-		    rx_DestroyConnection(tcons[i]);
-		    tcons[i] = 0;
-		}
-	    }
-	}
-    }
-
-    /* Security object will be freed when all connections destroyed */
-    RXS_Close(securityObject);
-
-    /* these next calls implictly call rx_Write when writing out data */
-    code = DumpVolMulti(tcalls, i, vp, fromDate, 0, codes);
-
-
-  fail:
-    for (i--; i >= 0; i--) {
-	struct replica *dest = &(destinations->manyDests_val[i]);
-
-	if (!code && tcalls[i] && !codes[i]) {
-	    EndAFSVolRestore(tcalls[i]);
-	}
-	if (tcalls[i]) {
-	    ec = rx_EndCall(tcalls[i], 0);
-	    if (!codes[i])
-		codes[i] = ec;
-	}
-	if (tcons[i]) {
-	    rx_DestroyConnection(tcons[i]);	/* done with the connection */
-	}
 
 	osi_auditU(acid, VS_ForwardEvent, (code ? code : codes[i]), AUD_LONG,
 		   fromTrans, AUD_HOST, htonl(dest->server.destHost), AUD_LONG,
 		   dest->trans, AUD_END);
     }
-    free(tcons);
-    free(tcalls);
 
     if (tt) {
         TClearRxCall(tt);
@@ -1532,18 +1637,60 @@ SAFSVolRestore(struct rx_call *acid, afs_int32 atrans, afs_int32 aflags,
 {
     afs_int32 code;
 
-    code = VolRestore(acid, atrans, aflags, cookie);
+    code = VolRestore(acid, atrans, aflags, cookie, 0, NULL, NULL);
     osi_auditU(acid, VS_RestoreEvent, code, AUD_LONG, atrans, AUD_END);
     return code;
 }
 
+/*
+ * Restore the first of destinations, a transaction here, and pass the dump
+ * on to the rest of them as it comes in.  The call itself fails only if
+ * none of them could be tried.
+ */
+afs_int32
+SAFSVolRestoreForward(struct rx_call *acid, afs_int32 aflags,
+		      struct restoreCookie *cookie, afs_int32 fanout,
+		      manyDests *destinations, manyResults *results)
+{
+    manyDests onward;
+    afs_int32 code, atrans;
+    int i, n = destinations->manyDests_len;
+
+    memset(results, 0, sizeof(manyResults));
+    if (n < 1)
+	return EINVAL;
+    results->manyResults_val = malloc(n * sizeof(afs_int32));
+    if (!results->manyResults_val)
+	return ENOMEM;
+    results->manyResults_len = n;
+    for (i = 1; i < n; i++)
+	results->manyResults_val[i] = VOLSERDUMPERROR;	/* until sent */
+
+    atrans = destinations->manyDests_val[0].trans;
+    onward.manyDests_len = n - 1;
+    onward.manyDests_val = destinations->manyDests_val + 1;
+    code = VolRestore(acid, atrans, aflags, cookie, fanout, &onward,
+		      results->manyResults_val + 1);
+    results->manyResults_val[0] = code;
+    osi_auditU(acid, VS_RestoreEvent, code, AUD_LONG, atrans, AUD_END);
+    return 0;
+}
+
+/*
+ * Restore the volume of transaction atrans.  If onward is given, the dump
+ * is passed on to those destinations as well, with fanout as for
+ * ForwardMultiple, and onwardCodes gets their results.
+ */
 static afs_int32
 VolRestore(struct rx_call *acid, afs_int32 atrans, afs_int32 aflags,
-	   struct restoreCookie *cookie)
+	   struct restoreCookie *cookie, int fanout, manyDests *onward,
+	   afs_int32 *onwardCodes)
 {
     struct volser_trans *tt;
+    struct forwardCalls fc;
     afs_int32 code, tcode;
     char caller[MAXKTCNAMELEN];
+    int i, forward = 0;
 
     if (!afsconf_SuperUser(tdir, acid, caller))
 	return VOLSERBAD_ACCESS;	/*not a super user */
@@ -1563,8 +1710,25 @@ VolRestore(struct rx_call *acid, afs_int32 atrans, afs_int32 aflags,
     TSetRxCall(tt, acid, "Restore");
 
     DFlushVolume(V_parentId(tt->volume)); /* Ensure dir buffers get dropped */
-
-    code = RestoreVolume(acid, tt->volume, (aflags & 1), cookie);	/* last is incrementalp */
+    /* The restore writes the vnode index behind the changed-vnode log */
+    VChangeLogDestroy(V_partition(tt->volume), tt->volid);
+
+    if (onward && onward->manyDests_len > 0) {
+	code = ForwardStart(acid, onward, fanout, (aflags & 1), cookie, &fc);
+	if (code) {
+	    for (i = 0; i < onward->manyDests_len; i++)
+		onwardCodes[i] = code;
+	} else
+	    forward = 1;
+    }
+
+    if (forward) {
+	code = RestoreVolumeForward(acid, tt->volume, (aflags & 1), cookie,
+				    fc.calls, fc.ncalls, fc.codes);
+	/* The rest of the dump was passed on even if the restore failed */
+	ForwardEnd(&fc, 1, onwardCodes);
+    } else
+	code = RestoreVolume(acid, tt->volume, (aflags & 1), cookie);	/* last is incrementalp */
     FSYNC_VolOp(tt->volid, NULL, FSYNC_VOL_BREAKCBKS, 0l, NULL);
     TClearRxCall(tt);
     tcode = TRELE(tt);
@@ -3127,6 +3291,10 @@ SAFSVolSplitVolume(struct rx_call *acall, afs_uint32 ovid, afs_uint32 onew,
 
     code = split_volume(acall, vol, newvol, where, verbose);
 
+    /* split_volume moves vnodes without VnStore; forget what we knew */
+    VChangeLogDestroy(V_partition(vol), vid);
+    VChangeLogDestroy(V_partition(newvol), new);
+
     VDetachVolume(&code2, vol);
     DeleteTrans(tt, 1);
     VDetachVolume(&code2, newvol);
@@ -3137,6 +3305,18 @@ SAFSVolSplitVolume(struct rx_call *acall, afs_uint32 ovid, afs_uint32 onew,
 #endif
 }
 
+/* Tell a client which optional features this volserver supports; see the
+ * VOLSER_CAP bits in volint.xg */
+afs_int32
+SAFSVolGetCapabilities(struct rx_call *acid, afs_uint32 *capabilities)
+{
+    *capabilities = VOLSER_CAP_CHANGEDONLY;
+#ifdef AFS_PTHREAD_ENV
+    *capabilities |= VOLSER_CAP_RESTOREFORWARD;
+#endif
+    return 0;
+}
+
 /* GetPartName - map partid (a decimal number) into pname (a string)
  * Since for NT we actually want to return the drive name, we map through the
  * partition struct.
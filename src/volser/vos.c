@@ -2889,7 +2889,7 @@ ReleaseVolume(struct cmd_syndesc *as, void *arock)
     struct nvldbentry entry;
     afs_uint32 avolid;
     afs_uint32 aserver;
-    afs_int32 apart, vtype, code, err;
+    afs_int32 apart, vtype, code, err, fanout = 0;
     int flags = 0;
 
     if (as->parms[1].items) /* -force */
@@ -2900,6 +2900,14 @@ ReleaseVolume(struct cmd_syndesc *as, void *arock)
     }
     if (as->parms[3].items) /* -force-reclone */
         flags |= REL_COMPLETE;
+    if (as->parms[4].items) { /* -fanout */
+	if (util_GetInt32(as->parms[4].items->data, &fanout) != 0
+	    || fanout < 1 || fanout > 255) {
+	    fprintf(STDERR, "vos: bad fanout '%s'; must be 1 to 255\n",
+		    as->parms[4].items->data);
+	    return EINVAL;
+	}
+    }
 
     avolid = vsu_GetVolumeID(as->parms[0].items->data, cstruct, &err);
     if (avolid == 0) {
@@ -2926,7 +2934,7 @@ ReleaseVolume(struct cmd_syndesc *as, void *arock)
 	return E2BIG;
     }
 
-    code = UV_ReleaseVolume(avolid, aserver, apart, flags);
+    code = UV_ReleaseVolume(avolid, aserver, apart, flags, fanout);
 
     if (code) {
 	PrintDiagnostics("release", code);
@@ -6122,6 +6130,8 @@ main(int argc, char **argv)
 		"release to cloned temp vol, then clone back to repsite RO");
     cmd_AddParm(ts, "-force-reclone", CMD_FLAG, CMD_OPTIONAL,
 		"force a reclone and complete release with incremental dumps");
+    cmd_AddParm(ts, "-fanout", CMD_SINGLE, CMD_OPTIONAL,
+		"most sites to send to, each passing it on to the rest");
     COMMONPARMS;
 
     ts = cmd_CreateSyntax("dump", DumpVolumeCmd, NULL, 0, "dump a volume");
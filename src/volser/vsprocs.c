@@ -172,6 +172,8 @@ static int SimulateForwardMultiple(struct rx_connection *fromconn,
 				   afs_int32 fromtid, afs_int32 fromdate,
 				   manyDests * tr, afs_int32 flags,
 				   void *cookie, manyResults * results);
+static afs_uint32 CommonCapabilities(struct rx_connection **conns,
+				     int nconns);
 static int DoVolClone(struct rx_connection *aconn, afs_uint32 avolid,
 		      afs_int32 apart, int type, afs_uint32 cloneid,
 		      char *typestring, char *pname, char *vname, char *suffix,
@@ -3329,6 +3331,24 @@ SimulateForwardMultiple(struct rx_connection *fromconn, afs_int32 fromtid,
     return 0;
 }
 
+/*
+ * The VOLSER_CAP bits which all the given volservers have; none, if any
+ * of them is too old to say.
+ */
+static afs_uint32
+CommonCapabilities(struct rx_connection **conns, int nconns)
+{
+    afs_uint32 caps, common = ~0;
+    int i;
+
+    for (i = 0; i < nconns; i++) {
+	if (AFSVolGetCapabilities(conns[i], &caps) != 0)
+	    return 0;
+	common &= caps;
+    }
+    return common;
+}
+
 /**
  * Check if a trans has timed out, and recreate it if necessary.
  *
@@ -3448,10 +3468,12 @@ PutTrans(afs_int32 *vldbindex, struct replica *replicas,
  * @param[in] flags         bitmap of options
  *                            REL_COMPLETE  - force a complete release
  *                            REL_FULLDUMPS - force full dumps
+ * @param[in] fanout        if nonzero, send to at most this many sites, and
+ *                          have them pass the release on to the others
  */
 int
 UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
-		 afs_int32 afrompart, int flags)
+		 afs_int32 afrompart, int flags, int fanout)
 {
     char vname[64];
     afs_int32 code = 0;
@@ -3472,6 +3494,8 @@ UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
     afs_int32 fromtid = 0;
     afs_uint32 fromdate = 0;
     afs_uint32 thisdate;
+    afs_int32 fwdflags;
+    afs_uint32 caps;
     time_t tmv;
     int s;
     manyDests tr;
@@ -4108,9 +4132,20 @@ UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
 	/* Release the ones we have collected */
 	tr.manyDests_val = &(replicas[0]);
 	tr.manyDests_len = results.manyResults_len = volcount;
+	fwdflags = 0;
+	caps = CommonCapabilities(toconns, volcount);
+	if (fromdate != 0 && (caps & VOLSER_CAP_CHANGEDONLY))
+	    fwdflags |= VOLFORWARD_CHANGEDONLY;
+	if (fanout > 0 && volcount > fanout
+	    && (caps & VOLSER_CAP_RESTOREFORWARD)) {
+	    VPRINT1("Sending to %d sites at a time, which pass it on\n",
+		    fanout);
+	    fwdflags |= (fanout << VOLFORWARD_FANOUTSHIFT)
+		& VOLFORWARD_FANOUTMASK;
+	}
 	code =
 	    AFSVolForwardMultiple(fromconn, fromtid, fromdate, &tr,
-				  0 /*spare */ , &cookie, &results);
+				  fwdflags, &cookie, &results);
 	if (code == RXGEN_OPCODE) {	/* RPC Interface Mismatch */
 	    code =
 		SimulateForwardMultiple(fromconn, fromtid, fromdate, &tr,
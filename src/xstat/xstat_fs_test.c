@@ -237,6 +237,26 @@ PrintOverallPerfInfo(struct afs_PerfStats *a_ovP)
 
     printf("\t%10u fs_nBusies\n", a_ovP->fs_nBusies);
     printf("\t%10u fs_GetCapabilities\n\n", a_ovP->fs_nGetCaps);
+
+    printf("\t%10u fs_nFetchReads\n", a_ovP->fs_nFetchReads);
+    printf("\t%10u fs_FetchReadKBytes\n", a_ovP->fs_FetchReadKBytes);
+    printf("\t%10u fs_FetchCopyKBytes\n\n", a_ovP->fs_FetchCopyKBytes);
+
+    printf("\t%10u fs_CBBreakQueued\n", a_ovP->fs_CBBreakQueued);
+    printf("\t%10u fs_CBBreakQueuedMax\n", a_ovP->fs_CBBreakQueuedMax);
+    printf("\t%10u fs_nCBBreakBatches\n", a_ovP->fs_nCBBreakBatches);
+    printf("\t%10u fs_nCBBreakFids\n", a_ovP->fs_nCBBreakFids);
+    printf("\t%10u fs_nCBBreakFailed\n", a_ovP->fs_nCBBreakFailed);
+    printf("\t%10u fs_CBBreakAvgMsec\n", a_ovP->fs_CBBreakAvgMsec);
+    printf("\t%10u fs_CBBreakMaxMsec\n\n", a_ovP->fs_CBBreakMaxMsec);
+
+    printf("\t%10u fs_VolAttachFound\n", a_ovP->fs_VolAttachFound);
+    printf("\t%10u fs_VolAttached\n", a_ovP->fs_VolAttached);
+    printf("\t%10u fs_VolAttachFailed\n", a_ovP->fs_VolAttachFailed);
+    printf("\t%10u fs_VolAttachHot\n", a_ovP->fs_VolAttachHot);
+    printf("\t%10u fs_VolAttachHotDone\n", a_ovP->fs_VolAttachHotDone);
+    printf("\t%10u fs_VolAttachSecs\n", a_ovP->fs_VolAttachSecs);
+    printf("\t%10d fs_VolAttachETA\n\n", a_ovP->fs_VolAttachETA);
     /*
      * Host module fields.
      */
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Check the directory name index against a model of the directory.  A
+ * large directory is filled, put through a run of random creates and
+ * deletes, and every name is looked up; the same is then done with the
+ * index disabled.  The buffer cache is kept much smaller than the
+ * directory, so header pages, and the index hanging off them, are
+ * evicted and rebuilt as it runs.  The cache is allowed to grow a little
+ * under that pressure, and is resized between the runs.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <afs/dir.h>
+#include <tests/tap/basic.h>
+
+#define PAGESIZE 2048
+#define NENTRIES 5000
+#define NBUFFERS 32
+#define MAXBUFFERS 64
+
+typedef struct DirHandle {
+    int fd;
+    int uniq;
+} dirhandle;
+
+static afs_int32 model[NENTRIES];	/* unique of each name present, or 0 */
+static int nentries;			/* names in the model */
+static int nfound;			/* names found by EnumerateDir */
+static int failures;
+static unsigned int seed = 1;
+static int Uniq;
+
+static unsigned int
+Random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) & 0xffffff;
+}
+
+static void
+EntryName(char *buf, size_t len, int i)
+{
+    snprintf(buf, len, "entry.name.%07d", i);
+}
+
+static void
+Fail(const char *what, int i, int code)
+{
+    char name[32];
+
+    EntryName(name, sizeof(name), i);
+    diag("%s of '%s' failed: code %d, expected %s", what, name, code,
+	 model[i] ? "present" : "absent");
+    failures++;
+}
+
+static void
+CreateEntry(dirhandle *dir, int i, afs_int32 uniq)
+{
+    char name[32];
+    afs_int32 fid[3];
+    int code;
+
+    EntryName(name, sizeof(name), i);
+    fid[0] = 0;
+    fid[1] = i + 2;
+    fid[2] = uniq;
+    code = afs_dir_Create(dir, name, fid);
+    if (code != (model[i] ? EEXIST : 0))
+	Fail("create", i, code);
+    if (code == 0) {
+	model[i] = uniq;
+	nentries++;
+    }
+}
+
+static void
+DeleteEntry(dirhandle *dir, int i)
+{
+    char name[32];
+    int code;
+
+    EntryName(name, sizeof(name), i);
+    code = afs_dir_Delete(dir, name);
+    if (code != (model[i] ? 0 : ENOENT))
+	Fail("delete", i, code);
+    if (code == 0) {
+	model[i] = 0;
+	nentries--;
+    }
+}
+
+static void
+LookupEntry(dirhandle *dir, int i)
+{
+    char name[32];
+    afs_int32 fid[3];
+    int code;
+
+    EntryName(name, sizeof(name), i);
+    code = afs_dir_Lookup(dir, name, fid);
+    if (model[i]) {
+	if (code != 0 || fid[1] != i + 2 || fid[2] != model[i])
+	    Fail("lookup", i, code);
+    } else if (code != ENOENT) {
+	Fail("lookup", i, code);
+    }
+}
+
+static int
+CountEntry(void *handle, char *name, afs_int32 vnode, afs_int32 unique)
+{
+    nfound++;
+    return 0;
+}
+
+/* Run the whole workload on a fresh directory in file. */
+static void
+RunDir(char *file, const char *how)
+{
+    dirhandle dir;
+    afs_int32 me[3], uniq = 1;
+    int i, j;
+
+    memset(model, 0, sizeof(model));
+    nentries = nfound = 0;
+
+    dir.fd = open(file, O_CREAT | O_RDWR | O_TRUNC, 0666);
+    dir.uniq = ++Uniq;
+    if (dir.fd == -1)
+	sysbail("unable to create %s", file);
+    memset(me, 0, sizeof(me));
+    me[1] = me[2] = 1;
+    afs_dir_MakeDir(&dir, me, me);
+
+    failures = 0;
+    for (i = 0; i < NENTRIES; i++)
+	CreateEntry(&dir, i, uniq++);
+    DFlush();
+    is_int(0, failures, "%s: %d creates", how, NENTRIES);
+
+    failures = 0;
+    for (j = 0; j < 2 * NENTRIES; j++) {
+	i = Random() % NENTRIES;
+	/* a create of a name that is present must fail with EEXIST */
+	if (model[i] && (Random() & 1))
+	    DeleteEntry(&dir, i);
+	else
+	    CreateEntry(&dir, i, uniq++);
+    }
+    DFlush();
+    is_int(0, failures, "%s: mixed creates and deletes", how);
+
+    failures = 0;
+    for (j = 0; j < 3; j++)
+	for (i = 0; i < NENTRIES; i++)
+	    LookupEntry(&dir, i);
+    is_int(0, failures, "%s: lookups", how);
+
+    afs_dir_EnumerateDir(&dir, CountEntry, NULL);
+    is_int(nentries + 2, nfound, "%s: enumerate finds every entry", how);
+    ok(DirOK(&dir), "%s: DirOK", how);
+
+    DZap(&dir);
+    close(dir.fd);
+    unlink(file);
+}
+
+int
+ReallyRead(dirhandle *dir, int block, char *data)
+{
+    int code;
+    if (lseek(dir->fd, block * PAGESIZE, 0) == -1)
+	return errno;
+    code = read(dir->fd, data, PAGESIZE);
+    if (code < 0)
+	return errno;
+    if (code != PAGESIZE)
+	return EIO;
+    return 0;
+}
+
+int
+ReallyWrite(dirhandle *dir, int block, char *data)
+{
+    int code;
+    if (lseek(dir->fd, block * PAGESIZE, 0) == -1)
+	return errno;
+    code = write(dir->fd, data, PAGESIZE);
+    if (code < 0)
+	return errno;
+    if (code != PAGESIZE)
+	return EIO;
+    return 0;
+}
+
+void
+FidZap(dirhandle *dir)
+{
+    dir->fd = -1;
+}
+
+void
+FidZero(long *afid)
+{
+    *afid = 0;
+}
+
+int
+FidEq(dirhandle *dir1, dirhandle *dir2)
+{
+    return (dir1->uniq == dir2->uniq);
+}
+
+afs_uint32
+FidHash(dirhandle *dir)
+{
+    return dir->uniq;
+}
+
+int
+FidVolEq(long *afid, long *bfid)
+{
+    return 1;
+}
+
+void
+FidCpy(dirhandle *todir, dirhandle *fromdir)
+{
+    *todir = *fromdir;
+}
+
+void
+Die(const char *msg)
+{
+    bail("directory package died: %s", msg);
+}
+
+void
+Log(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+int
+main(int argc, char **argv)
+{
+    char file[] = "dindex-t.XXXXXX";
+    int fd, buffers, calls, ios;
+
+    plan(14);
+
+    fd = mkstemp(file);
+    if (fd == -1)
+	sysbail("mkstemp");
+    close(fd);
+
+    afs_dir_maxBuffers = MAXBUFFERS;
+    DInit(NBUFFERS);
+    RunDir(file, "indexed");
+    DStat(&buffers, &calls, &ios);
+    ok(buffers > NBUFFERS && buffers <= MAXBUFFERS,
+       "cache grew within its limit");
+
+    is_int(EINVAL, DResize(buffers), "resize to the same size fails");
+    is_int(0, DResize(2 * MAXBUFFERS), "resize to twice the size");
+    DStat(&buffers, &calls, &ios);
+    is_int(2 * MAXBUFFERS, buffers, "cache has the new size");
+
+    afs_dir_indexPages = 0;
+    RunDir(file, "unindexed");
+
+    return 0;
+}